@@ -2,17 +2,24 @@
 #define ATOMIX_JS_H
 
 #include "api.h"
+#include "census.h"
 #include "dict.h"
 #include "execution.h"
 #include "format.h"
 #include "function.h"
+#include "generator.h"
+#include "heap.h"
 #include "instruction.h"
 #include "loader.h"
+#include "nursery.h"
 #include "object.h"
 #include "panic.h"
 #include "scope.h"
+#include "snapshot.h"
 #include "symbol.h"
+#include "upvalue.h"
 #include "value.h"
 #include "vm.h"
+#include "weak.h"
 
 #endif //ATOMIX_JS_H
\ No newline at end of file
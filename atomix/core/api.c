@@ -1,8 +1,9 @@
 #include "api.impl.h"
 
+#include <stdio.h>
 #include <string.h>
-#include <gc.h>
 
+#include "heap.h"
 #include "panic.h"
 #include "execution.h"
 
@@ -20,18 +21,56 @@ JSValue api_call_function(VM* vm, JSFunction* function, JSValue this, JSValue* a
         return function->native_function(vm, this, args, argc);
     }
 
+    if (vm->stats.stack_counter + argc + 1 > STACK_SIZE) {
+        PANIC("Stack overflow");
+    }
     for (size_t i = 0; i < argc; i++) {
-        vm->stats.stack[vm->stats.stack_counter++] = args[argc - i - 1];
+        vm->stack[vm->stats.stack_counter++] = args[argc - i - 1];
     }
     
-    char* key = init_string("this");
-    vm->stats.stack[vm->stats.stack_counter++] = this;
-    scope_declare(function->scope, key, this);
-    JSValue return_value = vm_exec_function(vm, function);
-    vm->stats.stack_counter -= argc;
+    vm->stack[vm->stats.stack_counter++] = this;
+    JSValue return_value = vm_exec_function(vm, function, argc);
+    vm->stats.stack_counter -= argc + 1;
     return return_value;
 }
 
+JSValue api_throw(VM* vm, JSValue value)
+{
+    vm->exception = value;
+    vm->unwinding = 1;
+    return JS_VALUE_UNDEFINED;
+}
+
+JSValue api_throw_error(VM* vm, JSObject* prototype, char* message)
+{
+    JSObject* error = object_create_object(prototype);
+    object_set_property(vm, error, init_string("message"), JS_VALUE_STRING(init_string(message)));
+    return api_throw(vm, JS_VALUE_OBJECT(error));
+}
+
+int api_report_exception(VM* vm)
+{
+    if (!vm->unwinding)
+    {
+        return 0;
+    }
+
+    JSValue exception = vm->exception;
+    if (exception.type == JS_OBJECT)
+    {
+        JSValue name = object_get_property(vm, exception.value.as_pointer, "name");
+        JSValue message = object_get_property(vm, exception.value.as_pointer, "message");
+        if (name.type == JS_STRING && message.type == JS_STRING)
+        {
+            fprintf(stderr, "Uncaught %s: %s\n", (char*)name.value.as_pointer, (char*)message.value.as_pointer);
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "Uncaught %s\n", value_to_string(&exception));
+    return 1;
+}
+
 extern const module_init __MOD_LOADER__[];
 extern const size_t __MOD_LOADER_SIZE__;
 
@@ -44,31 +83,18 @@ void bind_modules(VM* vm, Scope* scope) {
 char* init_string(char* str)
 {
     size_t len = strlen(str);
-    char* copy = GC_malloc_atomic(len + 1);
+    char* copy = vm_alloc_bytes(len + 1);
     strcpy(copy, str);
     copy[len] = '\0';
     return copy;
 }
 
-NativeModuleList* native_modules = NULL;
-
 void register_native_module(uint64_t hash, JSObject* exports)
 {
-    NativeModuleList* entry = GC_malloc(sizeof(NativeModuleList));
-    JSModule* module = GC_malloc(sizeof(JSModule));
+    JSModule* module = vm_alloc_object(sizeof(JSModule));
     memset(module, 0, sizeof(JSModule));
     module->header.hash = hash;
     module->initialized = 1;
     module->exports = exports;
-    
-    entry->module = module;
-    entry->next = native_modules;
-
-    if (!native_modules)
-    {
-        native_modules = entry;
-        return;
-    }
-
-    native_modules = entry;
+    module_table_add_module(module);
 }
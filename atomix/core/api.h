@@ -11,6 +11,22 @@
 
 JSValue api_call_function(VM* vm, JSFunction* function, JSValue this, JSValue* args, size_t argc);
 
+/**
+ * Raises an exception. Natives return right after raising, the interpreter unwinds once control is back
+ * in bytecode. Returns undefined so natives can return the result directly.
+ */
+JSValue api_throw(VM* vm, JSValue value);
+
+/**
+ * Raises a new error object inheriting from the given error prototype
+ */
+JSValue api_throw_error(VM* vm, JSObject* prototype, char* message);
+
+/**
+ * Prints an exception nobody caught. Returns the exit code of the process.
+ */
+int api_report_exception(VM* vm);
+
 void bind_modules(VM* vm, Scope* scope);
 
 char* init_string(char* str);
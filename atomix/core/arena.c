@@ -0,0 +1,54 @@
+#include "arena.impl.h"
+
+#include <string.h>
+
+#include "heap.h"
+
+// Chunks double from the first size on, so small modules stay small
+#define ARENA_FIRST_CHUNK 1024
+#define ARENA_MAX_CHUNK (64 * 1024)
+#define ARENA_ALIGNMENT 16
+
+static void* arena_chunk(Arena* arena, size_t size)
+{
+    if (arena->chunk_count == arena->chunk_capacity)
+    {
+        size_t capacity = arena->chunk_capacity ? arena->chunk_capacity * 2 : 8;
+        void** chunks = vm_alloc_object(capacity * sizeof(void*));
+        if (arena->chunk_count)
+        {
+            memcpy(chunks, arena->chunks, arena->chunk_count * sizeof(void*));
+        }
+        arena->chunks = chunks;
+        arena->chunk_capacity = capacity;
+    }
+
+    void* chunk = vm_alloc_bytes(size);
+    memset(chunk, 0, size);
+    arena->chunks[arena->chunk_count++] = chunk;
+    return chunk;
+}
+
+void* arena_alloc(Arena* arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if ((size_t)(arena->end - arena->cursor) < size)
+    {
+        size_t chunk_size = ARENA_FIRST_CHUNK;
+        for (size_t i = 0; i < arena->chunk_count && chunk_size < ARENA_MAX_CHUNK; i++)
+        {
+            chunk_size *= 2;
+        }
+        // Larger requests get a chunk of their own, so at most a quarter of a chunk is left unused
+        if (size > chunk_size / 4)
+        {
+            return arena_chunk(arena, size);
+        }
+        arena->cursor = arena_chunk(arena, chunk_size);
+        arena->end = arena->cursor + chunk_size;
+    }
+
+    void* pointer = arena->cursor;
+    arena->cursor += size;
+    return pointer;
+}
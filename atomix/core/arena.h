@@ -0,0 +1,16 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct Arena Arena;
+
+/**
+ * Bump allocates from large chunks the collector does not scan, for data living as long as the module
+ * owning the arena. The collector marks a chunk instead of every allocation, so the allocations may not hold
+ * the only pointer to a collectable object. A zeroed arena is empty, the memory is cleared and aligned like
+ * the collector aligns its objects.
+ */
+void* arena_alloc(Arena* arena, size_t size);
+
+#endif //ARENA_H
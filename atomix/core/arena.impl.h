@@ -0,0 +1,19 @@
+#ifndef ARENA_IMPL_H
+#define ARENA_IMPL_H
+
+#include <stdint.h>
+
+#include "arena.h"
+
+struct Arena
+{
+    // Free part of the current chunk
+    uint8_t* cursor;
+    uint8_t* end;
+    // Scanned, the only references keeping the chunks alive as allocations point into them
+    void** chunks;
+    size_t chunk_count;
+    size_t chunk_capacity;
+};
+
+#endif //ARENA_IMPL_H
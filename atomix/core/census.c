@@ -0,0 +1,546 @@
+#include "census.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <gc.h>
+#include <gc_mark.h>
+
+#include "panic.h"
+#include "nursery.h"
+#include "object.h"
+
+#include "vm.impl.h"
+#include "value.impl.h"
+#include "object.impl.h"
+#include "dict.impl.h"
+#include "scope.impl.h"
+#include "function.impl.h"
+#include "generator.impl.h"
+#include "upvalue.impl.h"
+#include "weak.impl.h"
+#include "format.impl.h"
+
+#define CENSUS_TOP_RETAINERS 10
+#define CENSUS_NO_PARENT UINT32_MAX
+
+typedef enum
+{
+    CENSUS_OBJECT,
+    CENSUS_DICT,
+    CENSUS_BUCKETS,
+    CENSUS_PROPERTY,
+    CENSUS_SCOPE,
+    CENSUS_FUNCTION,
+    CENSUS_UPVALUE,
+    CENSUS_GENERATOR,
+    CENSUS_WEAK_MAP,
+    CENSUS_STRING,
+    CENSUS_GS_BOX,
+    CENSUS_INTERNAL,
+    CENSUS_MODULE,
+    CENSUS_CODE,
+    CENSUS_IMAGE,
+    CENSUS_KIND_COUNT,
+
+    // Walked like the kinds above without being counted as a kind of their own
+    CENSUS_SYMBOLS = CENSUS_KIND_COUNT,
+    CENSUS_ROOT
+} CensusKind;
+
+static const char* const kind_names[CENSUS_KIND_COUNT] = {
+    "objects",
+    "dicts",
+    "dict buckets",
+    "properties",
+    "scopes",
+    "functions",
+    "upvalues",
+    "generators",
+    "weak maps",
+    "strings",
+    "accessors",
+    "host data",
+    "modules",
+    "instructions",
+    "module images"
+};
+
+typedef struct
+{
+    const void* pointer;
+    CensusKind kind;
+    // Node the walk first reached this one from, its retained size includes this one
+    uint32_t parent;
+    // Name of a variable or a root, only those are reported as retainers
+    const char* label;
+    size_t bytes;
+    size_t blocks;
+    size_t retained_bytes;
+    size_t retained_blocks;
+} CensusNode;
+
+// Open addressing, kept at most half full
+typedef struct
+{
+    const void** keys;
+    size_t slots;
+    size_t count;
+} CensusSet;
+
+typedef struct
+{
+    // Walked in the order they are added, so a node is always added after its parent
+    CensusNode* nodes;
+    uint32_t count;
+    uint32_t capacity;
+
+    CensusSet walked;
+    // Blocks of the collector already counted, an image holds many strings and a block many instructions
+    CensusSet blocks;
+
+    size_t counts[CENSUS_KIND_COUNT];
+    size_t bytes[CENSUS_KIND_COUNT];
+    size_t reachable_count;
+    size_t reachable_bytes;
+} Census;
+
+static void census_set_grow(CensusSet* set)
+{
+    const void** keys = set->keys;
+    size_t slots = set->slots;
+
+    set->slots = slots ? slots * 2 : 1024;
+    set->keys = calloc(set->slots, sizeof(void*));
+    if (!set->keys)
+    {
+        PANIC("Could not allocate memory");
+    }
+    for (size_t i = 0; i < slots; i++)
+    {
+        if (!keys[i])
+        {
+            continue;
+        }
+        size_t slot = ((uintptr_t)keys[i] >> 4) & (set->slots - 1);
+        while (set->keys[slot])
+        {
+            slot = (slot + 1) & (set->slots - 1);
+        }
+        set->keys[slot] = keys[i];
+    }
+    free(keys);
+}
+
+// Returns 0 if the pointer was already in the set
+static int census_set_add(CensusSet* set, const void* pointer)
+{
+    if ((set->count + 1) * 2 > set->slots)
+    {
+        census_set_grow(set);
+    }
+
+    size_t slot = ((uintptr_t)pointer >> 4) & (set->slots - 1);
+    while (set->keys[slot])
+    {
+        if (set->keys[slot] == pointer)
+        {
+            return 0;
+        }
+        slot = (slot + 1) & (set->slots - 1);
+    }
+    set->keys[slot] = pointer;
+    set->count++;
+    return 1;
+}
+
+static uint32_t census_node(Census* census, const void* pointer, CensusKind kind, uint32_t parent, const char* label)
+{
+    if (census->count == census->capacity)
+    {
+        census->capacity = census->capacity ? census->capacity * 2 : 1024;
+        census->nodes = realloc(census->nodes, census->capacity * sizeof(CensusNode));
+        if (!census->nodes)
+        {
+            PANIC("Could not allocate memory");
+        }
+    }
+    census->nodes[census->count] = (CensusNode){
+        .pointer = pointer,
+        .kind = kind,
+        .parent = parent,
+        .label = label
+    };
+    return census->count++;
+}
+
+static void census_add(Census* census, const void* pointer, CensusKind kind, uint32_t parent, const char* label)
+{
+    if (pointer && census_set_add(&census->walked, pointer))
+    {
+        census_node(census, pointer, kind, parent, label);
+    }
+}
+
+static void census_add_value(Census* census, JSValue value, uint32_t parent)
+{
+    switch (value.type)
+    {
+    case JS_STRING:
+        census_add(census, value.value.as_pointer, CENSUS_STRING, parent, NULL);
+        break;
+    case JS_OBJECT:
+    case JS_SYMBOL:
+        census_add(census, value.value.as_pointer, CENSUS_OBJECT, parent, NULL);
+        break;
+    case JS_FUNC:
+        census_add(census, value.value.as_pointer, CENSUS_FUNCTION, parent, NULL);
+        break;
+    case JS_GS_BOX:
+        census_add(census, value.value.as_pointer, CENSUS_GS_BOX, parent, NULL);
+        break;
+    case JS_INTERNAL:
+        census_add(census, value.value.as_pointer, CENSUS_INTERNAL, parent, NULL);
+        break;
+    default:
+        break;
+    }
+}
+
+// Counts the block holding the pointer once and charges it to the node. Strings of a module are read from
+// its image in place, so they count as part of the image. Pointers outside of the heap count nothing. Young
+// objects left in the nursery are the ones the collection before the walk pinned.
+static void census_block(Census* census, uint32_t node, const void* pointer, CensusKind kind)
+{
+    size_t size = nursery_object_size(pointer);
+    void* base = size ? (void*)pointer : pointer ? GC_base((void*)pointer) : NULL;
+    if (!base || !census_set_add(&census->blocks, base))
+    {
+        return;
+    }
+    if (base != pointer && kind == CENSUS_STRING)
+    {
+        kind = CENSUS_IMAGE;
+    }
+
+    size = size ? size : GC_size(base);
+    census->counts[kind]++;
+    census->bytes[kind] += size;
+    census->nodes[node].bytes += size;
+    census->nodes[node].blocks++;
+}
+
+static void census_walk_dict(Census* census, uint32_t node, const JSDict* dict, int symbols)
+{
+    census_block(census, node, dict, CENSUS_DICT);
+    if (!dict->buckets)
+    {
+        return;
+    }
+    census_block(census, node, dict->buckets, CENSUS_BUCKETS);
+    for (size_t i = 0; i < dict->bucket_count; i++)
+    {
+        for (JSProperty* property = dict->buckets[i]; property; property = property->next)
+        {
+            // The variables of a scope are the retainers a script can name
+            const char* label = symbols ? (property->key ? property->key : "[symbol]") : NULL;
+            census_add(census, property, CENSUS_PROPERTY, node, label);
+        }
+    }
+}
+
+static void census_walk_module(Census* census, uint32_t node, const JSModule* module)
+{
+    census_block(census, node, module, CENSUS_MODULE);
+    // Counted before the instructions, those of bodies that were not decoded point into the image
+    census_block(census, node, module->image, CENSUS_IMAGE);
+    census_block(census, node, module->arena.chunks, CENSUS_CODE);
+    for (size_t i = 0; i < module->arena.chunk_count; i++)
+    {
+        census_block(census, node, module->arena.chunks[i], CENSUS_CODE);
+    }
+    census_block(census, node, module->data_section.instructions, CENSUS_CODE);
+    census_block(census, node, module->data_section.depths, CENSUS_CODE);
+    census_block(census, node, module->handler_table.entries, CENSUS_CODE);
+    for (uint32_t i = 0; module->data_section.instructions && i < module->data_section.count; i++)
+    {
+        census_block(census, node, module->data_section.instructions[i], CENSUS_CODE);
+    }
+    census_add(census, module->exports, CENSUS_OBJECT, node, NULL);
+    census_add(census, module->scope, CENSUS_SCOPE, node, NULL);
+}
+
+static void census_walk(Census* census, uint32_t node)
+{
+    const void* pointer = census->nodes[node].pointer;
+    switch (census->nodes[node].kind)
+    {
+    case CENSUS_OBJECT:
+        {
+            JSObject* object = (JSObject*)pointer;
+            census_block(census, node, object, CENSUS_OBJECT);
+            // Before the properties, which hold the generator or map as host data
+            if (generator_prototype && object->prototype == generator_prototype)
+            {
+                census_add(census, object_get_internal(object), CENSUS_GENERATOR, node, NULL);
+            }
+            else if (weak_map_prototype && object->prototype == weak_map_prototype)
+            {
+                census_add(census, object_get_internal(object), CENSUS_WEAK_MAP, node, NULL);
+            }
+            census_add(census, object->prototype, CENSUS_OBJECT, node, NULL);
+            census_add(census, object->properties, CENSUS_DICT, node, NULL);
+        }
+        break;
+    case CENSUS_DICT:
+    case CENSUS_SYMBOLS:
+        census_walk_dict(census, node, pointer, census->nodes[node].kind == CENSUS_SYMBOLS);
+        break;
+    case CENSUS_PROPERTY:
+        {
+            const JSProperty* property = pointer;
+            census_block(census, node, property, CENSUS_PROPERTY);
+            census_add(census, property->key, CENSUS_STRING, node, NULL);
+            // Host data is keyed by the address of a static, which is no symbol object
+            if (property->symbol && GC_base(property->symbol))
+            {
+                census_add(census, property->symbol, CENSUS_OBJECT, node, NULL);
+            }
+            census_add_value(census, property->value, node);
+        }
+        break;
+    case CENSUS_SCOPE:
+        {
+            const Scope* scope = pointer;
+            census_block(census, node, scope, CENSUS_SCOPE);
+            census_add(census, scope->parent, CENSUS_SCOPE, node, NULL);
+            census_add(census, scope->symbols, CENSUS_SYMBOLS, node, NULL);
+        }
+        break;
+    case CENSUS_FUNCTION:
+        {
+            const JSFunction* function = pointer;
+            census_block(census, node, function, CENSUS_FUNCTION);
+            census_add(census, function->base, CENSUS_OBJECT, node, NULL);
+            census_add(census, function->scope, CENSUS_SCOPE, node, NULL);
+            census_add(census, function->module, CENSUS_MODULE, node, NULL);
+            census_block(census, node, function->upvalues, CENSUS_UPVALUE);
+            for (size_t i = 0; function->upvalues && i < function->upvalue_count; i++)
+            {
+                census_add(census, function->upvalues[i], CENSUS_UPVALUE, node, NULL);
+            }
+        }
+        break;
+    case CENSUS_UPVALUE:
+        {
+            const JSUpvalue* upvalue = pointer;
+            census_block(census, node, upvalue, CENSUS_UPVALUE);
+            // Open upvalues point into a stack, which is walked on its own. Those of a suspended generator
+            // can outlive it, their value is reached through them.
+            if (upvalue->location == &upvalue->closed || upvalue->owner)
+            {
+                census_add_value(census, *upvalue->location, node);
+            }
+        }
+        break;
+    case CENSUS_GENERATOR:
+        {
+            const JSGenerator* generator = pointer;
+            census_block(census, node, generator, CENSUS_GENERATOR);
+            census_add(census, generator->function, CENSUS_FUNCTION, node, NULL);
+            census_add(census, generator->scope, CENSUS_SCOPE, node, NULL);
+            census_block(census, node, generator->values, CENSUS_GENERATOR);
+            for (size_t i = 0; generator->values && i < generator->count; i++)
+            {
+                census_add_value(census, generator->values[i], node);
+            }
+            for (JSUpvalue* upvalue = generator->upvalues; upvalue; upvalue = upvalue->next)
+            {
+                census_add(census, upvalue, CENSUS_UPVALUE, node, NULL);
+            }
+        }
+        break;
+    case CENSUS_WEAK_MAP:
+        {
+            const JSWeakMap* map = pointer;
+            census_block(census, node, map, CENSUS_WEAK_MAP);
+            census_block(census, node, map->keys, CENSUS_WEAK_MAP);
+            census_block(census, node, map->types, CENSUS_WEAK_MAP);
+            census_block(census, node, map->slots, CENSUS_WEAK_MAP);
+            // Keys are weak and the values are counted with the properties of their keys
+            census_add(census, map->token, CENSUS_OBJECT, node, NULL);
+        }
+        break;
+    case CENSUS_STRING:
+    case CENSUS_INTERNAL:
+        census_block(census, node, pointer, census->nodes[node].kind);
+        break;
+    case CENSUS_GS_BOX:
+        {
+            const JSGSBox* box = pointer;
+            census_block(census, node, box, CENSUS_GS_BOX);
+            census_add(census, box->getter, CENSUS_FUNCTION, node, NULL);
+            census_add(census, box->setter, CENSUS_FUNCTION, node, NULL);
+        }
+        break;
+    case CENSUS_MODULE:
+        census_walk_module(census, node, pointer);
+        break;
+    default:
+        break;
+    }
+}
+
+static void census_add_roots(Census* census, VM* vm)
+{
+    uint32_t root = census_node(census, NULL, CENSUS_ROOT, CENSUS_NO_PARENT, "[vm]");
+    census_add(census, vm->globalScope, CENSUS_SCOPE, root, NULL);
+    census_add(census, vm->scope, CENSUS_SCOPE, root, NULL);
+    census_add(census, vm->function, CENSUS_FUNCTION, root, NULL);
+    census_add(census, vm->module, CENSUS_MODULE, root, NULL);
+    census_add(census, vm->generator, CENSUS_GENERATOR, root, NULL);
+    census_add_value(census, vm->exception, root);
+    for (size_t i = 0; i < vm->stats.stack_counter; i++)
+    {
+        census_add_value(census, vm->stack[i], root);
+    }
+    for (JSUpvalue* upvalue = vm->open_upvalues; upvalue; upvalue = upvalue->next)
+    {
+        census_add(census, upvalue, CENSUS_UPVALUE, root, NULL);
+    }
+
+    root = census_node(census, NULL, CENSUS_ROOT, CENSUS_NO_PARENT, "[built-ins]");
+    for (size_t i = 0; i < object_builtin_root_count; i++)
+    {
+        census_add(census, *object_builtin_roots[i], CENSUS_OBJECT, root, NULL);
+    }
+
+    // Modules of a bundle that were never imported still hold their part of its image, decoded ones may not
+    // have been looked up through the table yet
+    root = census_node(census, NULL, CENSUS_ROOT, CENSUS_NO_PARENT, "[modules]");
+    census_block(census, root, module_table.entries, CENSUS_MODULE);
+    for (uint32_t i = 0; i < module_table.capacity; i++)
+    {
+        ModuleTableEntry* entry = &module_table.entries[i];
+        if (entry->bundle)
+        {
+            census_block(census, root, entry->bundle->image, CENSUS_IMAGE);
+            census_block(census, root, entry->bundle->modules, CENSUS_MODULE);
+            if (entry->bundle->modules[entry->index].bundle)
+            {
+                census_add(census, &entry->bundle->modules[entry->index], CENSUS_MODULE, root, NULL);
+            }
+        }
+        census_add(census, entry->module, CENSUS_MODULE, root, NULL);
+    }
+}
+
+static void GC_CALLBACK census_count_reachable(void* object, size_t bytes, void* data)
+{
+    Census* census = data;
+    census->reachable_count++;
+    census->reachable_bytes += bytes;
+}
+
+static void* census_count_reachable_locked(void* census)
+{
+    GC_enumerate_reachable_objects_inner(census_count_reachable, census);
+    return NULL;
+}
+
+// Children come after their parents, so a single pass from the back sums every subtree
+static void census_retain(Census* census)
+{
+    for (uint32_t i = census->count; i-- > 0;)
+    {
+        CensusNode* node = &census->nodes[i];
+        node->retained_bytes += node->bytes;
+        node->retained_blocks += node->blocks;
+        if (node->parent != CENSUS_NO_PARENT)
+        {
+            census->nodes[node->parent].retained_bytes += node->retained_bytes;
+            census->nodes[node->parent].retained_blocks += node->retained_blocks;
+        }
+    }
+}
+
+static void census_print_retainers(Census* census, FILE* file)
+{
+    CensusNode* top[CENSUS_TOP_RETAINERS];
+    size_t count = 0;
+    for (uint32_t i = 0; i < census->count; i++)
+    {
+        CensusNode* node = &census->nodes[i];
+        if (!node->label)
+        {
+            continue;
+        }
+        size_t position = count < CENSUS_TOP_RETAINERS ? count++ : CENSUS_TOP_RETAINERS;
+        while (position > 0 && top[position - 1]->retained_bytes < node->retained_bytes)
+        {
+            if (position < CENSUS_TOP_RETAINERS)
+            {
+                top[position] = top[position - 1];
+            }
+            position--;
+        }
+        if (position < CENSUS_TOP_RETAINERS)
+        {
+            top[position] = node;
+        }
+    }
+
+    fprintf(file, "top retainers:\n");
+    for (size_t i = 0; i < count; i++)
+    {
+        fprintf(file, "    %12zu bytes %10zu blocks  %s%s\n",
+            top[i]->retained_bytes,
+            top[i]->retained_blocks,
+            top[i]->kind == CENSUS_ROOT ? "" : "variable ",
+            top[i]->label);
+    }
+}
+
+void census_print(VM* vm, FILE* file)
+{
+    Census census;
+    memset(&census, 0, sizeof(census));
+
+    // The walk only allocates with malloc, so the marks of this collection stay valid for it
+    nursery_collect();
+    GC_gcollect();
+    GC_call_with_alloc_lock(census_count_reachable_locked, &census);
+
+    census_add_roots(&census, vm);
+    for (uint32_t i = 0; i < census.count; i++)
+    {
+        census_walk(&census, i);
+    }
+    census_retain(&census);
+
+    size_t classified_count = 0;
+    size_t classified_bytes = 0;
+    fprintf(file, "heap census: %zu blocks, %zu bytes reachable\n", census.reachable_count, census.reachable_bytes);
+    fprintf(file, "    %-16s %10s %12s\n", "kind", "count", "bytes");
+    for (size_t i = 0; i < CENSUS_KIND_COUNT; i++)
+    {
+        if (census.counts[i])
+        {
+            fprintf(file, "    %-16s %10zu %12zu\n", kind_names[i], census.counts[i], census.bytes[i]);
+        }
+        classified_count += census.counts[i];
+        classified_bytes += census.bytes[i];
+    }
+    // Blocks of the collector itself, host data of native modules and words the collector took for pointers
+    if (census.reachable_count > classified_count && census.reachable_bytes > classified_bytes)
+    {
+        fprintf(file, "    %-16s %10zu %12zu\n", "unclassified",
+            census.reachable_count - classified_count,
+            census.reachable_bytes - classified_bytes);
+    }
+    census_print_retainers(&census, file);
+
+    free(census.nodes);
+    free(census.walked.keys);
+    free(census.blocks.keys);
+}
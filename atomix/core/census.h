@@ -0,0 +1,16 @@
+#ifndef CENSUS_H
+#define CENSUS_H
+
+#include <stdio.h>
+
+#include "vm.h"
+
+/**
+ * Collects, then walks the objects reachable from the VM, the built-ins and the loaded modules by their
+ * types and prints their count and bytes per kind together with the variables and roots retaining the
+ * most. An object is retained by the first path the walk reaches it on, so shared objects count once.
+ * Reachable blocks the walk does not know are reported as unclassified.
+ */
+void census_print(VM* vm, FILE* file);
+
+#endif //CENSUS_H
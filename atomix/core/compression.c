@@ -0,0 +1,85 @@
+#include "compression.h"
+
+#include <string.h>
+
+#include "panic.h"
+
+#define MIN_MATCH 4
+
+// Lengths of 15 continue in the following bytes, each adding up to 255
+static size_t read_length(const uint8_t* src, size_t length, size_t* position, size_t value)
+{
+    if (value != 15)
+    {
+        return value;
+    }
+
+    uint8_t byte;
+    do
+    {
+        if (*position >= length)
+        {
+            PANIC("Compressed data is corrupt");
+        }
+        byte = src[(*position)++];
+        value += byte;
+    }
+    while (byte == 255);
+    return value;
+}
+
+size_t lz_decompress(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity)
+{
+    size_t position = 0;
+    size_t written = 0;
+
+    while (position < length)
+    {
+        uint8_t token = src[position++];
+
+        size_t literals = read_length(src, length, &position, token >> 4);
+        if (literals > length - position || literals > capacity - written)
+        {
+            PANIC("Compressed data is corrupt");
+        }
+        memcpy(dst + written, src + position, literals);
+        position += literals;
+        written += literals;
+
+        // The last sequence only holds literals
+        if (position == length)
+        {
+            break;
+        }
+
+        if (length - position < 2)
+        {
+            PANIC("Compressed data is corrupt");
+        }
+        size_t offset = (size_t)src[position] | (size_t)src[position + 1] << 8;
+        position += 2;
+        size_t match = read_length(src, length, &position, token & 0x0F) + MIN_MATCH;
+        if (offset == 0 || offset > written || match > capacity - written)
+        {
+            PANIC("Compressed data is corrupt");
+        }
+
+        const uint8_t* from = dst + written - offset;
+        uint8_t* to = dst + written;
+        if (offset >= match)
+        {
+            memcpy(to, from, match);
+        }
+        else
+        {
+            // Overlapping matches repeat the last offset bytes, so they are copied in order
+            for (size_t i = 0; i < match; i++)
+            {
+                to[i] = from[i];
+            }
+        }
+        written += match;
+    }
+
+    return written;
+}
@@ -0,0 +1,13 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decompresses an LZ4 block into dst and returns the number of bytes written. Every back reference and
+ * length is checked against both buffers, a corrupt block stops the program with a panic.
+ */
+size_t lz_decompress(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity);
+
+#endif //COMPRESSION_H
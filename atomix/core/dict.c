@@ -3,13 +3,16 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
-#include <gc.h>
 
 #include "function.h"
+#include "heap.h"
+#include "nursery.h"
 #include "panic.h"
 #include "api.h"
 
 #define HASH_SEED 5381
+// Average chain length at which the bucket array is doubled
+#define DICT_MAX_LOAD 2
 
 static uint32_t hash_string(const char* str, size_t bucket_count)
 {
@@ -22,22 +25,108 @@ static uint32_t hash_string(const char* str, size_t bucket_count)
     return hash % bucket_count;
 }
 
+// Most objects and block scopes die young and many of them never get a property, the buckets are allocated
+// with the first one
+static JSDict* dict_init(JSDict* dict, size_t bucket_count)
+{
+    dict->buckets = NULL;
+    dict->bucket_count = bucket_count;
+    dict->count = 0;
+    return dict;
+}
+
 JSDict* dict_create_dict(size_t bucket_count)
 {
-    JSDict* dict = GC_malloc(sizeof(JSDict));
-    if (!dict)
+    return dict_init(vm_alloc_object(sizeof(JSDict)), bucket_count);
+}
+
+JSDict* dict_create_young_dict(size_t bucket_count)
+{
+    return dict_init(vm_alloc_young_object(sizeof(JSDict)), bucket_count);
+}
+
+// Buckets and properties are allocated where their dict is, so a young dict is promoted or dropped as a whole.
+// A dict a minor collection pinned may still point to promoted ones, every store below is followed by a barrier.
+static JSProperty** dict_alloc_buckets(const JSDict* dict, size_t bucket_count)
+{
+    return nursery_contains(dict)
+        ? vm_alloc_young_object(bucket_count * sizeof(JSProperty*))
+        : vm_alloc_object(bucket_count * sizeof(JSProperty*));
+}
+
+static JSProperty* dict_alloc_property(const JSDict* dict)
+{
+    return nursery_contains(dict) ? vm_alloc_young_property() : vm_alloc_property();
+}
+
+static inline void dict_set_bucket(JSProperty** buckets, size_t index, JSProperty* entry)
+{
+    buckets[index] = entry;
+    nursery_barrier(buckets, HEAP_ALLOC_OBJECT, entry);
+}
+
+static inline void dict_set_next(JSProperty* entry, JSProperty* next)
+{
+    entry->next = next;
+    nursery_barrier(entry, HEAP_ALLOC_PROPERTY, next);
+}
+
+static inline void dict_set_value(JSProperty* entry, JSValue value)
+{
+    entry->value = value;
+    nursery_barrier_value(entry, HEAP_ALLOC_PROPERTY, value);
+}
+
+void dict_store(JSValue* slot, JSValue value)
+{
+    dict_set_value((JSProperty*)((char*)slot - offsetof(JSProperty, value)), value);
+}
+
+static inline JSProperty* dict_bucket(const JSDict* dict, size_t index)
+{
+    return dict->buckets ? dict->buckets[index] : NULL;
+}
+
+// Symbol keyed properties stay in the first bucket, where the symbol lookups expect them
+static void dict_grow(JSDict* dict)
+{
+    size_t bucket_count = dict->bucket_count * 2;
+    JSProperty** buckets = dict_alloc_buckets(dict, bucket_count);
+    for (size_t i = 0; i < dict->bucket_count; i++)
     {
-        PANIC("Could not allocate memory");
+        JSProperty* entry = dict->buckets[i];
+        while (entry)
+        {
+            JSProperty* next = entry->next;
+            size_t index = entry->key ? hash_string(entry->key, bucket_count) : 0;
+            dict_set_next(entry, buckets[index]);
+            dict_set_bucket(buckets, index, entry);
+            entry = next;
+        }
     }
-    dict->buckets = GC_malloc(bucket_count * sizeof(JSProperty*));
+    dict->buckets = buckets;
+    nursery_barrier(dict, HEAP_ALLOC_OBJECT, buckets);
     dict->bucket_count = bucket_count;
-    return dict;
+}
+
+static void dict_reserve(JSDict* dict)
+{
+    if (!dict->buckets)
+    {
+        dict->buckets = dict_alloc_buckets(dict, dict->bucket_count);
+        nursery_barrier(dict, HEAP_ALLOC_OBJECT, dict->buckets);
+    }
+    else if (dict->count >= dict->bucket_count * DICT_MAX_LOAD)
+    {
+        dict_grow(dict);
+    }
+    dict->count++;
 }
 
 int dict_update(JSDict* dict, char* key, JSValue value)
 {
     size_t index = hash_string(key, dict->bucket_count);
-    JSProperty* entry = dict->buckets[index];
+    JSProperty* entry = dict_bucket(dict, index);
 
     while (entry)
     {
@@ -49,7 +138,7 @@ int dict_update(JSDict* dict, char* key, JSValue value)
 
         if (strcmp(key, entry->key) == 0)
         {
-            entry->value = value;
+            dict_set_value(entry, value);
             return 1;
         }
         entry = entry->next;
@@ -60,13 +149,13 @@ int dict_update(JSDict* dict, char* key, JSValue value)
 
 int dict_update_with_symbol(JSDict* dict, void* symbol, JSValue value)
 {
-    JSProperty* entry = dict->buckets[0];
+    JSProperty* entry = dict_bucket(dict, 0);
 
     while(entry)
     {
         if (entry->symbol == symbol)
         {
-            entry->value = value;
+            dict_set_value(entry, value);
             return 1;
         }
         entry = entry->next;
@@ -78,7 +167,7 @@ int dict_update_with_symbol(JSDict* dict, void* symbol, JSValue value)
 JSValue* dict_get(JSDict* dict, char* key)
 {
     size_t index = hash_string(key, dict->bucket_count);
-    JSProperty* entry = dict->buckets[index];
+    JSProperty* entry = dict_bucket(dict, index);
 
     while (entry)
     {
@@ -99,7 +188,7 @@ JSValue* dict_get(JSDict* dict, char* key)
 
 JSValue* dict_get_by_symbol(JSDict* dict, void* symbol)
 {
-    JSProperty* entry = dict->buckets[0];
+    JSProperty* entry = dict_bucket(dict, 0);
 
     while (entry)
     {
@@ -114,37 +203,30 @@ JSValue* dict_get_by_symbol(JSDict* dict, void* symbol)
 }
 
 void dict_add(JSDict* dict, char* key, JSValue value) {
+    dict_reserve(dict);
     size_t index = hash_string(key, dict->bucket_count);
 
-    JSProperty* new_entry = GC_malloc(sizeof(JSProperty));
-    if (!new_entry)
-    {
-        PANIC("Could not allocate memory");
-    }
+    JSProperty* new_entry = dict_alloc_property(dict);
     new_entry->key = key;
-    new_entry->value = value;
-    new_entry->next = dict->buckets[index];
-    dict->buckets[index] = new_entry;
+    dict_set_value(new_entry, value);
+    dict_set_next(new_entry, dict->buckets[index]);
+    dict_set_bucket(dict->buckets, index, new_entry);
 }
 
 void dict_add_with_symbol(JSDict* dict, void* symbol, JSValue value) {
-    JSProperty* new_entry = GC_MALLOC(sizeof(JSProperty));
-    if (!new_entry)
-    {
-        PANIC("Could not allocate memory");
-    }
+    dict_reserve(dict);
+    JSProperty* new_entry = dict_alloc_property(dict);
     new_entry->symbol = symbol;
     new_entry->key = NULL;
-    new_entry->value = value;
-    new_entry->next = dict->buckets[0];
-    dict->buckets[0] = new_entry;
-
+    dict_set_value(new_entry, value);
+    dict_set_next(new_entry, dict->buckets[0]);
+    dict_set_bucket(dict->buckets, 0, new_entry);
 }
 
 int dict_delete(JSDict* dict, char* key)
 {
     size_t index = hash_string(key, dict->bucket_count);
-    JSProperty* entry = dict->buckets[index];
+    JSProperty* entry = dict_bucket(dict, index);
 
     while (entry)
     {
@@ -158,17 +240,18 @@ int dict_delete(JSDict* dict, char* key)
         {
             if (entry == dict->buckets[index])
             {
-                dict->buckets[index] = entry->next;
+                dict_set_bucket(dict->buckets, index, entry->next);
             }
             else
             {
-                JSProperty* prev = dict->buckets[index]->next;
+                JSProperty* prev = dict->buckets[index];
                 while (prev->next != entry)
                 {
                     prev = prev->next;
                 }
-                prev->next = entry->next;
+                dict_set_next(prev, entry->next);
             }
+            dict->count--;
             return 1;
         }
         entry = entry->next;
@@ -179,7 +262,7 @@ int dict_delete(JSDict* dict, char* key)
 
 int dict_delete_by_symbol(JSDict* dict, void* symbol)
 {
-    JSProperty* entry = dict->buckets[0];
+    JSProperty* entry = dict_bucket(dict, 0);
 
     while (entry)
     {
@@ -187,17 +270,18 @@ int dict_delete_by_symbol(JSDict* dict, void* symbol)
         {
             if (entry == dict->buckets[0])
             {
-                dict->buckets[0] = entry->next;
+                dict_set_bucket(dict->buckets, 0, entry->next);
             }
             else
             {
-                JSProperty* prev = dict->buckets[0]->next;
+                JSProperty* prev = dict->buckets[0];
                 while (prev->next != entry)
                 {
                     prev = prev->next;
                 }
-                prev->next = entry->next;
+                dict_set_next(prev, entry->next);
             }
+            dict->count--;
             return 1;
         }
         entry = entry->next;
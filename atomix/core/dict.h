@@ -7,12 +7,26 @@
 
 typedef struct JSDict JSDict;
 
+/**
+ * The bucket array starts with bucket_count entries and doubles as properties are added
+ */
 JSDict* dict_create_dict(size_t bucket_count);
 
+/**
+ * Allocates the dict in the nursery, its buckets and properties follow it there
+ */
+JSDict* dict_create_young_dict(size_t bucket_count);
+
 JSValue* dict_get(JSDict* dict, char* key);
 
 JSValue* dict_get_by_symbol(JSDict* dict, void* symbol);
 
+/**
+ * Replaces the value dict_get or dict_get_by_symbol returned, which must not be assigned directly as the
+ * property may have to be remembered for the next minor collection
+ */
+void dict_store(JSValue* slot, JSValue value);
+
 void dict_add(JSDict* dict, char* key, JSValue value);
 
 void dict_add_with_symbol(JSDict* dict, void* symbol, JSValue value);
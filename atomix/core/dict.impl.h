@@ -15,8 +15,10 @@ typedef struct JSProperty
 
 struct JSDict
 {
+    // NULL until the first property is added
     JSProperty** buckets;
     size_t bucket_count;
+    size_t count;
 };
 
 #endif //DICT_IMPL_H
\ No newline at end of file
@@ -1,29 +1,100 @@
 #include "execution.impl.h"
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
+#include "heap.h"
+#include "nursery.h"
 #include "panic.h"
 #include "api.h"
+#include "loader.h"
 
 #include "instruction.impl.h"
 #include "vm.impl.h"
 #include "format.impl.h"
 #include "function.impl.h"
 #include "scope.impl.h"
+#include "upvalue.impl.h"
+#include "generator.impl.h"
 
-static void inst_nop(VM* vm, void* ptr)
+// Handlers are only looked up once an exception is raised, code inside of try blocks runs unchanged
+static void vm_unwind(VM* vm)
 {
+    uint32_t owner = vm->function ? vm->function->meta.instruction_start : 0;
+    size_t pc = vm->stats.instruction_counter - 1;
+    HandlerTable* table = &vm->module->handler_table;
+
+    for (uint32_t i = 0; i < table->count; i++)
+    {
+        HandlerEntry* entry = &table->entries[i];
+        if (entry->owner != owner || pc < entry->start || pc >= entry->end)
+        {
+            continue;
+        }
+
+        Scope* base = vm->function ? vm->function->scope : vm->module->scope;
+        size_t scopes = 0;
+        for (Scope* scope = vm->scope; scope && scope != base; scope = scope->parent)
+        {
+            scopes++;
+        }
+        for (; scopes > entry->scopes; scopes--)
+        {
+            vm->scope = vm->scope->parent;
+        }
+
+        upvalue_close(vm, &vm->stack[vm->stats.stack_start + entry->close]);
+        vm->stats.stack_counter = vm->stats.stack_start + entry->depth;
+        vm->stack[vm->stats.stack_counter++] = vm->exception;
+        vm->stats.instruction_counter = entry->handler;
+        vm->exception = JS_VALUE_UNDEFINED;
+        vm->unwinding = 0;
+        return;
+    }
+
+    // Not handled here, leave the frame and let the caller continue unwinding
+    vm->stats.instruction_counter = vm->function
+        ? vm->function->meta.instruction_end
+        : vm->module->data_section.count;
 }
 
-static void inst_ld_int(VM* vm, void* ptr)
+// Bodies are verified when the module is loaded but only decoded on the first call
+static inline void vm_prepare_function(JSFunction* function)
 {
-    InstInt32* inst = ptr;
-    if (vm->stats.stack_counter >= STACK_SIZE)
+    if (!function->module->data_section.instructions[function->meta.instruction_start])
+    {
+        module_decode_function(function->module, function->meta.instruction_start);
+    }
+}
+
+// The handlers never check the stack. They rely on stack_start <= stack_counter <= stack_start + depth holding
+// between any two instructions of a frame, which the verifier proves for every body when the module is loaded.
+// Reserving the whole depth up front is therefore the only check a frame needs, debug engines recheck the
+// invariant after every instruction (see vm_check_frame)
+static inline void vm_reserve_frame(size_t stack_start, uint16_t depth)
+{
+    if (stack_start + depth > STACK_SIZE)
     {
         PANIC("Stack overflow");
     }
-    vm->stats.stack[vm->stats.stack_counter++] = ((JSValue){
+}
+
+static void vm_throw_error(VM* vm, JSObject* prototype, char* message)
+{
+    api_throw_error(vm, prototype, message);
+    vm_unwind(vm);
+}
+
+static void inst_nop(VM* vm, void* ptr)
+{
+}
+
+static void inst_ld_int(VM* vm, void* ptr)
+{
+    InstInt32* inst = ptr;
+    vm->stack[vm->stats.stack_counter++] = ((JSValue){
         .type = JS_INTEGER,
         .value.as_int = inst->operand
     });
@@ -32,11 +103,7 @@ static void inst_ld_int(VM* vm, void* ptr)
 static void inst_ld_double(VM* vm, void* ptr)
 {
     InstDouble* inst = ptr;
-    if (vm->stats.stack_counter >= STACK_SIZE)
-    {
-        PANIC("Stack overflow");
-    }
-    vm->stats.stack[vm->stats.stack_counter++] = ((JSValue){
+    vm->stack[vm->stats.stack_counter++] = ((JSValue){
         .type = JS_DOUBLE,
         .value.as_double = inst->operand
     });
@@ -44,65 +111,47 @@ static void inst_ld_double(VM* vm, void* ptr)
 
 static void inst_ld_string(VM* vm, void* ptr)
 {
-    InstUInt16* inst = ptr;
-    if (vm->stats.stack_counter >= STACK_SIZE)
-    {
-        PANIC("Stack overflow");
-    }
-
+    InstUInt32* inst = ptr;
     char* str = string_table_load_str(&vm->module->string_table, inst->operand);
-    vm->stats.stack[vm->stats.stack_counter++] = JS_VALUE_STRING(str);
+    vm->stack[vm->stats.stack_counter++] = JS_VALUE_STRING(str);
 }
 
 static void inst_ld_undf(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter >= STACK_SIZE)
-    {
-        PANIC("Stack overflow");
-    }
-    vm->stats.stack[vm->stats.stack_counter++] = JS_VALUE_UNDEFINED;
+    vm->stack[vm->stats.stack_counter++] = JS_VALUE_UNDEFINED;
 }
 
 static void inst_ld_null(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter >= STACK_SIZE)
-    {
-        PANIC("Stack overflow");
-    }
-    vm->stats.stack[vm->stats.stack_counter++] = JS_VALUE_NULL;
+    vm->stack[vm->stats.stack_counter++] = JS_VALUE_NULL;
 }
 
 static void inst_ld_boolean(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter >= STACK_SIZE)
-    {
-        PANIC("Stack overflow");
-    }
-    vm->stats.stack[vm->stats.stack_counter++] = JS_VALUE_BOOL(OPCODE_OF(ptr) == OP_LD_TRUE);
+    vm->stack[vm->stats.stack_counter++] = JS_VALUE_BOOL(OPCODE_OF(ptr) == OP_LD_TRUE);
 }
 
 static void inst_ld_this(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter >= STACK_SIZE)
+    if (!vm->function)
     {
-        PANIC("Stack overflow");
+        vm->stack[vm->stats.stack_counter++] = scope_get(vm->scope, "this");
+        return;
     }
-    vm->stats.stack[vm->stats.stack_counter++] = scope_get(vm->scope, "this");
+    // The callee's this value sits right below its frame
+    vm->stack[vm->stats.stack_counter] = vm->stack[vm->stats.stack_start - 1];
+    vm->stats.stack_counter++;
 }
 
 static void inst_add(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     // undefined + anything => NaN
     if (left.type == JS_UNDEFINED || right.type == JS_UNDEFINED)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
         return;
     }
 
@@ -121,16 +170,16 @@ static void inst_add(VM* vm, void* ptr)
 
     if (left.type == JS_INTEGER && right.type == JS_INTEGER)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1].type = JS_INTEGER;
-        vm->stats.stack[vm->stats.stack_counter - 1].value.as_int = left.value.as_int + right.value.as_int;
+        vm->stack[vm->stats.stack_counter - 1].type = JS_INTEGER;
+        vm->stack[vm->stats.stack_counter - 1].value.as_int = left.value.as_int + right.value.as_int;
     }
     else if (left.type == JS_DOUBLE || right.type == JS_DOUBLE)
     {
         double l = left.type == JS_DOUBLE ? left.value.as_double : (double)left.value.as_int;
         double r = right.type == JS_DOUBLE ? right.value.as_double : (double)right.value.as_int;
 
-        vm->stats.stack[vm->stats.stack_counter - 1].value.as_double = l + r;
-        vm->stats.stack[vm->stats.stack_counter - 1].type = JS_DOUBLE;
+        vm->stack[vm->stats.stack_counter - 1].value.as_double = l + r;
+        vm->stack[vm->stats.stack_counter - 1].type = JS_DOUBLE;
     }
     else
     {
@@ -141,18 +190,14 @@ static void inst_add(VM* vm, void* ptr)
 
 static void inst_minus(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     // undefined or object or function - anything => NaN
     if (left.type == JS_UNDEFINED || left.type == JS_OBJECT || left.type == JS_FUNC ||
         right.type == JS_UNDEFINED || right.type == JS_OBJECT || right.type == JS_FUNC)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
         return;
     }
 
@@ -170,16 +215,16 @@ static void inst_minus(VM* vm, void* ptr)
 
     if (left.type == JS_INTEGER && right.type == JS_INTEGER)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1].type = JS_INTEGER;
-        vm->stats.stack[vm->stats.stack_counter - 1].value.as_int = left.value.as_int - right.value.as_int;
+        vm->stack[vm->stats.stack_counter - 1].type = JS_INTEGER;
+        vm->stack[vm->stats.stack_counter - 1].value.as_int = left.value.as_int - right.value.as_int;
     }
     else if (left.type == JS_DOUBLE || right.type == JS_DOUBLE)
     {
         double l = left.type == JS_DOUBLE ? left.value.as_double : (double)left.value.as_int;
         double r = right.type == JS_DOUBLE ? right.value.as_double : (double)right.value.as_int;
 
-        vm->stats.stack[vm->stats.stack_counter - 1].value.as_double = l - r;
-        vm->stats.stack[vm->stats.stack_counter - 1].type = JS_DOUBLE;
+        vm->stack[vm->stats.stack_counter - 1].value.as_double = l - r;
+        vm->stack[vm->stats.stack_counter - 1].type = JS_DOUBLE;
     }
     else
     {
@@ -189,18 +234,14 @@ static void inst_minus(VM* vm, void* ptr)
 
 static void inst_mul(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     // undefined or object or function * anything => NaN
     if (left.type == JS_UNDEFINED || left.type == JS_OBJECT || left.type == JS_FUNC ||
         right.type == JS_UNDEFINED || right.type == JS_OBJECT || right.type == JS_FUNC)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
         return;
     }
 
@@ -218,8 +259,8 @@ static void inst_mul(VM* vm, void* ptr)
 
     if (left.type == JS_INTEGER && right.type == JS_INTEGER)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1].type = JS_INTEGER;
-        vm->stats.stack[vm->stats.stack_counter - 1].value.as_int = left.value.as_int * right.value.as_int;
+        vm->stack[vm->stats.stack_counter - 1].type = JS_INTEGER;
+        vm->stack[vm->stats.stack_counter - 1].value.as_int = left.value.as_int * right.value.as_int;
     }
     else if (left.type == JS_DOUBLE || right.type == JS_DOUBLE)
     {
@@ -227,7 +268,7 @@ static void inst_mul(VM* vm, void* ptr)
         double r = right.type == JS_DOUBLE ? right.value.as_double : (double)right.value.as_int;
 
         r = l * r;
-        vm->stats.stack[vm->stats.stack_counter - 1] = r == (int)r
+        vm->stack[vm->stats.stack_counter - 1] = r == (int)r
                                                            ? JS_VALUE_INT((int)r)
                                                            : JS_VALUE_DOUBLE(r);
     }
@@ -239,18 +280,14 @@ static void inst_mul(VM* vm, void* ptr)
 
 static void inst_div(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     // undefined or object or function / anything => NaN
     if (left.type == JS_UNDEFINED || left.type == JS_OBJECT || left.type == JS_FUNC ||
         right.type == JS_UNDEFINED || right.type == JS_OBJECT || right.type == JS_FUNC || right.type == JS_NULL)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
         return;
     }
 
@@ -278,18 +315,18 @@ static void inst_div(VM* vm, void* ptr)
 
         if (r == 0.0 && l == 0.0)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
+            vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
             return;
         }
         else if (r == 0.0)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(l > 0 ? JS_POS_INFINITY : JS_NEG_INFINITY);
+            vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(l > 0 ? JS_POS_INFINITY : JS_NEG_INFINITY);
             return;
         }
 
 
         r = l / r;
-        vm->stats.stack[vm->stats.stack_counter - 1] = r == (int)r
+        vm->stack[vm->stats.stack_counter - 1] = r == (int)r
                                                            ? JS_VALUE_INT((int)r)
                                                            : JS_VALUE_DOUBLE(r);
     }
@@ -301,18 +338,14 @@ static void inst_div(VM* vm, void* ptr)
 
 static void inst_mod(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     // undefined or object or function % anything => NaN
     if (left.type == JS_UNDEFINED || left.type == JS_OBJECT || left.type == JS_FUNC ||
         right.type == JS_UNDEFINED || right.type == JS_OBJECT || right.type == JS_FUNC || right.type == JS_NULL)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
         return;
     }
 
@@ -332,12 +365,12 @@ static void inst_mod(VM* vm, void* ptr)
     {
         if (right.value.as_int == 0)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
+            vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
             return;
         }
 
-        vm->stats.stack[vm->stats.stack_counter - 1].type = JS_INTEGER;
-        vm->stats.stack[vm->stats.stack_counter - 1].value.as_int = left.value.as_int % right.value.as_int;
+        vm->stack[vm->stats.stack_counter - 1].type = JS_INTEGER;
+        vm->stack[vm->stats.stack_counter - 1].value.as_int = left.value.as_int % right.value.as_int;
     }
     else if (left.type == JS_DOUBLE || right.type == JS_DOUBLE)
     {
@@ -346,12 +379,12 @@ static void inst_mod(VM* vm, void* ptr)
 
         if (r == 0.0)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
+            vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
             return;
         }
 
         r = fmod(l, r);
-        vm->stats.stack[vm->stats.stack_counter - 1] = r == (int)r
+        vm->stack[vm->stats.stack_counter - 1] = r == (int)r
                                                            ? JS_VALUE_INT((int)r)
                                                            : JS_VALUE_DOUBLE(r);
     }
@@ -363,19 +396,15 @@ static void inst_mod(VM* vm, void* ptr)
 
 static void inst_binary_and(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
     if ((left.type != JS_INTEGER && left.type != JS_DOUBLE) ||
         (right.type != JS_INTEGER && right.type != JS_DOUBLE))
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
         return;
     }
 
@@ -386,17 +415,13 @@ static void inst_binary_and(VM* vm, void* ptr)
     int rightValue = right.type == JS_DOUBLE
                          ? (int)right.value.as_double
                          : right.value.as_int;
-    vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(leftValue & rightValue);
+    vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(leftValue & rightValue);
 }
 
 static void inst_binary_or(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
@@ -405,23 +430,23 @@ static void inst_binary_or(VM* vm, void* ptr)
     {
         if (left.type == JS_INTEGER)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = left;
+            vm->stack[vm->stats.stack_counter - 1] = left;
         }
         else if (left.type == JS_DOUBLE)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT((int)left.value.as_double);
+            vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT((int)left.value.as_double);
         }
         else if (right.type == JS_INTEGER)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = right;
+            vm->stack[vm->stats.stack_counter - 1] = right;
         }
         else if (right.type == JS_DOUBLE)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT((int)right.value.as_double);
+            vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT((int)right.value.as_double);
         }
         else
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
+            vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
         }
         return;
     }
@@ -434,17 +459,13 @@ static void inst_binary_or(VM* vm, void* ptr)
                          ? (int)right.value.as_double
                          : right.value.as_int;
 
-    vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(leftValue | rightValue);
+    vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(leftValue | rightValue);
 }
 
 static void inst_binary_xor(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
@@ -453,23 +474,23 @@ static void inst_binary_xor(VM* vm, void* ptr)
     {
         if (left.type == JS_INTEGER)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = left;
+            vm->stack[vm->stats.stack_counter - 1] = left;
         }
         else if (left.type == JS_DOUBLE)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT((int)left.value.as_double);
+            vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT((int)left.value.as_double);
         }
         else if (right.type == JS_INTEGER)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = right;
+            vm->stack[vm->stats.stack_counter - 1] = right;
         }
         else if (right.type == JS_DOUBLE)
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT((int)right.value.as_double);
+            vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT((int)right.value.as_double);
         }
         else
         {
-            vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
+            vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
         }
         return;
     }
@@ -482,28 +503,24 @@ static void inst_binary_xor(VM* vm, void* ptr)
                          ? (int)right.value.as_double
                          : right.value.as_int;
 
-    vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(leftValue ^ rightValue);
+    vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(leftValue ^ rightValue);
 }
 
 static void inst_binary_lshft(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
     if (left.type != JS_INTEGER && left.type != JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
         return;
     }
     if (right.type != JS_INTEGER && right.type != JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = left.type == JS_DOUBLE
+        vm->stack[vm->stats.stack_counter - 1] = left.type == JS_DOUBLE
                                                            ? JS_VALUE_DOUBLE((int)left.value.as_double)
                                                            : left;
         return;
@@ -517,28 +534,24 @@ static void inst_binary_lshft(VM* vm, void* ptr)
                          ? (int)right.value.as_double
                          : right.value.as_int;
 
-    vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(leftValue << rightValue);
+    vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(leftValue << rightValue);
 }
 
 static void inst_binary_rshft(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
     if (left.type != JS_INTEGER && left.type != JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
         return;
     }
     if (right.type != JS_INTEGER && right.type != JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = left.type == JS_DOUBLE
+        vm->stack[vm->stats.stack_counter - 1] = left.type == JS_DOUBLE
                                                            ? JS_VALUE_DOUBLE((int)left.value.as_double)
                                                            : left;
         return;
@@ -552,28 +565,24 @@ static void inst_binary_rshft(VM* vm, void* ptr)
                          ? (int)right.value.as_double
                          : right.value.as_int;
 
-    vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(leftValue >> rightValue);
+    vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(leftValue >> rightValue);
 }
 
 static void inst_binary_zrshft(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
     if (left.type != JS_INTEGER && left.type != JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(0);
         return;
     }
     if (right.type != JS_INTEGER && right.type != JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = left.type == JS_DOUBLE
+        vm->stack[vm->stats.stack_counter - 1] = left.type == JS_DOUBLE
                                                            ? JS_VALUE_DOUBLE((int)left.value.as_double)
                                                            : left;
         return;
@@ -587,21 +596,17 @@ static void inst_binary_zrshft(VM* vm, void* ptr)
                          ? (int)right.value.as_double
                          : right.value.as_int;
 
-    vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(
+    vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(
         (int)((unsigned int)leftValue >> (unsigned int)rightValue));
 }
 
 static void inst_binary_not(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 1)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     if (right.type == JS_UNDEFINED || right.type == JS_OBJECT || right.type == JS_FUNC)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(-1);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(-1);
         return;
     }
 
@@ -614,28 +619,19 @@ static void inst_binary_not(VM* vm, void* ptr)
         right = JS_VALUE_INT((int)right.value.as_double);
     }
 
-    vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(~right.value.as_int);
+    vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(~right.value.as_int);
 }
 
 static void inst_not(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 1)
-    {
-        PANIC("Stack underflow");
-    }
-    vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(
-        value_is_falsy(&vm->stats.stack[vm->stats.stack_counter - 1]) ? 1 : 0
+    vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(
+        value_is_falsy(&vm->stack[vm->stats.stack_counter - 1]) ? 1 : 0
     );
 }
 
 static void inst_negate(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 1)
-    {
-        PANIC("Stack underflow");
-    }
-
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     if (right.type == JS_BOOLEAN || right.type == JS_NULL)
     {
@@ -643,18 +639,18 @@ static void inst_negate(VM* vm, void* ptr)
     }
     else if (right.type == JS_UNDEFINED || right.type == JS_OBJECT || right.type == JS_FUNC)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(JS_NaN);
         return;
     }
 
     if (right.type == JS_INTEGER)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(-right.value.as_int);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_INT(-right.value.as_int);
         return;
     }
     if (right.type == JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(-right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_DOUBLE(-right.value.as_double);
         return;
     }
     PANIC("Unknown operand type");
@@ -662,47 +658,42 @@ static void inst_negate(VM* vm, void* ptr)
 
 static void inst_typeof(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 1)
-    {
-        PANIC("Stack underflow");
-    }
-
-    switch (vm->stats.stack[vm->stats.stack_counter - 1].type)
+    switch (vm->stack[vm->stats.stack_counter - 1].type)
     {
     case JS_INTEGER:
     case JS_DOUBLE:
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("number"));
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("number"));
         return;
     case JS_STRING:
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("string"));
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("string"));
         return;
     case JS_OBJECT:
     case JS_NULL:
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("object"));
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("object"));
         return;
     case JS_FUNC:
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("function"));
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("function"));
         return;
     case JS_UNDEFINED:
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("undefined"));
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("undefined"));
         return;
     case JS_BOOLEAN:
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("boolean"));
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_STRING(init_string("boolean"));
         return;
     case JS_SYMBOL:
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_SYMBOL(init_string("symbol"));
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_SYMBOL(init_string("symbol"));
+    case JS_GS_BOX:
+    case JS_INTERNAL:
+        // Accessor boxes and host data live in property tables, scripts never get hold of them
+        break;
     }
     PANIC("Unknown operand type");
 }
 
 static void inst_teq(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
@@ -711,42 +702,42 @@ static void inst_teq(VM* vm, void* ptr)
             (left.type == JS_INTEGER && right.type == JS_DOUBLE))
     )
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
         return;
     }
 
     if (left.type == JS_DOUBLE && right.type == JS_INTEGER)
     {
         double rightValue = (double)right.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double == rightValue);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double == rightValue);
         return;
     }
     if (left.type == JS_INTEGER && right.type == JS_DOUBLE)
     {
         double leftValue = (double)left.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue == right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue == right.value.as_double);
         return;
     }
     if (left.type == JS_INTEGER)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int == right.value.as_int);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int == right.value.as_int);
         return;
     }
     if (left.type == JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double == right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double == right.value.as_double);
         return;
     }
 
     if (left.type == JS_NULL || left.type == JS_UNDEFINED)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(1);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(1);
         return;
     }
 
     if (left.type == JS_FUNC || left.type == JS_OBJECT)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_pointer == right.value.as_pointer);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_pointer == right.value.as_pointer);
         return;
     }
 
@@ -755,12 +746,8 @@ static void inst_teq(VM* vm, void* ptr)
 
 static void inst_nteq(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
@@ -769,42 +756,42 @@ static void inst_nteq(VM* vm, void* ptr)
             (left.type == JS_INTEGER && right.type == JS_DOUBLE))
     )
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(1);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(1);
         return;
     }
 
     if (left.type == JS_DOUBLE && right.type == JS_INTEGER)
     {
         double rightValue = (double)right.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double != rightValue);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double != rightValue);
         return;
     }
     if (left.type == JS_INTEGER && right.type == JS_DOUBLE)
     {
         double leftValue = (double)left.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue != right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue != right.value.as_double);
         return;
     }
     if (left.type == JS_INTEGER)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int != right.value.as_int);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int != right.value.as_int);
         return;
     }
     if (left.type == JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double != right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double != right.value.as_double);
         return;
     }
 
     if (left.type == JS_NULL || left.type == JS_UNDEFINED)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
         return;
     }
 
     if (left.type == JS_FUNC || left.type == JS_OBJECT)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_pointer != right.value.as_pointer);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_pointer != right.value.as_pointer);
         return;
     }
 
@@ -813,12 +800,8 @@ static void inst_nteq(VM* vm, void* ptr)
 
 static void inst_gt(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
@@ -833,7 +816,7 @@ static void inst_gt(VM* vm, void* ptr)
 
     if (left.type == JS_UNDEFINED || right.type == JS_UNDEFINED)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
         return;
     }
     if (left.type == JS_NULL)
@@ -847,24 +830,24 @@ static void inst_gt(VM* vm, void* ptr)
 
     if (left.type == JS_INTEGER && right.type == JS_INTEGER)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int > right.value.as_int);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int > right.value.as_int);
         return;
     }
     if (left.type == JS_DOUBLE && right.type == JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double > right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double > right.value.as_double);
         return;
     }
     if (left.type == JS_DOUBLE && right.type == JS_INTEGER)
     {
         double rightValue = right.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double > rightValue);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double > rightValue);
         return;
     }
     if (left.type == JS_INTEGER && right.type == JS_DOUBLE)
     {
         double leftValue = left.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue > right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue > right.value.as_double);
         return;
     }
     // TODO string comparison
@@ -873,12 +856,8 @@ static void inst_gt(VM* vm, void* ptr)
 
 static void inst_geq(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
@@ -893,7 +872,7 @@ static void inst_geq(VM* vm, void* ptr)
 
     if (left.type == JS_UNDEFINED || right.type == JS_UNDEFINED)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
         return;
     }
     if (left.type == JS_NULL)
@@ -907,24 +886,24 @@ static void inst_geq(VM* vm, void* ptr)
 
     if (left.type == JS_INTEGER && right.type == JS_INTEGER)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int >= right.value.as_int);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int >= right.value.as_int);
         return;
     }
     if (left.type == JS_DOUBLE && right.type == JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double >= right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double >= right.value.as_double);
         return;
     }
     if (left.type == JS_DOUBLE && right.type == JS_INTEGER)
     {
         double rightValue = right.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double >= rightValue);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double >= rightValue);
         return;
     }
     if (left.type == JS_INTEGER && right.type == JS_DOUBLE)
     {
         double leftValue = left.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue >= right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue >= right.value.as_double);
         return;
     }
     // TODO string comparison
@@ -933,12 +912,8 @@ static void inst_geq(VM* vm, void* ptr)
 
 static void inst_lt(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
@@ -953,7 +928,7 @@ static void inst_lt(VM* vm, void* ptr)
 
     if (left.type == JS_UNDEFINED || right.type == JS_UNDEFINED)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
         return;
     }
     if (left.type == JS_NULL)
@@ -967,24 +942,24 @@ static void inst_lt(VM* vm, void* ptr)
 
     if (left.type == JS_INTEGER && right.type == JS_INTEGER)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int < right.value.as_int);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int < right.value.as_int);
         return;
     }
     if (left.type == JS_DOUBLE && right.type == JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double < right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double < right.value.as_double);
         return;
     }
     if (left.type == JS_DOUBLE && right.type == JS_INTEGER)
     {
         double rightValue = right.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double < rightValue);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double < rightValue);
         return;
     }
     if (left.type == JS_INTEGER && right.type == JS_DOUBLE)
     {
         double leftValue = left.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue < right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue < right.value.as_double);
         return;
     }
     // TODO string comparison
@@ -993,12 +968,8 @@ static void inst_lt(VM* vm, void* ptr)
 
 static void inst_leq(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue left = vm->stats.stack[vm->stats.stack_counter - 2];
-    JSValue right = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue left = vm->stack[vm->stats.stack_counter - 2];
+    JSValue right = vm->stack[vm->stats.stack_counter - 1];
 
     vm->stats.stack_counter--;
 
@@ -1013,7 +984,7 @@ static void inst_leq(VM* vm, void* ptr)
 
     if (left.type == JS_UNDEFINED || right.type == JS_UNDEFINED)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(0);
         return;
     }
     if (left.type == JS_NULL)
@@ -1027,24 +998,24 @@ static void inst_leq(VM* vm, void* ptr)
 
     if (left.type == JS_INTEGER && right.type == JS_INTEGER)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int <= right.value.as_int);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_int <= right.value.as_int);
         return;
     }
     if (left.type == JS_DOUBLE && right.type == JS_DOUBLE)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double <= right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double <= right.value.as_double);
         return;
     }
     if (left.type == JS_DOUBLE && right.type == JS_INTEGER)
     {
         double rightValue = right.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double <= rightValue);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(left.value.as_double <= rightValue);
         return;
     }
     if (left.type == JS_INTEGER && right.type == JS_DOUBLE)
     {
         double leftValue = left.value.as_int;
-        vm->stats.stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue <= right.value.as_double);
+        vm->stack[vm->stats.stack_counter - 1] = JS_VALUE_BOOL(leftValue <= right.value.as_double);
         return;
     }
     // TODO string comparison
@@ -1053,48 +1024,27 @@ static void inst_leq(VM* vm, void* ptr)
 
 static void inst_pop(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter == 0)
-    {
-        PANIC("Stack underflow");
-    }
-
     vm->stats.stack_counter--;
 }
 
 static void inst_dup(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter == 0)
-    {
-        PANIC("Stack underflow");
-    }
-    if (vm->stats.stack_counter >= STACK_SIZE)
-    {
-        PANIC("Stack overflow");
-    }
     vm->stats.stack_counter++;
-    vm->stats.stack[vm->stats.stack_counter - 1] = vm->stats.stack[vm->stats.stack_counter - 2];
+    vm->stack[vm->stats.stack_counter - 1] = vm->stack[vm->stats.stack_counter - 2];
 }
 
 static void inst_swap(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue tmp = vm->stats.stack[vm->stats.stack_counter - 2];
-    vm->stats.stack[vm->stats.stack_counter - 2] = vm->stats.stack[vm->stats.stack_counter - 1];
-    vm->stats.stack[vm->stats.stack_counter - 1] = tmp;
+    JSValue tmp = vm->stack[vm->stats.stack_counter - 2];
+    vm->stack[vm->stats.stack_counter - 2] = vm->stack[vm->stats.stack_counter - 1];
+    vm->stack[vm->stats.stack_counter - 1] = tmp;
 }
 
 static void inst_alloc_store_local(VM* vm, void* ptr)
 {
-    InstUInt16* inst = ptr;
+    InstUInt32* inst = ptr;
     int is_alloc = inst->opcode == OP_ALLOC_LOCAL;
-    if (vm->stats.stack_counter == 0)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue value = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue value = vm->stack[vm->stats.stack_counter - 1];
     vm->stats.stack_counter--;
     char* key = string_table_load_str(&vm->module->string_table, inst->operand);
     if (is_alloc)
@@ -1105,60 +1055,54 @@ static void inst_alloc_store_local(VM* vm, void* ptr)
 
     if (!scope_set(vm->scope, key, value))
     {
-        PANIC("Could not update local");
+        vm_throw_error(vm, object_get_reference_error_prototype(), "Assignment to undeclared variable");
     }
 }
 
 static void inst_load_local(VM* vm, void* ptr)
 {
-    InstUInt16* inst = ptr;
-    if (vm->stats.stack_counter >= STACK_SIZE)
-    {
-        PANIC("Stack overflow");
-    }
+    InstUInt32* inst = ptr;
     char* key = string_table_load_str(&vm->module->string_table, inst->operand);
     if (!scope_contains(vm->scope, key, 1))
     {
-        PANIC("Symbol not found");
+        vm_throw_error(vm, object_get_reference_error_prototype(), "Variable is not defined");
+        return;
     }
-    vm->stats.stack[vm->stats.stack_counter++] = scope_get(vm->scope, key);
+    vm->stack[vm->stats.stack_counter++] = scope_get(vm->scope, key);
 }
 
 static void inst_load_arg(VM* vm, void* ptr)
 {
-    InstUInt16* inst = ptr;
-    if (vm->stats.stack_counter - (vm->stats.stack_counter - vm->stats.stack_start) <= inst->operand)
+    InstUInt32* inst = ptr;
+    // Index 0 is this, which is pushed after the arguments
+    if (inst->operand > vm->stats.argc || vm->stats.stack_start <= inst->operand)
     {
-        vm->stats.stack[vm->stats.stack_counter++] = JS_VALUE_UNDEFINED;
+        vm->stack[vm->stats.stack_counter++] = JS_VALUE_UNDEFINED;
         return;
     }
 
-    vm->stats.stack[vm->stats.stack_counter++]
-        = vm->stats.stack[vm->stats.stack_counter - (vm->stats.stack_counter - vm->stats.stack_start) - inst->operand - 1];
+    vm->stack[vm->stats.stack_counter] = vm->stack[vm->stats.stack_start - inst->operand - 1];
+    vm->stats.stack_counter++;
 }
 
 static void inst_func_decl(VM* vm, void* ptr)
 {
     int is_function_decl = OPCODE_OF(ptr) == OP_FUNC_DECL;
-    uint16_t idx;
-    uint16_t size;
+    uint32_t idx;
+    uint32_t size;
     if (is_function_decl)
     {
-        Inst2UInt16* inst = ptr;
-        idx = inst->operand;
-        size = inst->operand2;
+        InstFuncDecl* inst = ptr;
+        idx = inst->name;
+        size = inst->size;
     }
     else
     {
-        InstUInt16* inst = ptr;
+        InstFuncDeclE* inst = ptr;
         idx = 0;
-        size = inst->operand;
+        size = inst->size;
     }
 
-    if (vm->stats.stack_counter >= STACK_SIZE)
-    {
-        PANIC("Stack overflow");
-    }
     JSFunction* function = function_create_function(
         vm->scope,
         vm->module,
@@ -1173,21 +1117,18 @@ static void inst_func_decl(VM* vm, void* ptr)
         char* key = string_table_load_str(&vm->module->string_table, idx);
         scope_declare(vm->scope, key, value);
     }
-    vm->stats.stack[vm->stats.stack_counter++] = value;
+    vm->stack[vm->stats.stack_counter++] = value;
     vm->stats.instruction_counter += size;
 }
 
 static void inst_call(VM* vm, void* ptr)
 {
-    InstUInt16* inst = ptr;
-    if (vm->stats.stack_counter == 0)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue value = vm->stats.stack[--vm->stats.stack_counter];
+    InstUInt32* inst = ptr;
+    JSValue value = vm->stack[--vm->stats.stack_counter];
     if (value.type != JS_FUNC)
     {
-        PANIC("Callee is not a function");
+        vm_throw_error(vm, object_get_type_error_prototype(), "Callee is not a function");
+        return;
     }
 
     JSFunction* function = value.value.as_pointer;
@@ -1200,8 +1141,8 @@ static void inst_call(VM* vm, void* ptr)
             PANIC("Function holds not a valid pointer");
         }
         JSValue args[inst->operand + 1];
-        for (uint16_t i = 0; i <= inst->operand; i++) {
-            args[i] = vm->stats.stack[vm->stats.stack_counter - i - 1];
+        for (uint32_t i = 0; i <= inst->operand; i++) {
+            args[i] = vm->stack[vm->stats.stack_counter - i - 1];
         }
     
         JSValue this = args[0];
@@ -1210,85 +1151,99 @@ static void inst_call(VM* vm, void* ptr)
     }
     else
     {
-        JSValue this_value = vm->stats.stack[vm->stats.stack_counter - 1];
-        char* this_key = init_string("this");
-        scope_declare(function->scope, this_key, this_value);
-        return_value = vm_exec_function(vm, function);
+        return_value = vm_exec_function(vm, function, inst->operand);
         vm->stats.stack_counter -= inst->operand + 1;
     }
-    vm->stats.stack[vm->stats.stack_counter++] = return_value;
+    vm->stack[vm->stats.stack_counter++] = return_value;
+    if (vm->unwinding)
+    {
+        vm_unwind(vm);
+    }
 }
 
-static void inst_arr_alloc(VM* vm, void* ptr)
+static void inst_import(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter >= STACK_SIZE)
+    InstUInt64* inst = ptr;
+    JSModule* module;
+    const char* rejection = module_table_get(inst->operand, &module);
+    if (rejection)
     {
-        PANIC("Stack overflow");
+        vm_throw_error(vm, object_get_error_prototype(), (char*)rejection);
+        return;
     }
-    JSObject* obj = object_create_object(object_get_array_prototype());
-    vm->stats.stack[vm->stats.stack_counter++] = JS_VALUE_OBJECT(obj);
+    if (!module->initialized)
+    {
+        module->initialized = 1;
+        vm_exec_module(vm, module);
+    }
+    vm->stack[vm->stats.stack_counter++] = JS_VALUE_OBJECT(module->exports);
+    if (vm->unwinding)
+    {
+        vm_unwind(vm);
+    }
+}
+
+static void inst_arr_alloc(VM* vm, void* ptr)
+{
+    JSObject* obj = object_create_young_object(object_get_array_prototype());
+    vm->stack[vm->stats.stack_counter++] = JS_VALUE_OBJECT(obj);
 }
 
 static void inst_obj_alloc(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter >= STACK_SIZE)
-    {
-        PANIC("Stack overflow");
-    }
-    JSObject* obj = object_create_object(object_get_object_prototype());
-    vm->stats.stack[vm->stats.stack_counter++] = JS_VALUE_OBJECT(obj);
+    JSObject* obj = object_create_young_object(object_get_object_prototype());
+    vm->stack[vm->stats.stack_counter++] = JS_VALUE_OBJECT(obj);
 }
 
 static void inst_obj_store(VM* vm, void* ptr)
 {
-    InstUInt16* inst = ptr;
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue value = vm->stats.stack[--vm->stats.stack_counter];
-    JSValue obj = vm->stats.stack[--vm->stats.stack_counter];
+    InstUInt32* inst = ptr;
+    JSValue value = vm->stack[--vm->stats.stack_counter];
+    JSValue obj = vm->stack[--vm->stats.stack_counter];
     if (obj.type != JS_OBJECT && obj.type != JS_FUNC)
     {
-        PANIC("Target is not a object");
+        vm_throw_error(vm, object_get_type_error_prototype(), "Target is not an object");
+        return;
     }
     char* key = string_table_load_str(&vm->module->string_table, inst->operand);
     JSObject* obj_ptr = obj.type == JS_FUNC
         ? ((JSFunction*)obj.value.as_pointer)->base
         : (JSObject*)obj.value.as_pointer;
     object_set_property(vm, obj_ptr, key, value);
+    if (vm->unwinding)
+    {
+        vm_unwind(vm);
+    }
 }
 
 static void inst_obj_load(VM* vm, void* ptr)
 {
-    InstUInt16* inst = ptr;
-    if (vm->stats.stack_counter < 1)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue obj = vm->stats.stack[vm->stats.stack_counter - 1];
+    InstUInt32* inst = ptr;
+    JSValue obj = vm->stack[vm->stats.stack_counter - 1];
     if (obj.type != JS_OBJECT && obj.type != JS_FUNC)
     {
-        PANIC("Target is not a object");
+        vm_throw_error(vm, object_get_type_error_prototype(), "Target is not an object");
+        return;
     }
     char* key = string_table_load_str(&vm->module->string_table, inst->operand);
     JSObject* obj_ptr = obj.type == JS_FUNC
         ? ((JSFunction*)obj.value.as_pointer)->base
         : (JSObject*)obj.value.as_pointer;
-    vm->stats.stack[vm->stats.stack_counter - 1] = object_get_property(vm, obj_ptr, key);
+    vm->stack[vm->stats.stack_counter - 1] = object_get_property(vm, obj_ptr, key);
+    if (vm->unwinding)
+    {
+        vm_unwind(vm);
+    }
 }
 
 static void inst_obj_cload(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 2)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue computed = vm->stats.stack[--vm->stats.stack_counter];
-    JSValue obj = vm->stats.stack[vm->stats.stack_counter - 1];
+    JSValue computed = vm->stack[--vm->stats.stack_counter];
+    JSValue obj = vm->stack[vm->stats.stack_counter - 1];
     if (obj.type != JS_OBJECT && obj.type != JS_FUNC)
     {
-        PANIC("Target is not a object");
+        vm_throw_error(vm, object_get_type_error_prototype(), "Target is not an object");
+        return;
     }
     JSObject* obj_ptr = obj.type == JS_FUNC
         ? ((JSFunction*)obj.value.as_pointer)->base
@@ -1296,26 +1251,28 @@ static void inst_obj_cload(VM* vm, void* ptr)
     
     if (computed.type == JS_SYMBOL)
     {
-        vm->stats.stack[vm->stats.stack_counter - 1] = object_get_property_by_symbol(vm, obj_ptr, computed.value.as_pointer);
-        return;
+        vm->stack[vm->stats.stack_counter - 1] = object_get_property_by_symbol(vm, obj_ptr, computed.value.as_pointer);
+    }
+    else
+    {
+        char* key = value_to_string(&computed);
+        vm->stack[vm->stats.stack_counter - 1] = object_get_property(vm, obj_ptr, key);
+    }
+    if (vm->unwinding)
+    {
+        vm_unwind(vm);
     }
-
-    char* key = value_to_string(&computed);
-    vm->stats.stack[vm->stats.stack_counter - 1] = object_get_property(vm, obj_ptr, key);
 }
 
 static void inst_obj_cstore(VM* vm, void* ptr)
 {
-    if (vm->stats.stack_counter < 3)
-    {
-        PANIC("Stack underflow");
-    }
-    JSValue computed = vm->stats.stack[--vm->stats.stack_counter];
-    JSValue obj = vm->stats.stack[--vm->stats.stack_counter];
-    JSValue value = vm->stats.stack[--vm->stats.stack_counter];
+    JSValue computed = vm->stack[--vm->stats.stack_counter];
+    JSValue obj = vm->stack[--vm->stats.stack_counter];
+    JSValue value = vm->stack[--vm->stats.stack_counter];
     if (obj.type != JS_OBJECT && obj.type != JS_FUNC)
     {
-        PANIC("Target is not a object");
+        vm_throw_error(vm, object_get_type_error_prototype(), "Target is not an object");
+        return;
     }
     JSObject* obj_ptr = obj.type == JS_FUNC
         ? ((JSFunction*)obj.value.as_pointer)->base
@@ -1323,15 +1280,21 @@ static void inst_obj_cstore(VM* vm, void* ptr)
     if (computed.type == JS_SYMBOL)
     {
         object_set_property_with_symbol(vm, obj_ptr, computed.value.as_pointer, value);
-        return;
     }
-    char* key = value_to_string(&computed);
-    object_set_property(vm, obj_ptr, key, value);
+    else
+    {
+        char* key = value_to_string(&computed);
+        object_set_property(vm, obj_ptr, key, value);
+    }
+    if (vm->unwinding)
+    {
+        vm_unwind(vm);
+    }
 }
 
 static void inst_push_scope(VM* vm, void* ptr)
 {
-    vm->scope = scope_create_scope(vm->scope);
+    vm->scope = scope_create_young_scope(vm->scope);
 }
 
 static void inst_pop_scope(VM* vm, void* ptr)
@@ -1346,14 +1309,14 @@ static void inst_pop_scope(VM* vm, void* ptr)
 
 static void inst_jmp(VM* vm, void* ptr)
 {
-    InstUInt16* inst = ptr;
+    InstUInt32* inst = ptr;
     vm->stats.instruction_counter = inst->operand;
 }
 
 static void inst_jmp_f(VM* vm, void* ptr)
 {
-    InstUInt16* inst = ptr;
-    JSValue test = vm->stats.stack[--vm->stats.stack_counter];
+    InstUInt32* inst = ptr;
+    JSValue test = vm->stack[--vm->stats.stack_counter];
     if (value_is_falsy(&test))
     {
         vm->stats.instruction_counter = inst->operand;
@@ -1362,8 +1325,8 @@ static void inst_jmp_f(VM* vm, void* ptr)
 
 static void inst_jmp_t(VM* vm, void* ptr)
 {
-    InstUInt16* inst = ptr;
-    JSValue test = vm->stats.stack[--vm->stats.stack_counter];
+    InstUInt32* inst = ptr;
+    JSValue test = vm->stack[--vm->stats.stack_counter];
     if (value_is_truthy(&test))
     {
         vm->stats.instruction_counter = inst->operand;
@@ -1372,103 +1335,325 @@ static void inst_jmp_t(VM* vm, void* ptr)
 
 static void inst_export(VM* vm, void* ptr)
 {
-    InstUInt16* inst = ptr;
-    if (vm->stats.stack_counter < 1)
+    InstUInt32* inst = ptr;
+    JSValue value = vm->stack[--vm->stats.stack_counter];
+    char* key = string_table_load_str(&vm->module->string_table, inst->operand);
+    object_set_property(vm, vm->module->exports, key, value);
+}
+
+static void inst_enter(VM* vm, void* ptr)
+{
+    InstUInt32* inst = ptr;
+    for (uint32_t i = 0; i < inst->operand; i++)
     {
-        PANIC("Stack underflow");
+        vm->stack[vm->stats.stack_counter++] = JS_VALUE_UNDEFINED;
     }
+}
 
-    JSValue value = vm->stats.stack[--vm->stats.stack_counter];
-    char* key = string_table_load_str(&vm->module->string_table, inst->operand);
-    object_set_property(vm, vm->module->exports, key, value);
+static void inst_load_slot(VM* vm, void* ptr)
+{
+    InstUInt32* inst = ptr;
+    vm->stack[vm->stats.stack_counter] = vm->stack[vm->stats.stack_start + inst->operand];
+    vm->stats.stack_counter++;
+}
+
+static void inst_store_slot(VM* vm, void* ptr)
+{
+    InstUInt32* inst = ptr;
+    vm->stack[vm->stats.stack_start + inst->operand] = vm->stack[--vm->stats.stack_counter];
+}
+
+static void inst_load_upval(VM* vm, void* ptr)
+{
+    InstUInt32* inst = ptr;
+    if (!vm->function || inst->operand >= vm->function->upvalue_count)
+    {
+        PANIC("Upvalue index is out of bounds");
+    }
+    vm->stack[vm->stats.stack_counter++] = *vm->function->upvalues[inst->operand]->location;
+}
+
+static void inst_store_upval(VM* vm, void* ptr)
+{
+    InstUInt32* inst = ptr;
+    if (!vm->function || inst->operand >= vm->function->upvalue_count)
+    {
+        PANIC("Upvalue index is out of bounds");
+    }
+    // The location is in the upvalue once it is closed and in the saved frame of its suspended generator
+    JSUpvalue* upvalue = vm->function->upvalues[inst->operand];
+    JSValue value = vm->stack[--vm->stats.stack_counter];
+    *upvalue->location = value;
+    if (upvalue->owner)
+    {
+        nursery_barrier_value(upvalue->owner, HEAP_ALLOC_VALUES, value);
+    }
+    else if (upvalue->location == &upvalue->closed)
+    {
+        nursery_barrier_value(upvalue, HEAP_ALLOC_UPVALUE, value);
+    }
 }
 
-VM vm_init(JSModule* module)
-{
-    VM vm;
-    vm.module = module;
-    vm.stats.instruction_counter = 0;
-    vm.stats.stack_counter = 0;
-    vm.stats.stack_start = 0;
-    vm.globalScope = scope_create_scope(NULL);
-
-    vm.inst_set[OP_NOP] = inst_nop;
-    vm.inst_set[OP_LD_INT] = inst_ld_int;
-    vm.inst_set[OP_LD_DOUBLE] = inst_ld_double;
-    vm.inst_set[OP_LD_STRING] = inst_ld_string;
-    vm.inst_set[OP_LD_UNDF] = inst_ld_undf;
-    vm.inst_set[OP_LD_NULL] = inst_ld_null;
-    vm.inst_set[OP_LD_TRUE] = inst_ld_boolean;
-    vm.inst_set[OP_LD_FALSE] = inst_ld_boolean;
-    vm.inst_set[OP_LD_THIS] = inst_ld_this;
-    vm.inst_set[OP_ADD] = inst_add;
-    vm.inst_set[OP_MINUS] = inst_minus;
-    vm.inst_set[OP_MUL] = inst_mul;
-    vm.inst_set[OP_DIV] = inst_div;
-    vm.inst_set[OP_MOD] = inst_mod;
-    vm.inst_set[OP_BINARY_AND] = inst_binary_and;
-    vm.inst_set[OP_BINARY_OR] = inst_binary_or;
-    vm.inst_set[OP_BINARY_XOR] = inst_binary_xor;
-    vm.inst_set[OP_BINARY_LSHFT] = inst_binary_lshft;
-    vm.inst_set[OP_BINARY_RSHFT] = inst_binary_rshft;
-    vm.inst_set[OP_BINARY_ZRSHFT] = inst_binary_zrshft;
-    vm.inst_set[OP_BINARY_NOT] = inst_binary_not;
-    vm.inst_set[OP_NOT] = inst_not;
-    vm.inst_set[OP_NEGATE] = inst_negate;
-    vm.inst_set[OP_TYPEOF] = inst_typeof;
-    vm.inst_set[OP_TEQ] = inst_teq;
-    vm.inst_set[OP_NTEQ] = inst_nteq;
-    vm.inst_set[OP_GT] = inst_gt;
-    vm.inst_set[OP_GEQ] = inst_geq;
-    vm.inst_set[OP_LT] = inst_lt;
-    vm.inst_set[OP_LEQ] = inst_leq;
-    vm.inst_set[OP_POP] = inst_pop;
-    vm.inst_set[OP_DUP] = inst_dup;
-    vm.inst_set[OP_SWAP] = inst_swap;
-    vm.inst_set[OP_ALLOC_LOCAL] = inst_alloc_store_local;
-    vm.inst_set[OP_STORE_LOCAL] = inst_alloc_store_local;
-    vm.inst_set[OP_LOAD_LOCAL] = inst_load_local;
-    vm.inst_set[OP_LOAD_ARG] = inst_load_arg;
-    vm.inst_set[OP_FUNC_DECL] = inst_func_decl;
-    vm.inst_set[OP_FUNC_DECL_E] = inst_func_decl;
-    vm.inst_set[OP_CALL] = inst_call;
-    vm.inst_set[OP_ARR_ALLOC] = inst_arr_alloc;
-    vm.inst_set[OP_OBJ_ALLOC] = inst_obj_alloc;
-    vm.inst_set[OP_OBJ_STORE] = inst_obj_store;
-    vm.inst_set[OP_OBJ_LOAD] = inst_obj_load;
-    vm.inst_set[OP_OBJ_CSTORE] = inst_obj_cstore;
-    vm.inst_set[OP_OBJ_CLOAD] = inst_obj_cload;
-    vm.inst_set[OP_RETURN] = inst_nop;
-    vm.inst_set[OP_PUSH_SCOPE] = inst_push_scope;
-    vm.inst_set[OP_POP_SCOPE] = inst_pop_scope;
-    vm.inst_set[OP_JMP] = inst_jmp;
-    vm.inst_set[OP_JMP_F] = inst_jmp_f;
-    vm.inst_set[OP_JMP_T] = inst_jmp_t;
-    vm.inst_set[OP_EXPORT] = inst_export;
-
-    bind_modules(&vm, vm.globalScope);
+static void inst_capture(VM* vm, void* ptr)
+{
+    InstCapture* inst = ptr;
+    JSValue value = vm->stack[vm->stats.stack_counter - 1];
+    if (value.type != JS_FUNC)
+    {
+        PANIC("Capture target is not a function");
+    }
+
+    JSFunction* function = value.value.as_pointer;
+    function->upvalues = vm_alloc_object(inst->count * sizeof(JSUpvalue*));
+    function->upvalue_count = inst->count;
+    for (uint32_t i = 0; i < inst->count; i++)
+    {
+        uint16_t index = inst->entries[i] & CAPTURE_INDEX_MASK;
+        if (!(inst->entries[i] & CAPTURE_FROM_UPVALUE))
+        {
+            function->upvalues[i] = upvalue_capture(vm, &vm->stack[vm->stats.stack_start + index]);
+            continue;
+        }
+        if (!vm->function || index >= vm->function->upvalue_count)
+        {
+            PANIC("Upvalue index is out of bounds");
+        }
+        function->upvalues[i] = vm->function->upvalues[index];
+    }
+}
+
+static void inst_close_upvals(VM* vm, void* ptr)
+{
+    InstUInt32* inst = ptr;
+    upvalue_close(vm, &vm->stack[vm->stats.stack_start + inst->operand]);
+}
+
+static void inst_ld_callee(VM* vm, void* ptr)
+{
+    vm->stack[vm->stats.stack_counter++] = vm->function
+        ? JS_VALUE_FUNCTION(vm->function)
+        : JS_VALUE_UNDEFINED;
+}
+
+static void inst_tail_call(VM* vm, void* ptr)
+{
+    InstUInt32* inst = ptr;
+    JSValue value = vm->stack[vm->stats.stack_counter - 1];
+    if (value.type != JS_FUNC)
+    {
+        vm_throw_error(vm, object_get_type_error_prototype(), "Callee is not a function");
+        return;
+    }
+
+    JSFunction* function = value.value.as_pointer;
+    if (function->is_native || !vm->function)
+    {
+        // Nothing to reuse, call as usual and leave the current function with the result
+        inst_call(vm, ptr);
+        if (vm->function)
+        {
+            vm->stats.instruction_counter = vm->function->meta.instruction_end;
+        }
+        return;
+    }
+    vm->stats.stack_counter--;
+    vm_prepare_function(function);
+
+    // Replace the arguments, this and slots of the current frame with the ones of the callee
+    upvalue_close(vm, &vm->stack[vm->stats.stack_start]);
+    size_t base = vm->stats.stack_start - vm->stats.argc - 1;
+    size_t source = vm->stats.stack_counter - inst->operand - 1;
+    memmove(&vm->stack[base], &vm->stack[source], (inst->operand + 1) * sizeof(JSValue));
+
+    vm->stats.stack_start = base + inst->operand + 1;
+    vm->stats.stack_counter = vm->stats.stack_start;
+    vm_reserve_frame(vm->stats.stack_start, function->module->data_section.depths[function->meta.instruction_start]);
+    vm->stats.argc = inst->operand;
+    vm->stats.instruction_counter = function->meta.instruction_start;
+    vm->function = function;
+    vm->module = function->module;
+    vm->scope = function->scope;
+}
+
+static void inst_throw(VM* vm, void* ptr)
+{
+    api_throw(vm, vm->stack[--vm->stats.stack_counter]);
+    vm_unwind(vm);
+}
+
+static void inst_yield(VM* vm, void* ptr)
+{
+    if (!vm->generator)
+    {
+        PANIC("Yield outside of a generator");
+    }
+    JSValue value = vm->stack[--vm->stats.stack_counter];
+    generator_suspend(vm, vm->generator, vm->stats.instruction_counter);
+    vm->generator->state = GENERATOR_SUSPENDED_YIELD;
+
+    vm->stack[vm->stats.stack_counter++] = value;
+    vm->stats.instruction_counter = vm->function->meta.instruction_end;
+}
+
+static void inst_generator(VM* vm, void* ptr)
+{
+    if (!vm->function)
+    {
+        PANIC("Generator outside of a function");
+    }
+    // The arguments are stored by now, the body runs once next is called
+    JSGenerator* generator = generator_create(vm->function);
+    generator_suspend(vm, generator, vm->stats.instruction_counter);
+
+    JSObject* object = object_create_object(object_get_generator_prototype());
+    object_set_internal(object, generator);
+    vm->stack[vm->stats.stack_counter++] = JS_VALUE_OBJECT(object);
+    vm->stats.instruction_counter = vm->function->meta.instruction_end;
+}
+
+static VM* vm_create(JSModule* module, Scope* global_scope)
+{
+    // Outside of the conservatively scanned C stack, the heap traces the used part of the value stack
+    VM* vm = malloc(sizeof(VM));
+    if (!vm)
+    {
+        PANIC("Could not allocate memory");
+    }
+    vm->module = module;
+    vm->function = NULL;
+    vm->open_upvalues = NULL;
+    vm->generator = NULL;
+    vm->exception = JS_VALUE_UNDEFINED;
+    vm->unwinding = 0;
+    vm->stats.instruction_counter = 0;
+    vm->stats.stack_counter = 0;
+    vm->stats.stack_start = 0;
+    vm->stats.argc = 0;
+    vm->globalScope = global_scope;
+    heap_add_vm(vm);
+
+    vm->inst_set[OP_NOP] = inst_nop;
+    vm->inst_set[OP_LD_INT] = inst_ld_int;
+    vm->inst_set[OP_LD_DOUBLE] = inst_ld_double;
+    vm->inst_set[OP_LD_STRING] = inst_ld_string;
+    vm->inst_set[OP_LD_UNDF] = inst_ld_undf;
+    vm->inst_set[OP_LD_NULL] = inst_ld_null;
+    vm->inst_set[OP_LD_TRUE] = inst_ld_boolean;
+    vm->inst_set[OP_LD_FALSE] = inst_ld_boolean;
+    vm->inst_set[OP_LD_THIS] = inst_ld_this;
+    vm->inst_set[OP_ADD] = inst_add;
+    vm->inst_set[OP_MINUS] = inst_minus;
+    vm->inst_set[OP_MUL] = inst_mul;
+    vm->inst_set[OP_DIV] = inst_div;
+    vm->inst_set[OP_MOD] = inst_mod;
+    vm->inst_set[OP_BINARY_AND] = inst_binary_and;
+    vm->inst_set[OP_BINARY_OR] = inst_binary_or;
+    vm->inst_set[OP_BINARY_XOR] = inst_binary_xor;
+    vm->inst_set[OP_BINARY_LSHFT] = inst_binary_lshft;
+    vm->inst_set[OP_BINARY_RSHFT] = inst_binary_rshft;
+    vm->inst_set[OP_BINARY_ZRSHFT] = inst_binary_zrshft;
+    vm->inst_set[OP_BINARY_NOT] = inst_binary_not;
+    vm->inst_set[OP_NOT] = inst_not;
+    vm->inst_set[OP_NEGATE] = inst_negate;
+    vm->inst_set[OP_TYPEOF] = inst_typeof;
+    vm->inst_set[OP_TEQ] = inst_teq;
+    vm->inst_set[OP_NTEQ] = inst_nteq;
+    vm->inst_set[OP_GT] = inst_gt;
+    vm->inst_set[OP_GEQ] = inst_geq;
+    vm->inst_set[OP_LT] = inst_lt;
+    vm->inst_set[OP_LEQ] = inst_leq;
+    vm->inst_set[OP_POP] = inst_pop;
+    vm->inst_set[OP_DUP] = inst_dup;
+    vm->inst_set[OP_SWAP] = inst_swap;
+    vm->inst_set[OP_ALLOC_LOCAL] = inst_alloc_store_local;
+    vm->inst_set[OP_STORE_LOCAL] = inst_alloc_store_local;
+    vm->inst_set[OP_LOAD_LOCAL] = inst_load_local;
+    vm->inst_set[OP_LOAD_ARG] = inst_load_arg;
+    vm->inst_set[OP_FUNC_DECL] = inst_func_decl;
+    vm->inst_set[OP_FUNC_DECL_E] = inst_func_decl;
+    vm->inst_set[OP_CALL] = inst_call;
+    vm->inst_set[OP_ARR_ALLOC] = inst_arr_alloc;
+    vm->inst_set[OP_OBJ_ALLOC] = inst_obj_alloc;
+    vm->inst_set[OP_OBJ_STORE] = inst_obj_store;
+    vm->inst_set[OP_OBJ_LOAD] = inst_obj_load;
+    vm->inst_set[OP_OBJ_CSTORE] = inst_obj_cstore;
+    vm->inst_set[OP_OBJ_CLOAD] = inst_obj_cload;
+    vm->inst_set[OP_RETURN] = inst_nop;
+    vm->inst_set[OP_PUSH_SCOPE] = inst_push_scope;
+    vm->inst_set[OP_POP_SCOPE] = inst_pop_scope;
+    vm->inst_set[OP_JMP] = inst_jmp;
+    vm->inst_set[OP_JMP_F] = inst_jmp_f;
+    vm->inst_set[OP_JMP_T] = inst_jmp_t;
+    vm->inst_set[OP_EXPORT] = inst_export;
+    vm->inst_set[OP_ENTER] = inst_enter;
+    vm->inst_set[OP_LOAD_SLOT] = inst_load_slot;
+    vm->inst_set[OP_STORE_SLOT] = inst_store_slot;
+    vm->inst_set[OP_LOAD_UPVAL] = inst_load_upval;
+    vm->inst_set[OP_STORE_UPVAL] = inst_store_upval;
+    vm->inst_set[OP_CAPTURE] = inst_capture;
+    vm->inst_set[OP_CLOSE_UPVALS] = inst_close_upvals;
+    vm->inst_set[OP_LD_CALLEE] = inst_ld_callee;
+    vm->inst_set[OP_TAIL_CALL] = inst_tail_call;
+    vm->inst_set[OP_THROW] = inst_throw;
+    vm->inst_set[OP_YIELD] = inst_yield;
+    vm->inst_set[OP_GENERATOR] = inst_generator;
+    vm->inst_set[OP_IMPORT] = inst_import;
 
     return vm;
 }
 
-static void vm_exec(VM* vm)
+VM* vm_init(JSModule* module)
+{
+    VM* vm = vm_create(module, scope_create_scope(NULL));
+    bind_modules(vm, vm->globalScope);
+    return vm;
+}
+
+VM* vm_init_from_snapshot(JSModule* module, Scope* global_scope)
 {
-    if (vm->stats.instruction_counter >= vm->module->data_section.count)
+    return vm_create(module, global_scope);
+}
+
+void vm_free(VM* vm)
+{
+    heap_remove_vm(vm);
+    free(vm);
+}
+
+#ifndef NDEBUG
+// Catches handlers or verifier rules that disagree on the stack effect of an instruction
+static void vm_check_frame(VM* vm, Opcode opcode)
+{
+    uint16_t depth = vm->function
+        ? vm->module->data_section.depths[vm->function->meta.instruction_start]
+        : vm->module->data_section.depth;
+    if (vm->stats.stack_counter < vm->stats.stack_start || vm->stats.stack_counter > vm->stats.stack_start + depth)
     {
-        PANIC("Instruction counter is out of bounds of the current module");
+        printf("Instruction %u left the stack at %zu, the frame spans %zu to %zu\n", opcode,
+               vm->stats.stack_counter, vm->stats.stack_start, vm->stats.stack_start + depth);
+        PANIC("Stack left the verified frame");
     }
+}
+#endif
 
+// Only verified code is executed: the counter stays inside of decoded bodies and every handler finds its operands
+static void vm_exec(VM* vm)
+{
     void* instruction = vm->module->data_section.instructions[vm->stats.instruction_counter++];
-    if (instruction == NULL || OPCODE_OF(instruction) == OP_NOP)
+    if (OPCODE_OF(instruction) == OP_NOP)
     {
         return;
     }
     vm->inst_set[OPCODE_OF(instruction)](vm, instruction);
+#ifndef NDEBUG
+    vm_check_frame(vm, OPCODE_OF(instruction));
+#endif
 }
 
 void vm_exec_module(VM* vm, JSModule* module)
 {
     JSModule* current_module = vm->module;
+    JSFunction* current_function = vm->function;
     VMStats stats = vm->stats;
     Scope* scope = vm->scope;
 
@@ -1476,9 +1661,12 @@ void vm_exec_module(VM* vm, JSModule* module)
 
     vm->scope = module->scope;
     vm->module = module;
+    vm->function = NULL;
     vm->stats.instruction_counter = 0;
-    vm->stats.stack_counter = 0;
-    vm->stats.stack_start = 0;
+    // Modules may be imported from within a function, so the caller's values must stay untouched
+    vm->stats.stack_start = vm->stats.stack_counter;
+    vm->stats.argc = 0;
+    vm_reserve_frame(vm->stats.stack_start, module->data_section.depth);
 
     while (vm->stats.instruction_counter < vm->module->data_section.count)
     {
@@ -1486,22 +1674,30 @@ void vm_exec_module(VM* vm, JSModule* module)
     }
 
     vm->module = current_module;
+    vm->function = current_function;
     vm->stats = stats;
     vm->scope = scope;
 }
 
-JSValue vm_exec_function(VM* vm, JSFunction* function)
+JSValue vm_exec_function(VM* vm, JSFunction* function, size_t argc)
 {
+    // Only the frame registers are saved, the value stack itself is shared by all frames
     JSModule* current_module = vm->module;
+    JSFunction* current_function = vm->function;
     VMStats stats = vm->stats;
     Scope* scope = vm->scope;
 
+    vm_prepare_function(function);
     vm->module = function->module;
+    vm->function = function;
     vm->stats.instruction_counter = function->meta.instruction_start;
     vm->stats.stack_start = vm->stats.stack_counter;
+    vm->stats.argc = argc;
     vm->scope = function->scope;
+    vm_reserve_frame(vm->stats.stack_start, function->module->data_section.depths[function->meta.instruction_start]);
 
-    while (vm->stats.instruction_counter < function->meta.instruction_end)
+    // Tail calls replace the executing function, so the bounds are read from the frame
+    while (vm->stats.instruction_counter < vm->function->meta.instruction_end)
     {
         Opcode opcode = OPCODE_OF(vm->module->data_section.instructions[vm->stats.instruction_counter]);
         if (opcode == OP_RETURN)
@@ -1511,12 +1707,70 @@ JSValue vm_exec_function(VM* vm, JSFunction* function)
         vm_exec(vm);
     }
     JSValue return_value = vm->stats.stack_counter > vm->stats.stack_start
-        ? vm->stats.stack[--vm->stats.stack_counter]
+        ? vm->stack[--vm->stats.stack_counter]
         : JS_VALUE_UNDEFINED;
+    upvalue_close(vm, &vm->stack[vm->stats.stack_start]);
 
     vm->module = current_module;
+    vm->function = current_function;
     vm->stats = stats;
     vm->scope = scope;
 
     return return_value;
 }
+
+JSValue vm_exec_generator(VM* vm, JSGenerator* generator, JSValue sent)
+{
+    // The saved frame is pushed on top of the caller, so only the registers it overwrites are kept
+    JSModule* current_module = vm->module;
+    JSFunction* current_function = vm->function;
+    JSGenerator* current_generator = vm->generator;
+    Scope* scope = vm->scope;
+    size_t instruction_counter = vm->stats.instruction_counter;
+    size_t stack_start = vm->stats.stack_start;
+    size_t argc = vm->stats.argc;
+    size_t stack_counter = vm->stats.stack_counter;
+
+    int started = generator->state == GENERATOR_SUSPENDED_YIELD;
+    generator_enter(vm, generator);
+    generator->state = GENERATOR_RUNNING;
+    vm->generator = generator;
+    if (started)
+    {
+        // Result of the yield expression the generator was suspended at
+        vm->stack[vm->stats.stack_counter++] = sent;
+    }
+
+    while (vm->stats.instruction_counter < vm->function->meta.instruction_end)
+    {
+        Opcode opcode = OPCODE_OF(vm->module->data_section.instructions[vm->stats.instruction_counter]);
+        if (opcode == OP_RETURN)
+        {
+            break;
+        }
+        vm_exec(vm);
+    }
+    JSValue value = vm->stats.stack_counter > vm->stats.stack_start
+        ? vm->stack[--vm->stats.stack_counter]
+        : JS_VALUE_UNDEFINED;
+    if (generator->state == GENERATOR_RUNNING)
+    {
+        // Returned or threw, the frame is gone for good
+        upvalue_close(vm, &vm->stack[vm->stats.stack_start]);
+        generator->state = GENERATOR_DONE;
+        generator->values = NULL;
+        generator->count = 0;
+        generator->capacity = 0;
+    }
+
+    vm->module = current_module;
+    vm->function = current_function;
+    vm->generator = current_generator;
+    vm->scope = scope;
+    vm->stats.instruction_counter = instruction_counter;
+    vm->stats.stack_start = stack_start;
+    vm->stats.argc = argc;
+    vm->stats.stack_counter = stack_counter;
+
+    return value;
+}
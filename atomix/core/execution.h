@@ -5,11 +5,29 @@
 #include "format.h"
 #include "vm.h"
 #include "function.h"
+#include "generator.h"
+#include "scope.h"
 
-VM vm_init(JSModule* module);
+/**
+ * The VM is allocated outside of the collected heap, release it with vm_free
+ */
+VM* vm_init(JSModule* module);
+
+/**
+ * Creates a VM around the global scope of a restored snapshot instead of running the module loaders
+ */
+VM* vm_init_from_snapshot(JSModule* module, Scope* global_scope);
+
+void vm_free(VM* vm);
 
 void vm_exec_module(VM* vm, JSModule* module);
 
-JSValue vm_exec_function(VM* vm, JSFunction* function);
+JSValue vm_exec_function(VM* vm, JSFunction* function, size_t argc);
+
+/**
+ * Resumes a suspended generator until it yields or returns. Returns the yielded or returned value,
+ * the generator is done afterwards if it returned.
+ */
+JSValue vm_exec_generator(VM* vm, JSGenerator* generator, JSValue sent);
 
 #endif //EXECUTION_H
@@ -3,10 +3,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <gc.h>
 
+#include "heap.h"
 #include "panic.h"
-#include "api.impl.h"
+#include "loader.h"
 
 char* string_table_load_str(StringTable* table, uint32_t idx)
 {
@@ -15,50 +15,118 @@ char* string_table_load_str(StringTable* table, uint32_t idx)
         PANIC("StringTable idx is out of bounds");
     }
 
-    uint32_t offset = table->offsets[idx];
-    uint32_t length = idx == table->count - 1
-        ? table->length - (offset + 2 * sizeof(uint32_t) + table->count * sizeof(uint32_t))
-        : table->offsets[idx + 1] - offset;
-    char* copy = GC_malloc_atomic(length + 1);
-    memcpy(copy, table->strings + offset, length);
-    copy[length] = '\0';
-    return copy;
+    // Strings are zero terminated in the image, so they are handed out without copying
+    uint32_t offset;
+    memcpy(&offset, table->offsets + idx * sizeof(uint32_t), sizeof(uint32_t));
+    return table->strings + offset;
 }
 
-JSModule* bundle_get_module(JSBundle* bundle, uint64_t hash)
+ModuleTable module_table = { NULL, 0, 0 };
+
+// Fibonacci hashing, the low bits of the module hashes alone are not spread well enough
+static uint32_t module_table_slot(uint64_t hash, uint32_t capacity)
+{
+    return (uint32_t)((hash * 0x9E3779B97F4A7C15ull) >> 32) & (capacity - 1);
+}
+
+static ModuleTableEntry* module_table_find(uint64_t hash)
 {
-    if (bundle) {
-        uint16_t low = 0;
-        uint16_t high = bundle->moduleCount;
-        while(low <= high)
+    if (!module_table.capacity)
+    {
+        return NULL;
+    }
+
+    uint32_t slot = module_table_slot(hash, module_table.capacity);
+    while (module_table.entries[slot].bundle || module_table.entries[slot].module)
+    {
+        if (module_table.entries[slot].hash == hash)
         {
-            uint16_t mid = low + (high - low) / 2;
+            return &module_table.entries[slot];
+        }
+        slot = (slot + 1) & (module_table.capacity - 1);
+    }
+    return NULL;
+}
 
-            JSModule* module = &bundle->modules[mid];
-            if (module->header.hash == hash)
-            {
-                return module;
-            }
+static void module_table_grow(void)
+{
+    uint32_t capacity = module_table.capacity ? module_table.capacity * 2 : 16;
+    ModuleTableEntry* entries = vm_alloc_object(capacity * sizeof(ModuleTableEntry));
 
-            if (module->header.hash < hash) 
-            {
-                low = mid + 1;
-            } else
-            {
-                high = mid - 1;
-            }
+    for (uint32_t i = 0; i < module_table.capacity; i++)
+    {
+        ModuleTableEntry* entry = &module_table.entries[i];
+        if (!entry->bundle && !entry->module)
+        {
+            continue;
+        }
+        uint32_t slot = module_table_slot(entry->hash, capacity);
+        while (entries[slot].bundle || entries[slot].module)
+        {
+            slot = (slot + 1) & (capacity - 1);
         }
+        entries[slot] = *entry;
     }
-    
-    NativeModuleList* entry = native_modules;
-    while(entry != NULL)
+    module_table.entries = entries;
+    module_table.capacity = capacity;
+}
+
+static void module_table_insert(ModuleTableEntry entry)
+{
+    ModuleTableEntry* existing = module_table_find(entry.hash);
+    if (existing)
     {
-        if (entry->module->header.hash == hash)
+        // Bundled code wins over a native module of the same name, the first bundle over later ones
+        if (!existing->bundle && entry.bundle)
         {
-            return entry->module;
+            *existing = entry;
         }
-        entry = entry->next;
+        return;
     }
 
-    PANIC("Could not find module in bundle");
-}
\ No newline at end of file
+    if ((module_table.count + 1) * 2 > module_table.capacity)
+    {
+        module_table_grow();
+    }
+    uint32_t slot = module_table_slot(entry.hash, module_table.capacity);
+    while (module_table.entries[slot].bundle || module_table.entries[slot].module)
+    {
+        slot = (slot + 1) & (module_table.capacity - 1);
+    }
+    module_table.entries[slot] = entry;
+    module_table.count++;
+}
+
+void module_table_add_bundle(JSBundle* bundle)
+{
+    for (uint32_t i = 0; i < bundle->moduleCount; i++)
+    {
+        module_table_insert((ModuleTableEntry){ bundle->index[i].hash, bundle, i, NULL });
+    }
+}
+
+void module_table_add_module(JSModule* module)
+{
+    module_table_insert((ModuleTableEntry){ module->header.hash, NULL, 0, module });
+}
+
+const char* module_table_get(uint64_t hash, JSModule** module)
+{
+    ModuleTableEntry* entry = module_table_find(hash);
+    if (!entry)
+    {
+        return "Could not find module";
+    }
+    if (!entry->module)
+    {
+        // A rejected module stays in the table undecoded, so importing it again reports the same
+        const char* rejection = bundle_decode_module(entry->bundle, entry->index, &entry->module);
+        if (rejection)
+        {
+            entry->module = NULL;
+            return rejection;
+        }
+    }
+    *module = entry->module;
+    return NULL;
+}
@@ -4,12 +4,32 @@
 #include <stdint.h>
 
 typedef struct JSBundle JSBundle;
+typedef struct BundleIndexEntry BundleIndexEntry;
 typedef struct StringTable StringTable;
+typedef struct ConstantPool ConstantPool;
 typedef struct DataSection DataSection;
+typedef struct HandlerEntry HandlerEntry;
+typedef struct HandlerTable HandlerTable;
 typedef struct JSModule JSModule;
+typedef struct ModuleTableEntry ModuleTableEntry;
+typedef struct ModuleTable ModuleTable;
 
 char* string_table_load_str(StringTable* table, uint32_t idx);
 
-JSModule* bundle_get_module(JSBundle* bundle, uint64_t hash);
+/**
+ * Makes every module of the bundle importable by its hash, they are still decoded on first lookup
+ */
+void module_table_add_bundle(JSBundle* bundle);
+
+/**
+ * Registers an already loaded module, modules of a bundle take precedence over it
+ */
+void module_table_add_module(JSModule* module);
+
+/**
+ * Looks a module of a loaded bundle or a native module up by its hash and decodes it if necessary. Returns why
+ * the module cannot be imported, NULL once module is set.
+ */
+const char* module_table_get(uint64_t hash, JSModule** module);
 
 #endif //FORMAT_H
\ No newline at end of file
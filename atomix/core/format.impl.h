@@ -6,48 +6,135 @@
 #include "object.h"
 #include "scope.h"
 
+#include "arena.impl.h"
+
 #define MODULE_MAGIC0 0x2E
 #define MODULE_MAGIC1 0x41
 #define MODULE_MAGIC2 0x78
 #define MODULE_MAGIC3 0x4D
 
-#define MODULE_VERSION 2
+#define MODULE_VERSION 8
 
 #define BUNDLE_MAGIC0 0x2E
 #define BUNDLE_MAGIC1 0x41
 #define BUNDLE_MAGIC2 0x78
 #define BUNDLE_MAGIC3 0x42
 
-#define BUNDLE_VERSION 1
+#define BUNDLE_VERSION 3
+
+// Wraps a module or a bundle compressed as a single LZ4 block
+#define CONTAINER_MAGIC0 0x2E
+#define CONTAINER_MAGIC1 0x41
+#define CONTAINER_MAGIC2 0x78
+#define CONTAINER_MAGIC3 0x5A
+
+#define CONTAINER_VERSION 1
 
 struct JSModule;
 
+// Offset and length of a module relative to the start of the bundle, the index is sorted by hash
+struct __attribute__((packed)) BundleIndexEntry
+{
+    uint64_t hash;
+    uint32_t offset;
+    uint32_t length;
+};
+
 struct JSBundle {
     char magic[4];
     uint16_t version;
     uint64_t entryPoint;
-    uint16_t moduleCount;
+    uint32_t moduleCount;
+    // Read from the image in place
+    const BundleIndexEntry* index;
+    uint8_t* image;
+    // Every index entry lies within the image
+    size_t size;
+    // Modules are decoded when they are first looked up, until then their bundle is NULL
     struct JSModule* modules;
 };
 
+// A module of a bundle is known by its index until it is decoded, native modules have no bundle
+struct ModuleTableEntry
+{
+    uint64_t hash;
+    JSBundle* bundle;
+    uint32_t index;
+    JSModule* module;
+};
+
+// Open addressing with linear probing, kept at most half full. Slots without bundle and module are free.
+struct ModuleTable
+{
+    ModuleTableEntry* entries;
+    uint32_t capacity;
+    uint32_t count;
+};
+
+extern ModuleTable module_table;
+
+// Sections reference the loaded image in place, it has to outlive the module
 struct StringTable
 {
     uint32_t length;
     uint32_t count;
-    uint32_t* offsets;
+    // Little endian and not necessarily aligned, read through string_table_load_str
+    const uint8_t* offsets;
+    // Zero terminated strings
     char* strings;
 };
 
+// Doubles shared by the LD_DOUBLE instructions of the module, stored once per distinct value
+struct ConstantPool
+{
+    uint32_t length;
+    uint32_t count;
+    // Little endian and not necessarily aligned
+    const uint8_t* constants;
+};
+
 struct DataSection
 {
     uint32_t length;
     uint32_t count;
+    // Start of the section in the image
+    const uint8_t* code;
+    // Instructions point into the image or into the block their body was decoded to, see instruction.impl.h
+    // for their layout. Function bodies stay NULL until the function is called for the first time. The
+    // table, the blocks and depths live in the arena of the module.
     void** instructions;
+    // Stack slots a frame needs at most, found by the verifier when the code is decoded. depths is indexed
+    // by the first instruction of a function body, depth covers the module body.
+    uint16_t* depths;
+    uint16_t depth;
+};
+
+// A protected range [start, end) of the function beginning at owner (0 for the module body). The
+// entries of nested try statements come before the ones of the statements enclosing them.
+struct __attribute__((packed)) HandlerEntry
+{
+    uint32_t owner;
+    uint32_t start;
+    uint32_t end;
+    uint32_t handler;
+    uint16_t depth;
+    uint16_t scopes;
+    uint16_t close;
+};
+
+struct HandlerTable
+{
+    uint32_t length;
+    uint32_t count;
+    HandlerEntry* entries;
 };
 
 struct JSModule
 {
     JSBundle* bundle;
+    // Start of the image the sections point into. The collector only recognizes pointers to the start of a
+    // block, so this is what keeps a read or inflated image alive.
+    const uint8_t* image;
 
     struct
     {
@@ -55,14 +142,20 @@ struct JSModule
         uint16_t version;
         uint64_t hash;
         uint32_t string_table;
+        uint32_t constant_pool;
         uint32_t data_section;
+        uint32_t handler_table;
     } header;
 
     StringTable string_table;
+    ConstantPool constant_pool;
     DataSection data_section;
+    HandlerTable handler_table;
     int initialized;
     JSObject* exports;
     Scope* scope;
+    // Holds the decoded code, which lives as long as the module
+    Arena arena;
 };
 
 #endif //FORMAT_IMPL_H
\ No newline at end of file
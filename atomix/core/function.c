@@ -1,14 +1,14 @@
 #include "function.impl.h"
 
-#include <gc.h>
-
 #include "api.h"
+#include "heap.h"
+#include "nursery.h"
 
 #include "value.impl.h"
 
 JSFunction* function_create_native_function(JSNativeFunction function_ptr)
 {
-    JSFunction* function = GC_malloc(sizeof(JSFunction));
+    JSFunction* function = vm_alloc_object(sizeof(JSFunction));
     function->is_native = 1;
     function->native_function = function_ptr;
     function->base = object_create_object(object_get_object_prototype());
@@ -21,20 +21,22 @@ JSFunction* function_create_native_function(JSNativeFunction function_ptr)
 }
 
 JSFunction* function_create_function(
-    Scope* parentScope,
+    Scope* scope,
     JSModule* module,
     size_t instruction_start,
     size_t instruction_end)
 {
     // TODO add name to constructor
-    JSFunction* function = GC_malloc(sizeof(JSFunction));
+    JSFunction* function = vm_alloc_object(sizeof(JSFunction));
     function->is_native = 0;
     function->meta.instruction_start = instruction_start;
     function->meta.instruction_end = instruction_end;
     function->module = module;
-
-    Scope* scope = scope_create_scope(parentScope);
+    // Locals live in stack slots and captured ones in upvalues, the scope only resolves module-level names
     function->scope = scope;
+    nursery_barrier(function, HEAP_ALLOC_OBJECT, scope);
+    function->upvalues = NULL;
+    function->upvalue_count = 0;
     function->base = object_create_object(object_get_function_prototype());
 
     JSObject* prototype = object_create_object(object_get_object_prototype());
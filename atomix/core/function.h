@@ -19,6 +19,6 @@ typedef struct {
 
 JSFunction* function_create_native_function(JSNativeFunction function_ptr);
 
-JSFunction* function_create_function(Scope* parentScope, JSModule* module, size_t instruction_start, size_t instruction_end);
+JSFunction* function_create_function(Scope* scope, JSModule* module, size_t instruction_start, size_t instruction_end);
 
 #endif //FUNCTION_H
@@ -4,6 +4,7 @@
 #include "function.h"
 
 #include "object.h"
+#include "upvalue.h"
 
 struct JSFunction
 {
@@ -11,6 +12,8 @@ struct JSFunction
     JSNativeFunction native_function;
     Scope* scope;
     JSModule* module;
+    JSUpvalue** upvalues;
+    size_t upvalue_count;
 
     struct
     {
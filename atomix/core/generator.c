@@ -0,0 +1,120 @@
+#include "generator.impl.h"
+
+#include <string.h>
+
+#include "heap.h"
+#include "nursery.h"
+#include "panic.h"
+#include "object.h"
+
+#include "vm.impl.h"
+#include "object.impl.h"
+#include "function.impl.h"
+#include "format.impl.h"
+#include "upvalue.impl.h"
+
+JSGenerator* generator_create(JSFunction* function)
+{
+    JSGenerator* generator = vm_alloc_object(sizeof(JSGenerator));
+    generator->function = function;
+    generator->scope = function->scope;
+    nursery_barrier(generator, HEAP_ALLOC_OBJECT, generator->scope);
+    generator->state = GENERATOR_SUSPENDED_START;
+    generator->resume = function->meta.instruction_start;
+    generator->values = NULL;
+    generator->count = 0;
+    generator->capacity = 0;
+    generator->upvalues = NULL;
+    return generator;
+}
+
+void generator_suspend(VM* vm, JSGenerator* generator, size_t resume)
+{
+    JSValue* frame = &vm->stack[vm->stats.stack_start - 1];
+    size_t count = vm->stats.stack_counter - vm->stats.stack_start + 1;
+    if (count > generator->capacity)
+    {
+        generator->values = vm_alloc_values(count);
+        generator->capacity = count;
+    }
+    memcpy(generator->values, frame, count * sizeof(JSValue));
+    for (size_t i = 0; i < count; i++)
+    {
+        nursery_barrier_value(generator->values, HEAP_ALLOC_VALUES, frame[i]);
+    }
+
+    // The open list is sorted by descending location, so the upvalues of the topmost frame are its head
+    JSUpvalue* last = NULL;
+    generator->upvalues = NULL;
+    while (vm->open_upvalues && vm->open_upvalues->location >= frame)
+    {
+        JSUpvalue* upvalue = vm->open_upvalues;
+        vm->open_upvalues = upvalue->next;
+        upvalue->location = generator->values + (upvalue->location - frame);
+        upvalue->owner = generator->values;
+        upvalue->next = NULL;
+        if (last)
+        {
+            last->next = upvalue;
+        }
+        else
+        {
+            generator->upvalues = upvalue;
+        }
+        last = upvalue;
+    }
+
+    generator->count = count;
+    generator->resume = resume;
+    generator->scope = vm->scope;
+    nursery_barrier(generator, HEAP_ALLOC_OBJECT, generator->scope);
+}
+
+void generator_enter(VM* vm, JSGenerator* generator)
+{
+    // The saved values never exceed the verified depth of the body, which sits above this
+    JSFunction* function = generator->function;
+    if (vm->stats.stack_counter + 1 + function->module->data_section.depths[function->meta.instruction_start] > STACK_SIZE)
+    {
+        PANIC("Stack overflow");
+    }
+    JSValue* frame = &vm->stack[vm->stats.stack_counter];
+    memcpy(frame, generator->values, generator->count * sizeof(JSValue));
+
+    // The frame is the topmost one again, its upvalues go back to the head of the open list
+    JSUpvalue* last = NULL;
+    for (JSUpvalue* upvalue = generator->upvalues; upvalue; upvalue = upvalue->next)
+    {
+        upvalue->location = frame + (upvalue->location - generator->values);
+        upvalue->owner = NULL;
+        last = upvalue;
+    }
+    if (last)
+    {
+        last->next = vm->open_upvalues;
+        vm->open_upvalues = generator->upvalues;
+        generator->upvalues = NULL;
+    }
+
+    vm->stats.stack_start = vm->stats.stack_counter + 1;
+    vm->stats.stack_counter += generator->count;
+    vm->stats.argc = 0;
+    vm->stats.instruction_counter = generator->resume;
+    vm->function = generator->function;
+    vm->module = generator->function->module;
+    vm->scope = generator->scope;
+}
+
+JSGenerator* generator_of(JSValue value)
+{
+    if (value.type != JS_OBJECT)
+    {
+        return NULL;
+    }
+    JSObject* object = value.value.as_pointer;
+    if (object->prototype != object_get_generator_prototype())
+    {
+        return NULL;
+    }
+    return object_get_internal(object);
+}
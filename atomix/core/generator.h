@@ -0,0 +1,28 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "function.h"
+#include "value.h"
+#include "vm.h"
+
+typedef struct JSGenerator JSGenerator;
+
+JSGenerator* generator_create(JSFunction* function);
+
+/**
+ * Copies the live part of the executing frame into the generator and moves its open upvalues along.
+ * Execution continues at resume once the generator is entered again.
+ */
+void generator_suspend(VM* vm, JSGenerator* generator, size_t resume);
+
+/**
+ * Pushes the saved frame on top of the stack and makes it the executing frame
+ */
+void generator_enter(VM* vm, JSGenerator* generator);
+
+/**
+ * Returns the generator of a generator object, NULL for any other value
+ */
+JSGenerator* generator_of(JSValue value);
+
+#endif //GENERATOR_H
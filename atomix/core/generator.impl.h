@@ -0,0 +1,31 @@
+#ifndef GENERATOR_IMPL_H
+#define GENERATOR_IMPL_H
+
+#include "generator.h"
+
+#include "scope.h"
+#include "upvalue.h"
+
+typedef enum
+{
+    GENERATOR_SUSPENDED_START,
+    GENERATOR_SUSPENDED_YIELD,
+    GENERATOR_RUNNING,
+    GENERATOR_DONE
+} JSGeneratorState;
+
+struct JSGenerator
+{
+    JSFunction* function;
+    Scope* scope;
+    JSGeneratorState state;
+    size_t resume;
+    // this followed by the slots and temporaries of the frame, arguments are already stored in slots
+    JSValue* values;
+    size_t count;
+    size_t capacity;
+    // Open upvalues of the frame point into values while it is suspended
+    JSUpvalue* upvalues;
+};
+
+#endif //GENERATOR_IMPL_H
@@ -0,0 +1,785 @@
+#include "heap.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <gc.h>
+#include <gc_mark.h>
+
+#include "panic.h"
+#include "nursery.h"
+
+#include "dict.impl.h"
+#include "upvalue.impl.h"
+#include "vm.impl.h"
+
+// Kinds of the collector for the precisely traced allocation kinds
+static unsigned gc_kinds[HEAP_ALLOC_KIND_COUNT];
+
+#define HEAP_SITE_SLOTS 256
+#define HEAP_TOP_SITES 20
+
+typedef struct
+{
+    const char* site;
+    HeapAllocKind kind;
+    size_t count;
+    size_t bytes;
+} HeapAllocSite;
+
+typedef struct
+{
+    HeapAllocSite sites[HEAP_SITE_SLOTS];
+    size_t counts[HEAP_ALLOC_KIND_COUNT];
+    size_t bytes[HEAP_ALLOC_KIND_COUNT];
+} HeapAllocations;
+
+static const char* const alloc_kind_names[HEAP_ALLOC_KIND_COUNT] = {
+    "objects", "bytes", "values", "properties", "upvalues"
+};
+
+static const char* const alloc_kind_scans[HEAP_ALLOC_KIND_COUNT] = {
+    "conservative", "not scanned", "precise", "precise", "precise"
+};
+
+static int count_allocations = 0;
+static size_t allocation_counts[HEAP_ALLOC_KIND_COUNT];
+static size_t allocation_bytes[HEAP_ALLOC_KIND_COUNT];
+static HeapAllocSite allocation_sites[HEAP_SITE_SLOTS];
+
+static VM** vms = NULL;
+static size_t vm_count = 0;
+static GC_push_other_roots_proc next_push_roots = NULL;
+
+static HeapPauses pauses = {0};
+static double pause_start = 0;
+
+// Only changed by the thread entering the sections, except for the overrun set when the heap grows
+static size_t critical_growth = 0;
+static unsigned critical_depth = 0;
+static size_t critical_limit = 0;
+static volatile int critical_overrun = 0;
+static int critical_lifted = 0;
+
+static inline int heap_is_pointer(JSValueType type)
+{
+    switch (type)
+    {
+    case JS_STRING:
+    case JS_OBJECT:
+    case JS_FUNC:
+    case JS_SYMBOL:
+    case JS_GS_BOX:
+    case JS_INTERNAL:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static inline struct GC_ms_entry* heap_mark_value(
+    JSValue* value,
+    struct GC_ms_entry* mark_stack_ptr,
+    struct GC_ms_entry* mark_stack_limit)
+{
+    if (!heap_is_pointer(value->type))
+    {
+        return mark_stack_ptr;
+    }
+    return GC_MARK_AND_PUSH(value->value.as_pointer, mark_stack_ptr, mark_stack_limit, &value->value.as_pointer);
+}
+
+// Objects on a free list are cleared except for the link in their first word, which is read as a key,
+// a location or the type of a value there. A type never matches the aligned low bits of a link.
+static struct GC_ms_entry* heap_mark_property(
+    GC_word* addr,
+    struct GC_ms_entry* mark_stack_ptr,
+    struct GC_ms_entry* mark_stack_limit,
+    GC_word env)
+{
+    JSProperty* property = (JSProperty*)addr;
+    mark_stack_ptr = GC_MARK_AND_PUSH(property->key, mark_stack_ptr, mark_stack_limit, (void**)&property->key);
+    mark_stack_ptr = GC_MARK_AND_PUSH(property->symbol, mark_stack_ptr, mark_stack_limit, &property->symbol);
+    mark_stack_ptr = heap_mark_value(&property->value, mark_stack_ptr, mark_stack_limit);
+    return GC_MARK_AND_PUSH(property->next, mark_stack_ptr, mark_stack_limit, (void**)&property->next);
+}
+
+static struct GC_ms_entry* heap_mark_upvalue(
+    GC_word* addr,
+    struct GC_ms_entry* mark_stack_ptr,
+    struct GC_ms_entry* mark_stack_limit,
+    GC_word env)
+{
+    JSUpvalue* upvalue = (JSUpvalue*)addr;
+    mark_stack_ptr = GC_MARK_AND_PUSH(upvalue->location, mark_stack_ptr, mark_stack_limit, (void**)&upvalue->location);
+    mark_stack_ptr = GC_MARK_AND_PUSH(upvalue->owner, mark_stack_ptr, mark_stack_limit, (void**)&upvalue->owner);
+    mark_stack_ptr = heap_mark_value(&upvalue->closed, mark_stack_ptr, mark_stack_limit);
+    return GC_MARK_AND_PUSH(upvalue->next, mark_stack_ptr, mark_stack_limit, (void**)&upvalue->next);
+}
+
+static struct GC_ms_entry* heap_mark_values(
+    GC_word* addr,
+    struct GC_ms_entry* mark_stack_ptr,
+    struct GC_ms_entry* mark_stack_limit,
+    GC_word env)
+{
+    // The length is not stored, unused values past the requested count are cleared
+    JSValue* values = (JSValue*)addr;
+    size_t count = GC_size(addr) / sizeof(JSValue);
+    for (size_t i = 0; i < count; i++)
+    {
+        mark_stack_ptr = heap_mark_value(&values[i], mark_stack_ptr, mark_stack_limit);
+    }
+    return mark_stack_ptr;
+}
+
+static unsigned heap_new_kind(GC_mark_proc proc)
+{
+    return GC_new_kind(GC_new_free_list(), GC_MAKE_PROC(GC_new_proc(proc), 0), 0, 1);
+}
+
+static void heap_push_pointer(void** slot)
+{
+    GC_push_all_eager(slot, slot + 1);
+}
+
+// Slots above the stack counter keep stale values, they are neither scanned nor retained
+void heap_visit_roots(void (*visit)(void** slot))
+{
+    for (size_t i = 0; i < vm_count; i++)
+    {
+        VM* vm = vms[i];
+        visit((void**)&vm->module);
+        visit((void**)&vm->function);
+        visit((void**)&vm->globalScope);
+        visit((void**)&vm->scope);
+        visit((void**)&vm->open_upvalues);
+        visit((void**)&vm->generator);
+        if (heap_is_pointer(vm->exception.type))
+        {
+            visit(&vm->exception.value.as_pointer);
+        }
+        for (size_t j = 0; j < vm->stats.stack_counter; j++)
+        {
+            if (heap_is_pointer(vm->stack[j].type))
+            {
+                visit(&vm->stack[j].value.as_pointer);
+            }
+        }
+    }
+}
+
+static void GC_CALLBACK heap_push_roots(void)
+{
+    heap_visit_roots(heap_push_pointer);
+    if (next_push_roots)
+    {
+        next_push_roots();
+    }
+}
+
+// 1-2-5 steps from 100us, a pause of exactly a limit falls into the next bucket
+static const double pause_limits[HEAP_PAUSE_BUCKETS - 1] = {0.1, 0.2, 0.5, 1, 2, 5, 10, 20, 50, 100, 200};
+
+double heap_now_ms(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1e6;
+#endif
+}
+
+// Runs with the allocation lock held, so the counters need no synchronization of their own
+static void GC_CALLBACK heap_on_collection_event(GC_EventType event)
+{
+    if (event == GC_EVENT_PRE_STOP_WORLD)
+    {
+        pause_start = heap_now_ms();
+    }
+    else if (event == GC_EVENT_POST_START_WORLD)
+    {
+        double pause = heap_now_ms() - pause_start;
+        pauses.count++;
+        pauses.total_ms += pause;
+        if (pause > pauses.max_ms)
+        {
+            pauses.max_ms = pause;
+        }
+
+        size_t bucket = 0;
+        while (bucket < HEAP_PAUSE_BUCKETS - 1 && pause >= pause_limits[bucket])
+        {
+            bucket++;
+        }
+        pauses.histogram[bucket]++;
+    }
+}
+
+// Runs with the allocation lock held, collections can only be enabled again once it is released
+static void GC_CALLBACK heap_on_resize(GC_word size)
+{
+    if (critical_depth && size > critical_limit)
+    {
+        critical_overrun = 1;
+    }
+}
+
+// Option names of the command line, the variables are named ATOMIX_GC_<NAME> with underscores
+static const char* const config_names[] = {
+    "markers", "incremental", "pause-ms", "free-space-divisor", "initial-heap", "max-heap", "stats", "census", "critical-growth",
+    "allocations", "nursery"
+};
+
+static size_t heap_parse_size(const char* value)
+{
+    char* end;
+    size_t size = strtoull(value, &end, 10);
+    switch (*end)
+    {
+    case 'g':
+    case 'G':
+        size <<= 10;
+        // fallthrough
+    case 'm':
+    case 'M':
+        size <<= 10;
+        // fallthrough
+    case 'k':
+    case 'K':
+        size <<= 10;
+        break;
+    default:
+        break;
+    }
+    return size;
+}
+
+// Switches take no value, any other option without one is not valid
+static int heap_config_set(HeapConfig* config, const char* name, const char* value)
+{
+    if (strcmp(name, "incremental") == 0)
+    {
+        config->incremental = !value || strtoul(value, NULL, 10) != 0;
+        return 1;
+    }
+    if (strcmp(name, "stats") == 0)
+    {
+        config->stats = !value || strtoul(value, NULL, 10) != 0;
+        return 1;
+    }
+    if (strcmp(name, "census") == 0)
+    {
+        config->census = !value || strtoul(value, NULL, 10) != 0;
+        return 1;
+    }
+    if (strcmp(name, "allocations") == 0)
+    {
+        config->allocations = !value || strtoul(value, NULL, 10) != 0;
+        return 1;
+    }
+    if (!value)
+    {
+        return 0;
+    }
+
+    if (strcmp(name, "markers") == 0)
+    {
+        config->markers = strtoul(value, NULL, 10);
+    }
+    else if (strcmp(name, "pause-ms") == 0)
+    {
+        config->pause_ms = strtoul(value, NULL, 10);
+    }
+    else if (strcmp(name, "free-space-divisor") == 0)
+    {
+        config->free_space_divisor = strtoul(value, NULL, 10);
+    }
+    else if (strcmp(name, "initial-heap") == 0)
+    {
+        config->initial_heap = heap_parse_size(value);
+    }
+    else if (strcmp(name, "max-heap") == 0)
+    {
+        config->max_heap = heap_parse_size(value);
+    }
+    else if (strcmp(name, "critical-growth") == 0)
+    {
+        config->critical_growth = heap_parse_size(value);
+    }
+    else if (strcmp(name, "nursery") == 0)
+    {
+        config->nursery = heap_parse_size(value);
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+HeapConfig heap_config_from_env(void)
+{
+    HeapConfig config = {0};
+    for (size_t i = 0; i < sizeof(config_names) / sizeof(config_names[0]); i++)
+    {
+        char variable[64] = "ATOMIX_GC_";
+        size_t length = strlen(variable);
+        for (const char* c = config_names[i]; *c; c++)
+        {
+            variable[length++] = *c == '-' ? '_' : (char)toupper((unsigned char)*c);
+        }
+        variable[length] = '\0';
+
+        const char* value = getenv(variable);
+        if (value)
+        {
+            heap_config_set(&config, config_names[i], value);
+        }
+    }
+    return config;
+}
+
+int heap_config_parse_option(HeapConfig* config, const char* option)
+{
+    if (strncmp(option, "--gc-", 5) != 0)
+    {
+        return 0;
+    }
+
+    char name[64];
+    const char* value = strchr(option, '=');
+    size_t length = value ? (size_t)(value - option - 5) : strlen(option + 5);
+    if (length >= sizeof(name))
+    {
+        return 0;
+    }
+    memcpy(name, option + 5, length);
+    name[length] = '\0';
+
+    return heap_config_set(config, name, value ? value + 1 : NULL);
+}
+
+void heap_init(const HeapConfig* config)
+{
+#ifdef PARALLEL_MARK
+    GC_set_markers_count(config->markers);
+#endif
+    GC_init();
+
+    // Set after GC_init, which reads the variables of the collector itself, so these take precedence
+    if (config->free_space_divisor)
+    {
+        GC_set_free_space_divisor(config->free_space_divisor);
+    }
+    if (config->max_heap)
+    {
+        GC_set_max_heap_size(config->max_heap);
+    }
+    size_t heap_size = GC_get_heap_size();
+    if (config->initial_heap > heap_size && !GC_expand_hp(config->initial_heap - heap_size))
+    {
+        PANIC("Could not reserve the initial heap");
+    }
+    GC_set_on_collection_event(heap_on_collection_event);
+    GC_set_on_heap_resize(heap_on_resize);
+    // Finalizers change the heap the VM is working on, they are only run at the safe points of heap_run_finalizers
+    GC_set_finalize_on_demand(1);
+    critical_growth = config->critical_growth;
+
+    gc_kinds[HEAP_ALLOC_VALUES] = heap_new_kind(heap_mark_values);
+    gc_kinds[HEAP_ALLOC_PROPERTY] = heap_new_kind(heap_mark_property);
+    gc_kinds[HEAP_ALLOC_UPVALUE] = heap_new_kind(heap_mark_upvalue);
+    count_allocations = config->allocations;
+    nursery_init(config->nursery);
+
+    // Threaded builds push the stacks of other threads through the same hook
+    next_push_roots = GC_get_push_other_roots();
+    GC_set_push_other_roots(heap_push_roots);
+
+    if (config->incremental)
+    {
+        // Uses soft-dirty bits where the kernel has them and write protection of the heap otherwise. The
+        // VM writes to the heap only from user code and roots are pushed again when marking completes.
+        GC_enable_incremental();
+        if (config->pause_ms)
+        {
+            GC_set_time_limit(config->pause_ms);
+        }
+    }
+
+#ifdef PARALLEL_MARK
+    // Otherwise the markers are only started together with the first thread, which a script may never need
+    GC_start_mark_threads();
+#endif
+}
+
+double heap_pause_bucket_limit(size_t bucket)
+{
+    return bucket < HEAP_PAUSE_BUCKETS - 1 ? pause_limits[bucket] : INFINITY;
+}
+
+static void* heap_get_pauses_locked(void* result)
+{
+    *(HeapPauses*)result = pauses;
+    return result;
+}
+
+HeapPauses heap_get_pauses(void)
+{
+    HeapPauses result;
+    GC_call_with_alloc_lock(heap_get_pauses_locked, &result);
+    return result;
+}
+
+static void* heap_get_stats_locked(void* result)
+{
+    HeapStats* stats = result;
+    stats->collections = GC_get_gc_no();
+    stats->pauses = pauses;
+    return result;
+}
+
+HeapStats heap_get_stats(void)
+{
+    HeapStats stats;
+    GC_word heap_size, free_bytes, unmapped_bytes, bytes_since_gc, total_bytes;
+    GC_get_heap_usage_safe(&heap_size, &free_bytes, &unmapped_bytes, &bytes_since_gc, &total_bytes);
+    stats.heap_size = heap_size;
+    stats.free_bytes = free_bytes;
+    stats.unmapped_bytes = unmapped_bytes;
+    stats.bytes_since_gc = bytes_since_gc;
+    stats.total_bytes = total_bytes;
+    GC_call_with_alloc_lock(heap_get_stats_locked, &stats);
+    return stats;
+}
+
+void heap_print_stats(FILE* file)
+{
+    HeapStats stats = heap_get_stats();
+    fprintf(file, "gc heap: %zu bytes, %zu free, %zu unmapped\n", stats.heap_size, stats.free_bytes, stats.unmapped_bytes);
+    fprintf(file, "gc allocated: %zu bytes since the last collection, %zu in total\n", stats.bytes_since_gc, stats.total_bytes);
+    fprintf(file, "gc collections: %zu\n", stats.collections);
+    fprintf(file, "gc pauses: %zu, total %.3f ms, max %.3f ms\n", stats.pauses.count, stats.pauses.total_ms, stats.pauses.max_ms);
+    for (size_t i = 0; i < HEAP_PAUSE_BUCKETS; i++)
+    {
+        if (stats.pauses.histogram[i])
+        {
+            fprintf(file, "    < %g ms: %zu\n", heap_pause_bucket_limit(i), stats.pauses.histogram[i]);
+        }
+    }
+
+    NurseryStats nursery = nursery_get_stats();
+    if (nursery.size)
+    {
+        fprintf(file, "gc nursery: %zu bytes, %zu minor collections, %zu bytes promoted, %zu objects pinned\n",
+            nursery.size, nursery.collections, nursery.promoted_bytes, nursery.pinned);
+        fprintf(file, "gc minor pauses: total %.3f ms, max %.3f ms\n", nursery.total_ms, nursery.max_ms);
+    }
+}
+
+static void heap_check_critical(void)
+{
+    if (critical_overrun && !critical_lifted)
+    {
+        critical_lifted = 1;
+        GC_enable();
+    }
+}
+
+int heap_collect_a_little(void)
+{
+    heap_check_critical();
+    return GC_collect_a_little();
+}
+
+int heap_collect_idle(double budget_ms)
+{
+    heap_check_critical();
+    double start = heap_now_ms();
+    do
+    {
+        if (!GC_collect_a_little())
+        {
+            return 0;
+        }
+    } while (heap_now_ms() - start < budget_ms);
+    return 1;
+}
+
+void heap_collect(void)
+{
+    heap_check_critical();
+    nursery_collect();
+    GC_gcollect();
+    heap_run_finalizers();
+}
+
+int heap_run_finalizers(void)
+{
+    return GC_should_invoke_finalizers() ? GC_invoke_finalizers() : 0;
+}
+
+static void* heap_enter_critical_locked(void* unused)
+{
+    size_t size = GC_get_heap_size();
+    critical_limit = size + (critical_growth ? critical_growth : size);
+    critical_overrun = 0;
+    critical_lifted = 0;
+    critical_depth = 1;
+    return NULL;
+}
+
+void heap_enter_critical(void)
+{
+    if (critical_depth)
+    {
+        critical_depth++;
+        return;
+    }
+    GC_disable();
+    GC_call_with_alloc_lock(heap_enter_critical_locked, NULL);
+}
+
+static void* heap_leave_critical_locked(void* unused)
+{
+    critical_depth = 0;
+    critical_overrun = 0;
+    return NULL;
+}
+
+int heap_leave_critical(void)
+{
+    if (!critical_depth)
+    {
+        return 0;
+    }
+    if (--critical_depth)
+    {
+        return 1;
+    }
+    GC_call_with_alloc_lock(heap_leave_critical_locked, NULL);
+    if (!critical_lifted)
+    {
+        GC_enable();
+    }
+    return 1;
+}
+
+static void* heap_count_allocation_locked(void* allocation)
+{
+    const HeapAllocSite* counted = allocation;
+    allocation_counts[counted->kind]++;
+    allocation_bytes[counted->kind] += counted->bytes;
+
+    // The sites are fixed at compile time, so the table does not have to grow
+    size_t slot = (size_t)(((uintptr_t)counted->site >> 3) * 0x9E3779B97F4A7C15ull >> 40) & (HEAP_SITE_SLOTS - 1);
+    for (size_t i = 0; i < HEAP_SITE_SLOTS; i++, slot = (slot + 1) & (HEAP_SITE_SLOTS - 1))
+    {
+        HeapAllocSite* site = &allocation_sites[slot];
+        if (!site->site)
+        {
+            *site = (HeapAllocSite){.site = counted->site, .kind = counted->kind};
+        }
+        if (site->site == counted->site && site->kind == counted->kind)
+        {
+            site->count++;
+            site->bytes += counted->bytes;
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void heap_count_allocation(size_t size, HeapAllocKind kind, const char* site)
+{
+    // Loader threads allocate as well
+    HeapAllocSite counted = {.site = site, .kind = kind, .bytes = size};
+    GC_call_with_alloc_lock(heap_count_allocation_locked, &counted);
+}
+
+void* heap_alloc(size_t size, HeapAllocKind kind, const char* site)
+{
+    // Checked on every allocation, so a critical section cannot grow the heap past its limit
+    heap_check_critical();
+    void* pointer;
+    switch (kind)
+    {
+    case HEAP_ALLOC_OBJECT:
+        pointer = GC_malloc(size);
+        break;
+    case HEAP_ALLOC_BYTES:
+        pointer = GC_malloc_atomic(size);
+        break;
+    default:
+        pointer = GC_generic_malloc(size, gc_kinds[kind]);
+        break;
+    }
+    if (!pointer)
+    {
+        PANIC("Could not allocate memory");
+    }
+
+    if (count_allocations)
+    {
+        heap_count_allocation(size, kind, site);
+    }
+    return pointer;
+}
+
+void* heap_alloc_young(size_t size, HeapAllocKind kind, const char* site)
+{
+    void* pointer = nursery_alloc(size, kind);
+    if (!pointer)
+    {
+        return heap_alloc(size, kind, site);
+    }
+    if (count_allocations)
+    {
+        heap_count_allocation(size, kind, site);
+    }
+    return pointer;
+}
+
+struct JSProperty* heap_alloc_property(const char* site)
+{
+    return heap_alloc(sizeof(JSProperty), HEAP_ALLOC_PROPERTY, site);
+}
+
+struct JSProperty* heap_alloc_young_property(const char* site)
+{
+    return heap_alloc_young(sizeof(JSProperty), HEAP_ALLOC_PROPERTY, site);
+}
+
+JSUpvalue* heap_alloc_upvalue(const char* site)
+{
+    return heap_alloc(sizeof(JSUpvalue), HEAP_ALLOC_UPVALUE, site);
+}
+
+JSValue* heap_alloc_values(size_t count, const char* site)
+{
+    return heap_alloc(count * sizeof(JSValue), HEAP_ALLOC_VALUES, site);
+}
+
+static int heap_compare_sites(const void* a, const void* b)
+{
+    size_t left = ((const HeapAllocSite*)a)->bytes;
+    size_t right = ((const HeapAllocSite*)b)->bytes;
+    return left < right ? 1 : left > right ? -1 : 0;
+}
+
+// Sites are named by their full path, only the directory of the file is kept
+static const char* heap_site_name(const char* site)
+{
+    const char* name = site;
+    const char* last = NULL;
+    for (const char* c = site; *c; c++)
+    {
+        if (*c == '/' || *c == '\\')
+        {
+            name = last ? last + 1 : site;
+            last = c;
+        }
+    }
+    return name;
+}
+
+static void* heap_get_allocations_locked(void* result)
+{
+    HeapAllocations* allocations = result;
+    memcpy(allocations->sites, allocation_sites, sizeof(allocation_sites));
+    memcpy(allocations->counts, allocation_counts, sizeof(allocation_counts));
+    memcpy(allocations->bytes, allocation_bytes, sizeof(allocation_bytes));
+    return NULL;
+}
+
+void heap_print_allocations(FILE* file)
+{
+    static HeapAllocations allocations;
+    GC_call_with_alloc_lock(heap_get_allocations_locked, &allocations);
+    HeapAllocSite* sites = allocations.sites;
+    const size_t* counts = allocations.counts;
+    const size_t* bytes = allocations.bytes;
+
+    size_t total_count = 0;
+    size_t total_bytes = 0;
+    for (size_t i = 0; i < HEAP_ALLOC_KIND_COUNT; i++)
+    {
+        total_count += counts[i];
+        total_bytes += bytes[i];
+    }
+    fprintf(file, "gc allocations: %zu, %zu bytes\n", total_count, total_bytes);
+    for (size_t i = 0; i < HEAP_ALLOC_KIND_COUNT; i++)
+    {
+        fprintf(file, "    %-12s %-14s %10zu %12zu\n", alloc_kind_names[i], alloc_kind_scans[i], counts[i], bytes[i]);
+    }
+
+    size_t site_count = 0;
+    for (size_t i = 0; i < HEAP_SITE_SLOTS; i++)
+    {
+        if (sites[i].site)
+        {
+            sites[site_count++] = sites[i];
+        }
+    }
+    qsort(sites, site_count, sizeof(HeapAllocSite), heap_compare_sites);
+    fprintf(file, "gc allocation sites:\n");
+    for (size_t i = 0; i < site_count && i < HEAP_TOP_SITES; i++)
+    {
+        fprintf(file, "    %-32s %-12s %10zu %12zu\n", heap_site_name(sites[i].site), alloc_kind_names[sites[i].kind], sites[i].count, sites[i].bytes);
+    }
+}
+
+static void* heap_add_vm_locked(void* vm)
+{
+    VM** resized = realloc(vms, (vm_count + 1) * sizeof(VM*));
+    if (!resized)
+    {
+        return NULL;
+    }
+    vms = resized;
+    vms[vm_count++] = vm;
+    return vm;
+}
+
+void heap_add_vm(VM* vm)
+{
+    // The list is read while the world is stopped, so it only changes under the allocation lock
+    if (!GC_call_with_alloc_lock(heap_add_vm_locked, vm))
+    {
+        PANIC("Could not allocate memory");
+    }
+}
+
+static void* heap_remove_vm_locked(void* vm)
+{
+    for (size_t i = 0; i < vm_count; i++)
+    {
+        if (vms[i] == vm)
+        {
+            vms[i] = vms[--vm_count];
+            break;
+        }
+    }
+    return NULL;
+}
+
+void heap_remove_vm(VM* vm)
+{
+    GC_call_with_alloc_lock(heap_remove_vm_locked, vm);
+}
@@ -0,0 +1,205 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "value.h"
+#include "upvalue.h"
+#include "vm.h"
+
+struct JSProperty;
+
+#define HEAP_PAUSE_BUCKETS 12
+
+typedef struct HeapConfig
+{
+    // Threads marking the heap in threaded engines, 0 uses one per core
+    unsigned markers;
+    // Marks in steps between allocations, writes to the heap are tracked through virtual dirty bits
+    int incremental;
+    // Longest stop-the-world phase an incremental collection aims for, 0 keeps the default of the collector
+    unsigned long pause_ms;
+    // The heap grows instead of collecting while less than 1/divisor of it is free, 0 keeps the default of 3
+    unsigned long free_space_divisor;
+    // Bytes reserved before the first allocation, 0 starts with the minimal heap
+    size_t initial_heap;
+    // Bytes the heap may not grow past, allocations beyond it fail. 0 leaves the heap unbounded.
+    size_t max_heap;
+    // Prints the statistics of the heap to stderr when the runner exits
+    int stats;
+    // Prints what the reachable objects are and which variables retain them when the runner exits
+    int census;
+    // Bytes the heap may grow by while collections are suppressed, 0 lets it double
+    size_t critical_growth;
+    // Counts the allocations of the VM per kind and call site and prints them when the runner exits
+    int allocations;
+    // Bytes of the nursery young objects and block scopes are bumped off, 0 allocates them in the heap
+    size_t nursery;
+} HeapConfig;
+
+typedef struct HeapPauses
+{
+    size_t count;
+    double total_ms;
+    double max_ms;
+    size_t histogram[HEAP_PAUSE_BUCKETS];
+} HeapPauses;
+
+typedef struct HeapStats
+{
+    size_t heap_size;
+    size_t free_bytes;
+    size_t unmapped_bytes;
+    size_t bytes_since_gc;
+    size_t total_bytes;
+    size_t collections;
+    HeapPauses pauses;
+} HeapStats;
+
+/**
+ * Reads ATOMIX_GC_MARKERS, ATOMIX_GC_INCREMENTAL, ATOMIX_GC_PAUSE_MS, ATOMIX_GC_FREE_SPACE_DIVISOR,
+ * ATOMIX_GC_INITIAL_HEAP, ATOMIX_GC_MAX_HEAP, ATOMIX_GC_STATS, ATOMIX_GC_CENSUS, ATOMIX_GC_CRITICAL_GROWTH,
+ * ATOMIX_GC_ALLOCATIONS and ATOMIX_GC_NURSERY, unset variables keep the defaults. Sizes take a k, m or g suffix.
+ */
+HeapConfig heap_config_from_env(void);
+
+/**
+ * Applies a command line option of the form --gc-<name>[=<value>] named like the variables above, e.g.
+ * --gc-max-heap=512m. Returns 0 if the option is not one of them.
+ */
+int heap_config_parse_option(HeapConfig* config, const char* option);
+
+/**
+ * Initializes the collector together with the object kinds below, has to run before anything is allocated
+ */
+void heap_init(const HeapConfig* config);
+
+/**
+ * A pause lasts from stopping the world until it is restarted, every collection is timed from heap_init on
+ */
+HeapPauses heap_get_pauses(void);
+
+HeapStats heap_get_stats(void);
+
+void heap_print_stats(FILE* file);
+
+/**
+ * Does a slice of collection work, in incremental mode roughly marking one page, and starts a collection if
+ * one is due. Returns 0 once no collection is in progress, so an idle host can call it until then.
+ */
+int heap_collect_a_little(void);
+
+/**
+ * Does slices of collection work for at most budget_ms, returns 0 if no collection is left in progress
+ */
+int heap_collect_idle(double budget_ms);
+
+/**
+ * Collects the nursery and then the whole heap at once, e.g. at a safe point between requests. Has no effect
+ * while collections are suppressed.
+ */
+void heap_collect(void);
+
+/**
+ * Runs the finalizers of objects found unreachable since the last call, returns how many ran. The collector
+ * only queues them, so this has to be called where no heap structure is half updated, e.g. before a weak map
+ * operation. heap_collect calls it after collecting.
+ */
+int heap_run_finalizers(void);
+
+/**
+ * Suppresses collections until the matching heap_leave_critical, sections nest. The heap grows instead, if
+ * it grew by more than the critical growth of the config since the outermost section was entered,
+ * collections resume with the next allocation of the VM.
+ */
+void heap_enter_critical(void);
+
+/**
+ * Returns 0 if no section was entered
+ */
+int heap_leave_critical(void);
+
+/**
+ * Exclusive upper bound of a histogram bucket in milliseconds, the last bucket is unbounded
+ */
+double heap_pause_bucket_limit(size_t bucket);
+
+typedef enum
+{
+    // Scanned conservatively, every word may be a pointer
+    HEAP_ALLOC_OBJECT,
+    // Not scanned at all
+    HEAP_ALLOC_BYTES,
+    // Traced precisely, see heap_alloc_values
+    HEAP_ALLOC_VALUES,
+    HEAP_ALLOC_PROPERTY,
+    HEAP_ALLOC_UPVALUE,
+    HEAP_ALLOC_KIND_COUNT
+} HeapAllocKind;
+
+#define HEAP_STRINGIFY_(x) #x
+#define HEAP_STRINGIFY(x) HEAP_STRINGIFY_(x)
+// Call site an allocation is counted for
+#define HEAP_SITE __FILE__ ":" HEAP_STRINGIFY(__LINE__)
+
+/**
+ * Every allocation of the VM goes through these, they panic instead of returning NULL. Objects are for
+ * structs and arrays holding pointers, the memory is cleared. Bytes are for strings, code and other buffers
+ * without pointers into the heap, the collector does not look into them and the memory is not cleared.
+ */
+#define vm_alloc_object(size) heap_alloc((size), HEAP_ALLOC_OBJECT, HEAP_SITE)
+#define vm_alloc_bytes(size) heap_alloc((size), HEAP_ALLOC_BYTES, HEAP_SITE)
+#define vm_alloc_values(count) heap_alloc_values((count), HEAP_SITE)
+#define vm_alloc_property() heap_alloc_property(HEAP_SITE)
+#define vm_alloc_upvalue() heap_alloc_upvalue(HEAP_SITE)
+
+void* heap_alloc(size_t size, HeapAllocKind kind, const char* site);
+
+/**
+ * Young objects are bumped off the nursery and promoted into the heap by a minor collection if they survive
+ * it, see nursery.h. Only objects and properties are allocated young, the ones the nursery can not take are
+ * allocated in the heap. Stores into them need no barrier, stores of them into other objects do.
+ */
+#define vm_alloc_young_object(size) heap_alloc_young((size), HEAP_ALLOC_OBJECT, HEAP_SITE)
+#define vm_alloc_young_property() heap_alloc_young_property(HEAP_SITE)
+
+void* heap_alloc_young(size_t size, HeapAllocKind kind, const char* site);
+
+struct JSProperty* heap_alloc_young_property(const char* site);
+
+/**
+ * Objects holding values are traced precisely, the payload of a value is only followed if its type is a
+ * pointer type. The memory is cleared.
+ */
+struct JSProperty* heap_alloc_property(const char* site);
+
+JSUpvalue* heap_alloc_upvalue(const char* site);
+
+JSValue* heap_alloc_values(size_t count, const char* site);
+
+/**
+ * Prints the allocations counted per kind and the call sites allocating the most bytes, nothing is counted
+ * unless the allocations of the config are set
+ */
+void heap_print_allocations(FILE* file);
+
+/**
+ * The value stack of a registered VM is a root of the collector, only its used part is traced
+ */
+void heap_add_vm(VM* vm);
+
+void heap_remove_vm(VM* vm);
+
+/**
+ * Calls visit with every root slot of the registered VMs that holds a pointer, values only while their type
+ * is a pointer type
+ */
+void heap_visit_roots(void (*visit)(void** slot));
+
+/**
+ * Monotonic clock the pauses are timed with
+ */
+double heap_now_ms(void);
+
+#endif //HEAP_H
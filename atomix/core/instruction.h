@@ -1,16 +1,21 @@
 #ifndef OPCODE_H
 #define OPCODE_H
 
-#define OPCODE_OF(ptr) ptr == NULL ? OP_NOP : *((Opcode*)ptr)
+#include <stdint.h>
+
+#define OPCODE_OF(ptr) ((ptr) == NULL ? OP_NOP : (Opcode)*((const uint8_t*)(ptr)))
 
 typedef enum Opcode Opcode;
 
-#define OPCODE_LENGTH 53
+#define OPCODE_LENGTH 66
 
 typedef struct Inst Inst;
 typedef struct InstInt32 InstInt32;
 typedef struct InstDouble InstDouble;
-typedef struct InstUInt16 InstUInt16;
-typedef struct Inst2UInt16 Inst2UInt16;
+typedef struct InstUInt32 InstUInt32;
+typedef struct InstUInt64 InstUInt64;
+typedef struct InstFuncDecl InstFuncDecl;
+typedef struct InstFuncDeclE InstFuncDeclE;
+typedef struct InstCapture InstCapture;
 
 #endif //OPCODE_H
@@ -59,37 +59,82 @@ enum Opcode
     OP_JMP,
     OP_JMP_F,
     OP_JMP_T,
-    OP_EXPORT
+    OP_EXPORT,
+    OP_ENTER,
+    OP_LOAD_SLOT,
+    OP_STORE_SLOT,
+    OP_LOAD_UPVAL,
+    OP_STORE_UPVAL,
+    OP_CAPTURE,
+    OP_CLOSE_UPVALS,
+    OP_LD_CALLEE,
+    OP_TAIL_CALL,
+    OP_THROW,
+    OP_YIELD,
+    OP_GENERATOR,
+    OP_IMPORT
 };
 
-struct InstInt32
+// Capture entries with this flag reference an upvalue of the enclosing function instead of one of its slots
+#define CAPTURE_FROM_UPVALUE 0x8000
+#define CAPTURE_INDEX_MASK 0x7FFF
+
+// The image encodes operands as LEB128 (signed for LD_INT, unsigned otherwise), the loader decodes
+// them into these structs. Instructions without operands are executed in place from the image, the
+// decoded ones of a body are packed back to back into a single block.
+struct __attribute__((packed)) InstInt32
 {
-    Opcode opcode;
+    uint8_t opcode;
     int32_t operand;
 };
 
-struct InstDouble
+// Loaded from the constant pool of the module when decoded
+struct __attribute__((packed)) InstDouble
 {
-    Opcode opcode;
+    uint8_t opcode;
     double operand;
 };
 
-struct Inst
+struct __attribute__((packed)) Inst
+{
+    uint8_t opcode;
+};
+
+struct __attribute__((packed)) InstUInt32
+{
+    uint8_t opcode;
+    uint32_t operand;
+};
+
+// Loaded from the constant pool of the module when decoded, like InstDouble
+struct __attribute__((packed)) InstUInt64
+{
+    uint8_t opcode;
+    uint64_t operand;
+};
+
+// size counts the instructions of the body, position is the offset of its code in the data section.
+// The image stores the byte length of the body instead, so the loader can skip it undecoded.
+struct __attribute__((packed)) InstFuncDecl
 {
-    Opcode opcode;
+    uint8_t opcode;
+    uint32_t name;
+    uint32_t size;
+    uint32_t position;
 };
 
-struct InstUInt16
+struct __attribute__((packed)) InstFuncDeclE
 {
-    Opcode opcode;
-    uint16_t operand;
+    uint8_t opcode;
+    uint32_t size;
+    uint32_t position;
 };
 
-struct Inst2UInt16
+struct __attribute__((packed)) InstCapture
 {
-    Opcode opcode;
-    uint16_t operand;
-    uint16_t operand2;
+    uint8_t opcode;
+    uint32_t count;
+    uint16_t entries[];
 };
 
 #endif //INSTRUCTION_IMPL_H
\ No newline at end of file
@@ -3,17 +3,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <gc.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "arena.h"
+#include "compression.h"
+#include "heap.h"
+#include "parallel.h"
 #include "panic.h"
 #include "scope.h"
+#include "verifier.h"
 
 #include "format.impl.h"
 #include "instruction.impl.h"
 
 #define EXPORT_BUCKET_SIZE 16
 
-static uint8_t* loader_read_file(const char* filename)
+static uint8_t* loader_read_file(const char* filename, size_t* length)
 {
     FILE* file = fopen(filename, "rb");
     if (!file) {
@@ -23,35 +36,110 @@ static uint8_t* loader_read_file(const char* filename)
     size_t size = ftell(file);
     fseek(file, 0, SEEK_SET);
 
-    uint8_t* buffer = GC_malloc_uncollectable(size);
-    if (!buffer) {
-        PANIC("Could not allocate memory");
+    // Modules reference the buffer in place, their image keeps it alive
+    uint8_t* buffer = vm_alloc_bytes(size);
+    if (size && fread(buffer, size, 1, file) != 1)
+    {
+        PANIC("Could not read file");
     }
-    fread(buffer, size, 1, file);
     fclose(file);
+    *length = size;
     return buffer;
 }
 
-void module_load_from_file(const char* filename, JSModule* module)
+// The mapping is never released, loaded modules live until the process exits
+static uint8_t* loader_map_file(const char* filename, size_t* length)
 {
-    uint8_t* buffer = loader_read_file(filename);
-    module_load_from_buffer(buffer, module);
-    GC_free(buffer);
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        PANIC("Could not open file");
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        PANIC("Could not read file");
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+    {
+        return loader_read_file(filename, length);
+    }
+    uint8_t* image = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!image)
+    {
+        return loader_read_file(filename, length);
+    }
+    *length = (size_t)size.QuadPart;
+    return image;
+#else
+    int file = open(filename, O_RDONLY);
+    if (file < 0)
+    {
+        PANIC("Could not open file");
+    }
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+        close(file);
+        return loader_read_file(filename, length);
+    }
+    void* image = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (image == MAP_FAILED)
+    {
+        // Not mappable (a pipe for example), fall back to reading it
+        return loader_read_file(filename, length);
+    }
+    *length = info.st_size;
+    return image;
+#endif
+}
+
+LoadResult module_load_from_file(const char* filename, JSModule* module)
+{
+    size_t size;
+    uint8_t* buff = loader_read_file(filename, &size);
+    return module_load_from_buffer(buff, size, module);
 }
 
-void bundle_load_from_file(const char* filename, JSBundle* bundle)
+LoadResult bundle_load_from_file(const char* filename, JSBundle* bundle)
 {
-    uint8_t* buffer = loader_read_file(filename);
-    bundle_load_from_buffer(buffer, bundle);
-    GC_free(buffer);
+    size_t size;
+    uint8_t* buff = loader_read_file(filename, &size);
+    return bundle_load_from_buffer(buff, size, bundle);
 }
 
 LoadResult unknown_load_from_file(const char* filename, JSModule* module, JSBundle* bundle)
 {
-    uint8_t* buffer = loader_read_file(filename);
-    LoadResult result = unknown_load_from_buffer(buffer, module, bundle);
-    GC_free(buffer);
-    return result;
+    size_t size;
+    uint8_t* buff = loader_read_file(filename, &size);
+    return unknown_load_from_buffer(buff, size, module, bundle);
+}
+
+LoadResult module_map_file(const char* filename, JSModule* module)
+{
+    size_t size;
+    uint8_t* buff = loader_map_file(filename, &size);
+    return module_load_from_buffer(buff, size, module);
+}
+
+LoadResult bundle_map_file(const char* filename, JSBundle* bundle)
+{
+    size_t size;
+    uint8_t* buff = loader_map_file(filename, &size);
+    return bundle_load_from_buffer(buff, size, bundle);
+}
+
+LoadResult unknown_map_file(const char* filename, JSModule* module, JSBundle* bundle)
+{
+    size_t size;
+    uint8_t* buff = loader_map_file(filename, &size);
+    return unknown_load_from_buffer(buff, size, module, bundle);
 }
 
 #define READ_BLOCK(buff, position, offset, shift) (((uint32_t)(uint8_t)buff[position - offset]) << shift)
@@ -62,12 +150,31 @@ LoadResult unknown_load_from_file(const char* filename, JSModule* module, JSBund
 #define READ_U64(buff, position) (position += 8, (uint64_t)(READ_BIG_BLOCK(buff, position, 1, 56) | READ_BIG_BLOCK(buff, position, 2, 48) | READ_BIG_BLOCK(buff, position, 3, 40) | READ_BIG_BLOCK(buff, position, 4, 32) | \
                                                             READ_BIG_BLOCK(buff, position, 5, 24) | READ_BIG_BLOCK(buff, position, 6, 16) | READ_BIG_BLOCK(buff, position, 7, 8) | READ_BIG_BLOCK(buff, position, 8, 0)))
 
-static double READ_DOUBLE(const uint8_t* buff, size_t* position)
+// Module and bundle headers: magic, version, hash or entry point, then the section offsets or the module count
+#define MODULE_HEADER_LENGTH (4 + sizeof(uint16_t) + sizeof(uint64_t) + 4 * sizeof(uint32_t))
+#define BUNDLE_HEADER_LENGTH (4 + sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint32_t))
+#define CONTAINER_HEADER_LENGTH (4 + sizeof(uint16_t) + 2 * sizeof(uint32_t))
+
+// Steps of the loader return why they reject the image or NULL, the first rejection is passed on as it is
+#define LOAD_CHECK(step) do { const char* rejection = (step); if (rejection) return rejection; } while (0)
+
+// Finds the section at offset of a module image of size bytes, every section starts with its length and
+// count and has to lie within the image
+static const char* load_section(const uint8_t* buff, size_t size, uint32_t offset, const uint8_t** section)
 {
-    double _val;
-    memcpy(&_val, buff + *position, 8);
-    *position += 8;
-    return _val;
+    if (offset > size || size - offset < 2 * sizeof(uint32_t))
+    {
+        return "Section is out of bounds";
+    }
+    const uint8_t* start = buff + offset;
+    size_t position = 0;
+    uint32_t length = READ_U32(start, position);
+    if (length < 2 * sizeof(uint32_t) || length > size - offset)
+    {
+        return "Section is out of bounds";
+    }
+    *section = start;
+    return NULL;
 }
 
 static StringTable load_string_table(const uint8_t* buff)
@@ -77,46 +184,102 @@ static StringTable load_string_table(const uint8_t* buff)
 
     string_table.length = READ_U32(buff, position);
     string_table.count = READ_U32(buff, position);
-    string_table.offsets = GC_malloc(string_table.count * sizeof(uint32_t));
-    if (!string_table.offsets)
+    string_table.offsets = buff + position;
+    string_table.strings = (char*)buff + position + string_table.count * sizeof(uint32_t);
+
+    return string_table;
+}
+
+static const char* load_constant_pool(const uint8_t* buff, ConstantPool* constant_pool)
+{
+    size_t position = 0;
+
+    constant_pool->length = READ_U32(buff, position);
+    constant_pool->count = READ_U32(buff, position);
+    constant_pool->constants = buff + position;
+    if (constant_pool->length < position + (size_t)constant_pool->count * sizeof(double))
     {
-        PANIC("Could not allocate memory");
+        return "Constant pool is truncated";
     }
-    memcpy(string_table.offsets, buff + position, string_table.count * sizeof(uint32_t));
-    size_t str_buff_length = string_table.length - string_table.count * sizeof(uint32_t) - 2 * sizeof(uint32_t);
-    string_table.strings = GC_malloc(str_buff_length);
-    memcpy(string_table.strings, buff + position + string_table.count * sizeof(uint32_t), str_buff_length);
 
-    return string_table;
+    return NULL;
 }
 
-static void* load_instruction(const uint8_t* buff, size_t* start_position)
+static const char* read_var_uint(const DataSection* data_section, size_t* position, uint32_t* value)
 {
-    size_t position = *start_position;
-    Opcode opcode = (Opcode)buff[position++];
-    void* inst;
-    switch (opcode)
+    *value = 0;
+    for (uint32_t shift = 0;; shift += 7)
     {
-    default:
-    case OP_NOP:
-        inst = NULL;
-        break;
-    case OP_LD_INT:
+        if (*position >= data_section->length)
         {
-            InstInt32* x = GC_malloc_atomic(sizeof(InstInt32));
-            x->opcode = opcode;
-            x->operand = READ_I32(buff, position);
-            inst = x;
-            break;
+            return "Data section is truncated";
         }
-    case OP_LD_DOUBLE:
+        uint8_t byte = data_section->code[(*position)++];
+        // The fifth byte only has room for the upper four bits
+        if (shift == 28 && byte > 0x0F)
         {
-            InstDouble* x = GC_malloc_atomic(sizeof(InstDouble));
-            x->opcode = opcode;
-            x->operand = READ_DOUBLE(buff, &position);
-            inst = x;
-            break;
+            return "Operand is out of range";
         }
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return NULL;
+        }
+    }
+}
+
+static const char* read_var_int(const DataSection* data_section, size_t* position, int32_t* result)
+{
+    uint32_t value = 0;
+    for (uint32_t shift = 0;; shift += 7)
+    {
+        if (*position >= data_section->length)
+        {
+            return "Data section is truncated";
+        }
+        uint8_t byte = data_section->code[(*position)++];
+        // The bits above the fifth byte have to be the sign extension of bit 31
+        if (shift == 28 && (byte & 0x78) != 0 && (byte & 0x78) != 0x78)
+        {
+            return "Operand is out of range";
+        }
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (shift == 28 || !(byte & 0x80))
+        {
+            if (byte & 0x80)
+            {
+                return "Operand is out of range";
+            }
+            if (shift < 25 && byte & 0x40)
+            {
+                value |= ~(uint32_t)0 << (shift + 7);
+            }
+            *result = (int32_t)value;
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Decodes the instruction at position and advances behind it. Sets size to the size of the decoded struct,
+ * which is written to out unless it is NULL. Instructions without operands are not decoded, they are
+ * executed from the image and need no space. skip is set to the number of instructions of a declared
+ * function body, which follow the declaration in the table but not in the code.
+ */
+static const char* decode_instruction(JSModule* module, size_t* position, uint8_t* out, uint32_t* skip, size_t* size)
+{
+    DataSection* data_section = &module->data_section;
+    if (*position >= data_section->length)
+    {
+        return "Data section is truncated";
+    }
+    uint8_t opcode = data_section->code[(*position)++];
+    *skip = 0;
+    *size = 0;
+
+    switch ((Opcode)opcode)
+    {
+    case OP_NOP:
     case OP_LD_THIS:
     case OP_ADD:
     case OP_MINUS:
@@ -153,18 +316,63 @@ static void* load_instruction(const uint8_t* buff, size_t* start_position)
     case OP_RETURN:
     case OP_PUSH_SCOPE:
     case OP_POP_SCOPE:
+    case OP_LD_CALLEE:
+    case OP_THROW:
+    case OP_YIELD:
+    case OP_GENERATOR:
+        return NULL;
+    case OP_LD_INT:
         {
-            Inst* x = GC_malloc_atomic(sizeof(Inst));
-            x->opcode = opcode;
-            inst = x;
-            break;
+            int32_t operand;
+            LOAD_CHECK(read_var_int(data_section, position, &operand));
+            InstInt32 inst = {.opcode = opcode, .operand = operand};
+            if (out)
+            {
+                memcpy(out, &inst, sizeof(inst));
+            }
+            *size = sizeof(inst);
+            return NULL;
+        }
+    case OP_LD_DOUBLE:
+        {
+            uint32_t idx;
+            LOAD_CHECK(read_var_uint(data_section, position, &idx));
+            if (idx >= module->constant_pool.count)
+            {
+                return "Constant pool idx is out of bounds";
+            }
+            InstDouble inst = {.opcode = opcode};
+            memcpy(&inst.operand, module->constant_pool.constants + idx * sizeof(double), sizeof(double));
+            if (out)
+            {
+                memcpy(out, &inst, sizeof(inst));
+            }
+            *size = sizeof(inst);
+            return NULL;
+        }
+    case OP_IMPORT:
+        {
+            uint32_t idx;
+            LOAD_CHECK(read_var_uint(data_section, position, &idx));
+            if (idx >= module->constant_pool.count)
+            {
+                return "Constant pool idx is out of bounds";
+            }
+            // The pool stores the hash of the imported module as the raw 64 bits of its entry
+            InstUInt64 inst = {.opcode = opcode};
+            memcpy(&inst.operand, module->constant_pool.constants + idx * sizeof(uint64_t), sizeof(uint64_t));
+            if (out)
+            {
+                memcpy(out, &inst, sizeof(inst));
+            }
+            *size = sizeof(inst);
+            return NULL;
         }
     case OP_LD_STRING:
     case OP_ALLOC_LOCAL:
     case OP_STORE_LOCAL:
     case OP_LOAD_LOCAL:
     case OP_LOAD_ARG:
-    case OP_FUNC_DECL_E:
     case OP_CALL:
     case OP_OBJ_STORE:
     case OP_OBJ_LOAD:
@@ -172,49 +380,253 @@ static void* load_instruction(const uint8_t* buff, size_t* start_position)
     case OP_JMP_F:
     case OP_JMP_T:
     case OP_EXPORT:
+    case OP_ENTER:
+    case OP_LOAD_SLOT:
+    case OP_STORE_SLOT:
+    case OP_LOAD_UPVAL:
+    case OP_STORE_UPVAL:
+    case OP_CLOSE_UPVALS:
+    case OP_TAIL_CALL:
         {
-            InstUInt16* x = GC_malloc_atomic(sizeof(InstUInt16));
-            x->opcode = opcode;
-            x->operand = READ_U16(buff, position);
-            inst = x;
-            break;
+            uint32_t operand;
+            LOAD_CHECK(read_var_uint(data_section, position, &operand));
+            InstUInt32 inst = {.opcode = opcode, .operand = operand};
+            if (out)
+            {
+                memcpy(out, &inst, sizeof(inst));
+            }
+            *size = sizeof(inst);
+            return NULL;
         }
     case OP_FUNC_DECL:
+    case OP_FUNC_DECL_E:
+        {
+            uint32_t name = 0;
+            uint32_t body_size;
+            uint32_t length;
+            if (opcode == OP_FUNC_DECL)
+            {
+                LOAD_CHECK(read_var_uint(data_section, position, &name));
+            }
+            LOAD_CHECK(read_var_uint(data_section, position, &body_size));
+            LOAD_CHECK(read_var_uint(data_section, position, &length));
+            if (length > data_section->length - *position)
+            {
+                return "Data section is truncated";
+            }
+            uint32_t body = (uint32_t)*position;
+            // The body is skipped, it is decoded on its own once the function is called
+            *position += length;
+            *skip = body_size;
+            if (opcode == OP_FUNC_DECL)
+            {
+                InstFuncDecl inst = {.opcode = opcode, .name = name, .size = body_size, .position = body};
+                if (out)
+                {
+                    memcpy(out, &inst, sizeof(inst));
+                }
+                *size = sizeof(inst);
+                return NULL;
+            }
+            InstFuncDeclE inst = {.opcode = opcode, .size = body_size, .position = body};
+            if (out)
+            {
+                memcpy(out, &inst, sizeof(inst));
+            }
+            *size = sizeof(inst);
+            return NULL;
+        }
+    case OP_CAPTURE:
+        {
+            uint32_t count;
+            LOAD_CHECK(read_var_uint(data_section, position, &count));
+            InstCapture inst = {.opcode = opcode, .count = count};
+            if (out)
+            {
+                memcpy(out, &inst, sizeof(inst));
+            }
+            for (uint32_t i = 0; i < count; i++)
+            {
+                uint32_t entry;
+                LOAD_CHECK(read_var_uint(data_section, position, &entry));
+                if (entry > UINT16_MAX)
+                {
+                    return "Capture entry is out of range";
+                }
+                if (out)
+                {
+                    uint16_t value = (uint16_t)entry;
+                    memcpy(out + sizeof(inst) + i * sizeof(uint16_t), &value, sizeof(uint16_t));
+                }
+            }
+            *size = sizeof(inst) + (size_t)count * sizeof(uint16_t);
+            return NULL;
+        }
+    default:
+        return "Invalid opcode";
+    }
+}
+
+// Fills the table for [start, end), nested function bodies are skipped without being looked at
+static const char* decode_instructions(JSModule* module, size_t start, size_t end, size_t position, Arena* arena)
+{
+    DataSection* data_section = &module->data_section;
+    uint32_t skip;
+    size_t length;
+
+    // The first pass only measures, so the decoded instructions of the body end up in a single block
+    size_t size = 0;
+    size_t cursor = position;
+    for (size_t i = start; i < end; i += (size_t)skip + 1)
+    {
+        LOAD_CHECK(decode_instruction(module, &cursor, NULL, &skip, &length));
+        if (skip >= end - i)
         {
-            Inst2UInt16* x = GC_malloc_atomic(sizeof(Inst2UInt16));
-            x->opcode = opcode;
-            x->operand = READ_U16(buff, position);
-            x->operand2 = READ_U16(buff, position);
-            inst = x;
-            break;
+            return "Function body exceeds the enclosing code";
         }
+        size += length;
     }
 
-    *start_position = position;
-    return inst;
+    uint8_t* block = size ? arena_alloc(arena, size) : NULL;
+
+    // Decodes the same bytes once more, which the first pass accepted
+    size_t offset = 0;
+    for (size_t i = start; i < end; i += (size_t)skip + 1)
+    {
+        const uint8_t* code = data_section->code + position;
+        decode_instruction(module, &position, block ? block + offset : NULL, &skip, &length);
+        data_section->instructions[i] = length ? (void*)(block + offset) : (void*)code;
+        offset += length;
+    }
+    return NULL;
 }
 
-static DataSection load_data_section(const uint8_t* buff)
+static const char* load_data_section(const uint8_t* buff, Arena* arena, DataSection* data_section)
 {
     size_t position = 0;
-    DataSection data_section;
 
-    data_section.length = READ_U32(buff, position);
-    data_section.count = READ_U32(buff, position);
-    data_section.instructions = GC_malloc(data_section.count * sizeof(void*));
-    for (size_t i = 0; i < data_section.count; i++)
+    data_section->length = READ_U32(buff, position);
+    data_section->count = READ_U32(buff, position);
+    data_section->code = buff;
+    // Every instruction takes at least a byte
+    if (data_section->count > data_section->length)
     {
-        data_section.instructions[i] = load_instruction(buff, &position);
+        return "Data section is truncated";
     }
+    // The arena is not scanned, so the pointers in the table keep nothing alive. They lead into chunks of the
+    // arena and into the image, which the module holds on to through its arena and its image pointer.
+    data_section->instructions = arena_alloc(arena, data_section->count * sizeof(void*));
+    data_section->depths = arena_alloc(arena, data_section->count * sizeof(uint16_t));
+    data_section->depth = 0;
 
-    return data_section;
+    return NULL;
 }
 
-static void module_load_from_buffer_offset(uint8_t* buff, JSModule* module, size_t* pos)
+static void function_body(const uint8_t* declaration, size_t* size, size_t* position)
+{
+    if (declaration[0] == OP_FUNC_DECL)
+    {
+        *size = ((const InstFuncDecl*)declaration)->size;
+        *position = ((const InstFuncDecl*)declaration)->position;
+    }
+    else
+    {
+        *size = ((const InstFuncDeclE*)declaration)->size;
+        *position = ((const InstFuncDeclE*)declaration)->position;
+    }
+}
+
+static int is_declaration(const uint8_t* instruction)
+{
+    return instruction && (instruction[0] == OP_FUNC_DECL || instruction[0] == OP_FUNC_DECL_E);
+}
+
+void module_decode_function(JSModule* module, size_t instruction_start)
+{
+    DataSection* data_section = &module->data_section;
+    const uint8_t* declaration = instruction_start > 0
+        ? data_section->instructions[instruction_start - 1]
+        : NULL;
+    if (!is_declaration(declaration))
+    {
+        PANIC("Function is not declared");
+    }
+
+    size_t size;
+    size_t position;
+    function_body(declaration, &size, &position);
+    // Verified together with the module, the same bytes decode without a rejection and keep their depth
+    decode_instructions(module, instruction_start, instruction_start + size, position, &module->arena);
+}
+
+/**
+ * Verifies every function body, so a module is either rejected as a whole or all of its code runs. Walking
+ * the table in order reaches every declaration after the body enclosing it was decoded. The bodies go to a
+ * scratch arena and their entries are cleared again, they are still decoded on their first call.
+ */
+static const char* verify_function_bodies(JSModule* module)
+{
+    DataSection* data_section = &module->data_section;
+    Arena scratch = {0};
+    const char* rejection = NULL;
+    for (size_t i = 0; i < data_section->count && !rejection; i++)
+    {
+        if (!is_declaration(data_section->instructions[i]))
+        {
+            continue;
+        }
+        size_t size;
+        size_t position;
+        function_body(data_section->instructions[i], &size, &position);
+        rejection = decode_instructions(module, i + 1, i + 1 + size, position, &scratch);
+        if (!rejection)
+        {
+            rejection = module_verify_code(module, i + 1, i + 1 + size, &data_section->depths[i + 1]);
+        }
+    }
+
+    // Entries of the module body are never part of a function, so clearing the outermost bodies clears all
+    for (size_t i = 0; i < data_section->count; i++)
+    {
+        if (is_declaration(data_section->instructions[i]))
+        {
+            size_t size;
+            size_t position;
+            function_body(data_section->instructions[i], &size, &position);
+            memset(&data_section->instructions[i + 1], 0, size * sizeof(void*));
+            i += size;
+        }
+    }
+    return rejection;
+}
+
+static const char* load_handler_table(const uint8_t* buff, HandlerTable* handler_table)
+{
+    size_t position = 0;
+
+    handler_table->length = READ_U32(buff, position);
+    handler_table->count = READ_U32(buff, position);
+    handler_table->entries = (HandlerEntry*)(buff + position);
+    if (handler_table->length < position + (size_t)handler_table->count * sizeof(HandlerEntry))
+    {
+        return "Handler table is truncated";
+    }
+
+    return NULL;
+}
+
+// Decodes and verifies the module, only allocates memory so bundles can decode modules in parallel
+// The module starts at *pos and may take the image up to end
+static const char* module_decode(uint8_t* buff, size_t end, JSModule* module, size_t* pos)
 {
     module->bundle = NULL;
+    module->image = buff;
 
     size_t position = *pos;
+    if (position > end || end - position < MODULE_HEADER_LENGTH)
+    {
+        return "Module is truncated";
+    }
     module->header.magic[0] = buff[position++];
     module->header.magic[1] = buff[position++];
     module->header.magic[2] = buff[position++];
@@ -225,36 +637,81 @@ static void module_load_from_buffer_offset(uint8_t* buff, JSModule* module, size
         module->header.magic[2] != MODULE_MAGIC2 ||
         module->header.magic[3] != MODULE_MAGIC3)
     {
-        PANIC("Invalid magic number");
+        return "Invalid magic number";
     }
 
     module->header.version = READ_U16(buff, position);
     if (module->header.version != MODULE_VERSION)
     {
-        PANIC("Invalid VM Version");
+        return "Invalid VM Version";
     }
 
     module->header.hash = READ_U64(buff, position);
     module->header.string_table = READ_U32(buff, position);
+    module->header.constant_pool = READ_U32(buff, position);
     module->header.data_section = READ_U32(buff, position);
+    module->header.handler_table = READ_U32(buff, position);
+
+    const uint8_t* start = buff + *pos;
+    size_t size = end - *pos;
+    const uint8_t* section;
+    LOAD_CHECK(load_section(start, size, module->header.string_table, &section));
+    module->string_table = load_string_table(section);
+    LOAD_CHECK(load_section(start, size, module->header.constant_pool, &section));
+    LOAD_CHECK(load_constant_pool(section, &module->constant_pool));
+    LOAD_CHECK(load_section(start, size, module->header.data_section, &section));
+    LOAD_CHECK(load_data_section(section, &module->arena, &module->data_section));
+    LOAD_CHECK(load_section(start, size, module->header.handler_table, &section));
+    LOAD_CHECK(load_handler_table(section, &module->handler_table));
+    // Nothing runs unverified, the module is rejected before any of its code runs
+    LOAD_CHECK(string_table_verify(&module->string_table));
+    LOAD_CHECK(decode_instructions(module, 0, module->data_section.count, 2 * sizeof(uint32_t), &module->arena));
+    LOAD_CHECK(module_verify_code(module, 0, module->data_section.count, &module->data_section.depth));
+    LOAD_CHECK(verify_function_bodies(module));
+    // The handler table is the last section, the next module of a bundle starts behind it
+    *pos += module->header.handler_table + module->handler_table.length;
+    return NULL;
+}
 
-    module->string_table = load_string_table(buff + module->header.string_table + *pos);
-    module->data_section = load_data_section(buff + module->header.data_section + *pos);
+static void module_init(JSModule* module)
+{
     module->initialized = 0;
     module->exports = object_create_object(object_get_object_prototype());
     module->scope = scope_create_scope(NULL);
-    *pos = position;
 }
 
-void module_load_from_buffer(uint8_t* buff, JSModule* module)
+// Only the hosts load images, always on the thread running the VM
+static const char* load_rejection = NULL;
+
+static LoadResult load_result(LoadResult result, const char* rejection)
+{
+    load_rejection = rejection;
+    return rejection ? LOAD_INVALID : result;
+}
+
+const char* loader_get_rejection(void)
+{
+    return load_rejection;
+}
+
+LoadResult module_load_from_buffer(uint8_t* buff, size_t size, JSModule* module)
 {
     size_t pos = 0;
-    return module_load_from_buffer_offset(buff, module, &pos);
+    const char* rejection = module_decode(buff, size, module, &pos);
+    if (!rejection)
+    {
+        module_init(module);
+    }
+    return load_result(LOAD_MODULE, rejection);
 }
 
-void bundle_load_from_buffer(uint8_t* buff, JSBundle* bundle)
+static const char* bundle_load(uint8_t* buff, size_t size, JSBundle* bundle)
 {
     size_t position = 0;
+    if (size < BUNDLE_HEADER_LENGTH)
+    {
+        return "Bundle is truncated";
+    }
     bundle->magic[0] = buff[position++];
     bundle->magic[1] = buff[position++];
     bundle->magic[2] = buff[position++];
@@ -265,41 +722,167 @@ void bundle_load_from_buffer(uint8_t* buff, JSBundle* bundle)
         bundle->magic[2] != BUNDLE_MAGIC2 ||
         bundle->magic[3] != BUNDLE_MAGIC3)
     {
-        PANIC("Invalid magic number");
+        return "Invalid magic number";
     }
 
     bundle->version = READ_U16(buff, position);
     if (bundle->version != BUNDLE_VERSION)
     {
-        PANIC("Invalid VM Version");
+        return "Invalid VM Version";
     }
 
     bundle->entryPoint = READ_U64(buff, position);
-    bundle->moduleCount = READ_U16(buff, position);
-    bundle->modules = GC_malloc(bundle->moduleCount * sizeof(JSModule));
-    if (!bundle->modules)
+    bundle->moduleCount = READ_U32(buff, position);
+    bundle->index = (const BundleIndexEntry*)(buff + position);
+    bundle->image = buff;
+    bundle->size = size;
+    if ((size - position) / sizeof(BundleIndexEntry) < bundle->moduleCount)
+    {
+        return "Bundle index is truncated";
+    }
+    for (uint32_t i = 0; i < bundle->moduleCount; i++)
+    {
+        const BundleIndexEntry* entry = &bundle->index[i];
+        if (entry->offset > size || entry->length > size - entry->offset)
+        {
+            return "Bundle index is out of bounds";
+        }
+    }
+    // Zeroed, so every module starts out undecoded
+    bundle->modules = vm_alloc_object((size_t)bundle->moduleCount * sizeof(JSModule));
+    module_table_add_bundle(bundle);
+    return NULL;
+}
+
+LoadResult bundle_load_from_buffer(uint8_t* buff, size_t size, JSBundle* bundle)
+{
+    return load_result(LOAD_BUNDLE, bundle_load(buff, size, bundle));
+}
+
+static const char* bundle_decode_entry(JSBundle* bundle, uint32_t index)
+{
+    JSModule* module = &bundle->modules[index];
+    const BundleIndexEntry* entry = &bundle->index[index];
+    size_t position = entry->offset;
+    LOAD_CHECK(module_decode(bundle->image, (size_t)entry->offset + entry->length, module, &position));
+    if (module->header.hash != entry->hash || position != (size_t)entry->offset + entry->length)
+    {
+        return "Bundle index does not match the module";
+    }
+    return NULL;
+}
+
+const char* bundle_decode_module(JSBundle* bundle, uint32_t index, JSModule** module)
+{
+    *module = &bundle->modules[index];
+    if ((*module)->bundle)
+    {
+        return NULL;
+    }
+
+    LOAD_CHECK(bundle_decode_entry(bundle, index));
+    module_init(*module);
+    (*module)->bundle = bundle;
+    return NULL;
+}
+
+#ifdef GC_THREADS
+typedef struct
+{
+    JSBundle* bundle;
+    const char** rejections;
+} BundleDecodeJob;
+
+static void bundle_decode_task(void* context, size_t index)
+{
+    BundleDecodeJob* job = context;
+    if (!job->bundle->modules[index].bundle)
+    {
+        job->rejections[index] = bundle_decode_entry(job->bundle, (uint32_t)index);
+    }
+}
+
+void bundle_decode_all(JSBundle* bundle, size_t threads)
+{
+    BundleDecodeJob job = { bundle, calloc(bundle->moduleCount, sizeof(const char*)) };
+    if (bundle->moduleCount && !job.rejections)
     {
         PANIC("Could not allocate memory");
     }
+    parallel_for(threads, bundle->moduleCount, bundle_decode_task, &job);
+
+    // Objects are created on this thread only, in the same way bundle_decode_module does. Rejected modules
+    // stay undecoded, importing them decodes them once more and reports why.
+    for (uint32_t i = 0; i < bundle->moduleCount; i++)
+    {
+        JSModule* module = &bundle->modules[i];
+        if (!module->bundle && !job.rejections[i])
+        {
+            module_init(module);
+            module->bundle = bundle;
+        }
+    }
+    free(job.rejections);
+}
+#endif
+
+// The container is inflated once into a buffer of its own, which the loader then uses in place
+static const char* container_decompress(uint8_t** buff, size_t* size)
+{
+    if (*size < CONTAINER_HEADER_LENGTH)
+    {
+        return "Compressed data is truncated";
+    }
+    const uint8_t* container = *buff;
+    size_t position = 4;
+    uint16_t version = READ_U16(container, position);
+    if (version != CONTAINER_VERSION)
+    {
+        return "Invalid VM Version";
+    }
 
-    for (uint16_t i = 0; i < bundle->moduleCount; i++)
+    uint32_t length = READ_U32(container, position);
+    uint32_t compressed = READ_U32(container, position);
+    if (compressed > *size - position)
     {
-        module_load_from_buffer_offset(buff, &bundle->modules[i], &position);
-        bundle->modules[i].bundle = bundle;
+        return "Compressed data is truncated";
     }
+    uint8_t* image = vm_alloc_bytes(length);
+    if (lz_decompress(container + position, compressed, image, length) != length)
+    {
+        return "Compressed data is corrupt";
+    }
+    *buff = image;
+    *size = length;
+    return NULL;
 }
 
-LoadResult unknown_load_from_buffer(uint8_t* buff, JSModule* module, JSBundle* bundle)
+LoadResult unknown_load_from_buffer(uint8_t* buff, size_t size, JSModule* module, JSBundle* bundle)
 {
-    if (buff[0] == MODULE_MAGIC0 &&
+    if (size < 4)
+    {
+        return load_result(LOAD_INVALID, "Invalid magic number");
+    }
+    if (buff[0] == CONTAINER_MAGIC0 &&
+        buff[1] == CONTAINER_MAGIC1 &&
+        buff[2] == CONTAINER_MAGIC2 &&
+        buff[3] == CONTAINER_MAGIC3)
+    {
+        const char* rejection = container_decompress(&buff, &size);
+        if (rejection)
+        {
+            return load_result(LOAD_INVALID, rejection);
+        }
+    }
+
+    if (size >= 4 &&
+        buff[0] == MODULE_MAGIC0 &&
         buff[1] == MODULE_MAGIC1 &&
         buff[2] == MODULE_MAGIC2 &&
         buff[3] == MODULE_MAGIC3)
     {
-        module_load_from_buffer(buff, module);
-        return LOAD_MODULE;
+        return module_load_from_buffer(buff, size, module);
     }
 
-    bundle_load_from_buffer(buff, bundle);
-    return LOAD_BUNDLE;
+    return bundle_load_from_buffer(buff, size, bundle);
 }
@@ -2,21 +2,66 @@
 #define LOADER_H
 
 #include <inttypes.h>
+#include <stddef.h>
 
 #include "format.h"
 
 typedef enum LoadResult LoadResult;
 
-void module_load_from_file(const char* filename, JSModule* module);
+/**
+ * Why the last load of the host returned LOAD_INVALID. A rejected image has run none of its code.
+ */
+const char* loader_get_rejection(void);
 
-void module_load_from_buffer(uint8_t* buff, JSModule* module);
+LoadResult module_load_from_file(const char* filename, JSModule* module);
 
-void bundle_load_from_file(const char* filename, JSBundle* bundle);
+/**
+ * The image is used in place and checked against its size before anything is read from it. Every function
+ * body is verified, but only decoded once it is called.
+ */
+LoadResult module_load_from_buffer(uint8_t* buff, size_t size, JSModule* module);
 
-void bundle_load_from_buffer(uint8_t* buff, JSBundle* bundle);
+LoadResult bundle_load_from_file(const char* filename, JSBundle* bundle);
+
+/**
+ * Only reads the header and the module index, modules are decoded by module_table_get on demand
+ */
+LoadResult bundle_load_from_buffer(uint8_t* buff, size_t size, JSBundle* bundle);
+
+/**
+ * Decodes and verifies the module at index unless it already is, returns why it is rejected or NULL
+ */
+const char* bundle_decode_module(JSBundle* bundle, uint32_t index, JSModule** module);
+
+#ifdef GC_THREADS
+/**
+ * Decodes every module that is not decoded yet, spread over up to threads threads (0 uses one per core).
+ * The modules end up exactly as bundle_decode_module leaves them. Only threaded engines have it.
+ */
+void bundle_decode_all(JSBundle* bundle, size_t threads);
+#endif
 
 LoadResult unknown_load_from_file(const char* filename, JSModule* module, JSBundle* bundle);
 
-LoadResult unknown_load_from_buffer(uint8_t* buff, JSModule* module, JSBundle* bundle);
+/**
+ * Loads a module or a bundle, either of them may be wrapped in a compressed container
+ */
+LoadResult unknown_load_from_buffer(uint8_t* buff, size_t size, JSModule* module, JSBundle* bundle);
+
+/**
+ * Builds the instruction table of the function body starting at instruction_start. The body was verified
+ * when the module was loaded, which also found the depth of its frames.
+ */
+void module_decode_function(JSModule* module, size_t instruction_start);
+
+/**
+ * Map the file read-only instead of reading it. Strings, constants, handler tables and instructions without
+ * operands are used from the mapping directly, so only the pages that are actually executed get loaded.
+ */
+LoadResult module_map_file(const char* filename, JSModule* module);
+
+LoadResult bundle_map_file(const char* filename, JSBundle* bundle);
+
+LoadResult unknown_map_file(const char* filename, JSModule* module, JSBundle* bundle);
 
 #endif //LOADER_H
@@ -5,7 +5,9 @@
 
 enum LoadResult {
     LOAD_BUNDLE,
-    LOAD_MODULE
+    LOAD_MODULE,
+    // The image is malformed or fails verification, see loader_get_rejection
+    LOAD_INVALID
 };
 
 #endif //LOADER_IMPL_H
\ No newline at end of file
@@ -0,0 +1,564 @@
+#include "nursery.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <gc.h>
+
+#include "panic.h"
+#include "weak.h"
+
+#include "dict.impl.h"
+#include "upvalue.impl.h"
+
+// Chunks are handed out whole and cleared once none of their objects is pinned
+#define NURSERY_CHUNK_SIZE (32 * 1024)
+// Larger objects, e.g. the buckets of big dicts, are allocated in the collected heap right away
+#define NURSERY_MAX_OBJECT (NURSERY_CHUNK_SIZE / 8)
+#define NURSERY_GRANULE 8
+#define NURSERY_MIN_REMEMBERED 64
+// Allocations that go to the collected heap before a nursery that had no chunk left is collected again
+#define NURSERY_FALLBACK_ALLOCATIONS 4096
+
+#define NURSERY_PINNED 1
+#define NURSERY_FORWARDED 2
+
+// Precedes every young object, whose first word receives the address of its copy once it is promoted
+typedef struct
+{
+    uint32_t size;
+    uint8_t kind;
+    uint8_t flags;
+} NurseryHeader;
+
+typedef struct
+{
+    // Bytes handed out, 0 while the chunk is free
+    size_t top;
+    // Holds an object the last minor collection pinned
+    int pinned;
+} NurseryChunk;
+
+typedef struct
+{
+    void* object;
+    size_t size;
+    HeapAllocKind kind;
+} NurseryCopy;
+
+uintptr_t nursery_start = 0;
+size_t nursery_size = 0;
+
+static NurseryChunk* chunks = NULL;
+static size_t chunk_count = 0;
+static size_t current = 0;
+static uint8_t* alloc_top = NULL;
+static uint8_t* alloc_limit = NULL;
+static size_t fallbacks = 0;
+// One bit per granule, set where an object starts, so pointers into objects can be resolved
+static uint64_t* starts = NULL;
+
+// Objects of the collected heap holding young pointers, in the order they were remembered, which keeps what
+// they hold close together once it is promoted. The collector does not recognize pointers into objects, so
+// they are remembered by their start. The list is uncollectable, which keeps them alive until the next minor
+// collection traced them.
+static void** remembered = NULL;
+static uint8_t* remembered_kinds = NULL;
+static size_t remembered_capacity = 0;
+static size_t remembered_count = 0;
+// Open addressing set of the positions in the list plus 1, so holders are only remembered once
+static uint32_t* remembered_index = NULL;
+static size_t remembered_index_capacity = 0;
+
+// Worklists of a minor collection
+static NurseryHeader** pinned = NULL;
+static size_t pinned_count = 0;
+static size_t pinned_capacity = 0;
+static NurseryCopy* copies = NULL;
+static size_t copy_count = 0;
+static size_t copy_capacity = 0;
+
+static NurseryStats stats = {0};
+
+static void nursery_reserve(void** array, size_t* capacity, size_t count, size_t element)
+{
+    if (count < *capacity)
+    {
+        return;
+    }
+    size_t resized_capacity = *capacity ? *capacity * 2 : 256;
+    void* resized = realloc(*array, resized_capacity * element);
+    if (!resized)
+    {
+        PANIC("Could not allocate memory");
+    }
+    *array = resized;
+    *capacity = resized_capacity;
+}
+
+static inline uint8_t* nursery_chunk_base(size_t chunk)
+{
+    return (uint8_t*)nursery_start + chunk * NURSERY_CHUNK_SIZE;
+}
+
+void nursery_init(size_t size)
+{
+    chunk_count = (size + NURSERY_CHUNK_SIZE - 1) / NURSERY_CHUNK_SIZE;
+    if (!chunk_count)
+    {
+        return;
+    }
+    size = chunk_count * NURSERY_CHUNK_SIZE;
+
+    void* memory = calloc(1, size);
+    starts = calloc(size / NURSERY_GRANULE / 64, sizeof(uint64_t));
+    chunks = calloc(chunk_count, sizeof(NurseryChunk));
+    if (!memory || !starts || !chunks)
+    {
+        PANIC("Could not allocate memory");
+    }
+
+    // Young objects keep what they point to in the collected heap alive, they are scanned conservatively
+    GC_add_roots(memory, (uint8_t*)memory + size);
+    nursery_start = (uintptr_t)memory;
+    nursery_size = size;
+    stats.size = size;
+}
+
+// Returns the header of the object the address points into or just past, NULL if it is in no object
+static NurseryHeader* nursery_find(uintptr_t address, size_t* offset)
+{
+    size_t position = address - nursery_start;
+    size_t chunk = position / NURSERY_CHUNK_SIZE;
+    if (position - chunk * NURSERY_CHUNK_SIZE >= chunks[chunk].top)
+    {
+        return NULL;
+    }
+
+    // Pointers to the start of an object are by far the most common
+    size_t granule = position / NURSERY_GRANULE;
+    size_t word = granule / 64;
+    if (!(position % NURSERY_GRANULE) && starts[word] >> (granule % 64) & 1)
+    {
+        *offset = 0;
+        return (NurseryHeader*)address - 1;
+    }
+
+    // Chunks span whole words of the bitmap, so the search ends at the first word of the chunk
+    size_t first = chunk * NURSERY_CHUNK_SIZE / NURSERY_GRANULE / 64;
+    uint64_t bits = starts[word] & (~(uint64_t)0 >> (63 - granule % 64));
+    while (!bits)
+    {
+        if (word == first)
+        {
+            return NULL;
+        }
+        bits = starts[--word];
+    }
+    size_t bit = 63;
+    while (!(bits >> bit & 1))
+    {
+        bit--;
+    }
+
+    size_t start = (word * 64 + bit) * NURSERY_GRANULE;
+    NurseryHeader* header = (NurseryHeader*)(nursery_start + start) - 1;
+    if (position - start > header->size)
+    {
+        return NULL;
+    }
+    *offset = position - start;
+    return header;
+}
+
+// The top of the chunk being allocated from is only stored when objects are looked up
+static void nursery_store_top(void)
+{
+    if (alloc_top)
+    {
+        chunks[current].top = (size_t)(alloc_top - nursery_chunk_base(current));
+    }
+}
+
+static void nursery_retire_chunk(void)
+{
+    nursery_store_top();
+    alloc_top = NULL;
+    alloc_limit = NULL;
+}
+
+static int nursery_take_chunk(void)
+{
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        size_t chunk = (current + i) % chunk_count;
+        if (!chunks[chunk].top)
+        {
+            current = chunk;
+            alloc_top = nursery_chunk_base(chunk);
+            alloc_limit = alloc_top + NURSERY_CHUNK_SIZE;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int nursery_refill(size_t bytes)
+{
+    if (bytes > NURSERY_MAX_OBJECT || !chunk_count)
+    {
+        return 0;
+    }
+    nursery_retire_chunk();
+    if (nursery_take_chunk())
+    {
+        return 1;
+    }
+    if (fallbacks)
+    {
+        fallbacks--;
+        return 0;
+    }
+
+    nursery_collect();
+    // Promotions may be all the heap allocates, they are not collected while collections are disabled
+    GC_collect_a_little();
+    if (nursery_take_chunk())
+    {
+        return 1;
+    }
+    // Every chunk is pinned or collections are suppressed
+    fallbacks = NURSERY_FALLBACK_ALLOCATIONS;
+    return 0;
+}
+
+void* nursery_alloc(size_t size, HeapAllocKind kind)
+{
+    size_t bytes = sizeof(NurseryHeader) + ((size + NURSERY_GRANULE - 1) & ~(size_t)(NURSERY_GRANULE - 1));
+    if (bytes > (size_t)(alloc_limit - alloc_top) && !nursery_refill(bytes))
+    {
+        return NULL;
+    }
+
+    NurseryHeader* header = (NurseryHeader*)alloc_top;
+    alloc_top += bytes;
+    header->size = (uint32_t)(bytes - sizeof(NurseryHeader));
+    header->kind = (uint8_t)kind;
+
+    size_t granule = ((uintptr_t)(header + 1) - nursery_start) / NURSERY_GRANULE;
+    starts[granule / 64] |= (uint64_t)1 << (granule % 64);
+    return header + 1;
+}
+
+static inline size_t nursery_hash(const void* holder, size_t capacity)
+{
+    return (size_t)(((uint64_t)(uintptr_t)holder >> 4) * 0x9E3779B97F4A7C15ull >> 32) & (capacity - 1);
+}
+
+// Returns the slot of the index the holder is found at or has to be inserted at
+static uint32_t* nursery_lookup(const void* holder)
+{
+    size_t mask = remembered_index_capacity - 1;
+    for (size_t slot = nursery_hash(holder, remembered_index_capacity);; slot = (slot + 1) & mask)
+    {
+        uint32_t position = remembered_index[slot];
+        if (!position || remembered[position - 1] == holder)
+        {
+            return &remembered_index[slot];
+        }
+    }
+}
+
+static void nursery_grow_remembered(void)
+{
+    size_t capacity = remembered_capacity ? remembered_capacity * 2 : NURSERY_MIN_REMEMBERED;
+    void** holders = GC_malloc_uncollectable(capacity * sizeof(void*));
+    uint8_t* kinds = realloc(remembered_kinds, capacity);
+    uint32_t* index = calloc(capacity * 2, sizeof(uint32_t));
+    if (!holders || !kinds || !index)
+    {
+        PANIC("Could not allocate memory");
+    }
+    memcpy(holders, remembered, remembered_count * sizeof(void*));
+    GC_free(remembered);
+    free(remembered_index);
+    remembered = holders;
+    remembered_kinds = kinds;
+    remembered_capacity = capacity;
+    remembered_index = index;
+    remembered_index_capacity = capacity * 2;
+    for (size_t i = 0; i < remembered_count; i++)
+    {
+        *nursery_lookup(remembered[i]) = (uint32_t)(i + 1);
+    }
+}
+
+void nursery_remember(void* holder, HeapAllocKind kind)
+{
+    if (remembered_count == remembered_capacity)
+    {
+        nursery_grow_remembered();
+    }
+    uint32_t* position = nursery_lookup(holder);
+    if (*position)
+    {
+        return;
+    }
+    remembered[remembered_count] = holder;
+    remembered_kinds[remembered_count] = (uint8_t)kind;
+    *position = (uint32_t)++remembered_count;
+}
+
+static void nursery_pin(void* pointer)
+{
+    size_t offset;
+    NurseryHeader* header = nursery_find((uintptr_t)pointer, &offset);
+    // Objects promoted by an earlier collection are left behind in pinned chunks, nothing live points to them
+    if (!header || header->flags)
+    {
+        return;
+    }
+    header->flags = NURSERY_PINNED;
+    chunks[((uintptr_t)header - nursery_start) / NURSERY_CHUNK_SIZE].pinned = 1;
+    nursery_reserve((void**)&pinned, &pinned_capacity, pinned_count, sizeof(NurseryHeader*));
+    pinned[pinned_count++] = header;
+}
+
+static void* nursery_evacuate(void* pointer)
+{
+    size_t offset;
+    NurseryHeader* header = nursery_find((uintptr_t)pointer, &offset);
+    if (!header || header->flags & NURSERY_PINNED)
+    {
+        return pointer;
+    }
+
+    void** object = (void**)(header + 1);
+    if (!(header->flags & NURSERY_FORWARDED))
+    {
+        void* copy = heap_alloc(header->size, header->kind, HEAP_SITE);
+        memcpy(copy, object, header->size);
+        header->flags = NURSERY_FORWARDED;
+        *object = copy;
+
+        nursery_reserve((void**)&copies, &copy_capacity, copy_count, sizeof(NurseryCopy));
+        copies[copy_count++] = (NurseryCopy){.object = copy, .size = header->size, .kind = header->kind};
+        stats.promoted_bytes += header->size;
+    }
+    return (uint8_t*)*object + offset;
+}
+
+// Returns 1 if the slot still points into the nursery, to a pinned object
+static inline int nursery_update(void** slot)
+{
+    if (!nursery_contains(*slot))
+    {
+        return 0;
+    }
+    *slot = nursery_evacuate(*slot);
+    return nursery_contains(*slot);
+}
+
+static inline int nursery_update_value(JSValue* value)
+{
+    return value->type == JS_OBJECT && nursery_update(&value->value.as_pointer);
+}
+
+
+// Promotes what the object points to, returns 1 if it still points into the nursery
+static int nursery_scan(void* object, size_t size, HeapAllocKind kind)
+{
+    int young = 0;
+    switch (kind)
+    {
+    case HEAP_ALLOC_PROPERTY:
+        young |= nursery_update_value(&((JSProperty*)object)->value);
+        young |= nursery_update((void**)&((JSProperty*)object)->next);
+        break;
+    case HEAP_ALLOC_UPVALUE:
+        young |= nursery_update_value(&((JSUpvalue*)object)->closed);
+        break;
+    case HEAP_ALLOC_VALUES:
+        for (size_t i = 0; i < size / sizeof(JSValue); i++)
+        {
+            young |= nursery_update_value(&((JSValue*)object)[i]);
+        }
+        break;
+    default:
+        // Objects hold pointers and counts, a count never falls into the nursery
+        for (size_t i = 0; i < size / sizeof(void*); i++)
+        {
+            young |= nursery_update(&((void**)object)[i]);
+        }
+        break;
+    }
+    return young;
+}
+
+static void nursery_scan_stack(void)
+{
+    struct GC_stack_base base;
+    GC_get_my_stackbottom(&base);
+    volatile uintptr_t marker = 0;
+    for (void** word = (void**)((uintptr_t)&marker & ~(uintptr_t)(sizeof(void*) - 1)); word < (void**)base.mem_base; word++)
+    {
+        if (nursery_contains(*word))
+        {
+            nursery_pin(*word);
+        }
+    }
+}
+
+// Copies are scanned depth first, right after the root they were reached from, so objects that point to
+// each other end up close together, as if they had been allocated in the collected heap
+static void nursery_drain(void)
+{
+    while (copy_count)
+    {
+        NurseryCopy copy = copies[--copy_count];
+        if (nursery_scan(copy.object, copy.size, copy.kind))
+        {
+            nursery_remember(copy.object, copy.kind);
+        }
+    }
+}
+
+static void nursery_update_root(void** slot)
+{
+    nursery_update(slot);
+    nursery_drain();
+}
+
+static void nursery_scan_remembered(void)
+{
+    void** holders = remembered;
+    uint8_t* kinds = remembered_kinds;
+    size_t count = remembered_count;
+    free(remembered_index);
+    remembered = NULL;
+    remembered_kinds = NULL;
+    remembered_index = NULL;
+    remembered_capacity = 0;
+    remembered_index_capacity = 0;
+    remembered_count = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (nursery_scan(holders[i], GC_size(holders[i]), kinds[i]))
+        {
+            nursery_remember(holders[i], kinds[i]);
+        }
+        nursery_drain();
+    }
+    GC_free(holders);
+    free(kinds);
+}
+
+static void nursery_clear_chunk(size_t chunk)
+{
+    memset(nursery_chunk_base(chunk), 0, chunks[chunk].top);
+    memset(&starts[chunk * NURSERY_CHUNK_SIZE / NURSERY_GRANULE / 64], 0, NURSERY_CHUNK_SIZE / NURSERY_GRANULE / 8);
+    chunks[chunk].top = 0;
+}
+
+// The registers are spilled by the caller, so the scan of the stack sees the pointers held in them
+static void nursery_collect_spilled(void)
+{
+    double start = heap_now_ms();
+    GC_disable();
+    nursery_retire_chunk();
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        chunks[i].pinned = 0;
+    }
+
+    // Everything the stack points into is pinned before anything is moved
+    nursery_scan_stack();
+    heap_visit_roots(nursery_update_root);
+    nursery_scan_remembered();
+    for (size_t i = 0; i < pinned_count; i++)
+    {
+        nursery_scan(pinned[i] + 1, pinned[i]->size, pinned[i]->kind);
+        nursery_drain();
+    }
+    weak_update_young();
+
+    for (size_t i = 0; i < pinned_count; i++)
+    {
+        pinned[i]->flags = 0;
+    }
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        if (!chunks[i].pinned)
+        {
+            nursery_clear_chunk(i);
+        }
+    }
+    stats.pinned += pinned_count;
+    pinned_count = 0;
+    current = 0;
+    GC_enable();
+
+    double pause = heap_now_ms() - start;
+    stats.collections++;
+    stats.total_ms += pause;
+    if (pause > stats.max_ms)
+    {
+        stats.max_ms = pause;
+    }
+}
+
+// Called through a pointer, so it is not inlined into the frame that spills the registers
+static void (*volatile nursery_collect_with_stack)(void) = nursery_collect_spilled;
+
+void nursery_collect(void)
+{
+    if (!chunk_count || GC_is_disabled())
+    {
+        return;
+    }
+
+#if defined(__GNUC__) || defined(__clang__)
+    // setjmp may mangle the registers it saves
+    __builtin_unwind_init();
+#endif
+    jmp_buf registers;
+    setjmp(registers);
+    nursery_collect_with_stack();
+}
+
+void* nursery_forward(void* pointer)
+{
+    if (!nursery_contains(pointer))
+    {
+        return pointer;
+    }
+    size_t offset;
+    NurseryHeader* header = nursery_find((uintptr_t)pointer, &offset);
+    if (!header)
+    {
+        return NULL;
+    }
+    if (header->flags & NURSERY_FORWARDED)
+    {
+        return (uint8_t*)*(void**)(header + 1) + offset;
+    }
+    return header->flags & NURSERY_PINNED ? pointer : NULL;
+}
+
+size_t nursery_object_size(const void* pointer)
+{
+    if (!nursery_contains(pointer))
+    {
+        return 0;
+    }
+    nursery_store_top();
+    size_t offset;
+    NurseryHeader* header = nursery_find((uintptr_t)pointer, &offset);
+    return header ? header->size : 0;
+}
+
+NurseryStats nursery_get_stats(void)
+{
+    return stats;
+}
@@ -0,0 +1,92 @@
+#ifndef NURSERY_H
+#define NURSERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "heap.h"
+#include "value.h"
+
+#include "value.impl.h"
+
+typedef struct NurseryStats
+{
+    size_t size;
+    size_t collections;
+    size_t promoted_bytes;
+    size_t pinned;
+    double total_ms;
+    double max_ms;
+} NurseryStats;
+
+// Bounds of the nursery, read by the barriers below. The size stays 0 while there is no nursery.
+extern uintptr_t nursery_start;
+extern size_t nursery_size;
+
+/**
+ * Reserves size bytes, rounded up to whole chunks, for young objects. 0 leaves every object in the collected
+ * heap. Runs from heap_init, after the collector was initialized.
+ */
+void nursery_init(size_t size);
+
+/**
+ * Bumps a cleared object of the kind, HEAP_ALLOC_OBJECT or HEAP_ALLOC_PROPERTY, off the nursery and collects
+ * it when it is full. Returns NULL if the object has to be allocated in the collected heap instead: there is
+ * no nursery, the object is too large, collections are suppressed or every chunk is pinned.
+ */
+void* nursery_alloc(size_t size, HeapAllocKind kind);
+
+/**
+ * Promotes every reachable young object into the collected heap and clears the nursery. Objects a word on
+ * the stack of the calling thread points into are pinned and stay where they are, so native code may keep
+ * young pointers in its locals. Has no effect while collections are suppressed.
+ */
+void nursery_collect(void);
+
+/**
+ * Adds an object of the collected heap to the remembered set, which the next minor collection traces as a
+ * root. Called by the barriers below.
+ */
+void nursery_remember(void* holder, HeapAllocKind kind);
+
+/**
+ * Returns where a young object is after the minor collection that is finishing: its copy, itself if it was
+ * pinned or NULL if it was collected. Other pointers are returned unchanged. Only valid while
+ * weak_update_young runs.
+ */
+void* nursery_forward(void* pointer);
+
+/**
+ * Bytes of the young object the pointer points into, 0 if it points into none
+ */
+size_t nursery_object_size(const void* pointer);
+
+NurseryStats nursery_get_stats(void);
+
+static inline int nursery_contains(const void* pointer)
+{
+    return (uintptr_t)pointer - nursery_start < nursery_size;
+}
+
+/**
+ * Has to follow every store of a pointer that may be young into an object that may not be. The holder is
+ * the start of that object and kind the one it was allocated with.
+ */
+static inline void nursery_barrier(void* holder, HeapAllocKind kind, const void* target)
+{
+    if (nursery_contains(target) && !nursery_contains(holder))
+    {
+        nursery_remember(holder, kind);
+    }
+}
+
+// Only objects are allocated young, so other values never need to be remembered
+static inline void nursery_barrier_value(void* holder, HeapAllocKind kind, JSValue value)
+{
+    if (value.type == JS_OBJECT)
+    {
+        nursery_barrier(holder, kind, value.value.as_pointer);
+    }
+}
+
+#endif //NURSERY_H
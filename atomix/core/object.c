@@ -1,23 +1,35 @@
 #include "object.impl.h"
 
 #include <string.h>
-#include <gc.h>
 
 #include "api.h"
-#include "panic.h"
-
+#include "heap.h"
+#include "nursery.h"
 #include "value.impl.h"
+#include "symbol.impl.h"
 
-#define OBJECT_BUCKET_SIZE 16
+#define OBJECT_BUCKET_SIZE 4
 
 JSObject* object_create_object(JSObject* prototype)
 {
-    JSObject* obj = GC_malloc(sizeof(JSObject));
+    JSObject* obj = vm_alloc_object(sizeof(JSObject));
     obj->prototype = prototype;
+    nursery_barrier(obj, HEAP_ALLOC_OBJECT, prototype);
     obj->properties = dict_create_dict(OBJECT_BUCKET_SIZE);
     return obj;
 }
 
+// The nursery may be full, then the object ends up in the heap while its dict is still young
+JSObject* object_create_young_object(JSObject* prototype)
+{
+    JSObject* obj = vm_alloc_young_object(sizeof(JSObject));
+    obj->prototype = prototype;
+    nursery_barrier(obj, HEAP_ALLOC_OBJECT, prototype);
+    obj->properties = dict_create_young_dict(OBJECT_BUCKET_SIZE);
+    nursery_barrier(obj, HEAP_ALLOC_OBJECT, obj->properties);
+    return obj;
+}
+
 void object_set_property(VM* vm, JSObject* obj, char* key, JSValue value)
 {
     JSValue* prop = dict_get(obj->properties, key);
@@ -28,13 +40,13 @@ void object_set_property(VM* vm, JSObject* obj, char* key, JSValue value)
             JSGSBox* box = prop->value.as_pointer;
             if (!box->setter)
             {
-                // TODO throw exception
-                PANIC("Property contains no setter");
+                api_throw_error(vm, object_get_type_error_prototype(), "Cannot set property which has only a getter");
+                return;
             }
             api_call_function(vm, box->setter, JS_VALUE_OBJECT(obj), &value, 1);
             return;
         }
-        *prop = value;
+        dict_store(prop, value);
         return;
     }
 
@@ -51,13 +63,13 @@ void object_set_property_with_symbol(VM* vm, JSObject* obj, void* symbol, JSValu
             JSGSBox* box = prop->value.as_pointer;
             if (!box->setter)
             {
-                // TODO throw exception
-                PANIC("Property contains no setter");
+                api_throw_error(vm, object_get_type_error_prototype(), "Cannot set property which has only a getter");
+                return;
             }
             api_call_function(vm, box->setter, JS_VALUE_OBJECT(obj), &value, 1);
             return;
         }
-        *prop = value;
+        dict_store(prop, value);
         return;
     }
 
@@ -75,8 +87,7 @@ JSValue object_get_property(VM* vm, JSObject* obj, char* key)
             JSGSBox* box = value->value.as_pointer;
             if (!box->getter)
             {
-                // TODO throw exception
-                PANIC("Property contains no getter");
+                return JS_VALUE_UNDEFINED;
             }
 
             return api_call_function(vm, box->getter, JS_VALUE_OBJECT(obj), NULL, 0);
@@ -103,8 +114,7 @@ JSValue object_get_property_by_symbol(VM* vm, JSObject* obj, void* symbol)
             JSGSBox* box = value->value.as_pointer;
             if (!box->getter)
             {
-                // TODO throw exception
-                PANIC("Property contains no getter");
+                return JS_VALUE_UNDEFINED;
             }
 
             return api_call_function(vm, box->getter, JS_VALUE_OBJECT(obj), NULL, 0);
@@ -170,4 +180,138 @@ JSObject* object_get_symbol_prototype()
     }
 
     return symbol_prototype;
-}
\ No newline at end of file
+}
+
+static JSObject* object_create_error_prototype(JSObject* prototype, char* name)
+{
+    JSObject* error = object_create_object(prototype);
+    dict_add(error->properties, init_string("name"), JS_VALUE_STRING(init_string(name)));
+    dict_add(error->properties, init_string("message"), JS_VALUE_STRING(init_string("")));
+    return error;
+}
+
+JSObject* error_prototype = NULL;
+
+JSObject* object_get_error_prototype()
+{
+    if (!error_prototype)
+    {
+        error_prototype = object_create_error_prototype(object_get_object_prototype(), "Error");
+    }
+
+    return error_prototype;
+}
+
+JSObject* type_error_prototype = NULL;
+
+JSObject* object_get_type_error_prototype()
+{
+    if (!type_error_prototype)
+    {
+        type_error_prototype = object_create_error_prototype(object_get_error_prototype(), "TypeError");
+    }
+
+    return type_error_prototype;
+}
+
+JSObject* range_error_prototype = NULL;
+
+JSObject* object_get_range_error_prototype()
+{
+    if (!range_error_prototype)
+    {
+        range_error_prototype = object_create_error_prototype(object_get_error_prototype(), "RangeError");
+    }
+
+    return range_error_prototype;
+}
+
+JSObject* reference_error_prototype = NULL;
+
+JSObject* object_get_reference_error_prototype()
+{
+    if (!reference_error_prototype)
+    {
+        reference_error_prototype = object_create_error_prototype(object_get_error_prototype(), "ReferenceError");
+    }
+
+    return reference_error_prototype;
+}
+
+JSObject* generator_prototype = NULL;
+
+JSObject* object_get_generator_prototype()
+{
+    // Shared by all generator objects, next and Symbol.iterator are attached by the core module
+    if (!generator_prototype)
+    {
+        generator_prototype = object_create_object(object_get_object_prototype());
+    }
+
+    return generator_prototype;
+}
+
+JSObject* weak_ref_prototype = NULL;
+
+JSObject* object_get_weak_ref_prototype()
+{
+    // Methods are attached by the core module, like the ones of generators
+    if (!weak_ref_prototype)
+    {
+        weak_ref_prototype = object_create_object(object_get_object_prototype());
+    }
+
+    return weak_ref_prototype;
+}
+
+JSObject* weak_map_prototype = NULL;
+
+JSObject* object_get_weak_map_prototype()
+{
+    if (!weak_map_prototype)
+    {
+        weak_map_prototype = object_create_object(object_get_object_prototype());
+    }
+
+    return weak_map_prototype;
+}
+
+JSObject** const object_builtin_roots[] = {
+    &object_prototype,
+    &array_prototype,
+    &function_prototype,
+    &symbol_prototype,
+    &error_prototype,
+    &type_error_prototype,
+    &range_error_prototype,
+    &reference_error_prototype,
+    &generator_prototype,
+    &weak_ref_prototype,
+    &weak_map_prototype,
+    &to_primitive_symbol,
+    &iterator_symbol
+};
+
+const size_t object_builtin_root_count = sizeof(object_builtin_roots) / sizeof(object_builtin_roots[0]);
+
+// Only the address is used, it can never collide with a symbol object
+static char internal_key;
+
+void object_set_internal(JSObject* obj, void* data)
+{
+    JSValue* prop = dict_get_by_symbol(obj->properties, &internal_key);
+    if (prop)
+    {
+        prop->value.as_pointer = data;
+        return;
+    }
+
+    dict_add_with_symbol(obj->properties, &internal_key, (JSValue){.type = JS_INTERNAL, .value.as_pointer = data});
+}
+
+void* object_get_internal(JSObject* obj)
+{
+    // Not inherited, an object created with such an object as prototype holds no host data
+    JSValue* prop = dict_get_by_symbol(obj->properties, &internal_key);
+    return prop ? prop->value.as_pointer : NULL;
+}
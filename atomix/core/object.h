@@ -8,6 +8,11 @@ typedef struct JSObject JSObject;
 
 JSObject* object_create_object(JSObject* prototype);
 
+/**
+ * Allocates the object in the nursery, for literals and other objects that mostly die young
+ */
+JSObject* object_create_young_object(JSObject* prototype);
+
 void object_set_property(VM* vm, JSObject* obj, char* key, JSValue value);
 
 void object_set_property_with_symbol(VM* vm, JSObject* obj, void* symbol, JSValue value);
@@ -24,4 +29,25 @@ JSObject* object_get_function_prototype();
 
 JSObject* object_get_symbol_prototype();
 
+JSObject* object_get_error_prototype();
+
+JSObject* object_get_type_error_prototype();
+
+JSObject* object_get_range_error_prototype();
+
+JSObject* object_get_reference_error_prototype();
+
+JSObject* object_get_generator_prototype();
+
+JSObject* object_get_weak_ref_prototype();
+
+JSObject* object_get_weak_map_prototype();
+
+/**
+ * Attaches host data to an object. Built-in objects like generators keep their native state here.
+ */
+void object_set_internal(JSObject* obj, void* data);
+
+void* object_get_internal(JSObject* obj);
+
 #endif //OBJECT_H
@@ -11,4 +11,22 @@ struct JSObject
     JSDict* properties;
 };
 
+// Created on first use through the object_get_*_prototype functions
+extern JSObject* object_prototype;
+extern JSObject* array_prototype;
+extern JSObject* function_prototype;
+extern JSObject* symbol_prototype;
+extern JSObject* error_prototype;
+extern JSObject* type_error_prototype;
+extern JSObject* range_error_prototype;
+extern JSObject* reference_error_prototype;
+extern JSObject* generator_prototype;
+extern JSObject* weak_ref_prototype;
+extern JSObject* weak_map_prototype;
+
+// The built-ins the core keeps outside of the global scope: the prototypes above and the well-known symbols.
+// Snapshots save and restore them, the census counts them as roots.
+extern JSObject** const object_builtin_roots[];
+extern const size_t object_builtin_root_count;
+
 #endif //OBJECT_IMPL_H
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "parallel.h"
+
+#ifdef GC_THREADS
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// Includes the thread redirects of the collector, threads started below are registered with it
+#include <gc.h>
+
+typedef struct
+{
+    ParallelTask task;
+    void* context;
+    size_t count;
+    size_t next;
+} ParallelJob;
+
+// Indices are handed out one at a time, so a few large tasks do not leave the other threads idle
+static void parallel_work(ParallelJob* job)
+{
+    size_t index;
+    while ((index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count)
+    {
+        job->task(job->context, index);
+    }
+}
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+
+static DWORD WINAPI parallel_thread(LPVOID job)
+{
+    parallel_work(job);
+    return 0;
+}
+
+static int thread_start(Thread* thread, ParallelJob* job)
+{
+    *thread = CreateThread(NULL, 0, parallel_thread, job, 0, NULL);
+    return *thread != NULL;
+}
+
+static void thread_join(Thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+size_t parallel_cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t Thread;
+
+static void* parallel_thread(void* job)
+{
+    parallel_work(job);
+    return NULL;
+}
+
+static int thread_start(Thread* thread, ParallelJob* job)
+{
+    return pthread_create(thread, NULL, parallel_thread, job) == 0;
+}
+
+static void thread_join(Thread thread)
+{
+    pthread_join(thread, NULL);
+}
+
+size_t parallel_cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t)count : 1;
+}
+#endif
+
+void parallel_for(size_t threads, size_t count, ParallelTask task, void* context)
+{
+    ParallelJob job = { task, context, count, 0 };
+    if (threads == 0)
+    {
+        threads = parallel_cpu_count();
+    }
+    if (threads > count)
+    {
+        threads = count;
+    }
+
+    // Threads that fail to start are not needed for correctness, the remaining ones take over their share
+    Thread* workers = threads > 1 ? malloc((threads - 1) * sizeof(Thread)) : NULL;
+    size_t started = 0;
+    while (workers && started < threads - 1 && thread_start(&workers[started], &job))
+    {
+        started++;
+    }
+
+    parallel_work(&job);
+    for (size_t i = 0; i < started; i++)
+    {
+        thread_join(workers[i]);
+    }
+    free(workers);
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+// Threads only register with collectors built for them, so the pool exists in threaded engines only
+#ifdef GC_THREADS
+
+typedef void (*ParallelTask)(void* context, size_t index);
+
+/**
+ * Runs task for every index in [0, count) on up to threads threads, 0 uses one per core. The calling
+ * thread takes part and the call returns once every index is done. Workers are registered with the
+ * collector, so tasks may allocate.
+ */
+void parallel_for(size_t threads, size_t count, ParallelTask task, void* context);
+
+size_t parallel_cpu_count(void);
+
+#endif
+
+#endif //PARALLEL_H
@@ -1,25 +1,36 @@
 #include "scope.impl.h"
 
-#include <gc.h>
-
+#include "heap.h"
+#include "nursery.h"
 #include "value.impl.h"
 
-#define SCOPE_BUCKET_SIZE 32
+#define SCOPE_BUCKET_SIZE 8
 
 Scope* scope_create_scope(Scope* parent)
 {
-    Scope* scope = GC_malloc(sizeof(Scope));
+    Scope* scope = vm_alloc_object(sizeof(Scope));
     scope->parent = parent;
+    nursery_barrier(scope, HEAP_ALLOC_OBJECT, parent);
     scope->symbols = dict_create_dict(SCOPE_BUCKET_SIZE);
     return scope;
 }
 
+Scope* scope_create_young_scope(Scope* parent)
+{
+    Scope* scope = vm_alloc_young_object(sizeof(Scope));
+    scope->parent = parent;
+    nursery_barrier(scope, HEAP_ALLOC_OBJECT, parent);
+    scope->symbols = dict_create_young_dict(SCOPE_BUCKET_SIZE);
+    nursery_barrier(scope, HEAP_ALLOC_OBJECT, scope->symbols);
+    return scope;
+}
+
 int scope_set(const Scope* scope, char* key, JSValue value)
 {
     JSValue* prop = dict_get(scope->symbols, key);
     if (prop)
     {
-        *prop = value;
+        dict_store(prop, value);
         return 1;
     }
 
@@ -36,7 +47,7 @@ void scope_declare(const Scope* scope, char* key, JSValue value)
     JSValue* prop = dict_get(scope->symbols, key);
     if (prop)
     {
-        *prop = value;
+        dict_store(prop, value);
         return;
     }
     
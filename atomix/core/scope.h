@@ -7,6 +7,11 @@ typedef struct Scope Scope;
 
 Scope* scope_create_scope(Scope* parent);
 
+/**
+ * Block scopes are allocated in the nursery, most are left before the next minor collection
+ */
+Scope* scope_create_young_scope(Scope* parent);
+
 int scope_set(const Scope* scope, char* key, JSValue value);
 
 void scope_declare(const Scope* scope, char* key, JSValue value);
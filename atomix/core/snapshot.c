@@ -0,0 +1,628 @@
+#include "snapshot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "heap.h"
+#include "panic.h"
+#include "api.impl.h"
+
+#include "vm.impl.h"
+#include "value.impl.h"
+#include "object.impl.h"
+#include "dict.impl.h"
+#include "scope.impl.h"
+#include "function.impl.h"
+#include "format.impl.h"
+
+#define SNAPSHOT_MAGIC0 0x2E
+#define SNAPSHOT_MAGIC1 0x41
+#define SNAPSHOT_MAGIC2 0x78
+#define SNAPSHOT_MAGIC3 0x53
+
+#define SNAPSHOT_VERSION 1
+
+typedef enum
+{
+    SNAPSHOT_STRING,
+    SNAPSHOT_OBJECT,
+    SNAPSHOT_DICT,
+    SNAPSHOT_SCOPE,
+    SNAPSHOT_FUNCTION,
+    SNAPSHOT_GS_BOX
+} SnapshotKind;
+
+extern const module_init __MOD_LOADER__[];
+extern const size_t __MOD_LOADER_SIZE__;
+
+// Code addresses are stored relative to this function, which keeps them valid under address randomization
+static int64_t snapshot_code_offset(const void* code)
+{
+    return (int64_t)((intptr_t)code - (intptr_t)&snapshot_restore);
+}
+
+typedef struct
+{
+    uint8_t* data;
+    size_t length;
+    size_t capacity;
+
+    // Pointer to record index, open addressing
+    const void** keys;
+    uint32_t* indices;
+    size_t slots;
+
+    // Records in the order they are written, index 0 is NULL
+    const void** pending;
+    SnapshotKind* kinds;
+    uint32_t count;
+    uint32_t written;
+} SnapshotWriter;
+
+static void writer_append(SnapshotWriter* writer, const void* data, size_t length)
+{
+    if (writer->length + length > writer->capacity)
+    {
+        while (writer->length + length > writer->capacity)
+        {
+            writer->capacity = writer->capacity ? writer->capacity * 2 : 4096;
+        }
+        writer->data = realloc(writer->data, writer->capacity);
+        if (!writer->data)
+        {
+            PANIC("Could not allocate memory");
+        }
+    }
+    memcpy(writer->data + writer->length, data, length);
+    writer->length += length;
+}
+
+static void writer_u8(SnapshotWriter* writer, uint8_t value)
+{
+    writer_append(writer, &value, sizeof(value));
+}
+
+static void writer_u32(SnapshotWriter* writer, uint32_t value)
+{
+    writer_append(writer, &value, sizeof(value));
+}
+
+static void writer_i64(SnapshotWriter* writer, int64_t value)
+{
+    writer_append(writer, &value, sizeof(value));
+}
+
+static void writer_grow(SnapshotWriter* writer)
+{
+    const void** keys = writer->keys;
+    uint32_t* indices = writer->indices;
+    size_t slots = writer->slots;
+
+    writer->slots = slots ? slots * 2 : 256;
+    writer->keys = calloc(writer->slots, sizeof(void*));
+    writer->indices = calloc(writer->slots, sizeof(uint32_t));
+    writer->pending = realloc(writer->pending, writer->slots * sizeof(void*));
+    writer->kinds = realloc(writer->kinds, writer->slots * sizeof(SnapshotKind));
+    if (!writer->keys || !writer->indices || !writer->pending || !writer->kinds)
+    {
+        PANIC("Could not allocate memory");
+    }
+    for (size_t i = 0; i < slots; i++)
+    {
+        if (!keys[i])
+        {
+            continue;
+        }
+        size_t slot = ((uintptr_t)keys[i] >> 4) & (writer->slots - 1);
+        while (writer->keys[slot])
+        {
+            slot = (slot + 1) & (writer->slots - 1);
+        }
+        writer->keys[slot] = keys[i];
+        writer->indices[slot] = indices[i];
+    }
+    free(keys);
+    free(indices);
+}
+
+// Returns the record index of a pointer, unseen ones are queued to be written
+static uint32_t writer_ref(SnapshotWriter* writer, const void* pointer, SnapshotKind kind)
+{
+    if (!pointer)
+    {
+        return 0;
+    }
+    // Kept at most half full, so the probing always ends
+    if ((writer->count + 1) * 2 > writer->slots)
+    {
+        writer_grow(writer);
+    }
+
+    size_t slot = ((uintptr_t)pointer >> 4) & (writer->slots - 1);
+    while (writer->keys[slot])
+    {
+        if (writer->keys[slot] == pointer)
+        {
+            return writer->indices[slot];
+        }
+        slot = (slot + 1) & (writer->slots - 1);
+    }
+
+    uint32_t index = ++writer->count;
+    writer->keys[slot] = pointer;
+    writer->indices[slot] = index;
+    writer->pending[index] = pointer;
+    writer->kinds[index] = kind;
+    return index;
+}
+
+static void writer_value(SnapshotWriter* writer, JSValue value)
+{
+    writer_u8(writer, (uint8_t)value.type);
+    switch (value.type)
+    {
+    case JS_INTEGER:
+    case JS_BOOLEAN:
+        writer_u32(writer, (uint32_t)value.value.as_int);
+        break;
+    case JS_DOUBLE:
+        writer_append(writer, &value.value.as_double, sizeof(double));
+        break;
+    case JS_STRING:
+        writer_u32(writer, writer_ref(writer, value.value.as_pointer, SNAPSHOT_STRING));
+        break;
+    case JS_OBJECT:
+    case JS_SYMBOL:
+        writer_u32(writer, writer_ref(writer, value.value.as_pointer, SNAPSHOT_OBJECT));
+        break;
+    case JS_FUNC:
+        writer_u32(writer, writer_ref(writer, value.value.as_pointer, SNAPSHOT_FUNCTION));
+        break;
+    case JS_GS_BOX:
+        writer_u32(writer, writer_ref(writer, value.value.as_pointer, SNAPSHOT_GS_BOX));
+        break;
+    case JS_UNDEFINED:
+    case JS_NULL:
+        break;
+    default:
+        PANIC("Snapshot can not hold host data");
+    }
+}
+
+static void writer_record(SnapshotWriter* writer, const void* pointer, SnapshotKind kind)
+{
+    writer_u8(writer, (uint8_t)kind);
+    switch (kind)
+    {
+    case SNAPSHOT_STRING:
+        {
+            uint32_t length = (uint32_t)strlen(pointer);
+            writer_u32(writer, length);
+            writer_append(writer, pointer, length);
+        }
+        break;
+    case SNAPSHOT_OBJECT:
+        {
+            const JSObject* object = pointer;
+            writer_u32(writer, writer_ref(writer, object->prototype, SNAPSHOT_OBJECT));
+            writer_u32(writer, writer_ref(writer, object->properties, SNAPSHOT_DICT));
+        }
+        break;
+    case SNAPSHOT_DICT:
+        {
+            const JSDict* dict = pointer;
+            writer_u32(writer, (uint32_t)dict->bucket_count);
+            writer_u32(writer, (uint32_t)dict->count);
+            // Chains are written in order, so lookups and enumeration behave exactly as before
+            for (size_t i = 0; dict->buckets && i < dict->bucket_count; i++)
+            {
+                for (JSProperty* property = dict->buckets[i]; property; property = property->next)
+                {
+                    writer_u32(writer, (uint32_t)i);
+                    writer_u32(writer, writer_ref(writer, property->key, SNAPSHOT_STRING));
+                    writer_u32(writer, writer_ref(writer, property->symbol, SNAPSHOT_OBJECT));
+                    writer_value(writer, property->value);
+                }
+            }
+        }
+        break;
+    case SNAPSHOT_SCOPE:
+        {
+            const Scope* scope = pointer;
+            writer_u32(writer, writer_ref(writer, scope->parent, SNAPSHOT_SCOPE));
+            writer_u32(writer, writer_ref(writer, scope->symbols, SNAPSHOT_DICT));
+        }
+        break;
+    case SNAPSHOT_FUNCTION:
+        {
+            const JSFunction* function = pointer;
+            if (!function->is_native)
+            {
+                // Bytecode functions belong to a module image, which is not part of the snapshot
+                PANIC("Snapshot can not hold bytecode functions");
+            }
+            writer_i64(writer, snapshot_code_offset((const void*)function->native_function));
+            writer_u32(writer, writer_ref(writer, function->base, SNAPSHOT_OBJECT));
+        }
+        break;
+    case SNAPSHOT_GS_BOX:
+        {
+            const JSGSBox* box = pointer;
+            writer_u32(writer, writer_ref(writer, box->getter, SNAPSHOT_FUNCTION));
+            writer_u32(writer, writer_ref(writer, box->setter, SNAPSHOT_FUNCTION));
+        }
+        break;
+    }
+}
+
+static void writer_flush(SnapshotWriter* writer)
+{
+    while (writer->written < writer->count)
+    {
+        writer->written++;
+        writer_record(writer, writer->pending[writer->written], writer->kinds[writer->written]);
+    }
+}
+
+uint8_t* snapshot_create(VM* vm, size_t* size)
+{
+    SnapshotWriter writer;
+    memset(&writer, 0, sizeof(writer));
+
+    uint8_t magic[4] = { SNAPSHOT_MAGIC0, SNAPSHOT_MAGIC1, SNAPSHOT_MAGIC2, SNAPSHOT_MAGIC3 };
+    uint16_t version = SNAPSHOT_VERSION;
+    writer_append(&writer, magic, sizeof(magic));
+    writer_append(&writer, &version, sizeof(version));
+
+    // The loaders identify the executable, a snapshot of another build is never restored
+    writer_u32(&writer, (uint32_t)__MOD_LOADER_SIZE__);
+    for (size_t i = 0; i < __MOD_LOADER_SIZE__; i++)
+    {
+        writer_i64(&writer, snapshot_code_offset((const void*)__MOD_LOADER__[i]));
+    }
+
+    // Records first, the roots refer to them by index
+    writer_ref(&writer, vm->globalScope, SNAPSHOT_SCOPE);
+    for (size_t i = 0; i < object_builtin_root_count; i++)
+    {
+        writer_ref(&writer, *object_builtin_roots[i], SNAPSHOT_OBJECT);
+    }
+    // Only native modules are part of the runtime, bundles are loaded after the snapshot is restored
+    for (uint32_t i = 0; i < module_table.capacity; i++)
+    {
+        ModuleTableEntry* entry = &module_table.entries[i];
+        if (entry->module && !entry->bundle)
+        {
+            writer_ref(&writer, entry->module->exports, SNAPSHOT_OBJECT);
+        }
+    }
+    size_t count_position = writer.length;
+    writer_u32(&writer, 0);
+    writer_flush(&writer);
+    memcpy(writer.data + count_position, &writer.count, sizeof(uint32_t));
+
+    writer_u32(&writer, writer_ref(&writer, vm->globalScope, SNAPSHOT_SCOPE));
+    writer_u32(&writer, (uint32_t)object_builtin_root_count);
+    for (size_t i = 0; i < object_builtin_root_count; i++)
+    {
+        writer_u32(&writer, writer_ref(&writer, *object_builtin_roots[i], SNAPSHOT_OBJECT));
+    }
+    uint32_t modules = 0;
+    for (uint32_t i = 0; i < module_table.capacity; i++)
+    {
+        modules += module_table.entries[i].module && !module_table.entries[i].bundle;
+    }
+    writer_u32(&writer, modules);
+    for (uint32_t i = 0; i < module_table.capacity; i++)
+    {
+        ModuleTableEntry* entry = &module_table.entries[i];
+        if (entry->module && !entry->bundle)
+        {
+            writer_append(&writer, &entry->module->header.hash, sizeof(uint64_t));
+            writer_u32(&writer, writer_ref(&writer, entry->module->exports, SNAPSHOT_OBJECT));
+        }
+    }
+
+    free(writer.keys);
+    free(writer.indices);
+    free(writer.pending);
+    free(writer.kinds);
+    *size = writer.length;
+    return writer.data;
+}
+
+typedef struct
+{
+    const uint8_t* image;
+    size_t size;
+    size_t position;
+    void** refs;
+    uint32_t count;
+} SnapshotReader;
+
+static void reader_read(SnapshotReader* reader, void* data, size_t length)
+{
+    if (reader->position + length > reader->size)
+    {
+        PANIC("Snapshot is truncated");
+    }
+    memcpy(data, reader->image + reader->position, length);
+    reader->position += length;
+}
+
+static uint8_t reader_u8(SnapshotReader* reader)
+{
+    uint8_t value;
+    reader_read(reader, &value, sizeof(value));
+    return value;
+}
+
+static uint32_t reader_u32(SnapshotReader* reader)
+{
+    uint32_t value;
+    reader_read(reader, &value, sizeof(value));
+    return value;
+}
+
+static int64_t reader_i64(SnapshotReader* reader)
+{
+    int64_t value;
+    reader_read(reader, &value, sizeof(value));
+    return value;
+}
+
+static void* reader_ref(SnapshotReader* reader)
+{
+    uint32_t index = reader_u32(reader);
+    if (index > reader->count)
+    {
+        PANIC("Snapshot reference is out of bounds");
+    }
+    return reader->refs[index];
+}
+
+static JSValue reader_value(SnapshotReader* reader)
+{
+    JSValue value;
+    value.type = (JSValueType)reader_u8(reader);
+    value.value.as_int = 0;
+    switch (value.type)
+    {
+    case JS_INTEGER:
+    case JS_BOOLEAN:
+        value.value.as_int = (int32_t)reader_u32(reader);
+        break;
+    case JS_DOUBLE:
+        reader_read(reader, &value.value.as_double, sizeof(double));
+        break;
+    case JS_STRING:
+    case JS_OBJECT:
+    case JS_SYMBOL:
+    case JS_FUNC:
+    case JS_GS_BOX:
+        value.value.as_pointer = reader_ref(reader);
+        break;
+    case JS_UNDEFINED:
+    case JS_NULL:
+        break;
+    default:
+        PANIC("Invalid snapshot value");
+    }
+    return value;
+}
+
+static void reader_skip_value(SnapshotReader* reader)
+{
+    switch ((JSValueType)reader_u8(reader))
+    {
+    case JS_DOUBLE:
+        reader->position += sizeof(double);
+        break;
+    case JS_UNDEFINED:
+    case JS_NULL:
+        break;
+    default:
+        reader->position += sizeof(uint32_t);
+        break;
+    }
+}
+
+// First pass: allocates every record so that the second one can resolve references in any direction
+static void reader_allocate(SnapshotReader* reader, uint32_t index)
+{
+    SnapshotKind kind = (SnapshotKind)reader_u8(reader);
+    switch (kind)
+    {
+    case SNAPSHOT_STRING:
+        {
+            uint32_t length = reader_u32(reader);
+            char* str = vm_alloc_bytes(length + 1);
+            reader_read(reader, str, length);
+            str[length] = '\0';
+            reader->refs[index] = str;
+        }
+        return;
+    case SNAPSHOT_OBJECT:
+        reader->refs[index] = vm_alloc_object(sizeof(JSObject));
+        reader->position += 2 * sizeof(uint32_t);
+        return;
+    case SNAPSHOT_DICT:
+        {
+            JSDict* dict = vm_alloc_object(sizeof(JSDict));
+            dict->bucket_count = reader_u32(reader);
+            uint32_t properties = reader_u32(reader);
+            if (!dict->bucket_count)
+            {
+                PANIC("Invalid snapshot record");
+            }
+            dict->buckets = properties ? vm_alloc_object(dict->bucket_count * sizeof(JSProperty*)) : NULL;
+            dict->count = properties;
+            for (uint32_t i = 0; i < properties; i++)
+            {
+                reader->position += 3 * sizeof(uint32_t);
+                reader_skip_value(reader);
+            }
+            reader->refs[index] = dict;
+        }
+        return;
+    case SNAPSHOT_SCOPE:
+        reader->refs[index] = vm_alloc_object(sizeof(Scope));
+        reader->position += 2 * sizeof(uint32_t);
+        return;
+    case SNAPSHOT_FUNCTION:
+        reader->refs[index] = vm_alloc_object(sizeof(JSFunction));
+        reader->position += sizeof(int64_t) + sizeof(uint32_t);
+        return;
+    case SNAPSHOT_GS_BOX:
+        reader->refs[index] = vm_alloc_object(sizeof(JSGSBox));
+        reader->position += 2 * sizeof(uint32_t);
+        return;
+    }
+    PANIC("Invalid snapshot record");
+}
+
+static void reader_fill(SnapshotReader* reader, uint32_t index)
+{
+    SnapshotKind kind = (SnapshotKind)reader_u8(reader);
+    void* pointer = reader->refs[index];
+    switch (kind)
+    {
+    case SNAPSHOT_STRING:
+        reader->position += sizeof(uint32_t) + strlen(pointer);
+        return;
+    case SNAPSHOT_OBJECT:
+        {
+            JSObject* object = pointer;
+            object->prototype = reader_ref(reader);
+            object->properties = reader_ref(reader);
+        }
+        return;
+    case SNAPSHOT_DICT:
+        {
+            JSDict* dict = pointer;
+            JSProperty* last[dict->bucket_count];
+            memset(last, 0, sizeof(last));
+            reader->position += sizeof(uint32_t);
+            uint32_t properties = reader_u32(reader);
+            for (uint32_t i = 0; i < properties; i++)
+            {
+                uint32_t bucket = reader_u32(reader);
+                if (bucket >= dict->bucket_count)
+                {
+                    PANIC("Invalid snapshot record");
+                }
+                JSProperty* property = vm_alloc_property();
+                property->key = reader_ref(reader);
+                property->symbol = reader_ref(reader);
+                property->value = reader_value(reader);
+                property->next = NULL;
+                if (last[bucket])
+                {
+                    last[bucket]->next = property;
+                }
+                else
+                {
+                    dict->buckets[bucket] = property;
+                }
+                last[bucket] = property;
+            }
+        }
+        return;
+    case SNAPSHOT_SCOPE:
+        {
+            Scope* scope = pointer;
+            scope->parent = reader_ref(reader);
+            scope->symbols = reader_ref(reader);
+        }
+        return;
+    case SNAPSHOT_FUNCTION:
+        {
+            JSFunction* function = pointer;
+            function->is_native = 1;
+            function->native_function = (JSNativeFunction)((intptr_t)&snapshot_restore + (intptr_t)reader_i64(reader));
+            function->base = reader_ref(reader);
+        }
+        return;
+    case SNAPSHOT_GS_BOX:
+        {
+            JSGSBox* box = pointer;
+            box->getter = reader_ref(reader);
+            box->setter = reader_ref(reader);
+        }
+        return;
+    }
+    PANIC("Invalid snapshot record");
+}
+
+Scope* snapshot_restore(const uint8_t* image, size_t size)
+{
+    SnapshotReader reader = { image, size, 0, NULL, 0 };
+
+    uint8_t magic[4];
+    uint16_t version;
+    reader_read(&reader, magic, sizeof(magic));
+    reader_read(&reader, &version, sizeof(version));
+    if (magic[0] != SNAPSHOT_MAGIC0 ||
+        magic[1] != SNAPSHOT_MAGIC1 ||
+        magic[2] != SNAPSHOT_MAGIC2 ||
+        magic[3] != SNAPSHOT_MAGIC3 ||
+        version != SNAPSHOT_VERSION)
+    {
+        return NULL;
+    }
+
+    if (reader_u32(&reader) != __MOD_LOADER_SIZE__)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < __MOD_LOADER_SIZE__; i++)
+    {
+        if (reader_i64(&reader) != snapshot_code_offset((const void*)__MOD_LOADER__[i]))
+        {
+            return NULL;
+        }
+    }
+
+    reader.count = reader_u32(&reader);
+    reader.refs = malloc((reader.count + 1) * sizeof(void*));
+    if (!reader.refs)
+    {
+        PANIC("Could not allocate memory");
+    }
+    reader.refs[0] = NULL;
+
+    size_t records = reader.position;
+    for (uint32_t i = 1; i <= reader.count; i++)
+    {
+        reader_allocate(&reader, i);
+    }
+    reader.position = records;
+    for (uint32_t i = 1; i <= reader.count; i++)
+    {
+        reader_fill(&reader, i);
+    }
+
+    Scope* global_scope = reader_ref(&reader);
+    if (reader_u32(&reader) != object_builtin_root_count)
+    {
+        PANIC("Invalid snapshot roots");
+    }
+    for (size_t i = 0; i < object_builtin_root_count; i++)
+    {
+        *object_builtin_roots[i] = reader_ref(&reader);
+    }
+
+    uint32_t modules = reader_u32(&reader);
+    for (uint32_t i = 0; i < modules; i++)
+    {
+        JSModule* module = vm_alloc_object(sizeof(JSModule));
+        memset(module, 0, sizeof(JSModule));
+        reader_read(&reader, &module->header.hash, sizeof(uint64_t));
+        module->initialized = 1;
+        module->exports = reader_ref(&reader);
+        module_table_add_module(module);
+    }
+
+    free(reader.refs);
+    return global_scope;
+}
@@ -0,0 +1,25 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scope.h"
+#include "vm.h"
+
+/**
+ * Serializes the runtime built by the module loaders: the global scope, the built-in prototypes and
+ * symbols and the registered native modules. Native functions are stored relative to the code of the
+ * binary, so the image is only valid for the executable that created it. The returned buffer is
+ * allocated with malloc.
+ */
+uint8_t* snapshot_create(VM* vm, size_t* size);
+
+/**
+ * Rebuilds the runtime of a snapshot and returns its global scope. Returns NULL when the image was
+ * created by another executable, the module loaders have to run instead then. Has to be called before
+ * anything else allocates objects, the built-in prototypes are replaced by the ones of the image.
+ */
+Scope* snapshot_restore(const uint8_t* image, size_t size);
+
+#endif //SNAPSHOT_H
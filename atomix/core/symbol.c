@@ -12,14 +12,25 @@ static JSObject* createSymbol(VM* vm, char* description)
     return symbol;
 }
 
-static JSObject* _symbol_to_primitive = NULL;
+JSObject* to_primitive_symbol = NULL;
 
 JSValue symbol_to_primitive(VM* vm)
 {
-    if (!_symbol_to_primitive)
+    if (!to_primitive_symbol)
     {
-        _symbol_to_primitive = createSymbol(vm, (char*)"Symbol.toPrimitive");
+        to_primitive_symbol = createSymbol(vm, (char*)"Symbol.toPrimitive");
     }
 
-    return JS_VALUE_SYMBOL(_symbol_to_primitive);
-}
\ No newline at end of file
+    return JS_VALUE_SYMBOL(to_primitive_symbol);
+}
+JSObject* iterator_symbol = NULL;
+
+JSValue symbol_iterator(VM* vm)
+{
+    if (!iterator_symbol)
+    {
+        iterator_symbol = createSymbol(vm, (char*)"Symbol.iterator");
+    }
+
+    return JS_VALUE_SYMBOL(iterator_symbol);
+}
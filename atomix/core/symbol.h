@@ -6,5 +6,7 @@
 
 JSValue symbol_to_primitive(VM* vm);
 
+JSValue symbol_iterator(VM* vm);
+
 
 #endif //SYMBOL_H
\ No newline at end of file
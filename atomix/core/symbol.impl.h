@@ -3,4 +3,10 @@
 
 #include "symbol.h"
 
+#include "object.h"
+
+// Created on first use through symbol_to_primitive and symbol_iterator
+extern JSObject* to_primitive_symbol;
+extern JSObject* iterator_symbol;
+
 #endif //SYMBOL_IMPL_H
\ No newline at end of file
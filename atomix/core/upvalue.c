@@ -0,0 +1,50 @@
+#include "upvalue.impl.h"
+
+#include "heap.h"
+#include "nursery.h"
+
+#include "vm.impl.h"
+
+JSUpvalue* upvalue_capture(VM* vm, JSValue* slot)
+{
+    JSUpvalue* previous = NULL;
+    JSUpvalue* upvalue = vm->open_upvalues;
+    while (upvalue && upvalue->location > slot)
+    {
+        previous = upvalue;
+        upvalue = upvalue->next;
+    }
+
+    if (upvalue && upvalue->location == slot)
+    {
+        return upvalue;
+    }
+
+    JSUpvalue* created = vm_alloc_upvalue();
+    created->location = slot;
+    created->owner = NULL;
+    created->closed = JS_VALUE_UNDEFINED;
+    created->next = upvalue;
+    if (previous)
+    {
+        previous->next = created;
+    }
+    else
+    {
+        vm->open_upvalues = created;
+    }
+    return created;
+}
+
+void upvalue_close(VM* vm, const JSValue* level)
+{
+    while (vm->open_upvalues && vm->open_upvalues->location >= level)
+    {
+        JSUpvalue* upvalue = vm->open_upvalues;
+        upvalue->closed = *upvalue->location;
+        nursery_barrier_value(upvalue, HEAP_ALLOC_UPVALUE, upvalue->closed);
+        upvalue->location = &upvalue->closed;
+        vm->open_upvalues = upvalue->next;
+        upvalue->next = NULL;
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef UPVALUE_H
+#define UPVALUE_H
+
+#include "value.h"
+#include "vm.h"
+
+typedef struct JSUpvalue JSUpvalue;
+
+JSUpvalue* upvalue_capture(VM* vm, JSValue* slot);
+
+void upvalue_close(VM* vm, const JSValue* level);
+
+#endif //UPVALUE_H
@@ -0,0 +1,20 @@
+#ifndef UPVALUE_IMPL_H
+#define UPVALUE_IMPL_H
+
+#include "upvalue.h"
+
+#include "value.impl.h"
+
+struct JSUpvalue
+{
+    // Points into the value stack while the owning frame is alive, afterwards to closed
+    JSValue* location;
+    // Start of the saved values of a suspended generator the location points into, otherwise NULL. Only a
+    // pointer to the start of a block keeps it alive.
+    JSValue* owner;
+    JSValue closed;
+    // Next open upvalue, the open list is sorted by descending stack location
+    JSUpvalue* next;
+};
+
+#endif //UPVALUE_IMPL_H
@@ -2,8 +2,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <gc.h>
 
+#include "heap.h"
 #include "panic.h"
 #include "api.h"
 
@@ -28,6 +28,10 @@ int value_is_falsy(JSValue* value)
     case JS_UNDEFINED:
     case JS_NULL:
         return 1;
+    case JS_GS_BOX:
+    case JS_INTERNAL:
+        // Accessor boxes and host data live in property tables, scripts never get hold of them
+        break;
     }
 
     PANIC("Undefined JSValue Type");
@@ -48,11 +52,7 @@ int value_is_NaN(JSValue* value)
 static char* int_to_string(int value)
 {
     int size = snprintf(NULL, 0, "%d", value);
-    char* str = GC_malloc_atomic(size + 1);
-    if (!str)
-    {
-        PANIC("Could not allocate memory");
-    }
+    char* str = vm_alloc_bytes(size + 1);
     snprintf(str, size + 1, "%d", value);
     return str;
 }
@@ -67,11 +67,7 @@ static char* double_to_string(double value)
     }
 
     int size = snprintf(NULL, 0, "%.7g", value);
-    char* str = GC_malloc_atomic(size + 1);
-    if (!str)
-    {
-        PANIC("Could not allocate memory");
-    }
+    char* str = vm_alloc_bytes(size + 1);
     snprintf(str, size + 1, "%.7g", value);
     return str;
 }
@@ -98,6 +94,10 @@ char* value_to_string(JSValue* value)
         return value->value.as_pointer;
     case JS_SYMBOL:
         return init_string("[Symbol]");
+    case JS_GS_BOX:
+    case JS_INTERNAL:
+        // Accessor boxes and host data live in property tables, scripts never get hold of them
+        break;
     }
 
     PANIC("Undefined JSValue Type");
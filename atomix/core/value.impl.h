@@ -30,7 +30,9 @@ enum JSValueType
     JS_NULL,
     JS_BOOLEAN,
     JS_SYMBOL,
-    JS_GS_BOX
+    JS_GS_BOX,
+    // Host data of built-in objects, stored under a key scripts can not reach
+    JS_INTERNAL
 };
 
 struct JSValue
@@ -0,0 +1,451 @@
+#include "verifier.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "panic.h"
+
+#include "format.impl.h"
+#include "instruction.impl.h"
+#include "vm.impl.h"
+
+#define HEIGHT_UNKNOWN (-1)
+
+typedef struct
+{
+    JSModule* module;
+    size_t start;
+    size_t end;
+    // Stack height relative to the frame before each instruction of the body
+    int32_t* heights;
+    // Instructions whose height is known but whose successors are not checked yet
+    size_t* pending;
+    size_t pending_count;
+    int32_t max;
+    // First reason the code is rejected for, the remaining instructions are not looked at
+    const char* error;
+} Verification;
+
+const char* string_table_verify(const StringTable* table)
+{
+    size_t header = 2 * sizeof(uint32_t) + (size_t)table->count * sizeof(uint32_t);
+    if (table->length < header)
+    {
+        return "String table is truncated";
+    }
+
+    // With a terminated last string every offset inside of the section points to a terminated string
+    size_t size = table->length - header;
+    if (table->count && (size == 0 || table->strings[size - 1] != '\0'))
+    {
+        return "String table is not terminated";
+    }
+    for (uint32_t i = 0; i < table->count; i++)
+    {
+        uint32_t offset;
+        memcpy(&offset, table->offsets + i * sizeof(uint32_t), sizeof(uint32_t));
+        if (offset >= size)
+        {
+            return "String offset is out of bounds";
+        }
+    }
+    return NULL;
+}
+
+static void verify_reject(Verification* verification, const char* error)
+{
+    if (!verification->error)
+    {
+        verification->error = error;
+    }
+}
+
+static void verify_string(Verification* verification, uint32_t idx)
+{
+    if (idx >= verification->module->string_table.count)
+    {
+        verify_reject(verification, "StringTable idx is out of bounds");
+    }
+}
+
+// Every path reaching an instruction has to arrive with the same height, the first one seen is kept
+static void verify_branch(Verification* verification, size_t target, int32_t height)
+{
+    if (target == verification->end)
+    {
+        return;
+    }
+    if (target < verification->start || target > verification->end ||
+        !verification->module->data_section.instructions[target])
+    {
+        verify_reject(verification, "Branch target is not an instruction of the body");
+        return;
+    }
+
+    int32_t* known = &verification->heights[target - verification->start];
+    if (*known == HEIGHT_UNKNOWN)
+    {
+        *known = height;
+        verification->pending[verification->pending_count++] = target;
+        if (height > verification->max)
+        {
+            verification->max = height;
+        }
+        return;
+    }
+    if (*known != height)
+    {
+        verify_reject(verification, "Stack height differs between branches");
+    }
+}
+
+static void verify_handlers(Verification* verification)
+{
+    HandlerTable* table = &verification->module->handler_table;
+    for (uint32_t i = 0; i < table->count; i++)
+    {
+        const HandlerEntry* entry = &table->entries[i];
+        if (entry->owner != verification->start)
+        {
+            continue;
+        }
+        if (entry->start > entry->end || entry->start < verification->start || entry->end > verification->end)
+        {
+            verify_reject(verification, "Handler range is out of bounds");
+            return;
+        }
+        if (entry->close > entry->depth)
+        {
+            verify_reject(verification, "Handler closes slots above its depth");
+            return;
+        }
+        // The exception is pushed onto the recorded depth
+        verify_branch(verification, entry->handler, (int32_t)entry->depth + 1);
+    }
+}
+
+static int in_handler_range(Verification* verification, size_t instruction)
+{
+    HandlerTable* table = &verification->module->handler_table;
+    for (uint32_t i = 0; i < table->count; i++)
+    {
+        const HandlerEntry* entry = &table->entries[i];
+        if (entry->owner == verification->start && instruction >= entry->start && instruction < entry->end)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int body_contains(JSModule* module, size_t start, size_t end, Opcode opcode)
+{
+    void** instructions = module->data_section.instructions;
+    for (size_t i = start; i < end; i++)
+    {
+        // Nested bodies are not decoded yet and stay NULL
+        if (instructions[i] && OPCODE_OF(instructions[i]) == opcode)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char* module_verify_code(JSModule* module, size_t start, size_t end, uint16_t* depth)
+{
+    *depth = 0;
+    if (start >= end)
+    {
+        return NULL;
+    }
+
+    void** instructions = module->data_section.instructions;
+    int is_function = start > 0;
+    int is_generator = is_function && body_contains(module, start, end, OP_GENERATOR);
+    uint32_t slots = is_function && OPCODE_OF(instructions[start]) == OP_ENTER
+        ? ((const InstUInt32*)instructions[start])->operand
+        : 0;
+
+    size_t count = end - start;
+    Verification verification = {
+        .module = module,
+        .start = start,
+        .end = end,
+        .heights = malloc(count * sizeof(int32_t)),
+        .pending = malloc(count * sizeof(size_t)),
+        .pending_count = 0,
+        .max = 0,
+        .error = NULL
+    };
+    if (!verification.heights || !verification.pending)
+    {
+        PANIC("Could not allocate memory");
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        verification.heights[i] = HEIGHT_UNKNOWN;
+    }
+
+    verify_branch(&verification, start, 0);
+    verify_handlers(&verification);
+
+    while (!verification.error && verification.pending_count > 0)
+    {
+        size_t i = verification.pending[--verification.pending_count];
+        const uint8_t* code = instructions[i];
+        const InstUInt32* inst = (const InstUInt32*)code;
+        // Operands are 32 bit, so the arithmetic is done wide enough to never overflow
+        int64_t height = verification.heights[i - start];
+        int64_t pops = 0;
+        int64_t pushes = 0;
+        size_t next = i + 1;
+        size_t branch = 0;
+        int jumps = 0;
+        int falls = 1;
+
+        switch ((Opcode)code[0])
+        {
+        case OP_NOP:
+        case OP_PUSH_SCOPE:
+        case OP_POP_SCOPE:
+            break;
+        case OP_LD_INT:
+        case OP_LD_DOUBLE:
+        case OP_LD_UNDF:
+        case OP_LD_NULL:
+        case OP_LD_TRUE:
+        case OP_LD_FALSE:
+        case OP_LD_THIS:
+        case OP_LOAD_ARG:
+        case OP_ARR_ALLOC:
+        case OP_OBJ_ALLOC:
+        case OP_LD_CALLEE:
+        case OP_IMPORT:
+            pushes = 1;
+            break;
+        case OP_LD_STRING:
+        case OP_LOAD_LOCAL:
+            verify_string(&verification, inst->operand);
+            pushes = 1;
+            break;
+        case OP_ADD:
+        case OP_MINUS:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+        case OP_BINARY_AND:
+        case OP_BINARY_OR:
+        case OP_BINARY_XOR:
+        case OP_BINARY_LSHFT:
+        case OP_BINARY_RSHFT:
+        case OP_BINARY_ZRSHFT:
+        case OP_TEQ:
+        case OP_NTEQ:
+        case OP_GT:
+        case OP_GEQ:
+        case OP_LT:
+        case OP_LEQ:
+        case OP_OBJ_CLOAD:
+            pops = 2;
+            pushes = 1;
+            break;
+        case OP_BINARY_NOT:
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_TYPEOF:
+            pops = 1;
+            pushes = 1;
+            break;
+        case OP_POP:
+            pops = 1;
+            break;
+        case OP_DUP:
+            pops = 1;
+            pushes = 2;
+            break;
+        case OP_SWAP:
+            pops = 2;
+            pushes = 2;
+            break;
+        case OP_ALLOC_LOCAL:
+        case OP_STORE_LOCAL:
+        case OP_EXPORT:
+            verify_string(&verification, inst->operand);
+            pops = 1;
+            break;
+        case OP_OBJ_STORE:
+            verify_string(&verification, inst->operand);
+            pops = 2;
+            break;
+        case OP_OBJ_LOAD:
+            verify_string(&verification, inst->operand);
+            pops = 1;
+            pushes = 1;
+            break;
+        case OP_OBJ_CSTORE:
+            pops = 3;
+            break;
+        case OP_FUNC_DECL:
+        case OP_FUNC_DECL_E:
+            {
+                uint32_t size = code[0] == OP_FUNC_DECL
+                    ? ((const InstFuncDecl*)code)->size
+                    : ((const InstFuncDeclE*)code)->size;
+                if (code[0] == OP_FUNC_DECL)
+                {
+                    verify_string(&verification, ((const InstFuncDecl*)code)->name);
+                }
+                // The body itself is verified once it is decoded
+                if (size >= end - i)
+                {
+                    verify_reject(&verification, "Function body exceeds the enclosing code");
+                }
+                next = i + 1 + size;
+                pushes = 1;
+            }
+            break;
+        case OP_CALL:
+            pops = (int64_t)inst->operand + 2;
+            pushes = 1;
+            break;
+        case OP_TAIL_CALL:
+            // The frame it replaces has to be left for good, which a handler or a suspended generator would
+            // still need. At module level it behaves like a call.
+            if (is_function && (is_generator || in_handler_range(&verification, i)))
+            {
+                verify_reject(&verification, "Tail call in a generator or a protected range");
+            }
+            pops = (int64_t)inst->operand + 2;
+            pushes = 1;
+            falls = !is_function;
+            break;
+        case OP_RETURN:
+            falls = !is_function;
+            break;
+        case OP_JMP:
+            branch = inst->operand;
+            jumps = 1;
+            falls = 0;
+            break;
+        case OP_JMP_F:
+        case OP_JMP_T:
+            pops = 1;
+            branch = inst->operand;
+            jumps = 1;
+            break;
+        case OP_ENTER:
+            if (!is_function || i != start)
+            {
+                verify_reject(&verification, "ENTER outside of a function prologue");
+            }
+            pushes = inst->operand;
+            break;
+        case OP_LOAD_SLOT:
+        case OP_STORE_SLOT:
+            if (inst->operand >= slots)
+            {
+                verify_reject(&verification, "Slot index is out of bounds");
+            }
+            pops = code[0] == OP_STORE_SLOT;
+            pushes = code[0] == OP_LOAD_SLOT;
+            break;
+        case OP_CLOSE_UPVALS:
+            if (inst->operand > slots)
+            {
+                verify_reject(&verification, "Slot index is out of bounds");
+            }
+            break;
+        case OP_LOAD_UPVAL:
+        case OP_STORE_UPVAL:
+            // The number of upvalues depends on the closure, so the index itself is checked when executing
+            if (!is_function)
+            {
+                verify_reject(&verification, "Upvalue outside of a function");
+            }
+            pops = code[0] == OP_STORE_UPVAL;
+            pushes = code[0] == OP_LOAD_UPVAL;
+            break;
+        case OP_CAPTURE:
+            {
+                const InstCapture* capture = (const InstCapture*)code;
+                for (uint32_t j = 0; j < capture->count; j++)
+                {
+                    uint16_t entry = capture->entries[j];
+                    if (entry & CAPTURE_FROM_UPVALUE ? !is_function : (entry & CAPTURE_INDEX_MASK) >= slots)
+                    {
+                        verify_reject(&verification, "Capture entry is out of bounds");
+                    }
+                }
+                pops = 1;
+                pushes = 1;
+            }
+            break;
+        case OP_THROW:
+            pops = 1;
+            falls = 0;
+            break;
+        case OP_YIELD:
+            if (!is_generator)
+            {
+                verify_reject(&verification, "Yield outside of a generator");
+            }
+            // Once resumed the sent value takes the place of the yielded one
+            pops = 1;
+            pushes = 1;
+            break;
+        case OP_GENERATOR:
+            if (!is_function)
+            {
+                verify_reject(&verification, "Generator outside of a function");
+            }
+            // The call returns the generator object from here, the resumed body continues without it
+            if (height + 1 > verification.max)
+            {
+                verification.max = (int32_t)height + 1;
+            }
+            break;
+        default:
+            verify_reject(&verification, "Invalid opcode");
+        }
+
+        if (height < pops)
+        {
+            verify_reject(&verification, "Stack underflow");
+        }
+        height += pushes - pops;
+        if (height > STACK_SIZE)
+        {
+            verify_reject(&verification, "Frame exceeds the stack size");
+        }
+        if (verification.error)
+        {
+            break;
+        }
+        if (height > verification.max)
+        {
+            verification.max = (int32_t)height;
+        }
+        if (jumps)
+        {
+            verify_branch(&verification, branch, (int32_t)height);
+        }
+        if (falls)
+        {
+            verify_branch(&verification, next, (int32_t)height);
+        }
+    }
+
+    free(verification.heights);
+    free(verification.pending);
+    if (verification.error)
+    {
+        return verification.error;
+    }
+    if (verification.max > STACK_SIZE)
+    {
+        return "Frame exceeds the stack size";
+    }
+    *depth = (uint16_t)verification.max;
+    return NULL;
+}
@@ -0,0 +1,24 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "format.h"
+
+/**
+ * Checks that every string of the table lies inside of the section and is zero terminated. Returns why the
+ * table is rejected, NULL if it is not.
+ */
+const char* string_table_verify(const StringTable* table);
+
+/**
+ * Verifies the decoded code [start, end) of a function body (or the module body for start 0) and sets depth
+ * to the number of stack slots a frame of it needs at most. Jump and handler targets, string indices and slot
+ * operands are checked and every instruction is proven to find its operands on the stack, so the
+ * interpreter only has to make sure a frame fits once when entering it. Returns why the code is rejected,
+ * NULL if it is not.
+ */
+const char* module_verify_code(JSModule* module, size_t start, size_t end, uint16_t* depth);
+
+#endif //VERIFIER_H
@@ -4,28 +4,39 @@
 #include "vm.h"
 
 #include "format.h"
+#include "function.h"
+#include "generator.h"
 #include "scope.h"
+#include "upvalue.h"
 #include "instruction.impl.h"
 
 #include "value.impl.h"
 
-#define STACK_SIZE 254
+#define STACK_SIZE 1024
 
 struct VMStats
 {
     size_t instruction_counter;
     size_t stack_counter;
     size_t stack_start;
-    JSValue stack[STACK_SIZE];
+    size_t argc;
 };
 
 struct VM
 {
     JSModule* module;
+    JSFunction* function;
     Scope* globalScope;
     Scope* scope;
+    JSUpvalue* open_upvalues;
+    // Generator whose frame is executing, YIELD suspends it
+    JSGenerator* generator;
+    // Set while an exception travels up the frames, cleared by the handler catching it
+    JSValue exception;
+    int unwinding;
     VMStats stats;
+    JSValue stack[STACK_SIZE];
     void (*inst_set[OPCODE_LENGTH])(struct VM*, void*);
 };
 
-#endif //VM_IMPL_H
\ No newline at end of file
+#endif //VM_IMPL_H
@@ -0,0 +1,425 @@
+#include "weak.impl.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <gc.h>
+
+#include "heap.h"
+#include "nursery.h"
+#include "panic.h"
+#include "dict.h"
+#include "object.h"
+
+#include "object.impl.h"
+#include "function.impl.h"
+
+#define WEAK_MAP_MIN_CAPACITY 8
+// Slots the sweep looks at per operation, a full pass takes at most capacity / 2 operations
+#define WEAK_MAP_SWEEP_STEP 2
+
+typedef struct
+{
+    void** items;
+    size_t count;
+    size_t capacity;
+} WeakList;
+
+// References and maps holding young objects, updated by the next minor collection. The collector does not
+// scan the lists, their entries are long links, so an entry is dropped once it is collected but still updated
+// while it waits for its finalizer.
+static WeakList young_refs = {0};
+static WeakList young_maps = {0};
+
+static void weak_list_add(WeakList* list, void* item)
+{
+    if (list->count == list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        void** items = malloc(capacity * sizeof(void*));
+        if (!items)
+        {
+            PANIC("Could not allocate memory");
+        }
+        // A collection in between would clear the links at their old addresses
+        GC_disable();
+        for (size_t i = 0; i < list->count; i++)
+        {
+            items[i] = list->items[i];
+            if (items[i])
+            {
+                GC_move_long_link(&list->items[i], &items[i]);
+            }
+        }
+        GC_enable();
+        free(list->items);
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count] = item;
+    if (GC_register_long_link(&list->items[list->count], item) == GC_NO_MEMORY)
+    {
+        PANIC("Could not allocate memory");
+    }
+    list->count++;
+}
+
+// Moves the entry to the position, the lists are compacted by the minor collections that update them
+static void weak_list_keep(WeakList* list, size_t from, size_t to)
+{
+    if (from != to)
+    {
+        list->items[to] = list->items[from];
+        list->items[from] = NULL;
+        GC_move_long_link(&list->items[from], &list->items[to]);
+    }
+}
+
+static void weak_list_drop(WeakList* list, size_t index)
+{
+    GC_unregister_long_link(&list->items[index]);
+    list->items[index] = NULL;
+}
+
+int weak_can_hold(JSValue value)
+{
+    return value.type == JS_OBJECT || value.type == JS_FUNC || value.type == JS_SYMBOL;
+}
+
+static void weak_register(void** link, void* object)
+{
+    if (GC_general_register_disappearing_link(link, object) == GC_NO_MEMORY)
+    {
+        PANIC("Could not allocate memory");
+    }
+}
+
+JSWeakRef* weak_ref_create(JSValue target)
+{
+    JSWeakRef* ref = vm_alloc_bytes(sizeof(JSWeakRef));
+    ref->target = target.value.as_pointer;
+    ref->type = target.type;
+    if (nursery_contains(ref->target))
+    {
+        weak_list_add(&young_refs, ref);
+    }
+    else
+    {
+        weak_register(&ref->target, ref->target);
+    }
+    return ref;
+}
+
+// A target the collector already found unreachable may only be cleared after marking, reading it under the
+// lock keeps another thread from reviving it in between
+static void* weak_ref_load_locked(void* ref)
+{
+    return ((JSWeakRef*)ref)->target;
+}
+
+JSValue weak_ref_deref(JSWeakRef* ref)
+{
+    void* target = GC_call_with_alloc_lock(weak_ref_load_locked, ref);
+    if (!target)
+    {
+        return JS_VALUE_UNDEFINED;
+    }
+    return (JSValue){.type = ref->type, .value.as_pointer = target};
+}
+
+// Objects and symbols keep the values of their entries in their own properties, functions in those of their base
+static inline JSDict* weak_map_holder(void* key, uint8_t type)
+{
+    return type == JS_FUNC ? ((JSFunction*)key)->base->properties : ((JSObject*)key)->properties;
+}
+
+// Properties the map left on keys that are still alive are dropped once the map itself is unreachable
+static void GC_CALLBACK weak_map_finalize(void* object, void* data)
+{
+    JSWeakMap* map = object;
+    for (size_t i = 0; i < map->capacity; i++)
+    {
+        if (map->slots[i] == WEAK_SLOT_USED && map->keys[i])
+        {
+            dict_delete_by_symbol(weak_map_holder(map->keys[i], map->types[i]), map->token);
+        }
+    }
+}
+
+JSWeakMap* weak_map_create(void)
+{
+    heap_run_finalizers();
+    JSWeakMap* map = vm_alloc_object(sizeof(JSWeakMap));
+    // Never reachable by scripts, so its properties are invisible to them
+    map->token = object_create_object(NULL);
+    // Allocated with the first entry, like the buckets of a dict
+    map->keys = NULL;
+    map->types = NULL;
+    map->slots = NULL;
+    map->capacity = 0;
+    map->used = 0;
+    map->count = 0;
+    map->sweep = 0;
+    map->young = 0;
+    GC_register_finalizer_ignore_self(map, weak_map_finalize, NULL, NULL, NULL);
+    return map;
+}
+
+static inline size_t weak_map_hash(const void* key, size_t capacity)
+{
+    // Objects are allocated in granules of 16 bytes, the multiplication spreads neighbouring ones
+    return (size_t)(((uint64_t)(uintptr_t)key >> 4) * 0x9E3779B97F4A7C15ull >> 32) & (capacity - 1);
+}
+
+// Frees the slot of an entry whose key was collected, its value was collected together with the key
+static inline void weak_map_release(JSWeakMap* map, size_t slot)
+{
+    map->slots[slot] = WEAK_SLOT_DELETED;
+    map->count--;
+}
+
+static void weak_map_sweep(JSWeakMap* map)
+{
+    for (size_t i = 0; i < WEAK_MAP_SWEEP_STEP && map->capacity; i++)
+    {
+        size_t slot = map->sweep++ & (map->capacity - 1);
+        if (map->slots[slot] == WEAK_SLOT_USED && !map->keys[slot])
+        {
+            weak_map_release(map, slot);
+        }
+    }
+}
+
+// Returns the slot of the key or SIZE_MAX, free receives the first slot an entry for it could be added at.
+// Cleared entries on the way are released.
+static size_t weak_map_find(JSWeakMap* map, const void* key, size_t* free)
+{
+    *free = SIZE_MAX;
+    if (!map->capacity)
+    {
+        return SIZE_MAX;
+    }
+
+    // At most half of the slots are used, so the probing always ends
+    for (size_t slot = weak_map_hash(key, map->capacity);; slot = (slot + 1) & (map->capacity - 1))
+    {
+        switch (map->slots[slot])
+        {
+        case WEAK_SLOT_EMPTY:
+            if (*free == SIZE_MAX)
+            {
+                *free = slot;
+            }
+            return SIZE_MAX;
+        case WEAK_SLOT_USED:
+            if (map->keys[slot] == key)
+            {
+                return slot;
+            }
+            if (map->keys[slot])
+            {
+                break;
+            }
+            weak_map_release(map, slot);
+            // fallthrough
+        case WEAK_SLOT_DELETED:
+            if (*free == SIZE_MAX)
+            {
+                *free = slot;
+            }
+            break;
+        }
+    }
+}
+
+// Moves the live entries into new arrays sized for them, deleted and cleared ones are dropped
+static void weak_map_rehash(JSWeakMap* map)
+{
+    size_t capacity = WEAK_MAP_MIN_CAPACITY;
+    while (capacity < (map->count + 1) * 4)
+    {
+        capacity *= 2;
+    }
+
+    void** keys = vm_alloc_bytes(capacity * sizeof(void*));
+    uint8_t* types = vm_alloc_bytes(capacity);
+    uint8_t* slots = vm_alloc_bytes(capacity);
+    memset(keys, 0, capacity * sizeof(void*));
+    memset(slots, WEAK_SLOT_EMPTY, capacity);
+
+    size_t count = 0;
+    for (size_t i = 0; i < map->capacity; i++)
+    {
+        if (map->slots[i] != WEAK_SLOT_USED || !map->keys[i])
+        {
+            continue;
+        }
+        size_t slot = weak_map_hash(map->keys[i], capacity);
+        while (slots[slot] != WEAK_SLOT_EMPTY)
+        {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        keys[slot] = map->keys[i];
+        // The key may have been cleared since it was read, then there is no link left to move. Young keys
+        // have none.
+        if (!nursery_contains(keys[slot]) && GC_move_disappearing_link(&map->keys[i], &keys[slot]) != GC_SUCCESS)
+        {
+            keys[slot] = NULL;
+            continue;
+        }
+        types[slot] = map->types[i];
+        slots[slot] = WEAK_SLOT_USED;
+        count++;
+    }
+
+    map->keys = keys;
+    map->types = types;
+    map->slots = slots;
+    map->capacity = capacity;
+    map->used = count;
+    map->count = count;
+    map->sweep = 0;
+}
+
+int weak_map_get(JSWeakMap* map, JSValue key, JSValue* value)
+{
+    heap_run_finalizers();
+    weak_map_sweep(map);
+    size_t free;
+    size_t slot = weak_can_hold(key) ? weak_map_find(map, key.value.as_pointer, &free) : SIZE_MAX;
+    if (slot == SIZE_MAX)
+    {
+        return 0;
+    }
+    *value = *dict_get_by_symbol(weak_map_holder(key.value.as_pointer, key.type), map->token);
+    return 1;
+}
+
+void weak_map_set(JSWeakMap* map, JSValue key, JSValue value)
+{
+    heap_run_finalizers();
+    weak_map_sweep(map);
+    JSDict* holder = weak_map_holder(key.value.as_pointer, key.type);
+    size_t free;
+    size_t slot = weak_map_find(map, key.value.as_pointer, &free);
+    if (slot != SIZE_MAX)
+    {
+        dict_store(dict_get_by_symbol(holder, map->token), value);
+        return;
+    }
+
+    if ((map->used + 1) * 2 > map->capacity)
+    {
+        weak_map_rehash(map);
+        weak_map_find(map, key.value.as_pointer, &free);
+    }
+    if (map->slots[free] == WEAK_SLOT_EMPTY)
+    {
+        map->used++;
+    }
+    map->keys[free] = key.value.as_pointer;
+    map->types[free] = (uint8_t)key.type;
+    map->slots[free] = WEAK_SLOT_USED;
+    map->count++;
+    if (!nursery_contains(key.value.as_pointer))
+    {
+        weak_register(&map->keys[free], key.value.as_pointer);
+    }
+    else if (!map->young)
+    {
+        map->young = 1;
+        weak_list_add(&young_maps, map);
+    }
+    dict_add_with_symbol(holder, map->token, value);
+}
+
+int weak_map_delete(JSWeakMap* map, JSValue key)
+{
+    heap_run_finalizers();
+    weak_map_sweep(map);
+    size_t free;
+    size_t slot = weak_can_hold(key) ? weak_map_find(map, key.value.as_pointer, &free) : SIZE_MAX;
+    if (slot == SIZE_MAX)
+    {
+        return 0;
+    }
+    GC_unregister_disappearing_link(&map->keys[slot]);
+    map->keys[slot] = NULL;
+    weak_map_release(map, slot);
+    dict_delete_by_symbol(weak_map_holder(key.value.as_pointer, key.type), map->token);
+    return 1;
+}
+
+// Returns 1 if a key of the map is still young
+static int weak_map_update_young(JSWeakMap* map)
+{
+    int moved = 0;
+    int young = 0;
+    for (size_t i = 0; i < map->capacity; i++)
+    {
+        if (map->slots[i] != WEAK_SLOT_USED || !nursery_contains(map->keys[i]))
+        {
+            continue;
+        }
+        // A collected key leaves its slot cleared, its value was collected together with it
+        void* key = nursery_forward(map->keys[i]);
+        moved |= key && key != map->keys[i];
+        map->keys[i] = key;
+        if (nursery_contains(key))
+        {
+            young = 1;
+        }
+        else if (key)
+        {
+            weak_register(&map->keys[i], key);
+        }
+    }
+    // Keys are hashed by their address
+    if (moved)
+    {
+        weak_map_rehash(map);
+    }
+    return young;
+}
+
+void weak_update_young(void)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < young_refs.count; i++)
+    {
+        JSWeakRef* ref = young_refs.items[i];
+        if (!ref)
+        {
+            continue;
+        }
+        ref->target = nursery_forward(ref->target);
+        if (nursery_contains(ref->target))
+        {
+            weak_list_keep(&young_refs, i, count++);
+            continue;
+        }
+        if (ref->target)
+        {
+            weak_register(&ref->target, ref->target);
+        }
+        weak_list_drop(&young_refs, i);
+    }
+    young_refs.count = count;
+
+    count = 0;
+    for (size_t i = 0; i < young_maps.count; i++)
+    {
+        JSWeakMap* map = young_maps.items[i];
+        if (!map)
+        {
+            continue;
+        }
+        map->young = weak_map_update_young(map);
+        if (map->young)
+        {
+            weak_list_keep(&young_maps, i, count++);
+            continue;
+        }
+        weak_list_drop(&young_maps, i);
+    }
+    young_maps.count = count;
+}
@@ -0,0 +1,49 @@
+#ifndef WEAK_H
+#define WEAK_H
+
+#include "value.h"
+
+typedef struct JSWeakRef JSWeakRef;
+typedef struct JSWeakMap JSWeakMap;
+
+/**
+ * Objects, functions and symbols can be held weakly, other values are not allocated on their own
+ */
+int weak_can_hold(JSValue value);
+
+/**
+ * The target has to be a value weak_can_hold accepts
+ */
+JSWeakRef* weak_ref_create(JSValue target);
+
+/**
+ * Returns undefined once the target was collected
+ */
+JSValue weak_ref_deref(JSWeakRef* ref);
+
+/**
+ * Entries are looked up by the identity of their key and do not keep it alive. The values are stored on the
+ * keys, so a value is collected together with its key even if it references the key. Once the map is
+ * collected, its finalizer removes the values from the keys that are still alive.
+ */
+JSWeakMap* weak_map_create(void);
+
+/**
+ * Returns 0 and leaves value untouched if the key has no entry
+ */
+int weak_map_get(JSWeakMap* map, JSValue key, JSValue* value);
+
+/**
+ * The key has to be a value weak_can_hold accepts
+ */
+void weak_map_set(JSWeakMap* map, JSValue key, JSValue value);
+
+int weak_map_delete(JSWeakMap* map, JSValue key);
+
+/**
+ * Young targets and keys get no disappearing links, the minor collection calls this once it knows which of
+ * them survived. Moved ones get their links, collected ones are cleared.
+ */
+void weak_update_young(void);
+
+#endif //WEAK_H
@@ -0,0 +1,47 @@
+#ifndef WEAK_IMPL_H
+#define WEAK_IMPL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "weak.h"
+#include "object.h"
+#include "value.impl.h"
+
+typedef enum
+{
+    WEAK_SLOT_EMPTY,
+    // Holds a key or held one the collector cleared, whose slot is not released yet
+    WEAK_SLOT_USED,
+    WEAK_SLOT_DELETED
+} JSWeakSlot;
+
+// Allocated atomic, so the collector does not see the target
+struct JSWeakRef
+{
+    void* target;
+    JSValueType type;
+};
+
+// Values are stored on their keys, as properties keyed by the token of the map. A value is therefore only
+// retained while its key is, even if it references the key, and the map itself holds no values.
+struct JSWeakMap
+{
+    JSObject* token;
+    // Atomic, every key is a disappearing link the collector clears together with its object
+    void** keys;
+    // Value types of the keys, which tell where their properties are
+    uint8_t* types;
+    uint8_t* slots;
+    size_t capacity;
+    // Slots that are not empty, probing ends at an empty one
+    size_t used;
+    // Used slots, including the ones of cleared keys
+    size_t count;
+    // Next slot the incremental sweep looks at
+    size_t sweep;
+    // Listed for the next minor collection, one of the keys is young
+    int young;
+};
+
+#endif //WEAK_IMPL_H
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <gc.h>
 
 #include "AtomixJS.h"
@@ -15,27 +16,74 @@ static JSBundle* bundle = &_bundle;
 
 int main(int argc, const char** argv)
 {
-    GC_init();
-    if (argc < 2)
+    // Options of the collector come before the file and take precedence over the environment
+    HeapConfig config = heap_config_from_env();
+    int arg = 1;
+    while (arg < argc && argv[arg][0] == '-' && argv[arg][1] == '-')
     {
-        printf("Usage: ./atomix <filename>\n");
+        if (!heap_config_parse_option(&config, argv[arg]))
+        {
+            printf("Unknown option: %s\n", argv[arg]);
+            return 1;
+        }
+        arg++;
+    }
+    heap_init(&config);
+    if (arg >= argc)
+    {
+        printf("Usage: ./atomix [--gc-<option>[=<value>]...] <filename>\n");
         return 1;
     }
-    const char* bin_file = argv[1];
+    const char* bin_file = argv[arg];
 
-    LoadResult result = unknown_load_from_file(bin_file, module, bundle);
+    LoadResult result = unknown_map_file(bin_file, module, bundle);
     
+    if (result == LOAD_INVALID)
+    {
+        fprintf(stderr, "Invalid bytecode: %s\n", loader_get_rejection());
+        return 1;
+    }
+
     if (result == LOAD_BUNDLE) {
+#ifdef GC_THREADS
+        // Decodes the whole bundle up front instead of on first import, e.g. ATOMIX_LOAD_THREADS=0 uses every core
+        const char* threads = getenv("ATOMIX_LOAD_THREADS");
+        if (threads)
+        {
+            bundle_decode_all(bundle, strtoul(threads, NULL, 10));
+        }
+#endif
+
         if (!bundle->entryPoint)
         {
             return 0;
         }
 
-        module = bundle_get_module(bundle, bundle->entryPoint);
+        const char* rejection = module_table_get(bundle->entryPoint, &module);
+        if (rejection)
+        {
+            fprintf(stderr, "Invalid bytecode: %s\n", rejection);
+            return 1;
+        }
     }
 
-    VM vm = vm_init(module);
-    vm_exec_module(&vm, module);    
+    VM* vm = vm_init(module);
+    vm_exec_module(vm, module);
+
+    int status = api_report_exception(vm);
+    if (config.census)
+    {
+        census_print(vm, stderr);
+    }
+    vm_free(vm);
 
-    return 0;
+    if (config.stats)
+    {
+        heap_print_stats(stderr);
+    }
+    if (config.allocations)
+    {
+        heap_print_allocations(stderr);
+    }
+    return status;
 }
@@ -9,6 +9,7 @@
 #include "format.impl.h"
 #include "function.impl.h"
 #include "object.impl.h"
+#include "generator.impl.h"
 
 JSValue print(VM* vm, JSValue this, JSValue* args, size_t argc)
 {
@@ -65,6 +66,10 @@ JSValue print(VM* vm, JSValue this, JSValue* args, size_t argc)
         case JS_SYMBOL:
             printf("[Symbol]\n");
             break;
+        case JS_GS_BOX:
+        case JS_INTERNAL:
+            // Accessor boxes and host data live in property tables, scripts never pass them
+            break;
         }
     }
 
@@ -76,21 +81,30 @@ JSValue module_get_export_obj(VM* vm, JSValue this, JSValue* args, size_t argc)
     return JS_VALUE_OBJECT(vm->module->exports);
 }
 
+static uint32_t module_hash_half(JSValue value)
+{
+    // Halves above INT32_MAX are compiled to doubles
+    return value.type == JS_INTEGER
+        ? (uint32_t)value.value.as_int
+        : (uint32_t)value.value.as_double;
+}
+
 JSValue module_import_module(VM* vm, JSValue this, JSValue* args, size_t argc)
 {
-    if (argc < 2)
+    if (argc < 2 ||
+        (args[0].type != JS_INTEGER && args[0].type != JS_DOUBLE) ||
+        (args[1].type != JS_INTEGER && args[1].type != JS_DOUBLE))
     {
-        // TODO throw exception
-        return JS_VALUE_UNDEFINED;
+        return api_throw_error(vm, object_get_type_error_prototype(), "Module hash has to be two integers");
     }
-
-    if (args[0].type != JS_INTEGER || args[1].type != JS_INTEGER)
+    // Low and high half, the same order the module header stores them in
+    uint64_t hash = ((uint64_t)module_hash_half(args[1])) << 32 | module_hash_half(args[0]);
+    JSModule* module;
+    const char* rejection = module_table_get(hash, &module);
+    if (rejection)
     {
-        // TODO throw exception
-        return JS_VALUE_UNDEFINED;
+        return api_throw_error(vm, object_get_error_prototype(), (char*)rejection);
     }
-    uint64_t hash = ((uint64_t)args[0].value.as_int) << 32 | ((uint32_t)args[1].value.as_int);
-    JSModule* module = bundle_get_module(vm->module->bundle, hash);
     if (!module->initialized)
     {
         module->initialized = 1;
@@ -108,25 +122,18 @@ JSValue object(VM* vm, JSValue this, JSValue* args, size_t argc)
 
 JSValue instantiate(VM* vm, JSValue this, JSValue* args, size_t argc)
 {
-    if (argc == 0)
+    if (argc == 0 || args[0].type != JS_FUNC)
     {
-        // TODO throw exception
-        return JS_VALUE_UNDEFINED;
+        return api_throw_error(vm, object_get_type_error_prototype(), "Constructor is not a function");
     }
 
     JSValue constructor_wrapped = args[0];
-    if (constructor_wrapped.type != JS_FUNC)
-    {
-        // TODO throw exception
-        return JS_VALUE_UNDEFINED;
-    }
     JSFunction* constructor = constructor_wrapped.value.as_pointer;
 
     JSValue prototype_wrapped = object_get_property(vm, constructor->base, "prototype");
     if (prototype_wrapped.type != JS_OBJECT)
     {
-        // TODO throw exception
-        return JS_VALUE_UNDEFINED;
+        return api_throw_error(vm, object_get_type_error_prototype(), "Constructor has no prototype object");
     }
 
     JSObject* obj = object_create_object((JSObject*)prototype_wrapped.value.as_pointer);
@@ -148,8 +155,7 @@ JSValue create(VM* vm, JSValue this, JSValue* args, size_t argc)
 
     if (args[0].type != JS_OBJECT)
     {
-        // TODO throw exception
-        return JS_VALUE_OBJECT(object_create_object(object_get_object_prototype()));
+        return api_throw_error(vm, object_get_type_error_prototype(), "Object prototype may only be an Object");
     }
 
     return JS_VALUE_OBJECT(object_create_object((JSObject*)args[0].value.as_pointer));
@@ -165,8 +171,7 @@ JSValue setPrototypeOf(VM* vm, JSValue this, JSValue* args, size_t argc)
     if ((args[0].type != JS_OBJECT && args[0].type != JS_FUNC) ||
         (args[1].type != JS_OBJECT && args[1].type != JS_FUNC))
     {
-        // TODO throw exception
-        return JS_VALUE_UNDEFINED;
+        return api_throw_error(vm, object_get_type_error_prototype(), "Object prototype may only be an Object");
     }
 
     JSObject* target = args[0].type == JS_OBJECT
@@ -177,6 +182,7 @@ JSValue setPrototypeOf(VM* vm, JSValue this, JSValue* args, size_t argc)
         : ((JSFunction*)args[1].value.as_pointer)->base;
 
     target->prototype = prototype;
+    nursery_barrier(target, HEAP_ALLOC_OBJECT, prototype);
     return JS_VALUE_UNDEFINED;
 }
 
@@ -189,8 +195,7 @@ JSValue array(VM* vm, JSValue this, JSValue* args, size_t argc)
         JSValue length = args[0];
         if (length.type == JS_DOUBLE)
         {
-            // TODO throw exception
-            return JS_VALUE_UNDEFINED;
+            return api_throw_error(vm, object_get_range_error_prototype(), "Invalid array length");
         }
 
         if (length.type == JS_INTEGER)
@@ -231,14 +236,12 @@ JSValue is_array(VM* vm, JSValue this, JSValue* args, size_t argc)
 }
 
 JSValue function(VM* vm, JSValue this, JSValue* args, size_t argc) {
-    // TODO throw exception
-    return JS_VALUE_UNDEFINED;
+    return api_throw_error(vm, object_get_error_prototype(), "Function constructor is not supported");
 }
 
 JSValue call(VM* vm, JSValue this, JSValue* args, size_t argc) {
     if (this.type != JS_FUNC) {
-        // TODO throw execption
-        return JS_VALUE_UNDEFINED;
+        return api_throw_error(vm, object_get_type_error_prototype(), "Function.prototype.call called on a non function");
     }
 
     JSFunction* function = this.value.as_pointer;
@@ -266,6 +269,306 @@ JSValue symbol(VM* vm, JSValue this, JSValue* args, size_t argc)
     return JS_VALUE_SYMBOL(symbol);
 }
 
+static JSValue error_create(VM* vm, JSValue this, JSValue* args, size_t argc, JSObject* prototype)
+{
+    // Object.instantiate already created the object with the right prototype
+    JSObject* error = this.type == JS_OBJECT
+        ? this.value.as_pointer
+        : object_create_object(prototype);
+    if (argc > 0 && args[0].type != JS_UNDEFINED)
+    {
+        JSValue message = args[0].type == JS_STRING
+            ? args[0]
+            : JS_VALUE_STRING(value_to_string(&args[0]));
+        object_set_property(vm, error, init_string("message"), message);
+    }
+
+    return JS_VALUE_OBJECT(error);
+}
+
+JSValue error(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    return error_create(vm, this, args, argc, object_get_error_prototype());
+}
+
+JSValue type_error(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    return error_create(vm, this, args, argc, object_get_type_error_prototype());
+}
+
+JSValue range_error(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    return error_create(vm, this, args, argc, object_get_range_error_prototype());
+}
+
+JSValue reference_error(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    return error_create(vm, this, args, argc, object_get_reference_error_prototype());
+}
+
+static JSValue iterator_result(VM* vm, JSValue value, int done)
+{
+    JSObject* result = object_create_young_object(object_get_object_prototype());
+    object_set_property(vm, result, init_string("value"), value);
+    object_set_property(vm, result, init_string("done"), JS_VALUE_BOOL(done));
+    return JS_VALUE_OBJECT(result);
+}
+
+JSValue iterator_self(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    return this;
+}
+
+JSValue generator_next(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    JSGenerator* generator = generator_of(this);
+    if (!generator)
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "next called on a non generator");
+    }
+    if (generator->state == GENERATOR_RUNNING)
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "Generator is already running");
+    }
+    if (generator->state == GENERATOR_DONE)
+    {
+        return iterator_result(vm, JS_VALUE_UNDEFINED, 1);
+    }
+
+    JSValue value = vm_exec_generator(vm, generator, argc > 0 ? args[0] : JS_VALUE_UNDEFINED);
+    if (vm->unwinding)
+    {
+        return JS_VALUE_UNDEFINED;
+    }
+    return iterator_result(vm, value, generator->state == GENERATOR_DONE);
+}
+
+typedef struct
+{
+    JSObject* array;
+    int32_t index;
+} ArrayIterator;
+
+static JSObject* array_iterator_prototype = NULL;
+
+JSValue array_iterator_next(VM* vm, JSValue this, JSValue* args, size_t argc);
+
+// Created on first use like the prototypes of the core, so a snapshot of the runtime does not have to hold it
+static JSObject* core_get_array_iterator_prototype(VM* vm)
+{
+    if (!array_iterator_prototype)
+    {
+        JSObject* iterator = symbol_iterator(vm).value.as_pointer;
+        array_iterator_prototype = object_create_object(object_get_object_prototype());
+        object_set_property(vm, array_iterator_prototype, init_string("next"), JS_VALUE_FUNCTION(function_create_native_function(array_iterator_next)));
+        object_set_property_with_symbol(vm, array_iterator_prototype, iterator, JS_VALUE_FUNCTION(function_create_native_function(iterator_self)));
+    }
+
+    return array_iterator_prototype;
+}
+
+JSValue array_values(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    if (this.type != JS_OBJECT)
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "Array iterator called on a non object");
+    }
+
+    ArrayIterator* state = vm_alloc_object(sizeof(ArrayIterator));
+    state->array = this.value.as_pointer;
+    nursery_barrier(state, HEAP_ALLOC_OBJECT, state->array);
+    state->index = 0;
+
+    JSObject* iterator = object_create_object(core_get_array_iterator_prototype(vm));
+    object_set_internal(iterator, state);
+    return JS_VALUE_OBJECT(iterator);
+}
+
+JSValue array_iterator_next(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    ArrayIterator* state = this.type == JS_OBJECT && ((JSObject*)this.value.as_pointer)->prototype == core_get_array_iterator_prototype(vm)
+        ? object_get_internal(this.value.as_pointer)
+        : NULL;
+    if (!state)
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "next called on a non array iterator");
+    }
+    if (!state->array)
+    {
+        return iterator_result(vm, JS_VALUE_UNDEFINED, 1);
+    }
+
+    // The length is read on every step, elements pushed while iterating are visited as well
+    JSValue length = object_get_property(vm, state->array, "length");
+    if (length.type != JS_INTEGER || state->index >= length.value.as_int)
+    {
+        state->array = NULL;
+        return iterator_result(vm, JS_VALUE_UNDEFINED, 1);
+    }
+
+    JSValue index = JS_VALUE_INT(state->index++);
+    return iterator_result(vm, object_get_property(vm, state->array, value_to_string(&index)), 0);
+}
+
+// Sizes are in bytes and times in milliseconds, sizes are doubles as they may not fit an integer
+JSValue gc_stats(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    HeapStats stats = heap_get_stats();
+    JSObject* result = object_create_object(object_get_object_prototype());
+    object_set_property(vm, result, init_string("heapSize"), JS_VALUE_DOUBLE((double)stats.heap_size));
+    object_set_property(vm, result, init_string("freeBytes"), JS_VALUE_DOUBLE((double)stats.free_bytes));
+    object_set_property(vm, result, init_string("unmappedBytes"), JS_VALUE_DOUBLE((double)stats.unmapped_bytes));
+    object_set_property(vm, result, init_string("bytesSinceGC"), JS_VALUE_DOUBLE((double)stats.bytes_since_gc));
+    object_set_property(vm, result, init_string("totalBytes"), JS_VALUE_DOUBLE((double)stats.total_bytes));
+    object_set_property(vm, result, init_string("collections"), JS_VALUE_DOUBLE((double)stats.collections));
+    object_set_property(vm, result, init_string("pauses"), JS_VALUE_DOUBLE((double)stats.pauses.count));
+    object_set_property(vm, result, init_string("pauseTotalMs"), JS_VALUE_DOUBLE(stats.pauses.total_ms));
+    object_set_property(vm, result, init_string("pauseMaxMs"), JS_VALUE_DOUBLE(stats.pauses.max_ms));
+    return JS_VALUE_OBJECT(result);
+}
+
+JSValue gc_collect(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    heap_collect();
+    return JS_VALUE_UNDEFINED;
+}
+
+// True while a collection is left in progress
+JSValue gc_collect_a_little(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    return JS_VALUE_BOOL(heap_collect_a_little() != 0);
+}
+
+JSValue gc_collect_idle(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    if (argc < 1 || (args[0].type != JS_INTEGER && args[0].type != JS_DOUBLE))
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "Idle time has to be a number of milliseconds");
+    }
+    double budget = args[0].type == JS_INTEGER ? args[0].value.as_int : args[0].value.as_double;
+    return JS_VALUE_BOOL(heap_collect_idle(budget) != 0);
+}
+
+JSValue gc_enter_critical(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    heap_enter_critical();
+    return JS_VALUE_UNDEFINED;
+}
+
+JSValue gc_leave_critical(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    if (!heap_leave_critical())
+    {
+        return api_throw_error(vm, object_get_error_prototype(), "No critical section was entered");
+    }
+    return JS_VALUE_UNDEFINED;
+}
+
+// Like the errors, called without new the object is created here
+static JSObject* weak_create(JSValue this, JSObject* prototype)
+{
+    return this.type == JS_OBJECT && ((JSObject*)this.value.as_pointer)->prototype == prototype
+        && !object_get_internal(this.value.as_pointer)
+        ? this.value.as_pointer
+        : object_create_object(prototype);
+}
+
+JSValue weak_ref(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    if (argc < 1 || !weak_can_hold(args[0]))
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "WeakRef target has to be an object or a symbol");
+    }
+
+    JSObject* ref = weak_create(this, object_get_weak_ref_prototype());
+    object_set_internal(ref, weak_ref_create(args[0]));
+    return JS_VALUE_OBJECT(ref);
+}
+
+JSValue weak_ref_deref_native(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    JSWeakRef* ref = this.type == JS_OBJECT && ((JSObject*)this.value.as_pointer)->prototype == object_get_weak_ref_prototype()
+        ? object_get_internal(this.value.as_pointer)
+        : NULL;
+    if (!ref)
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "deref called on a non WeakRef");
+    }
+    return weak_ref_deref(ref);
+}
+
+JSValue weak_map(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    JSObject* map = weak_create(this, object_get_weak_map_prototype());
+    object_set_internal(map, weak_map_create());
+    return JS_VALUE_OBJECT(map);
+}
+
+static JSWeakMap* weak_map_this(JSValue this)
+{
+    return this.type == JS_OBJECT && ((JSObject*)this.value.as_pointer)->prototype == object_get_weak_map_prototype()
+        ? object_get_internal(this.value.as_pointer)
+        : NULL;
+}
+
+JSValue weak_map_get_native(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    JSWeakMap* map = weak_map_this(this);
+    if (!map)
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "get called on a non WeakMap");
+    }
+    JSValue value = JS_VALUE_UNDEFINED;
+    if (argc > 0)
+    {
+        weak_map_get(map, args[0], &value);
+    }
+    return value;
+}
+
+JSValue weak_map_set_native(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    JSWeakMap* map = weak_map_this(this);
+    if (!map)
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "set called on a non WeakMap");
+    }
+    if (argc < 1 || !weak_can_hold(args[0]))
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "WeakMap key has to be an object or a symbol");
+    }
+    weak_map_set(map, args[0], argc > 1 ? args[1] : JS_VALUE_UNDEFINED);
+    return this;
+}
+
+JSValue weak_map_has_native(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    JSWeakMap* map = weak_map_this(this);
+    if (!map)
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "has called on a non WeakMap");
+    }
+    JSValue value;
+    return JS_VALUE_BOOL(argc > 0 && weak_map_get(map, args[0], &value));
+}
+
+JSValue weak_map_delete_native(VM* vm, JSValue this, JSValue* args, size_t argc)
+{
+    JSWeakMap* map = weak_map_this(this);
+    if (!map)
+    {
+        return api_throw_error(vm, object_get_type_error_prototype(), "delete called on a non WeakMap");
+    }
+    return JS_VALUE_BOOL(argc > 0 && weak_map_delete(map, args[0]));
+}
+
+static void core_declare_constructor(VM* vm, Scope* scope, char* name, JSFunction* constructor, JSObject* prototype)
+{
+    object_set_property(vm, constructor->base, init_string("prototype"), JS_VALUE_OBJECT(prototype));
+    object_set_property(vm, prototype, init_string("constructor"), JS_VALUE_FUNCTION(constructor));
+    scope_declare(scope, init_string(name), JS_VALUE_FUNCTION(constructor));
+}
+
 void core_init(VM* vm, Scope* scope)
 {
     // Helper
@@ -320,6 +623,58 @@ void core_init(VM* vm, Scope* scope)
     _symbol->base->prototype = object_get_symbol_prototype();
 
     object_set_property(vm, _symbol->base, init_string("toPrimitive"), symbol_to_primitive(vm));
+    object_set_property(vm, _symbol->base, init_string("iterator"), symbol_iterator(vm));
 
     scope_declare(scope, init_string("Symbol"), JS_VALUE_FUNCTION(_symbol));
+
+    // GC
+    JSObject* _gc = object_create_object(object_get_object_prototype());
+
+    JSFunction* _gc_stats = function_create_native_function(gc_stats);
+    object_set_property(vm, _gc, init_string("stats"), JS_VALUE_FUNCTION(_gc_stats));
+
+    JSFunction* _gc_collect = function_create_native_function(gc_collect);
+    object_set_property(vm, _gc, init_string("collect"), JS_VALUE_FUNCTION(_gc_collect));
+
+    JSFunction* _gc_collect_a_little = function_create_native_function(gc_collect_a_little);
+    object_set_property(vm, _gc, init_string("collectALittle"), JS_VALUE_FUNCTION(_gc_collect_a_little));
+
+    JSFunction* _gc_collect_idle = function_create_native_function(gc_collect_idle);
+    object_set_property(vm, _gc, init_string("collectIdle"), JS_VALUE_FUNCTION(_gc_collect_idle));
+
+    JSFunction* _gc_enter_critical = function_create_native_function(gc_enter_critical);
+    object_set_property(vm, _gc, init_string("enterCritical"), JS_VALUE_FUNCTION(_gc_enter_critical));
+
+    JSFunction* _gc_leave_critical = function_create_native_function(gc_leave_critical);
+    object_set_property(vm, _gc, init_string("leaveCritical"), JS_VALUE_FUNCTION(_gc_leave_critical));
+
+    scope_declare(scope, init_string("GC"), JS_VALUE_OBJECT(_gc));
+
+    // Errors
+    core_declare_constructor(vm, scope, "Error", function_create_native_function(error), object_get_error_prototype());
+    core_declare_constructor(vm, scope, "TypeError", function_create_native_function(type_error), object_get_type_error_prototype());
+    core_declare_constructor(vm, scope, "RangeError", function_create_native_function(range_error), object_get_range_error_prototype());
+    core_declare_constructor(vm, scope, "ReferenceError", function_create_native_function(reference_error), object_get_reference_error_prototype());
+
+    // Weak references
+    JSObject* _weak_ref_prototype = object_get_weak_ref_prototype();
+    object_set_property(vm, _weak_ref_prototype, init_string("deref"), JS_VALUE_FUNCTION(function_create_native_function(weak_ref_deref_native)));
+    core_declare_constructor(vm, scope, "WeakRef", function_create_native_function(weak_ref), _weak_ref_prototype);
+
+    JSObject* _weak_map_prototype = object_get_weak_map_prototype();
+    object_set_property(vm, _weak_map_prototype, init_string("get"), JS_VALUE_FUNCTION(function_create_native_function(weak_map_get_native)));
+    object_set_property(vm, _weak_map_prototype, init_string("set"), JS_VALUE_FUNCTION(function_create_native_function(weak_map_set_native)));
+    object_set_property(vm, _weak_map_prototype, init_string("has"), JS_VALUE_FUNCTION(function_create_native_function(weak_map_has_native)));
+    object_set_property(vm, _weak_map_prototype, init_string("delete"), JS_VALUE_FUNCTION(function_create_native_function(weak_map_delete_native)));
+    core_declare_constructor(vm, scope, "WeakMap", function_create_native_function(weak_map), _weak_map_prototype);
+
+    // Iteration protocol
+    JSObject* iterator = symbol_iterator(vm).value.as_pointer;
+    JSFunction* _iterator_self = function_create_native_function(iterator_self);
+
+    JSObject* _generator_prototype = object_get_generator_prototype();
+    object_set_property(vm, _generator_prototype, init_string("next"), JS_VALUE_FUNCTION(function_create_native_function(generator_next)));
+    object_set_property_with_symbol(vm, _generator_prototype, iterator, JS_VALUE_FUNCTION(_iterator_self));
+
+    object_set_property_with_symbol(vm, object_get_array_prototype(), iterator, JS_VALUE_FUNCTION(function_create_native_function(array_values)));
 }
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <gc.h>
 
 #include "AtomixJS.h"
@@ -16,23 +17,66 @@ static JSBundle* bundle = &_bundle;
 extern uint8_t __BYTECODE__[];
 extern const size_t __BYTECODE_SIZE__;
 
+// Empty unless the builder embeds the snapshot taken by snapshot_writer.c, which is not linked in here
+extern const uint8_t __SNAPSHOT__[];
+extern const size_t __SNAPSHOT_SIZE__;
+
 int main(int argc, const char** argv)
 {
-    GC_init();
+    // The program has no use for its arguments, so only options of the collector are picked out of them
+    HeapConfig config = heap_config_from_env();
+    for (int i = 1; i < argc; i++)
+    {
+        heap_config_parse_option(&config, argv[i]);
+    }
+    heap_init(&config);
+
+    // Restored before the bytecode is loaded, modules have to see the prototypes of the snapshot
+    Scope* global_scope = __SNAPSHOT_SIZE__
+        ? snapshot_restore(__SNAPSHOT__, __SNAPSHOT_SIZE__)
+        : NULL;
+
+    LoadResult result = unknown_load_from_buffer(__BYTECODE__, __BYTECODE_SIZE__, module, bundle);
+
+    if (result == LOAD_INVALID)
+    {
+        fprintf(stderr, "Invalid bytecode: %s\n", loader_get_rejection());
+        return 1;
+    }
 
-    LoadResult result = unknown_load_from_buffer(__BYTECODE__, module, bundle);
-    
     if (result == LOAD_BUNDLE) {
         if (!bundle->entryPoint)
         {
             return 0;
         }
 
-        module = bundle_get_module(bundle, bundle->entryPoint);
+        const char* rejection = module_table_get(bundle->entryPoint, &module);
+        if (rejection)
+        {
+            fprintf(stderr, "Invalid bytecode: %s\n", rejection);
+            return 1;
+        }
     }
 
-    VM vm = vm_init(module);
-    vm_exec_module(&vm, module);    
+    VM* vm = global_scope
+        ? vm_init_from_snapshot(module, global_scope)
+        : vm_init(module);
+    vm_exec_module(vm, module);
+
+    int status = api_report_exception(vm);
+    if (config.census)
+    {
+        census_print(vm, stderr);
+    }
+    vm_free(vm);
 
-    return 0;
+    if (config.stats)
+    {
+        heap_print_stats(stderr);
+    }
+    if (config.allocations)
+    {
+        heap_print_allocations(stderr);
+    }
+    return status;
 }
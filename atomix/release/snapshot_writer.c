@@ -0,0 +1,40 @@
+// Only compiled with ATOMIX_SNAPSHOT_WRITER into the executable the builder runs to take the snapshot.
+// The writer is linked after everything else and runs before main, so the runtime keeps the code offsets
+// it has in the release binary, which is how the snapshot refers to native functions.
+#ifdef ATOMIX_SNAPSHOT_WRITER
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "AtomixJS.h"
+
+#include "vm.impl.h"
+
+__attribute__((constructor)) static void snapshot_writer(void)
+{
+    const char* filename = getenv("ATOMIX_SNAPSHOT");
+    if (!filename)
+    {
+        PANIC("Missing snapshot file");
+    }
+
+    HeapConfig config = heap_config_from_env();
+    heap_init(&config);
+
+    VM* vm = vm_init(NULL);
+    size_t size;
+    uint8_t* image = snapshot_create(vm, &size);
+    vm_free(vm);
+
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        PANIC("Could not open file");
+    }
+    fwrite(image, size, 1, file);
+    fclose(file);
+    free(image);
+    exit(0);
+}
+
+#endif
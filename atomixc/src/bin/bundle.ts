@@ -3,18 +3,21 @@ import {OptionSet, SubCommandSet} from "@koschel-christoph/node.options";
 import {ModuleFormat} from "../format/module";
 import {BinaryReader, BinaryWriter} from "../binary";
 import {buildBundle, BundleFormat} from "../format/bundle";
+import {buildCompressed} from "../format/compressed";
 
 function* bundle(handler: SubCommandSet): Generator<OptionSet> {
     let help: boolean = false;
     const files: string[] = [];
     let entryPoint: string | null = null;
     let output: string | null = null;
+    let compress: boolean = false;
 
     const set: OptionSet = new OptionSet(
         "Usage: atomixc bundle <file> -o <output> [<option>]",
         ["<>", "Modules used for bundling", v => files.push(v)],
         ["e=|entry=", "Module that acts as the {entry} point", v => entryPoint = v],
         ["o=|output=", "The output {file} of the bundle", v => output = v],
+        ["z|compress", "Compress the bundle, the VM inflates it when loading", () => compress = true],
         ["h|help", "Prints this help text", () => help = true]
     );
 
@@ -79,8 +82,15 @@ function* bundle(handler: SubCommandSet): Generator<OptionSet> {
         modules
     );
 
-    const writer: BinaryWriter = new BinaryWriter(output);
+    if (!compress) {
+        const writer: BinaryWriter = new BinaryWriter(output);
+        bundle.writeTo(writer);
+        return;
+    }
+
+    const writer: BinaryWriter = new BinaryWriter();
     bundle.writeTo(writer);
+    fs.writeFileSync(output, buildCompressed(writer.toBuffer()));
 }
 
 const command: [string, string, (handler: SubCommandSet) => Generator<OptionSet | SubCommandSet>] = ["bundle", "Bundle multiple modules into a bundle", bundle];
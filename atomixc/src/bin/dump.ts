@@ -4,6 +4,7 @@ import {BinaryReader} from "../binary";
 import {Dumper} from "../dumper";
 import {ModuleFormat} from "../format/module";
 import {BundleFormat} from "../format/bundle";
+import {isCompressed, readCompressed} from "../format/compressed";
 
 function* dump(handler: SubCommandSet): Generator<OptionSet> {
     const files: string[] = [];
@@ -32,7 +33,11 @@ function* dump(handler: SubCommandSet): Generator<OptionSet> {
     const dumper: Dumper = new Dumper();
 
     for (const file of files) {
-        const reader: BinaryReader = new BinaryReader(file);
+        let reader: BinaryReader = new BinaryReader(file);
+        if (isCompressed(reader)) {
+            console.log("    COMPRESSED: " + file);
+            reader = new BinaryReader(readCompressed(fs.readFileSync(file)));
+        }
         if (ModuleFormat.isModule(reader)) {
             console.log("    MODULE: " + file);
             dumper.dumpModule(ModuleFormat.readFrom(reader));
@@ -17,6 +17,9 @@ function* init(handler: SubCommandSet): Generator<OptionSet> {
     let name: string | null = null;
     let bytecode: string | null = null;
     let release: boolean = false;
+    let compress: boolean = false;
+    let threaded: boolean = false;
+    let snapshot: boolean = false;
 
     const set: OptionSet = new OptionSet(
         "Usage: atomixc engine init -p <platform> -a <arch> [<options>]",
@@ -25,6 +28,9 @@ function* init(handler: SubCommandSet): Generator<OptionSet> {
         ["n=|name=", "The output {name}", v => name = v],
         ["bc=", "The {bytecode} file that should be embedded", v => bytecode = v],
         ["r|release", "Build a release version", () => release = true],
+        ["z|compress", "Compress the embedded bytecode", () => compress = true],
+        ["m|threaded", "Build the threaded engine, which marks the heap and decodes bundles with one thread per core", () => threaded = true],
+        ["s|snapshot", "Embed a snapshot of the initialized runtime into the release executable", () => snapshot = true],
         ["h|help", "Prints this help text", () => help = true]
     );
 
@@ -70,7 +76,7 @@ function* init(handler: SubCommandSet): Generator<OptionSet> {
     }
 
     structure.initStructure(process.cwd());
-    structure.initEngineBuild(process.cwd(), PLATFORMS[platform], ARCHITECTURES[architecture], release, name, bytecode);
+    structure.initEngineBuild(process.cwd(), PLATFORMS[platform], ARCHITECTURES[architecture], release, name, bytecode, compress, threaded, snapshot);
 }
 
 const command: [string, string, (handler: SubCommandSet) => Generator<OptionSet | SubCommandSet>] = ["init", "Init a new engine in the CWD", init];
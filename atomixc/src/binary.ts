@@ -1,10 +1,31 @@
 import * as fs from "fs";
 
+export function varUIntLength(x: number): number {
+    let length: number = 1;
+    for (x = x >>> 0; x >= 0x80; x = x >>> 7) {
+        length++;
+    }
+    return length;
+}
+
+export function varIntLength(x: number): number {
+    let length: number = 1;
+    for (x = x >> 0; x < -0x40 || x >= 0x40; x = x >> 7) {
+        length++;
+    }
+    return length;
+}
+
 export class BinaryWriter {
-    private stream: fs.WriteStream;
+    private stream: fs.WriteStream | null;
+    private chunks: Buffer[];
 
-    public constructor(file: string) {
-        this.stream = fs.createWriteStream(file);
+    /**
+     * Without a file everything written is kept in memory, see toBuffer
+     */
+    public constructor(file: string | null = null) {
+        this.stream = file ? fs.createWriteStream(file) : null;
+        this.chunks = [];
     }
 
     public writeU8(x: number): void {
@@ -47,6 +68,35 @@ export class BinaryWriter {
         this.write(buf);        
     }
 
+    /**
+     * Unsigned LEB128: seven bits per byte starting with the lowest ones, the high bit marks that another
+     * byte follows
+     */
+    public writeVarUInt(x: number): void {
+        x = x >>> 0;
+        do {
+            const byte: number = x & 0x7F;
+            x = x >>> 7;
+            this.writeU8(x != 0 ? byte | 0x80 : byte);
+        } while (x != 0);
+    }
+
+    /**
+     * Signed LEB128, the last byte is sign extended from its bit 0x40
+     */
+    public writeVarInt(x: number): void {
+        x = x >> 0;
+        while (true) {
+            const byte: number = x & 0x7F;
+            x = x >> 7;
+            if ((x == 0 && (byte & 0x40) == 0) || (x == -1 && (byte & 0x40) != 0)) {
+                this.writeU8(byte);
+                return;
+            }
+            this.writeU8(byte | 0x80);
+        }
+    }
+
     public writeString(str: string): void {
         for (const c of str) {
             this.writeU8(c.charCodeAt(0));
@@ -54,11 +104,19 @@ export class BinaryWriter {
     }
 
     public write(buff: Buffer): void {
-        this.stream.write(buff);
+        if (this.stream) {
+            this.stream.write(buff);
+        } else {
+            this.chunks.push(buff);
+        }
+    }
+
+    public toBuffer(): Buffer {
+        return Buffer.concat(this.chunks);
     }
 
     public close(): void {
-        this.stream.close();
+        this.stream?.close();
     }
 }
 
@@ -118,6 +176,39 @@ export class BinaryReader {
         return val;
     }
 
+    public readBytes(length: number): Buffer {
+        const val: Buffer = this.buffer.subarray(this.pos, this.pos + length);
+        this.pos += length;
+        return val;
+    }
+
+    public readVarUInt(): number {
+        let val: number = 0;
+        let shift: number = 0;
+        let byte: number;
+        do {
+            byte = this.readU8();
+            val += (byte & 0x7F) * 2 ** shift;
+            shift += 7;
+        } while (byte & 0x80);
+        return val;
+    }
+
+    public readVarInt(): number {
+        let val: number = 0;
+        let shift: number = 0;
+        let byte: number;
+        do {
+            byte = this.readU8();
+            val |= (byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        if (shift < 32 && (byte & 0x40)) {
+            val |= ~0 << shift;
+        }
+        return val >> 0;
+    }
+
     public readString(length: number): string {
         const val: string = this.buffer.toString('utf8', this.pos, this.pos + length);
         this.pos += length;
@@ -14,7 +14,9 @@ export class Dumper {
         this.writeIntend(`VERSION: ${module.header.version}`);
         this.writeIntend(`HASH: 0x${module.header.hash[0].toString(16)}${module.header.hash[1].toString(16)}`);
         this.writeIntend(`$STABLE: 0x${module.header.stableSectionStart.toString(16)}`);
+        this.writeIntend(`$CONSTANTS: 0x${module.header.constantSectionStart.toString(16)}`);
         this.writeIntend(`$DATA: 0x${module.header.dataSectionStart.toString(16)}`);
+        this.writeIntend(`$HANDLERS: 0x${module.header.handlerSectionStart.toString(16)}`);
         console.log();
 
         console.log("$STABLE:");
@@ -23,10 +25,24 @@ export class Dumper {
         }
         console.log();
 
+        console.log("$CONSTANTS:");
+        for (const [constant, i] of module.constantSection) {
+            // The pool does not record the type, LD_DOUBLE reads an entry as double and IMPORT as hash
+            const bits: string = `0x${constant.readUInt32LE(4).toString(16).padStart(8, "0")}${constant.readUInt32LE(0).toString(16).padStart(8, "0")}`;
+            this.writeIntend(`${i.toString().padStart(3, "0")}: ${bits} (${constant.readDoubleLE(0)})`);
+        }
+        console.log();
+
         console.log("$DATA:");
         for (const [instruction, i] of module.dataSection) {
             this.writeIntend(`${i.toString().padStart(3, "0")}: ${Opcodes[instruction.opcode].padEnd(15, " ")} ${instruction.operands.map(operand => operand.value).join(", ")}`);
         }
+        console.log();
+
+        console.log("$HANDLERS:");
+        for (const [entry, i] of module.handlerSection) {
+            this.writeIntend(`${i.toString().padStart(3, "0")}: ${entry.start}..${entry.end} -> ${entry.handler} (owner ${entry.owner}, depth ${entry.depth}, scopes ${entry.scopes}, close ${entry.close})`);
+        }
     }
 
     public dumpBundle(bundle: BundleFormat): void {
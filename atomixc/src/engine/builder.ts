@@ -3,6 +3,8 @@ import * as path from "path";
 import * as child_process from "child_process";
 import * as fs from "fs";
 import {createFolder} from "./helper";
+import {buildCompressed, isCompressed} from "../format/compressed";
+import {BinaryReader} from "../binary";
 
 const ENGINE_BASE: string = path.join(__dirname, "..", "..", "..", "atomix");
 
@@ -72,6 +74,12 @@ class Gateway {
 
         return `${arch}-${platform}`;
     }
+
+    public isHost(): boolean {
+        const platform: boolean = this.platform === EnginePlatform.WINDOWS ? process.platform === "win32" : process.platform === "linux";
+        const architecture: boolean = this.architecture === EngineArchitecture.X64 ? process.arch === "x64" : process.arch === "arm64";
+        return platform && architecture;
+    }
 }
 
 class Archiver {
@@ -140,14 +148,20 @@ export class EngineBuilder {
     private gateway: Gateway;
     private readonly modules: string[];
     private readonly debug: boolean;
+    private readonly compress: boolean;
+    private readonly threaded: boolean;
+    private readonly snapshot: boolean;
     private readonly objFolder: string;
     private readonly binFolder: string;
     private readonly bcFolder: string;
 
-    private constructor(dir: string, platform: EnginePlatform, architecture: EngineArchitecture, modules: string[], debug: boolean) {
+    private constructor(dir: string, platform: EnginePlatform, architecture: EngineArchitecture, modules: string[], debug: boolean, compress: boolean, threaded: boolean, snapshot: boolean) {
         this.gateway = new Gateway(platform, architecture, !debug);
         this.modules = modules;
         this.debug = debug;
+        this.compress = compress;
+        this.threaded = threaded;
+        this.snapshot = snapshot;
         this.objFolder = path.join(dir, ".atomix", "obj", debug ? "Debug" : "Release", generateRID(platform, architecture));
         this.binFolder = path.join(dir, ".atomix", "bin", debug ? "Debug" : "Release", generateRID(platform, architecture));
         this.bcFolder = path.join(dir, ".atomix", "bc");
@@ -190,7 +204,22 @@ export class EngineBuilder {
 
         includes.push(this.packBytecode(bytecode));
 
-        this.gateway.compiler.link(includes, result)
+        // Restoring the snapshot is not measurably faster than running the loaders yet, so it is opt-in. It can
+        // only be taken by running the runtime, binaries for other hosts always start without one.
+        if (!this.snapshot || !this.gateway.isHost()) {
+            this.gateway.compiler.link([...includes, this.packSnapshot(null)], result);
+            return;
+        }
+
+        // Linked from the same objects as the release, which does not contain the writer itself
+        const writer: string = path.join(this.objFolder, this.gateway.platform === EnginePlatform.WINDOWS ? "snapshot_writer.exe" : "snapshot_writer");
+        this.gateway.compiler.link([...includes, this.packSnapshot(null), this.compileSnapshotWriter()], writer);
+
+        const snapshot: string = path.join(this.objFolder, "snapshot.bin");
+        child_process.execFileSync(writer, [], {
+            env: {...process.env, ATOMIX_SNAPSHOT: snapshot}
+        });
+        this.gateway.compiler.link([...includes, this.packSnapshot(snapshot)], result);
     }
 
     public cdf(): CDFItem[] {
@@ -202,11 +231,29 @@ export class EngineBuilder {
         ];
     }
 
+    private getGarbageCollectorFlags(): string[] {
+        const flags: string[] = ["-I", path.join(ENGINE_BASE, "bdwgc"), "-I", path.join(ENGINE_BASE, "bdwgc", "private"), "-ULARGE_CONFIG", "-DSTATIC_LINK", "-DNO_GETCONTEXT", "-DNO_EXECUTE_PERMISSION", "-Wno-macro-redefined"];
+        if (this.threaded) {
+            // Marker threads are started by the VM, ATOMIX_GC_MARKERS limits their number
+            flags.push("-DGC_THREADS", "-DTHREAD_LOCAL_ALLOC", "-DGC_BUILTIN_ATOMIC", "-DPARALLEL_MARK");
+        }
+        return flags;
+    }
+
+    // The clients of the collector have to agree with it on whether threads are registered
+    private getClientFlags(): string[] {
+        const flags: string[] = ["-I", path.join(ENGINE_BASE, "bdwgc")];
+        if (this.threaded) {
+            flags.push("-DGC_THREADS", "-DPARALLEL_MARK");
+        }
+        return flags;
+    }
+
     private getGarbageCollectorCDF(): CDFItem[] {
         const files: string[] = this.readdirSync(path.join(ENGINE_BASE, "bdwgc")).filter(file => file.endsWith(".c"));
         return files.map(file => ({
             directory: ENGINE_BASE,
-            arguments: this.gateway.compiler.buildCDFArray(path.join(this.objFolder, "bdwgc", path.basename(file) + ".o"), ["-I", path.join(ENGINE_BASE, "bdwgc"), "-I", path.join(ENGINE_BASE, "bdwgc", "private"), "-DENABLE_THREADS=0", "-DGC_DISABLE_INCREMENTAL=1", "-DNO_INCREMENTAL=1", "-DNO_CLOCK=1", "-ULARGE_CONFIG", "-DSTATIC_LINK", "-DNO_GETCONTEXT", "-DNO_EXECUTE_PERMISSION", "-Wno-macro-redefined"]),
+            arguments: this.gateway.compiler.buildCDFArray(path.join(this.objFolder, "bdwgc", path.basename(file) + ".o"), this.getGarbageCollectorFlags()),
             file: file
         }));
     }
@@ -216,7 +263,7 @@ export class EngineBuilder {
         createFolder(base);
 
         const inputFiles: string[] = this.readdirSync(path.join(ENGINE_BASE, "bdwgc")).filter(file => file.endsWith(".c"));
-        const objectFiles: string[] = this.compileCFiles(inputFiles, base, ["-I", path.join(ENGINE_BASE, "bdwgc"), "-I", path.join(ENGINE_BASE, "bdwgc", "private"), "-DENABLE_THREADS=0", "-DGC_DISABLE_INCREMENTAL=1", "-DNO_INCREMENTAL=1", "-DNO_CLOCK=1", "-ULARGE_CONFIG", "-DSTATIC_LINK", "-DNO_GETCONTEXT", "-DNO_EXECUTE_PERMISSION", "-Wno-macro-redefined"]);
+        const objectFiles: string[] = this.compileCFiles(inputFiles, base, this.getGarbageCollectorFlags());
 
         const result: string = path.join(this.objFolder, "libgc.a");
         this.gateway.archiver.archive(objectFiles, result, []);
@@ -227,7 +274,7 @@ export class EngineBuilder {
         const files: string[] = this.readdirSync(path.join(ENGINE_BASE, "core")).filter(file => file.endsWith(".c"));
         return files.map(file => ({
             directory: ENGINE_BASE,
-            arguments: this.gateway.compiler.buildCDFArray(path.join(this.objFolder, "core", path.basename(file) + ".o"), ["-I", path.join(ENGINE_BASE, "core"), "-I", path.join(ENGINE_BASE, "bdwgc")]),
+            arguments: this.gateway.compiler.buildCDFArray(path.join(this.objFolder, "core", path.basename(file) + ".o"), ["-I", path.join(ENGINE_BASE, "core"), ...this.getClientFlags()]),
             file: file,
         }));
     }
@@ -237,7 +284,7 @@ export class EngineBuilder {
         createFolder(base);
 
         const inputFiles: string[] = this.readdirSync(path.join(ENGINE_BASE, "core")).filter(file => file.endsWith(".c"));
-        const objectFiles: string[] = this.compileCFiles(inputFiles, base, ["-I", path.join(ENGINE_BASE, "bdwgc")]);
+        const objectFiles: string[] = this.compileCFiles(inputFiles, base, this.getClientFlags());
 
         const result: string = path.join(this.objFolder, "libcore.a");
         this.gateway.archiver.archive(objectFiles, result, []);
@@ -249,7 +296,7 @@ export class EngineBuilder {
         const files: string[] = this.readdirSync(base).filter(file => file.endsWith(".c"));
         return files.map(file => ({
             directory: ENGINE_BASE,
-            arguments: this.gateway.compiler.buildCDFArray(path.join(this.objFolder, "loader", path.basename(file) + ".o"), ["-I", path.join(ENGINE_BASE, "core"), "-I", base, "-I", path.join(ENGINE_BASE, "bdwgc")]),
+            arguments: this.gateway.compiler.buildCDFArray(path.join(this.objFolder, "loader", path.basename(file) + ".o"), ["-I", path.join(ENGINE_BASE, "core"), "-I", base, ...this.getClientFlags()]),
             file: file,
         }));
     }
@@ -259,7 +306,7 @@ export class EngineBuilder {
         createFolder(base);
 
         const inputFiles: string[] = this.readdirSync(path.join(ENGINE_BASE, this.debug ? "debug" : "release")).filter(file => file.endsWith(".c"));
-        const objectFiles: string[] = this.compileCFiles(inputFiles, base, ["-I", path.join(ENGINE_BASE, "core"), "-I", path.join(ENGINE_BASE, "bdwgc")]);
+        const objectFiles: string[] = this.compileCFiles(inputFiles, base, ["-I", path.join(ENGINE_BASE, "core"), ...this.getClientFlags()]);
 
         const result: string = path.join(this.objFolder, "libloader.a");
         this.gateway.archiver.archive(objectFiles, result, []);
@@ -302,7 +349,7 @@ export class EngineBuilder {
         const files: string[] = this.readdirSync(base).filter(file => file.endsWith(".c"));
         return files.map(file => ({
             directory: ENGINE_BASE,
-            arguments: this.gateway.compiler.buildCDFArray(path.join(this.objFolder, `mod_${module}`, path.basename(file) + ".o"), ["-I", path.join(ENGINE_BASE, "core"), "-I", base, "-I", path.join(ENGINE_BASE, "bdwgc")]),
+            arguments: this.gateway.compiler.buildCDFArray(path.join(this.objFolder, `mod_${module}`, path.basename(file) + ".o"), ["-I", path.join(ENGINE_BASE, "core"), "-I", base, ...this.getClientFlags()]),
             file: file
         }));
     }
@@ -312,7 +359,7 @@ export class EngineBuilder {
         createFolder(base);
 
         const inputFiles: string[] = this.readdirSync(path.join(ENGINE_BASE, "modules", module)).filter(file => file.endsWith(".c"));
-        const objectFiles: string[] = this.compileCFiles(inputFiles, base, ["-I", path.join(ENGINE_BASE, "core"), "-I", path.join(ENGINE_BASE, "bdwgc")]);
+        const objectFiles: string[] = this.compileCFiles(inputFiles, base, ["-I", path.join(ENGINE_BASE, "core"), ...this.getClientFlags()]);
 
         const result: string = path.join(this.objFolder, `libmod_${module}.a`);
         this.gateway.archiver.archive(objectFiles, result, []);
@@ -335,17 +382,53 @@ export class EngineBuilder {
         if (!fs.existsSync(file) || !fs.statSync(file).isFile()) {
             throw "Bytecode not found or is not a file";
         }
-        const buff: string[] = Array.from(fs.readFileSync(file), x => "0x" + x.toString(16));
-        const output: string = path.join(this.objFolder, "bytecode.o");
 
+        let data: Buffer = fs.readFileSync(file);
+        // The VM recognizes the container, bytecode which already is compressed is embedded as it is
+        if (this.compress && !isCompressed(new BinaryReader(data))) {
+            data = buildCompressed(data);
+        }
+
+        return this.packData("BYTECODE", data, path.join(this.objFolder, "bytecode.o"));
+    }
+
+    private compileSnapshotWriter(): string {
+        const output: string = path.join(this.objFolder, "snapshot_writer.o");
+        this.gateway.compiler.compile(path.join(ENGINE_BASE, "release", "snapshot_writer.c"), output, ["-I", path.join(ENGINE_BASE, "core"), ...this.getClientFlags(), "-DATOMIX_SNAPSHOT_WRITER"]);
+        return output;
+    }
+
+    private packSnapshot(file: string | null): string {
+        const data: Uint8Array = file ? fs.readFileSync(file) : new Uint8Array(0);
+        return this.packData("SNAPSHOT", data, path.join(this.objFolder, "snapshot.o"));
+    }
+
+    private packData(symbol: string, data: Uint8Array, output: string): string {
+        // The data is pulled in by the assembler, turning it into C literals dominates the build of large bundles
+        const input: string = output.replace(/\.o$/, ".raw");
+        fs.writeFileSync(input, data);
+        const file: string = JSON.stringify(input.replace(/\\/g, "/"));
+
+        // Aligned like malloc memory, so the loader can read the image in place like any other buffer
         this.gateway.compiler.compileFromInput(`
         #include <stddef.h>
         #include <stdint.h>
 
-        const uint8_t __BYTECODE__[] = {
-            ${buff.join(", ")}
-        };
-        const size_t __BYTECODE_SIZE__ = sizeof(__BYTECODE__);
+        #ifdef _WIN32
+        #define SECTION ".section .rdata,\\"dr\\"\\n"
+        #else
+        #define SECTION ".section .rodata\\n"
+        #endif
+
+        __asm__(
+            SECTION
+            ".balign 16\\n"
+            ".globl __${symbol}__\\n"
+            "__${symbol}__:\\n"
+            ".incbin ${file.replace(/"/g, '\\"')}\\n"
+            ".text\\n"
+        );
+        const size_t __${symbol}_SIZE__ = ${data.length};
         `, output, []);
         return output;
     }
@@ -354,8 +437,8 @@ export class EngineBuilder {
         return fs.readdirSync(folder).map(file => path.join(folder, file));
     }
 
-    public static createEngine(dir: string, platform: EnginePlatform, architecture: EngineArchitecture, modules: string[], debug: boolean, name: string | null, bytecode: string | null) {
-        new EngineBuilder(dir, platform, architecture, modules, debug).create(name, bytecode);
+    public static createEngine(dir: string, platform: EnginePlatform, architecture: EngineArchitecture, modules: string[], debug: boolean, name: string | null, bytecode: string | null, compress: boolean, threaded: boolean, snapshot: boolean) {
+        new EngineBuilder(dir, platform, architecture, modules, debug, compress, threaded, snapshot).create(name, bytecode);
     }
 
     public static createCDF(output: string, platform: EnginePlatform, architecture: EngineArchitecture, modules: string[], debug: boolean) {
@@ -371,7 +454,7 @@ export class EngineBuilder {
             }
         }
 
-        const cdf: CDFItem[] = new EngineBuilder(process.cwd(), platform, architecture, modules, debug).cdf();
+        const cdf: CDFItem[] = new EngineBuilder(process.cwd(), platform, architecture, modules, debug, false, false, false).cdf();
         fs.writeFileSync(output, JSON.stringify(cdf, null, 4));
     }
 
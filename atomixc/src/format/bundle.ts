@@ -11,7 +11,9 @@ export interface BundleHeader {
 }
 
 const MAGIC: [number, number, number, number] = [46, 65, 120, 66];
-const VERSION: number = 1;
+const VERSION: number = 3;
+// Hash, offset and length of every module
+const INDEX_ENTRY_SIZE: number = Size.new(4, "ints").inBytes();
 
 export class BundleFormat implements Section {
     public header: BundleHeader;
@@ -30,20 +32,34 @@ export class BundleFormat implements Section {
         writer.writeU16(this.header.version);
         writer.writeU32(this.header.entryHash[0]);
         writer.writeU32(this.header.entryHash[1]);
-        writer.writeU16(this.header.count);
+        writer.writeU32(this.header.count);
+
+        // The VM looks modules up in the index and only decodes the ones that are imported
+        let offset: number = this.getHeaderLength();
+        for (const module of this.modules) {
+            writer.writeU32(module.header.hash[0]);
+            writer.writeU32(module.header.hash[1]);
+            writer.writeU32(offset);
+            writer.writeU32(module.getLength());
+            offset += module.getLength();
+        }
 
         for (const module of this.modules) {
             module.writeTo(writer);
         }
     }
 
-    public getLength(): number {
+    private getHeaderLength(): number {
         return Size.new()
             .add(4, "bytes")
             .add(1, "short")
             .add(1, "long")
-            .add(1, "short")
-            .inBytes() + this.modules.reduce((a: number, b: ModuleFormat): number => a + b.getLength(), 0);
+            .add(1, "int")
+            .inBytes() + this.modules.length * INDEX_ENTRY_SIZE;
+    }
+
+    public getLength(): number {
+        return this.getHeaderLength() + this.modules.reduce((a: number, b: ModuleFormat): number => a + b.getLength(), 0);
     }
 
     public readFrom(reader: BinaryReader): void {
@@ -54,8 +70,15 @@ export class BundleFormat implements Section {
         this.header.version = reader.readU16();
         this.header.entryHash[0] = reader.readU32();
         this.header.entryHash[1] = reader.readU32();
-        this.header.count = reader.readU16();
+        this.header.count = reader.readU32();
 
+        // Modules follow the index in the same order
+        for (let i: number = 0; i < this.header.count; i++) {
+            reader.readU32();
+            reader.readU32();
+            reader.readU32();
+            reader.readU32();
+        }
         for (let i: number = 0; i < this.header.count; i++) {
             this.modules.push(ModuleFormat.readFrom(reader));
         }
@@ -84,11 +107,12 @@ export class BundleFormat implements Section {
 }
 
 export function buildBundle(entryHash: [number, number], modules: ModuleFormat[]): BundleFormat {
+    // Ordered like the VM reads the hash: the second half is the high one
     modules.sort((a: ModuleFormat, b: ModuleFormat) => {
-        if (a.header.hash[0] < b.header.hash[0]) return -1;
-        if (a.header.hash[0] > b.header.hash[0]) return 1;
         if (a.header.hash[1] < b.header.hash[1]) return -1;
         if (a.header.hash[1] > b.header.hash[1]) return 1;
+        if (a.header.hash[0] < b.header.hash[0]) return -1;
+        if (a.header.hash[0] > b.header.hash[0]) return 1;
         return 0;
     });
 
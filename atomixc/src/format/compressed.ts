@@ -0,0 +1,166 @@
+import {BinaryReader} from "../binary";
+import {Size} from "../size";
+
+const MAGIC: [number, number, number, number] = [46, 65, 120, 90];
+const VERSION: number = 1;
+// Magic, version, uncompressed and compressed length
+const HEADER_LENGTH: number = Size.new().add(4, "bytes").add(1, "short").add(2, "ints").inBytes();
+
+const MIN_MATCH: number = 4;
+// The LZ4 block format ends with literals only: the last match starts at least 12 bytes before the end
+// and the last 5 bytes are never part of a match
+const MATCH_LIMIT: number = 12;
+const LAST_LITERALS: number = 5;
+const MAX_OFFSET: number = 0xFFFF;
+const HASH_BITS: number = 16;
+
+function hashAt(data: Buffer, position: number): number {
+    return Math.imul(data.readUInt32LE(position), 2654435761) >>> (32 - HASH_BITS);
+}
+
+function writeLength(out: Buffer, position: number, length: number): number {
+    while (length >= 255) {
+        out[position++] = 255;
+        length -= 255;
+    }
+    out[position++] = length;
+    return position;
+}
+
+/**
+ * Compresses data into a single LZ4 block. Matches are found greedily through a hash table of the last
+ * position of every four byte sequence, which is fast and is what bytecode with its repeated opcodes and
+ * operands compresses well with.
+ */
+export function compress(data: Buffer): Buffer {
+    const out: Buffer = Buffer.alloc(data.length + Math.ceil(data.length / 255) + 16);
+    const table: Int32Array = new Int32Array(1 << HASH_BITS).fill(-1);
+    let position: number = 0;
+    let anchor: number = 0;
+    let i: number = 0;
+
+    const writeSequence = (literals: number, offset: number, match: number): void => {
+        const token: number = position++;
+        out[token] = Math.min(literals, 15) << 4;
+        if (literals >= 15) {
+            position = writeLength(out, position, literals - 15);
+        }
+        data.copy(out, position, anchor, anchor + literals);
+        position += literals;
+        if (match == 0) {
+            return;
+        }
+
+        out.writeUInt16LE(offset, position);
+        position += 2;
+        out[token] |= Math.min(match - MIN_MATCH, 15);
+        if (match - MIN_MATCH >= 15) {
+            position = writeLength(out, position, match - MIN_MATCH - 15);
+        }
+    }
+
+    while (i < data.length - MATCH_LIMIT) {
+        const hash: number = hashAt(data, i);
+        const candidate: number = table[hash];
+        table[hash] = i;
+        if (candidate < 0 || i - candidate > MAX_OFFSET || data.readUInt32LE(candidate) != data.readUInt32LE(i)) {
+            i++;
+            continue;
+        }
+
+        let match: number = MIN_MATCH;
+        while (i + match < data.length - LAST_LITERALS && data[candidate + match] == data[i + match]) {
+            match++;
+        }
+        writeSequence(i - anchor, i - candidate, match);
+        i += match;
+        anchor = i;
+    }
+    writeSequence(data.length - anchor, 0, 0);
+
+    return out.subarray(0, position);
+}
+
+/**
+ * Inverse of compress, the VM has its own implementation in core/compression.c
+ */
+export function decompress(data: Buffer, length: number): Buffer {
+    const out: Buffer = Buffer.alloc(length);
+    let position: number = 0;
+    let written: number = 0;
+
+    const readLength = (value: number): number => {
+        if (value != 15) {
+            return value;
+        }
+        let byte: number;
+        do {
+            byte = data[position++];
+            value += byte;
+        } while (byte == 255);
+        return value;
+    }
+
+    while (position < data.length) {
+        const token: number = data[position++];
+        const literals: number = readLength(token >> 4);
+        data.copy(out, written, position, position + literals);
+        position += literals;
+        written += literals;
+        if (position == data.length) {
+            break;
+        }
+
+        const offset: number = data.readUInt16LE(position);
+        position += 2;
+        const match: number = readLength(token & 0x0F) + MIN_MATCH;
+        for (let j: number = 0; j < match; j++) {
+            out[written + j] = out[written - offset + j];
+        }
+        written += match;
+    }
+
+    if (written != length) {
+        throw "Compressed data is corrupt";
+    }
+    return out;
+}
+
+/**
+ * Wraps a module or bundle image into a compressed container the VM inflates when loading it
+ */
+export function buildCompressed(image: Buffer): Buffer {
+    const block: Buffer = compress(image);
+    const header: Buffer = Buffer.alloc(HEADER_LENGTH);
+    header.set(MAGIC, 0);
+    header.writeUInt16LE(VERSION, 4);
+    header.writeUInt32LE(image.length, 6);
+    header.writeUInt32LE(block.length, 10);
+    return Buffer.concat([header, block]);
+}
+
+export function isCompressed(reader: BinaryReader): boolean {
+    for (let i: number = 0; i < MAGIC.length; i++) {
+        if (reader.at(i) != MAGIC[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Returns the image of a compressed container
+ */
+export function readCompressed(image: Buffer): Buffer {
+    const reader: BinaryReader = new BinaryReader(image);
+    for (let i: number = 0; i < MAGIC.length; i++) {
+        reader.readU8();
+    }
+    if (reader.readU16() != VERSION) {
+        throw "Unsupported container version";
+    }
+    const length: number = reader.readU32();
+    const compressed: number = reader.readU32();
+    return decompress(image.subarray(HEADER_LENGTH, HEADER_LENGTH + compressed), length);
+}
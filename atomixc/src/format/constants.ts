@@ -0,0 +1,74 @@
+import {Section} from "./section";
+import {Size} from "../size";
+import {BinaryReader, BinaryWriter} from "../binary";
+
+const CONSTANT_SIZE: number = 8;
+
+/**
+ * 64 bit constants: doubles referenced by LD_DOUBLE and module hashes referenced by IMPORT. Every distinct
+ * value is stored once per module.
+ */
+export class ConstantSection implements Section {
+    private length: Size;
+    private constants: Buffer[];
+
+    public constructor() {
+        this.length = Size.new(2, "ints");
+        this.constants = [];
+    }
+
+    public registerDouble(x: number): number {
+        const constant: Buffer = Buffer.alloc(CONSTANT_SIZE);
+        constant.writeDoubleLE(x);
+        return this.register(constant);
+    }
+
+    /**
+     * Low and high half of the hash, the order the module header stores them in
+     */
+    public registerHash(hash: [number, number]): number {
+        const constant: Buffer = Buffer.alloc(CONSTANT_SIZE);
+        constant.writeUInt32LE(hash[0]);
+        constant.writeUInt32LE(hash[1], 4);
+        return this.register(constant);
+    }
+
+    // Compared bitwise, which tells 0 and -0 apart and finds NaN
+    private register(constant: Buffer): number {
+        let idx: number = this.constants.findIndex((c: Buffer): boolean => c.equals(constant));
+        if (idx != -1) {
+            return idx;
+        }
+
+        idx = this.constants.length;
+        this.constants.push(constant);
+        this.length.add(CONSTANT_SIZE, "bytes");
+        return idx;
+    }
+
+    public getLength(): number {
+        return this.length.inBytes();
+    }
+
+    public writeTo(writer: BinaryWriter): void {
+        writer.writeU32(this.length.inBytes());
+        writer.writeU32(this.constants.length);
+        for (const constant of this.constants) {
+            writer.write(constant);
+        }
+    }
+
+    public readFrom(reader: BinaryReader): void {
+        this.length = Size.new(reader.readU32(), "bytes");
+        const count: number = reader.readU32();
+        for (let i: number = 0; i < count; i++) {
+            this.constants.push(reader.readBytes(CONSTANT_SIZE));
+        }
+    }
+
+    public* [Symbol.iterator](): Generator<[Buffer, number]> {
+        for (let i: number = 0; i < this.constants.length; i++) {
+            yield [this.constants[i], i];
+        }
+    }
+}
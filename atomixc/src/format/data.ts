@@ -1,13 +1,12 @@
 import {Section} from "./section";
-import {Size, Unit} from "../size";
+import {Size} from "../size";
 import {
-    ConstantDoubleOperand,
-    ConstantIntegerOperand,
-    ConstantUNumberOperand,
     Instruction,
     OPCODE_SIZE,
     Opcodes,
-    Operand
+    Operand,
+    VarIntOperand,
+    VarUIntOperand
 } from "../opcodes";
 import {BinaryReader, BinaryWriter} from "../binary";
 
@@ -44,6 +43,20 @@ export class DataSection implements Section {
         this.instructions[index] = instruction;
     }
 
+    /**
+     * Byte length of the instructions [start, end)
+     */
+    public getLengthBetween(start: number, end: number): number {
+        let length: number = 0;
+        for (let i: number = start; i < end; i++) {
+            length += OPCODE_SIZE.inBytes();
+            for (const operand of this.instructions[i].operands) {
+                length += operand.length.inBytes();
+            }
+        }
+        return length;
+    }
+
     public getCount(): number {
         return this.count;
     }
@@ -64,49 +77,51 @@ export class DataSection implements Section {
     }
 
     public readFrom(reader: BinaryReader): void {
-        const uConstOperand = (unit: Unit) => () => {
-            switch (unit) {
-                case "byte":
-                case "bytes":
-                    return new ConstantUNumberOperand(reader.readU8(), unit);
-                case "short":
-                case "shorts":
-                    return new ConstantUNumberOperand(reader.readU16(), unit);
-                case "int":
-                case "ints":
-                    return new ConstantUNumberOperand(reader.readU32(), unit);
-                case "long":
-                case "longs":
-                    throw "Not implemented";
-            }
-        }
+        const uOperand = () => new VarUIntOperand(reader.readVarUInt());
 
-        const operandDictionary: Partial<Record<Opcodes, Array<() => Operand>>> = {
-            [Opcodes.LD_INT]: [() => new ConstantIntegerOperand(reader.readI32())],
-            [Opcodes.LD_DOUBLE]: [() => new ConstantDoubleOperand(reader.readDouble())],
-            [Opcodes.LD_STRING]: [uConstOperand("short")],
-            [Opcodes.ALLOC_LOCAL]: [uConstOperand("short")],
-            [Opcodes.STORE_LOCAL]: [uConstOperand("short")],
-            [Opcodes.LOAD_LOCAL]: [uConstOperand("short")],
-            [Opcodes.LOAD_ARG]: [uConstOperand("short")],
-            [Opcodes.DECLARE_FUNC]: [uConstOperand("short"), uConstOperand("short")],
-            [Opcodes.DECLARE_FUNC_E]: [uConstOperand("short")],
-            [Opcodes.CALL]: [uConstOperand("short")],
-            [Opcodes.OBJ_STORE]: [uConstOperand("short")],
-            [Opcodes.OBJ_LOAD]: [uConstOperand("short")],
-            [Opcodes.JMP]: [uConstOperand("short")],
-            [Opcodes.JMP_F]: [uConstOperand("short")],
-            [Opcodes.JMP_T]: [uConstOperand("short")],
-            [Opcodes.EXPORT]: [uConstOperand("short")]
+        // Every other operand is unsigned, LD_DOUBLE and IMPORT reference the constant pool
+        const operandCount: Partial<Record<Opcodes, number>> = {
+            [Opcodes.LD_DOUBLE]: 1,
+            [Opcodes.LD_STRING]: 1,
+            [Opcodes.ALLOC_LOCAL]: 1,
+            [Opcodes.STORE_LOCAL]: 1,
+            [Opcodes.LOAD_LOCAL]: 1,
+            [Opcodes.LOAD_ARG]: 1,
+            [Opcodes.DECLARE_FUNC]: 3,
+            [Opcodes.DECLARE_FUNC_E]: 2,
+            [Opcodes.CALL]: 1,
+            [Opcodes.OBJ_STORE]: 1,
+            [Opcodes.OBJ_LOAD]: 1,
+            [Opcodes.JMP]: 1,
+            [Opcodes.JMP_F]: 1,
+            [Opcodes.JMP_T]: 1,
+            [Opcodes.EXPORT]: 1,
+            [Opcodes.ENTER]: 1,
+            [Opcodes.LOAD_SLOT]: 1,
+            [Opcodes.STORE_SLOT]: 1,
+            [Opcodes.LOAD_UPVAL]: 1,
+            [Opcodes.STORE_UPVAL]: 1,
+            [Opcodes.CLOSE_UPVALS]: 1,
+            [Opcodes.TAIL_CALL]: 1,
+            [Opcodes.IMPORT]: 1
         }
 
         this.length = Size.new(reader.readU32(), "bytes");
         this.count = reader.readU32();
         for (let i: number = 0; i < this.count; i++) {
             const instruction: Instruction = new Instruction(reader.readU8());
-            if (instruction.opcode in operandDictionary) {
-                for (const operand of operandDictionary[instruction.opcode]!) {
-                    instruction.addOperand(operand());
+            if (instruction.opcode == Opcodes.LD_INT) {
+                instruction.addOperand(new VarIntOperand(reader.readVarInt()));
+            } else if (instruction.opcode == Opcodes.CAPTURE) {
+                // Variable length: entry count followed by the entries
+                const count: Operand = uOperand();
+                instruction.addOperand(count);
+                for (let j: number = 0; j < count.value; j++) {
+                    instruction.addOperand(uOperand());
+                }
+            } else {
+                for (let j: number = 0; j < (operandCount[instruction.opcode] ?? 0); j++) {
+                    instruction.addOperand(uOperand());
                 }
             }
             this.instructions.push(instruction);
@@ -0,0 +1,79 @@
+import {Section} from "./section";
+import {Size} from "../size";
+import {BinaryReader, BinaryWriter} from "../binary";
+
+/**
+ * A protected instruction range [start, end) of the function beginning at owner (0 for the module body).
+ * The VM only reads these while unwinding, so code inside of a try block runs without any overhead.
+ */
+export interface HandlerEntry {
+    owner: number;
+    start: number;
+    end: number;
+    handler: number;
+    // Stack depth relative to the frame the exception is pushed onto
+    depth: number;
+    // Scopes pushed by the frame when entering the try block
+    scopes: number;
+    // First slot of the try block, its upvalues are closed when unwinding
+    close: number;
+}
+
+export class HandlerSection implements Section {
+    private entries: HandlerEntry[];
+
+    public constructor() {
+        this.entries = [];
+    }
+
+    /**
+     * Nested try statements have to be added before the ones enclosing them, the VM uses the first match.
+     */
+    public addHandler(entry: HandlerEntry): void {
+        this.entries.push(entry);
+    }
+
+    public getLength(): number {
+        return Size.new()
+            .add(2, "ints")
+            .add(this.entries.length * 4, "ints")
+            .add(this.entries.length * 3, "shorts")
+            .inBytes();
+    }
+
+    public writeTo(writer: BinaryWriter): void {
+        writer.writeU32(this.getLength());
+        writer.writeU32(this.entries.length);
+        for (const entry of this.entries) {
+            writer.writeU32(entry.owner);
+            writer.writeU32(entry.start);
+            writer.writeU32(entry.end);
+            writer.writeU32(entry.handler);
+            writer.writeU16(entry.depth);
+            writer.writeU16(entry.scopes);
+            writer.writeU16(entry.close);
+        }
+    }
+
+    public readFrom(reader: BinaryReader): void {
+        reader.readU32();
+        const count: number = reader.readU32();
+        for (let i: number = 0; i < count; i++) {
+            this.entries.push({
+                owner: reader.readU32(),
+                start: reader.readU32(),
+                end: reader.readU32(),
+                handler: reader.readU32(),
+                depth: reader.readU16(),
+                scopes: reader.readU16(),
+                close: reader.readU16()
+            });
+        }
+    }
+
+    public *[Symbol.iterator](): Generator<[HandlerEntry, number]> {
+        for (let i: number = 0; i < this.entries.length; i++) {
+            yield [this.entries[i], i];
+        }
+    }
+}
@@ -1,6 +1,8 @@
 import {STableSection} from "./stable";
 import {Size} from "../size";
+import {ConstantSection} from "./constants";
 import {DataSection} from "./data";
+import {HandlerSection} from "./handlers";
 import {Section} from "./section";
 import {BinaryReader, BinaryWriter} from "../binary";
 
@@ -9,21 +11,27 @@ export interface ModuleHeader {
     version: number;
     hash: [number, number];
     stableSectionStart: number;
+    constantSectionStart: number;
     dataSectionStart: number;
+    handlerSectionStart: number;
 }
 
 const MAGIC: [number, number, number, number] = [46, 65, 120, 77];
-const VERSION: number = 2;
+const VERSION: number = 8;
 
 export class ModuleFormat implements Section {
     public header: ModuleHeader;
     public stableSection: STableSection;
+    public constantSection: ConstantSection;
     public dataSection: DataSection;
+    public handlerSection: HandlerSection;
 
-    public constructor(header: ModuleHeader, stableSection: STableSection, dataSection: DataSection) {
+    public constructor(header: ModuleHeader, stableSection: STableSection, constantSection: ConstantSection, dataSection: DataSection, handlerSection: HandlerSection) {
         this.header = header;
         this.stableSection = stableSection;
+        this.constantSection = constantSection;
         this.dataSection = dataSection;
+        this.handlerSection = handlerSection;
     }
 
     public getLength(): number {
@@ -31,9 +39,11 @@ export class ModuleFormat implements Section {
             .add(4, "bytes")
             .add(1, "short")
             .add(1, "long")
-            .add(2, "ints")
+            .add(4, "ints")
             .add(this.stableSection.getLength(), "bytes")
+            .add(this.constantSection.getLength(), "bytes")
             .add(this.dataSection.getLength(), "bytes")
+            .add(this.handlerSection.getLength(), "bytes")
             .inBytes();
     }
 
@@ -46,10 +56,14 @@ export class ModuleFormat implements Section {
         writer.writeU32(this.header.hash[0]);
         writer.writeU32(this.header.hash[1]);
         writer.writeU32(this.header.stableSectionStart);
+        writer.writeU32(this.header.constantSectionStart);
         writer.writeU32(this.header.dataSectionStart);
+        writer.writeU32(this.header.handlerSectionStart);
 
         this.stableSection.writeTo(writer);
+        this.constantSection.writeTo(writer);
         this.dataSection.writeTo(writer);
+        this.handlerSection.writeTo(writer);
     }
 
     public readFrom(reader: BinaryReader): void {
@@ -61,10 +75,14 @@ export class ModuleFormat implements Section {
         this.header.hash[0] = reader.readU32();
         this.header.hash[1] = reader.readU32();
         this.header.stableSectionStart = reader.readU32();
+        this.header.constantSectionStart = reader.readU32();
         this.header.dataSectionStart = reader.readU32();
+        this.header.handlerSectionStart = reader.readU32();
 
         this.stableSection.readFrom(reader);
+        this.constantSection.readFrom(reader);
         this.dataSection.readFrom(reader);
+        this.handlerSection.readFrom(reader);
     }
 
     public static readFrom(reader: BinaryReader): ModuleFormat {
@@ -73,8 +91,10 @@ export class ModuleFormat implements Section {
             version: 0,
             hash: [0, 0],
             stableSectionStart: 0,
-            dataSectionStart: 0
-        }, new STableSection(), new DataSection());
+            constantSectionStart: 0,
+            dataSectionStart: 0,
+            handlerSectionStart: 0
+        }, new STableSection(), new ConstantSection(), new DataSection(), new HandlerSection());
         module.readFrom(reader);
         return module;
     }
@@ -90,21 +110,23 @@ export class ModuleFormat implements Section {
     }
 }
 
-export function buildModule(hash: [number, number], stableSection: STableSection, dataSection: DataSection): ModuleFormat {
+export function buildModule(hash: [number, number], stableSection: STableSection, constantSection: ConstantSection, dataSection: DataSection, handlerSection: HandlerSection): ModuleFormat {
     const baseStart: Size = Size
         .new()
         .add(4, "byte")
         .add(1, "short")
         .add(1, "long")
-        .add(2, "int");
+        .add(4, "int");
 
     const header: ModuleHeader = {
         magic: MAGIC,
         version: VERSION,
         hash: hash,
         stableSectionStart: baseStart.inBytes(),
-        dataSectionStart: baseStart.add(stableSection.getLength(), "bytes").inBytes()
+        constantSectionStart: baseStart.add(stableSection.getLength(), "bytes").inBytes(),
+        dataSectionStart: baseStart.add(constantSection.getLength(), "bytes").inBytes(),
+        handlerSectionStart: baseStart.add(dataSection.getLength(), "bytes").inBytes()
     }
 
-    return new ModuleFormat(header, stableSection, dataSection);
+    return new ModuleFormat(header, stableSection, constantSection, dataSection, handlerSection);
 }
\ No newline at end of file
@@ -25,12 +25,13 @@ export class STableSection implements Section {
             ? Size.new()
             : this.offsets[this.count - 1]
                 .copy()
-                .add(this.strings[this.count - 1].length, "bytes");
+                .add(this.strings[this.count - 1].length + 1, "bytes");
 
         idx = this.count++;
         this.strings.push(x);
         this.offsets.push(offset);
-        this.length.add(1, "int").add(x.length, "bytes");
+        // Zero terminated, so the VM can use the strings in place
+        this.length.add(1, "int").add(x.length + 1, "bytes");
         return idx;
     }
 
@@ -46,6 +47,7 @@ export class STableSection implements Section {
         }
         for (const string of this.strings) {
             writer.writeString(string);
+            writer.writeU8(0);
         }
     }
 
@@ -64,8 +66,9 @@ export class STableSection implements Section {
                     .copy()
                     .subtract(2, "ints")
                     .subtract(this.offsets.length, "ints");
-            const length: number = end.inBytes() - start.inBytes();
+            const length: number = end.inBytes() - start.inBytes() - 1;
             this.strings.push(reader.readString(length));
+            reader.readU8();
         }
     }
 
@@ -1,5 +1,5 @@
-import { Size, Unit } from "./size";
-import { BinaryWriter } from "./binary";
+import { Size } from "./size";
+import { BinaryWriter, varIntLength, varUIntLength } from "./binary";
 
 export enum Opcodes {
     NOP,
@@ -54,9 +54,27 @@ export enum Opcodes {
     JMP,
     JMP_F,
     JMP_T,
-    EXPORT
+    EXPORT,
+    ENTER,
+    LOAD_SLOT,
+    STORE_SLOT,
+    LOAD_UPVAL,
+    STORE_UPVAL,
+    CAPTURE,
+    CLOSE_UPVALS,
+    LD_CALLEE,
+    TAIL_CALL,
+    THROW,
+    YIELD,
+    GENERATOR,
+    IMPORT
 }
 
+/**
+ * Marks a CAPTURE entry which references an upvalue of the enclosing function instead of one of its slots
+ */
+export const CAPTURE_FROM_UPVALUE: number = 0x8000;
+
 export const OPCODE_SIZE = Size.new(1, "byte");
 
 export interface Operand {
@@ -66,64 +84,40 @@ export interface Operand {
     writeTo(writer: BinaryWriter): void;
 }
 
-export class ConstantIntegerOperand implements Operand {
+/**
+ * Signed integer encoded as LEB128, the operand of LD_INT
+ */
+export class VarIntOperand implements Operand {
     value: number;
     length: Size;
 
     public constructor(value: number) {
-        this.value = value;
-        this.length = Size.new(1, "int");
+        this.value = value >> 0;
+        this.length = Size.new(varIntLength(this.value), "bytes");
     }
 
     public writeTo(writer: BinaryWriter): void {
-        writer.writeI32(this.value >> 0);
+        writer.writeVarInt(this.value);
     }
 }
 
-export class ConstantUNumberOperand implements Operand {
-    value: number;
-    length: Size;
-
-    private unit: Unit;
-
-    public constructor(value: number, unit: Unit) {
-        this.value = value;
-        this.length = Size.new(1, unit);
-        this.unit = unit;
-    }
-
-    public writeTo(writer: BinaryWriter): void {
-        switch (this.unit) {
-            case "byte":
-            case "bytes":
-                writer.writeU8(this.value);
-                break;
-            case "short":
-            case "shorts":
-                writer.writeU16(this.value);
-                break;
-            case "int":
-            case "ints":
-                writer.writeU32(this.value);
-                break;
-            case "long":
-            case "longs":
-                throw "Not implemented";
-        }
-    }
-}
-
-export class ConstantDoubleOperand implements Operand {
+/**
+ * Unsigned integer encoded as LEB128: indices, counts, jump targets and lengths
+ */
+export class VarUIntOperand implements Operand {
     value: number;
     length: Size;
 
     public constructor(value: number) {
+        if (value < 0 || value > 0xFFFFFFFF) {
+            throw "Operand is out of range";
+        }
         this.value = value;
-        this.length = Size.new(1, "int");
+        this.length = Size.new(varUIntLength(value), "bytes");
     }
 
     public writeTo(writer: BinaryWriter): void {
-        writer.writeDouble(this.value);
+        writer.writeVarUInt(this.value);
     }
 }
 
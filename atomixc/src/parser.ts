@@ -2,12 +2,15 @@ import * as fs from "fs";
 import * as babel from "@babel/parser";
 import type * as nodes from "@babel/types";
 import { STableSection } from "./format/stable";
+import { ConstantSection } from "./format/constants";
 import { DataSection } from "./format/data";
+import { HandlerSection } from "./format/handlers";
 import { beginPipe } from "./pipe";
 import { buildModule, ModuleFormat } from "./format/module";
 import { BinaryWriter } from "./binary";
 import { Dumper } from "./dumper";
 import * as transform from "./transform";
+import {resolveFile} from "./resolve";
 import {hashFilePath} from "./hash";
 
 export function parseFile(input: string, output: string, root: string, prefix: string): void {
@@ -28,15 +31,20 @@ export function parseFile(input: string, output: string, root: string, prefix: s
 
     const hash: [number, number] = hashFilePath(input, root, prefix);
     transform.transformFile(result, input, root, prefix);
+    resolveFile(result);
 
     const stableSection: STableSection = new STableSection();
+    const constantSection: ConstantSection = new ConstantSection();
     const dataSection: DataSection = new DataSection();
+    const handlerSection: HandlerSection = new HandlerSection();
     beginPipe(result.program, {
         stable: stableSection,
-        data: dataSection
+        constants: constantSection,
+        data: dataSection,
+        handlers: handlerSection
     });
 
-    const module: ModuleFormat = buildModule(hash, stableSection, dataSection);
+    const module: ModuleFormat = buildModule(hash, stableSection, constantSection, dataSection, handlerSection);
     const dumper: Dumper = new Dumper();
     dumper.dumpModule(module);
     const writer: BinaryWriter = new BinaryWriter(output);
@@ -1,17 +1,61 @@
 import type * as nodes from "@babel/types";
 import {DataSection} from "./format/data";
 import {STableSection} from "./format/stable";
-import {ConstantDoubleOperand, ConstantIntegerOperand, ConstantUNumberOperand, Instruction, Opcodes} from "./opcodes";
+import {ConstantSection} from "./format/constants";
+import {HandlerSection} from "./format/handlers";
+import {
+    CAPTURE_FROM_UPVALUE,
+    Instruction,
+    Opcodes,
+    VarIntOperand,
+    VarUIntOperand
+} from "./opcodes";
+import {type Capture, type Resolution, resolutionOf} from "./resolve";
 
 const pipe: Record<string, (node: any, ctx: PipeContext) => void> = {};
 
 export interface PipeContext {
     data: DataSection;
     stable: STableSection;
+    constants: ConstantSection;
+    handlers: HandlerSection;
+    frame: PipeFrame;
 }
 
-export function beginPipe(program: nodes.Program, ctx: PipeContext) {
-    pipeNode(program, ctx);
+/**
+ * The function currently emitted, handler entries are described relative to its frame
+ */
+interface PipeFrame {
+    // First instruction of the function, 0 for the module body
+    owner: number;
+    // Values on the stack of the frame at statement level
+    depth: number;
+    scopes: number;
+    tries: PipeTry[];
+    // Handler code is emitted behind the body so the non throwing path never has to jump over it
+    deferred: (() => void)[];
+    finished: PipeTry[];
+    // Generator frames are suspended and resumed in place and must never be replaced by a tail call
+    generator: boolean;
+}
+
+interface PipeTry {
+    finalizer: nodes.BlockStatement | null;
+    depth: number;
+    scopes: number;
+    close: number;
+    // Start of the range currently protected, -1 while suspended
+    start: number;
+    ranges: [number, number][];
+    handler: number;
+}
+
+export function beginPipe(program: nodes.Program, ctx: Omit<PipeContext, "frame">) {
+    pipeNode(program, {...ctx, frame: createFrame(0, 0, false)});
+}
+
+function createFrame(owner: number, depth: number, generator: boolean): PipeFrame {
+    return {owner: owner, depth: depth, scopes: 0, tries: [], deferred: [], finished: [], generator: generator};
 }
 
 function pipeNode(node: any, ctx: PipeContext) {
@@ -21,6 +65,105 @@ function pipeNode(node: any, ctx: PipeContext) {
     pipe[node.type](node, ctx);
 }
 
+function pipeLoadBinding(name: string, resolution: Resolution | undefined, ctx: PipeContext) {
+    if (!resolution) {
+        const idx: number = ctx.stable.registerString(name);
+        ctx.data.addInstruction(new Instruction(Opcodes.LOAD_LOCAL).addOperand(new VarUIntOperand(idx)));
+        return;
+    }
+    const opcode: Opcodes = resolution.kind == "slot" ? Opcodes.LOAD_SLOT : Opcodes.LOAD_UPVAL;
+    ctx.data.addInstruction(new Instruction(opcode).addOperand(new VarUIntOperand(resolution.index)));
+}
+
+function pipeStoreBinding(node: nodes.Identifier, ctx: PipeContext, declare: boolean) {
+    const resolution: Resolution | undefined = resolutionOf(node);
+    if (!resolution) {
+        const idx: number = ctx.stable.registerString(node.name);
+        ctx.data.addInstruction(new Instruction(declare ? Opcodes.ALLOC_LOCAL : Opcodes.STORE_LOCAL).addOperand(new VarUIntOperand(idx)));
+        return;
+    }
+    const opcode: Opcodes = resolution.kind == "slot" ? Opcodes.STORE_SLOT : Opcodes.STORE_UPVAL;
+    ctx.data.addInstruction(new Instruction(opcode).addOperand(new VarUIntOperand(resolution.index)));
+}
+
+function beginTry(node: nodes.Node, finalizer: nodes.BlockStatement | null, ctx: PipeContext): PipeTry {
+    const entry: PipeTry = {
+        finalizer: finalizer,
+        depth: ctx.frame.depth,
+        scopes: ctx.frame.scopes,
+        close: (node.extra?.firstSlot as number | undefined) ?? 0,
+        start: ctx.data.getCount(),
+        ranges: [],
+        handler: -1
+    };
+    ctx.frame.tries.push(entry);
+    return entry;
+}
+
+function suspendTry(entry: PipeTry, ctx: PipeContext) {
+    if (entry.start != -1 && entry.start < ctx.data.getCount()) {
+        entry.ranges.push([entry.start, ctx.data.getCount()]);
+    }
+    entry.start = -1;
+}
+
+function endTry(entry: PipeTry, ctx: PipeContext) {
+    suspendTry(entry, ctx);
+    ctx.frame.tries.pop();
+    ctx.frame.finished.push(entry);
+}
+
+function deferHandler(entry: PipeTry, ctx: PipeContext, emit: () => void) {
+    const frame: PipeFrame = ctx.frame;
+    const tries: PipeTry[] = frame.tries.slice();
+    frame.deferred.push(() => {
+        entry.handler = ctx.data.getCount();
+        frame.depth = entry.depth;
+        frame.scopes = entry.scopes;
+        frame.tries = tries;
+        // The handler is still protected by the try statements enclosing its own
+        for (const outer of tries) {
+            outer.start = ctx.data.getCount();
+        }
+        emit();
+        for (const outer of tries) {
+            suspendTry(outer, ctx);
+        }
+        frame.tries = [];
+    });
+}
+
+function pipeRethrow(finalizer: nodes.BlockStatement, ctx: PipeContext) {
+    // The exception stays below the finalizer and is thrown again afterward
+    ctx.frame.depth++;
+    pipeNode(finalizer, ctx);
+    ctx.frame.depth--;
+    ctx.data.addInstruction(new Instruction(Opcodes.THROW));
+}
+
+function finishFrame(ctx: PipeContext) {
+    const frame: PipeFrame = ctx.frame;
+    while (frame.deferred.length > 0) {
+        frame.deferred.shift()!();
+    }
+
+    // Nested ranges are never longer than the ones enclosing them and the VM takes the first match
+    const ranges: [[number, number], PipeTry][] = frame.finished
+        .flatMap((entry: PipeTry): [[number, number], PipeTry][] => entry.ranges.map((range: [number, number]): [[number, number], PipeTry] => [range, entry]))
+        .sort(([a]: [[number, number], PipeTry], [b]: [[number, number], PipeTry]): number => (a[1] - a[0]) - (b[1] - b[0]));
+    for (const [[start, end], entry] of ranges) {
+        ctx.handlers.addHandler({
+            owner: frame.owner,
+            start: start,
+            end: end,
+            handler: entry.handler,
+            depth: entry.depth,
+            scopes: entry.scopes,
+            close: entry.close
+        });
+    }
+}
+
 pipe["Program"] = (node: nodes.Program, ctx: PipeContext) => {
     for (const item of node.body) {
         pipeNode(item, ctx);
@@ -28,18 +171,26 @@ pipe["Program"] = (node: nodes.Program, ctx: PipeContext) => {
             ctx.data.addInstruction(new Instruction(Opcodes.POP));
         }
     }
+
+    const jmpEnd: number = ctx.frame.deferred.length > 0
+        ? ctx.data.addInstruction(new Instruction(Opcodes.NOP))
+        : -1;
+    finishFrame(ctx);
+    if (jmpEnd != -1) {
+        ctx.data.replaceInstruction(jmpEnd, new Instruction(Opcodes.JMP).addOperand(new VarUIntOperand(ctx.data.getCount())));
+    }
 }
 
 pipe["StringLiteral"] = (node: nodes.StringLiteral, ctx: PipeContext) => {
     const idx: number = ctx.stable.registerString(node.value);
-    ctx.data.addInstruction(new Instruction(Opcodes.LD_STRING).addOperand(new ConstantUNumberOperand(idx, "short")));
+    ctx.data.addInstruction(new Instruction(Opcodes.LD_STRING).addOperand(new VarUIntOperand(idx)));
 }
 
 pipe["NumericLiteral"] = (node: nodes.NumericLiteral, ctx: PipeContext) => {
-    if (node.value % 1 == 0) {
-        ctx.data.addInstruction(new Instruction(Opcodes.LD_INT).addOperand(new ConstantIntegerOperand(node.value)));
+    if (node.value % 1 == 0 && node.value >= -0x80000000 && node.value <= 0x7FFFFFFF) {
+        ctx.data.addInstruction(new Instruction(Opcodes.LD_INT).addOperand(new VarIntOperand(node.value)));
     } else {
-        ctx.data.addInstruction(new Instruction(Opcodes.LD_DOUBLE).addOperand(new ConstantDoubleOperand(node.value)));
+        ctx.data.addInstruction(new Instruction(Opcodes.LD_DOUBLE).addOperand(new VarUIntOperand(ctx.constants.registerDouble(node.value))));
     }
 }
 
@@ -60,8 +211,7 @@ pipe["Identifier"] = (node: nodes.Identifier, ctx: PipeContext) => {
         ctx.data.addInstruction(new Instruction(Opcodes.LD_UNDF));
         return;
     }
-    const idx = ctx.stable.registerString(node.name);
-    ctx.data.addInstruction(new Instruction(Opcodes.LOAD_LOCAL).addOperand(new ConstantUNumberOperand(idx, "short")));
+    pipeLoadBinding(node.name, resolutionOf(node), ctx);
 }
 
 pipe["ThisExpression"] = (node: nodes.ThisExpression, ctx: PipeContext) => {
@@ -160,6 +310,15 @@ pipe["UnaryExpression"] = (node: nodes.UnaryExpression, ctx: PipeContext) => {
 }
 
 pipe["CallExpression"] = (node: nodes.CallExpression, ctx: PipeContext) => {
+    const importHash: [number, number] | undefined = node.extra?.importHash as [number, number] | undefined;
+    if (importHash) {
+        ctx.data.addInstruction(new Instruction(Opcodes.IMPORT).addOperand(new VarUIntOperand(ctx.constants.registerHash(importHash))));
+        return;
+    }
+    pipeCallExpression(node, ctx, Opcodes.CALL);
+}
+
+function pipeCallExpression(node: nodes.CallExpression, ctx: PipeContext, opcode: Opcodes.CALL | Opcodes.TAIL_CALL) {
     for (const argument of node.arguments.reverse()) {
         pipeNode(argument, ctx);
     }
@@ -169,7 +328,7 @@ pipe["CallExpression"] = (node: nodes.CallExpression, ctx: PipeContext) => {
         ctx.data.addInstruction(new Instruction(Opcodes.LD_UNDF));
         pipeNode(node.callee, ctx);
     }
-    ctx.data.addInstruction(new Instruction(Opcodes.CALL).addOperand(new ConstantUNumberOperand(node.arguments.length, "short")));
+    ctx.data.addInstruction(new Instruction(opcode).addOperand(new VarUIntOperand(node.arguments.length)));
 }
 
 pipe["ObjectExpression"] = (node: nodes.ObjectExpression, ctx: PipeContext) => {
@@ -181,7 +340,7 @@ pipe["ObjectExpression"] = (node: nodes.ObjectExpression, ctx: PipeContext) => {
         ctx.data.addInstruction(new Instruction(Opcodes.DUP));
         const idx: number = ctx.stable.registerString(property.key.name);
         pipeNode(property.value, ctx);
-        ctx.data.addInstruction(new Instruction(Opcodes.OBJ_STORE).addOperand(new ConstantUNumberOperand(idx, "short")));
+        ctx.data.addInstruction(new Instruction(Opcodes.OBJ_STORE).addOperand(new VarUIntOperand(idx)));
     }
 }
 
@@ -189,15 +348,15 @@ pipe["ArrayExpression"] = (node: nodes.ArrayExpression, ctx: PipeContext) => {
     ctx.data.addInstruction(new Instruction(Opcodes.ARR_ALLOC));
     ctx.data.addInstruction(new Instruction(Opcodes.DUP));
     const lengthIdx = ctx.stable.registerString("length");
-    ctx.data.addInstruction(new Instruction(Opcodes.LD_INT).addOperand(new ConstantIntegerOperand(node.elements.length)));
-    ctx.data.addInstruction(new Instruction(Opcodes.OBJ_STORE).addOperand(new ConstantUNumberOperand(lengthIdx, "short")));
+    ctx.data.addInstruction(new Instruction(Opcodes.LD_INT).addOperand(new VarIntOperand(node.elements.length)));
+    ctx.data.addInstruction(new Instruction(Opcodes.OBJ_STORE).addOperand(new VarUIntOperand(lengthIdx)));
 
     let i = 0;
     for (const element of node.elements) {
         ctx.data.addInstruction(new Instruction(Opcodes.DUP));
         pipeNode(element, ctx);
         const indexIdx = ctx.stable.registerString((i++).toString());
-        ctx.data.addInstruction(new Instruction(Opcodes.OBJ_STORE).addOperand(new ConstantUNumberOperand(indexIdx, "short")));
+        ctx.data.addInstruction(new Instruction(Opcodes.OBJ_STORE).addOperand(new VarUIntOperand(indexIdx)));
     }
 }
 
@@ -210,11 +369,10 @@ function pipeMemberExpression(node: nodes.MemberExpression, ctx: PipeContext, do
         if (doubleObject) {
             ctx.data.addInstruction(new Instruction(Opcodes.LD_THIS));
         }
-        const superClassIdx: number = ctx.stable.registerString(obj.extra.targetName as string);
-        ctx.data.addInstruction(new Instruction(Opcodes.LOAD_LOCAL).addOperand(new ConstantUNumberOperand(superClassIdx, "short")));
+        pipeLoadBinding(obj.extra.targetName as string, resolutionOf(obj, "targetResolution"), ctx);
         if (!obj.extra.isStatic) {
             const prototypeIdx: number = ctx.stable.registerString("prototype");
-            ctx.data.addInstruction(new Instruction(Opcodes.OBJ_LOAD).addOperand(new ConstantUNumberOperand(prototypeIdx, "short")));
+            ctx.data.addInstruction(new Instruction(Opcodes.OBJ_LOAD).addOperand(new VarUIntOperand(prototypeIdx)));
         }
     } else {
         pipeNode(node.object, ctx);
@@ -233,7 +391,7 @@ function pipeMemberExpression(node: nodes.MemberExpression, ctx: PipeContext, do
         throw "Undefined property";
     }
     const idx: number = ctx.stable.registerString(node.property.name);
-    ctx.data.addInstruction(new Instruction(Opcodes.OBJ_LOAD).addOperand(new ConstantUNumberOperand(idx, "short")));
+    ctx.data.addInstruction(new Instruction(Opcodes.OBJ_LOAD).addOperand(new VarUIntOperand(idx)));
 }
 
 pipe["MemberExpression"] = (node: nodes.MemberExpression, ctx: PipeContext) => pipeMemberExpression(node, ctx, false);
@@ -246,8 +404,7 @@ pipe["AssignmentExpression"] = (node: nodes.AssignmentExpression, ctx: PipeConte
     if (node.left.type == "Identifier") {
         pipeNode(node.right, ctx);
         ctx.data.addInstruction(new Instruction(Opcodes.DUP));
-        const idx: number = ctx.stable.registerString(node.left.name);
-        ctx.data.addInstruction(new Instruction(Opcodes.STORE_LOCAL).addOperand(new ConstantUNumberOperand(idx, "short")));
+        pipeStoreBinding(node.left, ctx, false);
         return;
     }
 
@@ -265,7 +422,7 @@ pipe["AssignmentExpression"] = (node: nodes.AssignmentExpression, ctx: PipeConte
         pipeNode(node.left.object, ctx);
         ctx.data.addInstruction(new Instruction(Opcodes.SWAP));
         const idx: number = ctx.stable.registerString(node.left.property.name);
-        ctx.data.addInstruction(new Instruction(Opcodes.OBJ_STORE).addOperand(new ConstantUNumberOperand(idx, "short")));
+        ctx.data.addInstruction(new Instruction(Opcodes.OBJ_STORE).addOperand(new VarUIntOperand(idx)));
     }
 }
 
@@ -283,8 +440,7 @@ pipe["VariableDeclarator"] = (node: nodes.VariableDeclarator, ctx: PipeContext)
     }
 
     if (node.id.type == "Identifier") {
-        const idx: number = ctx.stable.registerString(node.id.name);
-        ctx.data.addInstruction(new Instruction(Opcodes.ALLOC_LOCAL).addOperand(new ConstantUNumberOperand(idx, "short")));
+        pipeStoreBinding(node.id, ctx, true);
     } else if (node.id.type == "ObjectPattern") {
         for (const property of node.id.properties) {
             if (property.type != "ObjectProperty") {
@@ -295,9 +451,8 @@ pipe["VariableDeclarator"] = (node: nodes.VariableDeclarator, ctx: PipeContext)
             }
             ctx.data.addInstruction(new Instruction(Opcodes.DUP));
             const keyIdx: number = ctx.stable.registerString(property.key.name);
-            const valueIdx: number = ctx.stable.registerString(property.value.name);
-            ctx.data.addInstruction(new Instruction(Opcodes.OBJ_LOAD).addOperand(new ConstantUNumberOperand(keyIdx, "short")));
-            ctx.data.addInstruction(new Instruction(Opcodes.ALLOC_LOCAL).addOperand(new ConstantUNumberOperand(valueIdx, "short")));
+            ctx.data.addInstruction(new Instruction(Opcodes.OBJ_LOAD).addOperand(new VarUIntOperand(keyIdx)));
+            pipeStoreBinding(property.value, ctx, true);
         }
     } else {
         throw "Unsupported identifier " + node.id.type;
@@ -306,37 +461,85 @@ pipe["VariableDeclarator"] = (node: nodes.VariableDeclarator, ctx: PipeContext)
 
 pipe["FunctionExpression"] = pipe["FunctionDeclaration"] = (node: nodes.FunctionDeclaration | nodes.FunctionExpression, ctx: PipeContext) => {
     const funcStart: number = ctx.data.addInstruction(new Instruction(Opcodes.NOP));
-    const idx: number = node.id
+    const slotCount: number = (node.extra?.slotCount as number | undefined) ?? 0;
+    const upvalues: Capture[] = (node.extra?.upvalues as Capture[] | undefined) ?? [];
+    // Declarations bound to a slot or upvalue are stored after the closure is complete
+    const declaration: Resolution | undefined = node.type == "FunctionDeclaration" && node.id
+        ? resolutionOf(node.id)
+        : undefined;
+    const idx: number = node.type == "FunctionDeclaration" && node.id && !declaration
         ? ctx.stable.registerString(node.id.name)
         : -1;
+
+    const frame: PipeFrame = ctx.frame;
+    ctx.frame = createFrame(funcStart + 1, slotCount, node.generator);
+
+    if (slotCount > 0) {
+        ctx.data.addInstruction(new Instruction(Opcodes.ENTER).addOperand(new VarUIntOperand(slotCount)));
+    }
+    if (node.type == "FunctionExpression" && node.id) {
+        ctx.data.addInstruction(new Instruction(Opcodes.LD_CALLEE));
+        pipeStoreBinding(node.id, ctx, true);
+    }
     for (let i: number = 0; i < node.params.length; i++) {
         const param: nodes.Identifier | nodes.Pattern | nodes.RestElement = node.params[i];
         if (param.type != "Identifier") {
             throw "Unsupported param type";
         }
-        ctx.data.addInstruction(new Instruction(Opcodes.LOAD_ARG).addOperand(new ConstantUNumberOperand(i + 1, "short")));
-        const idx: number = ctx.stable.registerString(param.name);
-        ctx.data.addInstruction(new Instruction(Opcodes.ALLOC_LOCAL).addOperand(new ConstantUNumberOperand(idx, "short")));
+        ctx.data.addInstruction(new Instruction(Opcodes.LOAD_ARG).addOperand(new VarUIntOperand(i + 1)));
+        pipeStoreBinding(param, ctx, true);
+    }
+    if (node.generator) {
+        // The call returns the generator object, the body only runs once next is called
+        ctx.data.addInstruction(new Instruction(Opcodes.GENERATOR));
     }
 
     pipeNode(node.body, ctx);
+    // Slots sit on the stack as well, so falling off the end has to return explicitly
+    ctx.data.addInstruction(new Instruction(Opcodes.LD_UNDF));
+    ctx.data.addInstruction(new Instruction(Opcodes.RETURN));
+    finishFrame(ctx);
     const funcEnd: number = ctx.data.getCount();
+    // The byte length lets the VM skip the body at load time and decode it on the first call
+    const funcLength: number = ctx.data.getLengthBetween(funcStart + 1, funcEnd);
+    ctx.frame = frame;
 
     if (idx != -1) {
         ctx.data.replaceInstruction(
             funcStart,
             new Instruction(Opcodes.DECLARE_FUNC)
-                .addOperand(new ConstantUNumberOperand(idx, "short"))
-                .addOperand(new ConstantUNumberOperand(funcEnd - funcStart - 1, "short"))
+                .addOperand(new VarUIntOperand(idx))
+                .addOperand(new VarUIntOperand(funcEnd - funcStart - 1))
+                .addOperand(new VarUIntOperand(funcLength))
         );
     } else {
-        ctx.data.replaceInstruction(funcStart, new Instruction(Opcodes.DECLARE_FUNC_E).addOperand(new ConstantUNumberOperand(funcEnd - funcStart - 1, "short")));
+        ctx.data.replaceInstruction(
+            funcStart,
+            new Instruction(Opcodes.DECLARE_FUNC_E)
+                .addOperand(new VarUIntOperand(funcEnd - funcStart - 1))
+                .addOperand(new VarUIntOperand(funcLength))
+        );
+    }
+
+    if (upvalues.length > 0) {
+        const capture: Instruction = new Instruction(Opcodes.CAPTURE).addOperand(new VarUIntOperand(upvalues.length));
+        for (const upvalue of upvalues) {
+            const entry: number = upvalue.fromUpvalue ? upvalue.index | CAPTURE_FROM_UPVALUE : upvalue.index;
+            capture.addOperand(new VarUIntOperand(entry));
+        }
+        ctx.data.addInstruction(capture);
+    }
+
+    if (declaration && node.id) {
+        ctx.data.addInstruction(new Instruction(Opcodes.DUP));
+        pipeStoreBinding(node.id, ctx, true);
     }
 }
 
 pipe["BlockStatement"] = (node: nodes.BlockStatement, ctx: PipeContext) => {
     if (!node.extra || !node.extra.isVirtual) {
         ctx.data.addInstruction(new Instruction(Opcodes.PUSH_SCOPE));
+        ctx.frame.scopes++;
     }
     for (const item of node.body) {
         pipeNode(item, ctx);
@@ -344,17 +547,125 @@ pipe["BlockStatement"] = (node: nodes.BlockStatement, ctx: PipeContext) => {
             ctx.data.addInstruction(new Instruction(Opcodes.POP));
         }
     }
+    const closeSlot: number | undefined = node.extra?.closeSlot as number | undefined;
+    if (closeSlot !== undefined) {
+        ctx.data.addInstruction(new Instruction(Opcodes.CLOSE_UPVALS).addOperand(new VarUIntOperand(closeSlot)));
+    }
     if (!node.extra || !node.extra.isVirtual) {
         ctx.data.addInstruction(new Instruction(Opcodes.POP_SCOPE));
+        ctx.frame.scopes--;
     }
 }
 
+/**
+ * The callee may only take over the frame if nothing of the current function runs after the call. Handlers and
+ * finalizers of an enclosing try statement still need the frame, and a generator returns through its iterator.
+ */
+function isTailCall(node: nodes.ReturnStatement, ctx: PipeContext): node is nodes.ReturnStatement & {argument: nodes.CallExpression} {
+    return node.argument?.type == "CallExpression" && ctx.frame.tries.length == 0 && !ctx.frame.generator;
+}
+
 pipe["ReturnStatement"] = (node: nodes.ReturnStatement, ctx: PipeContext) => {
+    const tries: PipeTry[] = ctx.frame.tries;
+    if (isTailCall(node, ctx)) {
+        // CALL followed by RETURN: the callee reuses the frame of the current function
+        pipeCallExpression(node.argument, ctx, Opcodes.TAIL_CALL);
+        return;
+    }
+
     if (node.argument) {
         pipeNode(node.argument, ctx);
+    } else {
+        ctx.data.addInstruction(new Instruction(Opcodes.LD_UNDF));
+    }
+
+    // Finalizers run with the return value below them and are only protected by the enclosing try statements
+    ctx.frame.depth++;
+    for (let i: number = tries.length - 1; i >= 0; i--) {
+        suspendTry(tries[i], ctx);
+        const finalizer: nodes.BlockStatement | null = tries[i].finalizer;
+        if (finalizer) {
+            ctx.frame.tries = tries.slice(0, i);
+            pipeNode(finalizer, ctx);
+        }
     }
+    ctx.frame.tries = tries;
+    ctx.frame.depth--;
 
     ctx.data.addInstruction(new Instruction(Opcodes.RETURN));
+    for (const entry of tries) {
+        entry.start = ctx.data.getCount();
+    }
+}
+
+pipe["ThrowStatement"] = (node: nodes.ThrowStatement, ctx: PipeContext) => {
+    pipeNode(node.argument, ctx);
+    ctx.data.addInstruction(new Instruction(Opcodes.THROW));
+}
+
+pipe["TryStatement"] = (node: nodes.TryStatement, ctx: PipeContext) => {
+    /*
+        0: <block>              protected, handled at 3
+        1: <finalizer>
+        2: ...
+        ...
+        3: <catch clause>       exception on the stack, protected, handled at 6
+        4: <finalizer>
+        5: jmp 2
+        6: <finalizer>          exception on the stack
+        7: throw
+     */
+    const finalizer: nodes.BlockStatement | null = node.finalizer ?? null;
+    const handler: nodes.CatchClause | null = node.handler ?? null;
+
+    const block: PipeTry = beginTry(node.block, finalizer, ctx);
+    pipeNode(node.block, ctx);
+    endTry(block, ctx);
+    if (finalizer) {
+        pipeNode(finalizer, ctx);
+    }
+    const resume: number = ctx.data.getCount();
+
+    if (handler) {
+        deferHandler(block, ctx, () => {
+            const guard: PipeTry | null = finalizer
+                ? beginTry(handler, finalizer, ctx)
+                : null;
+            pipeNode(handler, ctx);
+            if (guard && finalizer) {
+                endTry(guard, ctx);
+                pipeNode(finalizer, ctx);
+                deferHandler(guard, ctx, () => pipeRethrow(finalizer, ctx));
+            }
+            ctx.data.addInstruction(new Instruction(Opcodes.JMP).addOperand(new VarUIntOperand(resume)));
+        });
+    } else if (finalizer) {
+        deferHandler(block, ctx, () => pipeRethrow(finalizer, ctx));
+    }
+}
+
+pipe["CatchClause"] = (node: nodes.CatchClause, ctx: PipeContext) => {
+    if (!node.param) {
+        ctx.data.addInstruction(new Instruction(Opcodes.POP));
+        pipeNode(node.body, ctx);
+        return;
+    }
+    if (node.param.type != "Identifier") {
+        throw "Unsupported catch param type";
+    }
+
+    // Outside of functions the parameter lives in its own scope
+    const scoped: boolean = !resolutionOf(node.param);
+    if (scoped) {
+        ctx.data.addInstruction(new Instruction(Opcodes.PUSH_SCOPE));
+        ctx.frame.scopes++;
+    }
+    pipeStoreBinding(node.param, ctx, true);
+    pipeNode(node.body, ctx);
+    if (scoped) {
+        ctx.data.addInstruction(new Instruction(Opcodes.POP_SCOPE));
+        ctx.frame.scopes--;
+    }
 }
 
 pipe["IfStatement"] = (node: nodes.IfStatement, ctx: PipeContext) => {
@@ -365,15 +676,27 @@ pipe["IfStatement"] = (node: nodes.IfStatement, ctx: PipeContext) => {
     let jmpToEnd: number = -1
     if (node.alternate) {
         jmpToEnd = ctx.data.addInstruction(new Instruction(Opcodes.NOP));
-        ctx.data.replaceInstruction(jmpToElseOrEnd, new Instruction(Opcodes.JMP_F).addOperand(new ConstantUNumberOperand(jmpToEnd + 1, "short")));
+        ctx.data.replaceInstruction(jmpToElseOrEnd, new Instruction(Opcodes.JMP_F).addOperand(new VarUIntOperand(jmpToEnd + 1)));
         pipeNode(node.alternate, ctx);
     }
 
     if (jmpToEnd == -1) {
-        ctx.data.replaceInstruction(jmpToElseOrEnd, new Instruction(Opcodes.JMP_F).addOperand(new ConstantUNumberOperand(ctx.data.getCount(), "short")));
+        ctx.data.replaceInstruction(jmpToElseOrEnd, new Instruction(Opcodes.JMP_F).addOperand(new VarUIntOperand(ctx.data.getCount())));
     } else {
-        ctx.data.replaceInstruction(jmpToEnd, new Instruction(Opcodes.JMP).addOperand(new ConstantUNumberOperand(ctx.data.getCount(), "short")));
+        ctx.data.replaceInstruction(jmpToEnd, new Instruction(Opcodes.JMP).addOperand(new VarUIntOperand(ctx.data.getCount())));
+    }
+}
+
+pipe["YieldExpression"] = (node: nodes.YieldExpression, ctx: PipeContext) => {
+    if (node.delegate) {
+        throw "Unsupported yield delegation";
+    }
+    if (node.argument) {
+        pipeNode(node.argument, ctx);
+    } else {
+        ctx.data.addInstruction(new Instruction(Opcodes.LD_UNDF));
     }
+    ctx.data.addInstruction(new Instruction(Opcodes.YIELD));
 }
 
 pipe["WhileStatement"] = (node: nodes.WhileStatement, ctx: PipeContext) => {
@@ -389,8 +712,8 @@ pipe["WhileStatement"] = (node: nodes.WhileStatement, ctx: PipeContext) => {
     pipeNode(node.test, ctx);
     const jmpEnd = ctx.data.addInstruction(new Instruction(Opcodes.POP));
     pipeNode(node.body, ctx);
-    ctx.data.addInstruction(new Instruction(Opcodes.JMP).addOperand(new ConstantUNumberOperand(start, "short")));
-    ctx.data.replaceInstruction(jmpEnd, new Instruction(Opcodes.JMP_F).addOperand(new ConstantUNumberOperand(ctx.data.getCount(), "short")));
+    ctx.data.addInstruction(new Instruction(Opcodes.JMP).addOperand(new VarUIntOperand(start)));
+    ctx.data.replaceInstruction(jmpEnd, new Instruction(Opcodes.JMP_F).addOperand(new VarUIntOperand(ctx.data.getCount())));
 }
 
 pipe["ExportNamedDeclaration"] = (node: nodes.ExportNamedDeclaration, ctx: PipeContext) => {
@@ -405,14 +728,14 @@ pipe["ExportNamedDeclaration"] = (node: nodes.ExportNamedDeclaration, ctx: PipeC
 
                 pipeNode(declarator.id, ctx);
                 const idx: number = ctx.stable.registerString(declarator.id.name);
-                ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new ConstantUNumberOperand(idx, "short")));
+                ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new VarUIntOperand(idx)));
             }
         } else if (node.declaration.type == "FunctionDeclaration" || node.declaration.type == "ClassDeclaration") {
             if (!node.declaration.id) {
                 throw "Missing declaration id";
             }
             const idx: number = ctx.stable.registerString(node.declaration.id.name);
-            ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new ConstantUNumberOperand(idx, "short")));
+            ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new VarUIntOperand(idx)));
         } else {
             throw "Unsupported declaration type";
         }
@@ -424,7 +747,7 @@ pipe["ExportNamedDeclaration"] = (node: nodes.ExportNamedDeclaration, ctx: PipeC
             const exportIdx: number = specifier.exported.type == "StringLiteral"
                 ? ctx.stable.registerString(specifier.exported.value)
                 : ctx.stable.registerString(specifier.exported.name);
-            ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new ConstantUNumberOperand(exportIdx, "short")));
+            ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new VarUIntOperand(exportIdx)));
             continue;
         }
 
@@ -432,13 +755,13 @@ pipe["ExportNamedDeclaration"] = (node: nodes.ExportNamedDeclaration, ctx: PipeC
             pipeNode(node.declaration, ctx);
             // TODO may use a symbol for default exports
             const exportIdx: number = ctx.stable.registerString("default");
-            ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new ConstantUNumberOperand(exportIdx, "short")));
+            ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new VarUIntOperand(exportIdx)));
             continue
         }
 
         pipeNode(specifier.exported, ctx);
         const exportIdx: number = ctx.stable.registerString(specifier.exported.name);
-        ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new ConstantUNumberOperand(exportIdx, "short")));
+        ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new VarUIntOperand(exportIdx)));
     }
 }
 
@@ -446,5 +769,5 @@ pipe["ExportDefaultDeclaration"] = (node: nodes.ExportDefaultDeclaration, ctx: P
     pipeNode(node.declaration, ctx);
     // TODO may use a symbol for default exports
     const idx: number = ctx.stable.registerString("default");
-    ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new ConstantUNumberOperand(idx, "short")));
+    ctx.data.addInstruction(new Instruction(Opcodes.EXPORT).addOperand(new VarUIntOperand(idx)));
 }
\ No newline at end of file
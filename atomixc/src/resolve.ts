@@ -0,0 +1,207 @@
+import traverse, {type Binding, type NodePath, type Scope} from "@babel/traverse";
+import type * as nodes from "@babel/types";
+
+/**
+ * Where the value of a binding lives at runtime. Bindings without a resolution are module-level or
+ * global names and are looked up by name in the scope chain.
+ */
+export interface Resolution {
+    kind: "slot" | "upvalue";
+    index: number;
+}
+
+/**
+ * A variable captured by a closure, either a slot of the enclosing function or one of its upvalues
+ */
+export interface Capture {
+    fromUpvalue: boolean;
+    index: number;
+}
+
+interface Frame {
+    parent: Frame | null;
+    slots: Map<Binding, number>;
+    upvalues: Capture[];
+    upvalueIndices: Map<Binding, number>;
+}
+
+function extraOf(node: nodes.Node): Record<string, unknown> {
+    if (!node.extra) {
+        node.extra = {};
+    }
+    return node.extra;
+}
+
+export function resolutionOf(node: nodes.Node, key: string = "resolution"): Resolution | undefined {
+    return node.extra?.[key] as Resolution | undefined;
+}
+
+/**
+ * Assigns every binding declared inside a function a stack slot of that function and computes the
+ * upvalues each closure captures (Lua-style). Annotates:
+ * - Identifier.extra.resolution: how the identifier is loaded or stored
+ * - Super.extra.targetResolution: same for the super class referenced by name
+ * - Function.extra.slotCount / Function.extra.upvalues: frame size and capture list
+ * - BlockStatement.extra.isVirtual / BlockStatement.extra.closeSlot: blocks inside functions need no
+ *   scope, captured block bindings are closed at the end of the block so every iteration gets its own cell
+ * - extra.firstSlot of try blocks and catch clauses: upvalues from this slot on are closed when unwinding
+ */
+export function resolveFile(file: nodes.File): void {
+    const frames: Map<nodes.Node, Frame> = new Map();
+    const captured: Set<Binding> = new Set();
+
+    const frameOf = (scope: Scope): Frame | undefined => {
+        const functionScope: Scope | null = scope.getFunctionParent();
+        return functionScope
+            ? frames.get(functionScope.path.node)
+            : undefined;
+    };
+
+    const slotOf = (frame: Frame, binding: Binding): number => {
+        let slot: number | undefined = frame.slots.get(binding);
+        if (slot === undefined) {
+            slot = frame.slots.size;
+            frame.slots.set(binding, slot);
+        }
+        return slot;
+    };
+
+    const allocateSlots = (scope: Scope): void => {
+        const frame: Frame | undefined = frameOf(scope);
+        if (!frame) {
+            return;
+        }
+        // Allocating per scope on entry keeps the slots of inner blocks above the ones of outer blocks
+        for (const name of Object.keys(scope.bindings)) {
+            slotOf(frame, scope.bindings[name]);
+        }
+    };
+
+    const captureOf = (frame: Frame, binding: Binding, owner: Frame): number => {
+        const existing: number | undefined = frame.upvalueIndices.get(binding);
+        if (existing !== undefined) {
+            return existing;
+        }
+        if (!frame.parent) {
+            throw "Captured binding is not declared in an enclosing function";
+        }
+
+        let capture: Capture;
+        if (frame.parent === owner) {
+            capture = {fromUpvalue: false, index: slotOf(owner, binding)};
+            captured.add(binding);
+        } else {
+            capture = {fromUpvalue: true, index: captureOf(frame.parent, binding, owner)};
+        }
+        const index: number = frame.upvalues.length;
+        frame.upvalues.push(capture);
+        frame.upvalueIndices.set(binding, index);
+        return index;
+    };
+
+    const resolve = (binding: Binding | undefined, site: Frame | undefined): Resolution | undefined => {
+        if (!binding || !site) {
+            return undefined;
+        }
+        const owner: Frame | undefined = frameOf(binding.scope);
+        if (!owner) {
+            return undefined;
+        }
+        return owner === site
+            ? {kind: "slot", index: slotOf(owner, binding)}
+            : {kind: "upvalue", index: captureOf(site, binding, owner)};
+    };
+
+    traverse(file, {
+        Program(ctx: NodePath<nodes.Program>): void {
+            ctx.scope.crawl();
+        },
+        Function: {
+            enter(ctx: NodePath<nodes.Function>): void {
+                const parent: Frame | undefined = ctx.parentPath
+                    ? frameOf(ctx.parentPath.scope)
+                    : undefined;
+                frames.set(ctx.node, {
+                    parent: parent ?? null,
+                    slots: new Map(),
+                    upvalues: [],
+                    upvalueIndices: new Map()
+                });
+                allocateSlots(ctx.scope);
+            },
+            exit(ctx: NodePath<nodes.Function>): void {
+                const frame: Frame = frames.get(ctx.node)!;
+                extraOf(ctx.node).slotCount = frame.slots.size;
+                extraOf(ctx.node).upvalues = frame.upvalues;
+            }
+        },
+        Scopable(ctx: NodePath<nodes.Scopable>): void {
+            const frame: Frame | undefined = frameOf(ctx.scope);
+            if (frame && ((ctx.parentPath?.isTryStatement() && ctx.key == "block") || ctx.isCatchClause())) {
+                // Everything declared from here on is left when an exception unwinds the block
+                extraOf(ctx.node).firstSlot = frame.slots.size;
+            }
+            allocateSlots(ctx.scope);
+        },
+        BlockStatement: {
+            exit(ctx: NodePath<nodes.BlockStatement>): void {
+                const frame: Frame | undefined = frameOf(ctx.scope);
+                if (!frame) {
+                    return;
+                }
+                extraOf(ctx.node).isVirtual = true;
+                if (ctx.parentPath.isFunction()) {
+                    // Leaving the frame closes everything
+                    return;
+                }
+
+                let closeSlot: number = -1;
+                for (const name of Object.keys(ctx.scope.bindings)) {
+                    const binding: Binding = ctx.scope.bindings[name];
+                    if (!captured.has(binding)) {
+                        continue;
+                    }
+                    const slot: number = slotOf(frame, binding);
+                    closeSlot = closeSlot == -1 ? slot : Math.min(closeSlot, slot);
+                }
+                if (closeSlot != -1) {
+                    extraOf(ctx.node).closeSlot = closeSlot;
+                }
+            }
+        },
+        Identifier(ctx: NodePath<nodes.Identifier>): void {
+            const parent: NodePath | null = ctx.parentPath;
+            const isAssigned: boolean = !!parent?.isAssignmentExpression() && ctx.key == "left";
+            if (!ctx.isReferencedIdentifier() && !ctx.isBindingIdentifier() && !isAssigned) {
+                return;
+            }
+            const binding: Binding | undefined = ctx.scope.getBinding(ctx.node.name);
+
+            let site: Frame | undefined;
+            if (parent?.isFunctionExpression() && ctx.key == "id") {
+                // The name of a function expression is bound inside of the function itself
+                site = frames.get(parent.node);
+            } else if (parent?.isFunction() && ctx.key == "id") {
+                // Declarations are stored by the function containing them
+                site = parent.parentPath ? frameOf(parent.parentPath.scope) : undefined;
+            } else {
+                site = frameOf(ctx.scope);
+            }
+
+            const resolution: Resolution | undefined = resolve(binding, site);
+            if (resolution) {
+                extraOf(ctx.node).resolution = resolution;
+            }
+        },
+        Super(ctx: NodePath<nodes.Super>): void {
+            const targetName: unknown = ctx.node.extra?.targetName;
+            if (typeof targetName != "string") {
+                return;
+            }
+            const resolution: Resolution | undefined = resolve(ctx.scope.getBinding(targetName), frameOf(ctx.scope));
+            if (resolution) {
+                extraOf(ctx.node).targetResolution = resolution;
+            }
+        }
+    });
+}
@@ -1,11 +1,12 @@
 import * as path from "path";
-import traverse, {type NodePath} from "@babel/traverse";
+import traverse, {type Binding, type NodePath, type Scope} from "@babel/traverse";
 import * as nodes from "@babel/types";
 import {hashFilePath, hashString} from "./hash";
 
 export function transformFile(file: nodes.File, input: string, root: string, prefix: string): void {
     transformPreNode(file, input, root, prefix);
     transformPostNode(file, input, root, prefix);
+    transformHoistNode(file);
 }
 
 
@@ -52,7 +53,7 @@ function transformPreNode(file: nodes.File, input: string, root: string, prefix:
             }
             ctx.replaceWith(nodes.callExpression(
                 nodes.memberExpression(
-                    classContext.node.superClass,
+                    nodes.cloneNode(classContext.node.superClass),
                     nodes.identifier("call")
                 ),
                 [
@@ -117,6 +118,63 @@ function transformPostNode(file: nodes.File, input: string, root: string, prefix
                 ]) : ctx.node.body;
             ctx.replaceWith(nodes.whileStatement(test, body));
         },
+        ForOfStatement(ctx: NodePath<nodes.ForOfStatement>): void {
+            /*
+             * Before:
+             * for (const item of items) {
+             *      ...
+             * }
+             *
+             * After:
+             * {
+             *      const _it = items[Symbol.iterator]();
+             *      let _step = _it.next();
+             *      while (!_step.done) {
+             *          const item = _step.value;
+             *          ...
+             *          _step = _it.next();
+             *      }
+             * }
+             */
+            if (ctx.node.await) {
+                throw "Unsupported for await";
+            }
+            const iterator: string = ctx.scope.generateUidIdentifier("it").name;
+            const step: string = ctx.scope.generateUidIdentifier("step").name;
+            const next = (): nodes.CallExpression => nodes.callExpression(
+                nodes.memberExpression(nodes.identifier(iterator), nodes.identifier("next")),
+                []
+            );
+            const value: nodes.MemberExpression = nodes.memberExpression(nodes.identifier(step), nodes.identifier("value"));
+
+            const left: nodes.VariableDeclaration | nodes.LVal = ctx.node.left;
+            const bind: nodes.Statement = left.type == "VariableDeclaration"
+                ? nodes.variableDeclaration(left.kind, [nodes.variableDeclarator(left.declarations[0].id, value)])
+                : nodes.expressionStatement(nodes.assignmentExpression("=", left, value));
+
+            ctx.replaceWith(nodes.blockStatement([
+                nodes.variableDeclaration("const", [nodes.variableDeclarator(
+                    nodes.identifier(iterator),
+                    nodes.callExpression(
+                        nodes.memberExpression(
+                            ctx.node.right,
+                            nodes.memberExpression(nodes.identifier("Symbol"), nodes.identifier("iterator")),
+                            true
+                        ),
+                        []
+                    )
+                )]),
+                nodes.variableDeclaration("let", [nodes.variableDeclarator(nodes.identifier(step), next())]),
+                nodes.whileStatement(
+                    nodes.unaryExpression("!", nodes.memberExpression(nodes.identifier(step), nodes.identifier("done"))),
+                    nodes.blockStatement([
+                        bind,
+                        ctx.node.body,
+                        nodes.expressionStatement(nodes.assignmentExpression("=", nodes.identifier(step), next()))
+                    ])
+                )
+            ]));
+        },
         NewExpression(ctx: NodePath<nodes.NewExpression>): void {
             /*
              * Before:
@@ -215,7 +273,7 @@ function transformPostNode(file: nodes.File, input: string, root: string, prefix
             let source: string = ctx.node.source.value;
             let sourceHash: [number, number];
             if (source.startsWith(".")) {
-                source = path.join(path.basename(input), source);
+                source = path.join(path.dirname(input), source);
                 sourceHash = hashFilePath(source, root, prefix);
             } else {
                 sourceHash = hashString(source);
@@ -235,31 +293,13 @@ function transformPostNode(file: nodes.File, input: string, root: string, prefix
                         [
                             nodes.variableDeclarator(
                                 initializer,
-                                nodes.callExpression(
-                                    nodes.memberExpression(
-                                        nodes.identifier("Module"),
-                                        nodes.identifier("importModule"),
-                                    ),
-                                    [
-                                        nodes.numericLiteral(sourceHash[0]),
-                                        nodes.numericLiteral(sourceHash[1])
-                                    ]
-                                )
+                                importExpression(sourceHash)
                             )
                         ]
                     )
                 )
             } else {
-                initializer = nodes.callExpression(
-                    nodes.memberExpression(
-                        nodes.identifier("Module"),
-                        nodes.identifier("importModule"),
-                    ),
-                    [
-                        nodes.numericLiteral(sourceHash[0]),
-                        nodes.numericLiteral(sourceHash[1])
-                    ]
-                );
+                initializer = importExpression(sourceHash);
             }
 
             const props: nodes.ObjectProperty[] = [];
@@ -304,6 +344,114 @@ function transformPostNode(file: nodes.File, input: string, root: string, prefix
     });
 }
 
+/**
+ * Stands in for the module until it is emitted, the pipe compiles the call to a single IMPORT of the hash
+ */
+function importExpression(hash: [number, number]): nodes.CallExpression {
+    const call: nodes.CallExpression = nodes.callExpression(
+        nodes.memberExpression(
+            nodes.identifier("Module"),
+            nodes.identifier("importModule"),
+        ),
+        [
+            nodes.numericLiteral(hash[0]),
+            nodes.numericLiteral(hash[1])
+        ]
+    );
+    call.extra = {importHash: hash};
+    return call;
+}
+
+function transformHoistNode(file: nodes.File): void {
+    /*
+     * Before:
+     * function outer(list) {
+     *      function square(x) {
+     *          return x * x;
+     *      }
+     *      return square(list.length);
+     * }
+     *
+     * After:
+     * function _square(x) {
+     *      return x * x;
+     * }
+     * function outer(list) {
+     *      return _square(list.length);
+     * }
+     *
+     * Only inner declarations which don't capture a binding of an enclosing function are lifted. Their
+     * identity must not be observable, so they are only lifted if every reference is a direct call.
+     * Function expressions are left in place, every evaluation has to create a new function.
+     */
+    const hoisted: nodes.FunctionDeclaration[] = [];
+    traverse(file, {
+        Program: {
+            enter(ctx: NodePath<nodes.Program>): void {
+                ctx.scope.crawl();
+            },
+            exit(ctx: NodePath<nodes.Program>): void {
+                if (hoisted.length > 0) {
+                    ctx.unshiftContainer("body", hoisted.splice(0));
+                }
+            }
+        },
+        FunctionDeclaration: {
+            exit(ctx: NodePath<nodes.FunctionDeclaration>): void {
+                if (!ctx.node.id || !ctx.getFunctionParent()) {
+                    return;
+                }
+                const binding: Binding | undefined = ctx.parentPath.scope.getBinding(ctx.node.id.name);
+                if (!binding || !binding.constant || binding.path !== ctx) {
+                    return;
+                }
+                if (!binding.referencePaths.every(ref => ref.parentPath?.isCallExpression() && ref.key == "callee")) {
+                    return;
+                }
+                if (capturesEnclosingFunction(ctx, binding)) {
+                    return;
+                }
+                const program: Scope = ctx.scope.getProgramParent();
+                const name: string = program.generateUidIdentifier(ctx.node.id.name).name;
+                for (const ref of binding.referencePaths) {
+                    ref.replaceWith(nodes.identifier(name));
+                }
+                hoisted.push(nodes.functionDeclaration(nodes.identifier(name), ctx.node.params, ctx.node.body, ctx.node.generator, ctx.node.async));
+                ctx.remove();
+            }
+        }
+    });
+}
+
+function capturesEnclosingFunction(ctx: NodePath<nodes.FunctionDeclaration>, self: Binding): boolean {
+    const program: Scope = ctx.scope.getProgramParent();
+    let captures: boolean = false;
+    ctx.traverse({
+        Identifier(ref: NodePath<nodes.Identifier>): void {
+            const isAssigned: boolean = !!ref.parentPath?.isAssignmentExpression() && ref.key == "left";
+            if (!ref.isReferencedIdentifier() && !isAssigned) {
+                return;
+            }
+            const binding: Binding | undefined = ref.scope.getBinding(ref.node.name);
+            if (!binding || binding === self || binding.scope === program) {
+                return;
+            }
+            if (binding.scope === ctx.scope || binding.scope.path.isDescendant(ctx)) {
+                return;
+            }
+            captures = true;
+            ref.stop();
+        },
+        Super(ref: NodePath<nodes.Super>): void {
+            // super is resolved by the name of the super class, which may live in the enclosing function
+            captures = true;
+            ref.stop();
+        }
+    });
+    return captures;
+}
+
+// The identifier is cloned for every use, the resolver annotates identifiers per node
 function transformClass(node: nodes.ClassDeclaration | nodes.ClassExpression, identifier: nodes.Identifier): nodes.CallExpression {
     const constructorMethod: nodes.ClassMethod | undefined = node.body.body.find(node =>
         node.type == "ClassMethod" &&
@@ -326,7 +474,7 @@ function transformClass(node: nodes.ClassDeclaration | nodes.ClassExpression, id
                 nodes.assignmentExpression(
                     "=",
                     nodes.memberExpression(
-                        identifier,
+                        nodes.cloneNode(identifier),
                         nodes.identifier("prototype")
                     ),
                     nodes.callExpression(
@@ -336,7 +484,7 @@ function transformClass(node: nodes.ClassDeclaration | nodes.ClassExpression, id
                         ),
                         [
                             nodes.memberExpression(
-                                node.superClass,
+                                nodes.cloneNode(node.superClass),
                                 nodes.identifier("prototype")
                             )
                         ]
@@ -350,8 +498,8 @@ function transformClass(node: nodes.ClassDeclaration | nodes.ClassExpression, id
                         nodes.identifier("setPrototypeOf")
                     ),
                     [
-                        identifier,
-                        node.superClass
+                        nodes.cloneNode(identifier),
+                        nodes.cloneNode(node.superClass)
                     ]
                 )
             )
@@ -364,7 +512,7 @@ function transformClass(node: nodes.ClassDeclaration | nodes.ClassExpression, id
             [],
             nodes.blockStatement([
                 nodes.functionDeclaration(
-                    identifier,
+                    nodes.cloneNode(identifier),
                     constructorMethod ? constructorMethod.params as Array<nodes.Identifier | nodes.Pattern | nodes.RestElement> : [],
                     nodes.blockStatement([
                         ...properties.map(property => nodes.expressionStatement(
@@ -386,12 +534,12 @@ function transformClass(node: nodes.ClassDeclaration | nodes.ClassExpression, id
                         "=",
                         nodes.memberExpression(
                             nodes.memberExpression(
-                                identifier,
+                                nodes.cloneNode(identifier),
                                 nodes.identifier("prototype")
                             ),
                             nodes.identifier("constructor")
                         ),
-                        identifier
+                        nodes.cloneNode(identifier)
                     )
                 ),
                 ...methods.map(method => nodes.expressionStatement(
@@ -399,7 +547,7 @@ function transformClass(node: nodes.ClassDeclaration | nodes.ClassExpression, id
                         "=",
                         nodes.memberExpression(
                             nodes.memberExpression(
-                                identifier,
+                                nodes.cloneNode(identifier),
                                 nodes.identifier("prototype")
                             ),
                             method.key,
@@ -418,7 +566,7 @@ function transformClass(node: nodes.ClassDeclaration | nodes.ClassExpression, id
                     nodes.assignmentExpression(
                         "=",
                         nodes.memberExpression(
-                            identifier,
+                            nodes.cloneNode(identifier),
                             method.key,
                             method.key.type != "Identifier"
                         ),
@@ -435,7 +583,7 @@ function transformClass(node: nodes.ClassDeclaration | nodes.ClassExpression, id
                     nodes.assignmentExpression(
                         "=",
                         nodes.memberExpression(
-                            identifier,
+                            nodes.cloneNode(identifier),
                             property.key,
                             property.key.type != "Identifier"
                         ),
@@ -443,7 +591,7 @@ function transformClass(node: nodes.ClassDeclaration | nodes.ClassExpression, id
                     )
                 )),
                 ...staticBlocks.map(block => block.body).flat(),
-                nodes.returnStatement(identifier)
+                nodes.returnStatement(nodes.cloneNode(identifier))
             ])
         ),
         []
@@ -0,0 +1,244 @@
+const fsSync = require("fs");
+const path = require("path");
+const os = require("os");
+const child_process = require("child_process");
+
+const COMPILER = process.argv[2];
+const VM_RUNNER = process.argv[3];
+const RUNS = 5;
+
+// Every directory in bench/ holds variants of the same program, their timings are printed side by side
+function runSubprocess(command, args) {
+    const result = child_process.spawnSync(command, args, {encoding: "utf-8"});
+    if (result.status !== 0) {
+        throw new Error(`Command: ${[command, ...args].join(" ")}\nProcess exited with code ${result.status}\n${result.stderr}`);
+    }
+    return result.stdout;
+}
+
+function measure(file) {
+    const program = file + ".bin";
+    runSubprocess("node", [COMPILER, "compiler", "compile", file, "-o", program, "-r", "."]);
+
+    let best = Infinity;
+    let output = "";
+    for (let i = 0; i < RUNS; i++) {
+        const start = process.hrtime.bigint();
+        output = runSubprocess(VM_RUNNER, [program]);
+        const elapsed = Number(process.hrtime.bigint() - start) / 1e6;
+        best = Math.min(best, elapsed);
+    }
+    fsSync.unlinkSync(program);
+    return [best, output];
+}
+
+const root = path.join(__dirname, "bench");
+for (const group of fsSync.readdirSync(root, {withFileTypes: true})) {
+    if (!group.isDirectory()) {
+        continue;
+    }
+
+    console.log(`${group.name}:`);
+    const outputs = new Set();
+    for (const file of fsSync.readdirSync(path.join(root, group.name)).filter(f => f.endsWith(".js"))) {
+        const [best, output] = measure(path.join(root, group.name, file));
+        outputs.add(output);
+        console.log(`    ${file.padEnd(20, " ")} ${best.toFixed(1).padStart(10, " ")} ms`);
+    }
+    if (outputs.size > 1) {
+        console.log("    variants disagree on their output");
+        process.exitCode = 1;
+    }
+}
+
+// Runs a program RUNS times with the heap statistics enabled, returns the best time and the heap size of that run
+function measureHeap(program, env = {}) {
+    let best = null;
+    for (let i = 0; i < RUNS; i++) {
+        const start = process.hrtime.bigint();
+        const result = child_process.spawnSync(VM_RUNNER, [program], {
+            encoding: "utf-8",
+            env: {...process.env, ...env, ATOMIX_GC_STATS: "1"}
+        });
+        const elapsed = Number(process.hrtime.bigint() - start) / 1e6;
+        if (result.status !== 0) {
+            throw new Error(`Process exited with code ${result.status}\n${result.stderr}`);
+        }
+        const [, heap] = result.stderr.match(/gc heap: (\d+) bytes/);
+        if (!best || elapsed < best.ms) {
+            best = {ms: elapsed, heap: Number(heap)};
+        }
+    }
+    return best;
+}
+
+function printHeap(name, result) {
+    console.log(`    ${name.padEnd(20, " ")} ${result.ms.toFixed(1).padStart(10, " ")} ms ${(result.heap / 1048576).toFixed(1).padStart(10, " ")} MB heap`);
+}
+
+// A large module whose functions are never called, the runner maps it and executes the module body in place
+const FUNCTIONS = 20000;
+
+function measureImage() {
+    const dir = fsSync.mkdtempSync(path.join(os.tmpdir(), "atomix-image-"));
+    const lines = [];
+    for (let i = 0; i < FUNCTIONS; i++) {
+        lines.push(`function f${i}(a, b) { let x = a * ${i} + b; let y = x - ${i % 7}; return x + y * 0.5; }`);
+    }
+    lines.push("print(1);");
+    const file = path.join(dir, "image.js");
+    fsSync.writeFileSync(file, lines.join("\n"));
+    runSubprocess("node", [COMPILER, "compiler", "compile", file, "-o", file + ".bin", "-r", dir]);
+
+    console.log("image:");
+    console.log(`    ${"size".padEnd(20, " ")} ${(fsSync.statSync(file + ".bin").size / 1048576).toFixed(1).padStart(10, " ")} MB`);
+    printHeap("load", measureHeap(file + ".bin"));
+    fsSync.rmSync(dir, {recursive: true});
+}
+
+measureImage();
+
+// A bundle of generated modules, decoded up front by a threaded runner (engine init -m) with an increasing number of threads
+const MODULES = 128;
+const STATEMENTS = 2000;
+
+function measureLoader() {
+    const dir = fsSync.mkdtempSync(path.join(os.tmpdir(), "atomix-loader-"));
+    const programs = [];
+    for (let i = 0; i < MODULES; i++) {
+        const lines = [];
+        for (let j = 0; j < STATEMENTS; j++) {
+            lines.push(`let v${j} = "s${j % 100}" + ${i * j} * 0.5;`);
+        }
+        const file = path.join(dir, `m${i}.js`);
+        fsSync.writeFileSync(file, lines.join("\n"));
+        runSubprocess("node", [COMPILER, "compiler", "compile", file, "-o", file + ".bin", "-r", dir]);
+        programs.push(file + ".bin");
+    }
+    const entry = path.join(dir, "entry.js");
+    fsSync.writeFileSync(entry, "print(1);");
+    runSubprocess("node", [COMPILER, "compiler", "compile", entry, "-o", entry + ".bin", "-r", dir]);
+    const bundle = path.join(dir, "bundle.bin");
+    runSubprocess("node", [COMPILER, "bundle", ...programs, "-e", entry + ".bin", "-o", bundle]);
+
+    console.log("loader:");
+    for (let threads = 1; threads <= os.cpus().length; threads *= 2) {
+        let best = Infinity;
+        for (let i = 0; i < RUNS; i++) {
+            const start = process.hrtime.bigint();
+            child_process.spawnSync(VM_RUNNER, [bundle], {env: {...process.env, ATOMIX_LOAD_THREADS: String(threads)}});
+            best = Math.min(best, Number(process.hrtime.bigint() - start) / 1e6);
+        }
+        console.log(`    ${`${threads} threads`.padEnd(20, " ")} ${best.toFixed(1).padStart(10, " ")} ms`);
+    }
+
+    // The same bundle in a compressed container, inflated by the runner before it is decoded
+    const compressed = path.join(dir, "bundle.axz");
+    runSubprocess("node", [COMPILER, "bundle", ...programs, "-e", entry + ".bin", "-o", compressed, "-z"]);
+    console.log("compression:");
+    for (const [name, file] of [["plain", bundle], ["compressed", compressed]]) {
+        const result = measureHeap(file);
+        console.log(`    ${name.padEnd(20, " ")} ${result.ms.toFixed(1).padStart(10, " ")} ms ${(fsSync.statSync(file).size / 1048576).toFixed(1).padStart(10, " ")} MB file`);
+    }
+    fsSync.rmSync(dir, {recursive: true});
+}
+
+measureLoader();
+
+// A large retained heap collected while garbage is allocated, the runner reports its collection pauses
+const RETAINED = 1000000;
+
+function compileRetained(dir) {
+    const file = path.join(dir, "retain.js");
+    fsSync.writeFileSync(file, `
+        let keep = null;
+        let i = 0;
+        while (i < ${RETAINED}) {
+            keep = {value: i * 0.5, name: "n", next: keep};
+            i = i + 1;
+        }
+        print(keep.value);
+    `);
+    runSubprocess("node", [COMPILER, "compiler", "compile", file, "-o", file + ".bin", "-r", dir]);
+    return file + ".bin";
+}
+
+// The run with the shortest longest pause, its histogram lines follow the summary
+function measurePauses(program, env) {
+    let best = null;
+    for (let i = 0; i < RUNS; i++) {
+        const result = child_process.spawnSync(VM_RUNNER, [program], {
+            encoding: "utf-8",
+            env: {...process.env, ...env, ATOMIX_GC_STATS: "1"}
+        });
+        const [, count, total, max] = result.stderr.match(/gc pauses: (\d+), total ([\d.]+) ms, max ([\d.]+) ms/);
+        if (!best || Number(max) < best.max) {
+            const histogram = result.stderr.split("\n").filter(line => line.startsWith("    <"));
+            best = {count: Number(count), total: Number(total), max: Number(max), histogram: histogram};
+        }
+    }
+    return best;
+}
+
+function printPauses(name, pauses, histogram) {
+    console.log(`    ${name.padEnd(20, " ")} ${pauses.max.toFixed(1).padStart(10, " ")} ms max ${pauses.total.toFixed(1).padStart(10, " ")} ms total in ${pauses.count} pauses`);
+    if (histogram) {
+        for (const line of pauses.histogram) {
+            console.log(`        ${line.trim()}`);
+        }
+    }
+}
+
+// Forced full collections of the retained list once it is built, the longest pause is the time to mark it
+const COLLECTIONS = 5;
+
+function compileCollected(dir) {
+    const file = path.join(dir, "collect.js");
+    fsSync.writeFileSync(file, `
+        let keep = null;
+        let i = 0;
+        while (i < ${RETAINED}) {
+            keep = {value: i * 0.5, name: "n", next: keep};
+            i = i + 1;
+        }
+        let j = 0;
+        while (j < ${COLLECTIONS}) {
+            GC.collect();
+            j = j + 1;
+        }
+        print(keep.value);
+    `);
+    runSubprocess("node", [COMPILER, "compiler", "compile", file, "-o", file + ".bin", "-r", dir]);
+    return file + ".bin";
+}
+
+function measureMarking(program) {
+    console.log("marking:");
+    const pauses = measurePauses(program, {ATOMIX_GC_INCREMENTAL: "0"});
+    const heap = measureHeap(program, {ATOMIX_GC_INCREMENTAL: "0"});
+    console.log(`    ${"full collection".padEnd(20, " ")} ${pauses.max.toFixed(1).padStart(10, " ")} ms ${(heap.heap / 1048576).toFixed(1).padStart(10, " ")} MB heap`);
+}
+
+// Only threaded runners (engine init -m) use more markers
+function measureMarkers(program) {
+    console.log("markers:");
+    for (let markers = 1; markers <= os.cpus().length; markers *= 2) {
+        printPauses(`${markers} markers`, measurePauses(program, {ATOMIX_GC_MARKERS: String(markers)}), false);
+    }
+}
+
+function measureIncremental(program) {
+    console.log("incremental:");
+    printPauses("off", measurePauses(program, {ATOMIX_GC_INCREMENTAL: "0"}), true);
+    printPauses("on", measurePauses(program, {ATOMIX_GC_INCREMENTAL: "1"}), true);
+    for (const budget of [10, 5, 2]) {
+        printPauses(`on, ${budget} ms budget`, measurePauses(program, {ATOMIX_GC_INCREMENTAL: "1", ATOMIX_GC_PAUSE_MS: String(budget)}), true);
+    }
+}
+
+const pausesDir = fsSync.mkdtempSync(path.join(os.tmpdir(), "atomix-pauses-"));
+const retained = compileRetained(pausesDir);
+measureMarking(compileCollected(pausesDir));
+measureMarkers(retained);
+measureIncremental(retained);
+fsSync.rmSync(pausesDir, {recursive: true});
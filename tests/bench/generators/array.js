@@ -0,0 +1,36 @@
+function naturals(n) {
+    const out = Array(n);
+    let i = 0;
+    while (i < n) {
+        out[i] = i + 1;
+        i = i + 1;
+    }
+    return out;
+}
+
+function squares(source) {
+    const out = Array(source.length);
+    let i = 0;
+    while (i < source.length) {
+        out[i] = source[i] * source[i] % 1000;
+        i = i + 1;
+    }
+    return out;
+}
+
+function work(rounds) {
+    let sum = 0;
+    let round = 0;
+    while (round < rounds) {
+        const values = squares(naturals(1000));
+        let i = 0;
+        while (i < values.length) {
+            sum = (sum + values[i]) % 1000;
+            i = i + 1;
+        }
+        round = round + 1;
+    }
+    return sum;
+}
+
+print(work(200));
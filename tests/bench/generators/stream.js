@@ -0,0 +1,27 @@
+function* naturals(n) {
+    let i = 1;
+    while (i <= n) {
+        yield i;
+        i = i + 1;
+    }
+}
+
+function* squares(source) {
+    for (const x of source) {
+        yield x * x % 1000;
+    }
+}
+
+function work(rounds) {
+    let sum = 0;
+    let round = 0;
+    while (round < rounds) {
+        for (const value of squares(naturals(1000))) {
+            sum = (sum + value) % 1000;
+        }
+        round = round + 1;
+    }
+    return sum;
+}
+
+print(work(200));
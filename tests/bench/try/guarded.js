@@ -0,0 +1,15 @@
+function work(n) {
+    let sum = 0;
+    let i = 0;
+    while (i < n) {
+        try {
+            sum = (sum + i) % 1000;
+        } catch (e) {
+            sum = -1;
+        }
+        i = i + 1;
+    }
+    return sum;
+}
+
+print(work(3000000));
@@ -0,0 +1,11 @@
+function work(n) {
+    let sum = 0;
+    let i = 0;
+    while (i < n) {
+        sum = (sum + i) % 1000;
+        i = i + 1;
+    }
+    return sum;
+}
+
+print(work(3000000));
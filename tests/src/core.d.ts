@@ -98,6 +98,114 @@ declare global {
 
         readonly prototype: SymbolPrototype;
     }
+
+    interface GCStats {
+        /** Bytes of the heap, including free and unmapped ones */
+        heapSize: number;
+        freeBytes: number;
+        unmappedBytes: number;
+        /** Bytes allocated since the last collection */
+        bytesSinceGC: number;
+        /** Bytes allocated since the start */
+        totalBytes: number;
+        collections: number;
+        /** Number of stop-the-world pauses */
+        pauses: number;
+        pauseTotalMs: number;
+        pauseMaxMs: number;
+    }
+
+    /**
+     * Access to the garbage collector
+     */
+    interface GC {
+        /**
+         * Returns the current statistics of the heap
+         */
+        stats(): GCStats;
+
+        /**
+         * Collects the whole heap, has no effect inside a critical section
+         */
+        collect(): void;
+
+        /**
+         * Does a slice of collection work and starts a collection if one is due.
+         * Returns true while a collection is left in progress.
+         */
+        collectALittle(): boolean;
+
+        /**
+         * Does slices of collection work for at most the given time.
+         * Returns true if a collection is left in progress.
+         * @param ms - Milliseconds the caller is idle
+         */
+        collectIdle(ms: number): boolean;
+
+        /**
+         * Suppresses collections until the matching leaveCritical, sections nest.
+         * Collections resume early once the heap grew past the configured limit.
+         */
+        enterCritical(): void;
+
+        /**
+         * Throws if no critical section was entered
+         */
+        leaveCritical(): void;
+    }
+
+    declare const GC: GC;
+
+    interface WeakRefPrototype {
+        readonly prototype: ObjectPrototype;
+
+        /**
+         * Returns the target or undefined once it was collected
+         */
+        deref(): object | symbol | undefined;
+    }
+
+    /**
+     * Holds an object, function or symbol without keeping it alive
+     */
+    interface WeakRef {
+        (target: object | symbol): WeakRefPrototype;
+
+        new (target: object | symbol): WeakRefPrototype;
+
+        readonly prototype: WeakRefPrototype;
+    }
+
+    declare const WeakRef: WeakRef;
+
+    interface WeakMapPrototype {
+        readonly prototype: ObjectPrototype;
+
+        get(key: any): any;
+
+        /**
+         * Throws a TypeError if the key is no object, function or symbol
+         */
+        set(key: object | symbol, value: any): WeakMapPrototype;
+
+        has(key: any): boolean;
+
+        delete(key: any): boolean;
+    }
+
+    /**
+     * Maps objects, functions and symbols by identity without keeping them alive.
+     * A value is collected together with its key, even if it references the key.
+     */
+    interface WeakMap {
+        (): WeakMapPrototype;
+
+        new (): WeakMapPrototype;
+
+        readonly prototype: WeakMapPrototype;
+    }
+
+    declare const WeakMap: WeakMap;
 }
 
 export {}
\ No newline at end of file
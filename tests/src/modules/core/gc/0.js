@@ -0,0 +1,21 @@
+const before = GC.stats();
+print(typeof before.heapSize, typeof before.freeBytes, typeof before.unmappedBytes);
+print(typeof before.bytesSinceGC, typeof before.totalBytes);
+print(typeof before.collections, typeof before.pauses, typeof before.pauseTotalMs, typeof before.pauseMaxMs);
+print(before.heapSize > 0);
+print(before.heapSize >= before.freeBytes);
+print(before.totalBytes >= before.bytesSinceGC);
+print(before.pauseTotalMs >= before.pauseMaxMs);
+
+let keep = null;
+let i = 0;
+while (i < 100000) {
+    keep = {next: keep};
+    i = i + 1;
+}
+
+const after = GC.stats();
+print(after.totalBytes >= before.totalBytes);
+print(after.collections >= before.collections);
+print(after.pauses >= before.pauses);
+print(after.pauseTotalMs >= before.pauseTotalMs);
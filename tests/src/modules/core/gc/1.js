@@ -0,0 +1,16 @@
+GC.enterCritical();
+GC.enterCritical();
+GC.leaveCritical();
+GC.leaveCritical();
+
+try {
+    GC.leaveCritical();
+} catch (e) {
+    print("unbalanced");
+}
+
+const before = GC.stats().collections;
+GC.collect();
+print(GC.stats().collections > before);
+print(typeof GC.collectALittle());
+print(typeof GC.collectIdle(1));
@@ -0,0 +1,34 @@
+const map = new WeakMap();
+const a = {};
+const b = function () {};
+const c = Symbol("c");
+
+print(map.set(a, 1) === map);
+map.set(b, 2);
+map.set(c, 3);
+map.set(a, 4);
+print(map.get(a), map.get(b), map.get(c));
+print(map.has({}), map.get({}));
+
+for (let i = 0; i < 1000; i++) {
+    map.set({}, i);
+}
+print(map.get(a), map.has(b));
+
+print(map.delete(b), map.delete(b), map.has(b));
+print(map.has(1), map.delete("a"));
+
+try {
+    map.set(1, 1);
+} catch (e) {
+    print("invalid key");
+}
+
+const ref = new WeakRef(a);
+print(ref.deref() === a);
+
+try {
+    new WeakRef("a");
+} catch (e) {
+    print("invalid target");
+}
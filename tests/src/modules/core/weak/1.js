@@ -0,0 +1,31 @@
+// Values referencing their own key are collected together with it
+const map = new WeakMap();
+const keep = {};
+map.set(keep, {key: keep});
+
+let i = 0;
+while (i < 300000) {
+    const key = {};
+    map.set(key, {key: key, index: i});
+    i = i + 1;
+}
+GC.collect();
+print(GC.stats().heapSize < 64 * 1024 * 1024);
+print(map.get(keep).key === keep);
+
+// Every map keeps its own value for a key, collected maps leave nothing behind on it
+const other = new WeakMap();
+other.set(keep, 1);
+map.set(keep, 2);
+print(other.get(keep), map.get(keep));
+
+i = 0;
+while (i < 100000) {
+    new WeakMap().set(keep, {index: i});
+    i = i + 1;
+}
+GC.collect();
+print(GC.stats().heapSize < 64 * 1024 * 1024);
+print(other.get(keep), map.get(keep), new WeakMap().has(keep));
+
+print(map.delete(keep), map.has(keep), other.get(keep));
@@ -0,0 +1,27 @@
+// Every map stores its value on the key, deleting them one by one removes entries from the middle, the head
+// and the tail of the same property chain
+const key = {name: "key"};
+const maps = [];
+let i = 0;
+while (i < 8) {
+    const map = new WeakMap();
+    map.set(key, i);
+    maps.push(map);
+    i = i + 1;
+}
+
+print(maps[3].delete(key), maps[3].has(key), maps[3].delete(key));
+print(maps[5].delete(key), maps[0].delete(key), maps[7].delete(key));
+
+let values = "";
+i = 0;
+while (i < 8) {
+    values = values + " " + maps[i].has(key) + ":" + maps[i].get(key);
+    i = i + 1;
+}
+print(values);
+print(key.name);
+
+// The remaining entries are still found after more are added
+maps[3].set(key, "again");
+print(maps[3].get(key), maps[4].get(key), maps[6].get(key));
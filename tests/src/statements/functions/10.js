@@ -0,0 +1,50 @@
+// Calls in return position inside try statements and generators keep the frame of their function
+function fail(message) {
+    throw new Error(message);
+}
+
+function identity(value) {
+    return value;
+}
+
+function guarded() {
+    try {
+        return fail("inside try");
+    } catch (e) {
+        return "caught " + e.message;
+    }
+}
+
+function finalized() {
+    try {
+        return identity("returned");
+    } finally {
+        print("finally");
+    }
+}
+
+function nested() {
+    try {
+        try {
+            return fail("inner");
+        } finally {
+            print("inner finally");
+        }
+    } catch (e) {
+        return identity("outer " + e.message);
+    }
+}
+
+function* generated() {
+    yield 1;
+    return identity(2);
+}
+
+print(guarded());
+print(finalized());
+print(nested());
+const it = generated();
+print(it.next().value);
+const last = it.next();
+print(last.value, last.done);
+print(it.next().done);
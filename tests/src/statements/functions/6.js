@@ -0,0 +1,27 @@
+function apply(f, x) {
+    return f(x);
+}
+function outer(n) {
+    function square(x) {
+        return x * x;
+    }
+    print(square(n));
+    print(apply(function (x) {
+        return square(x) + 1;
+    }, n));
+    print(apply(function (x) {
+        return x + n;
+    }, 1));
+}
+outer(3);
+outer(4);
+
+function keep(f) {
+    return f;
+}
+function make() {
+    return keep(function () {
+        return 1;
+    });
+}
+print(make() === make());
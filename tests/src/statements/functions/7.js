@@ -0,0 +1,23 @@
+function counter() {
+    let count = 0;
+    return function () {
+        count = count + 1;
+        return count;
+    };
+}
+const a = counter();
+const b = counter();
+print(a());
+print(a());
+print(b());
+print(a());
+
+function outer(x) {
+    function middle() {
+        return function () {
+            return x * 2;
+        };
+    }
+    return middle()();
+}
+print(outer(21));
@@ -0,0 +1,32 @@
+function collect() {
+    const fns = [];
+    let i = 0;
+    while (i < 3) {
+        const v = i;
+        fns[i] = function () {
+            return v;
+        };
+        i = i + 1;
+    }
+    return fns;
+}
+const fns = collect();
+print(fns[0]());
+print(fns[1]());
+print(fns[2]());
+
+function fact(n) {
+    if (n === 0) {
+        return 1;
+    }
+    return n * fact(n - 1);
+}
+print(fact(6));
+
+const sum = function next(n) {
+    if (n === 0) {
+        return 0;
+    }
+    return n + next(n - 1);
+};
+print(sum(4));
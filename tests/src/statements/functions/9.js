@@ -0,0 +1,29 @@
+function sum(n, acc) {
+    if (n === 0) {
+        return acc;
+    }
+    return sum(n - 1, acc + n);
+}
+
+function isEven(n) {
+    if (n === 0) {
+        return true;
+    }
+    return isOdd(n - 1);
+}
+
+function isOdd(n) {
+    if (n === 0) {
+        return false;
+    }
+    return isEven(n - 1);
+}
+
+function show(value) {
+    return print(value);
+}
+
+print(sum(5000, 0));
+print(isEven(3000));
+print(isOdd(3001));
+show("done");
@@ -0,0 +1,112 @@
+function* range(from, to) {
+    let i = from;
+    while (i < to) {
+        yield i;
+        i += 1;
+    }
+    return "end";
+}
+
+for (const value of range(0, 3)) {
+    print(value);
+}
+
+const it = range(5, 7);
+print(it.next().value);
+print(it.next().value);
+const last = it.next();
+print(last.value, last.done);
+print(it.next().done);
+
+function* accumulate() {
+    let total = 0;
+    while (true) {
+        total += yield total;
+    }
+}
+
+const acc = accumulate();
+acc.next();
+acc.next(4);
+print(acc.next(6).value);
+
+function* counters() {
+    let count = 0;
+    const read = function () {
+        return count;
+    };
+    yield read;
+    count = 10;
+    yield read;
+    count += 1;
+}
+
+const reads = counters();
+const read = reads.next().value;
+print(read());
+reads.next();
+print(read());
+reads.next();
+print(read());
+
+function* map(source, fn) {
+    for (const value of source) {
+        yield fn(value);
+    }
+}
+
+function* take(source, count) {
+    let left = count;
+    let step = source.next();
+    while (left > 0) {
+        yield step.value;
+        left -= 1;
+        step = source.next();
+    }
+}
+
+function* naturals() {
+    let n = 1;
+    while (true) {
+        yield n;
+        n += 1;
+    }
+}
+
+let sum = 0;
+for (const square of take(map(naturals(), function (x) {
+    return x * x;
+}), 4)) {
+    sum += square;
+}
+print(sum);
+
+for (const item of [3, 1, 2]) {
+    print(item);
+}
+
+function* failing() {
+    yield 1;
+    throw new RangeError("stop");
+}
+
+const failed = failing();
+failed.next();
+try {
+    failed.next();
+} catch (e) {
+    print(e.name, e.message);
+}
+print(failed.next().done);
+
+function* guarded() {
+    try {
+        yield "inside";
+    } finally {
+        print("finally");
+    }
+}
+
+for (const value of guarded()) {
+    print(value);
+}
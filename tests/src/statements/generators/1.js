@@ -0,0 +1,29 @@
+// The closures outlive their suspended generators, the captured variables are kept in the saved frames
+function* counter(start) {
+    let count = start;
+    yield function () {
+        count += 1;
+        return count;
+    };
+    yield count;
+}
+
+const increments = [];
+for (let i = 0; i < 100; i++) {
+    increments.push(counter(i * 10).next().value);
+}
+
+GC.collect();
+const garbage = [];
+for (let i = 0; i < 10000; i++) {
+    garbage.push({index: i, name: "garbage" + i});
+}
+GC.collect();
+
+let sum = 0;
+for (const increment of increments) {
+    increment();
+    sum += increment();
+}
+print(sum);
+print(increments[7]());
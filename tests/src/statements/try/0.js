@@ -0,0 +1,44 @@
+try {
+    print("try");
+    throw "boom";
+} catch (e) {
+    print(e);
+} finally {
+    print("finally");
+}
+
+try {
+    print("no throw");
+} finally {
+    print("finally");
+}
+
+try {
+    throw new Error("message");
+} catch (e) {
+    print(e.message);
+    print(e.name);
+}
+
+try {
+    try {
+        throw 1;
+    } finally {
+        print("inner");
+    }
+} catch (e) {
+    print(e);
+}
+
+try {
+    missing;
+} catch (e) {
+    print(e.name);
+}
+
+try {
+    const callee = null;
+    callee();
+} catch (e) {
+    print(e.name);
+}
@@ -0,0 +1,66 @@
+function fail(n) {
+    if (n === 0) {
+        throw new TypeError("deep");
+    }
+    return fail(n - 1);
+}
+
+function guarded(n) {
+    try {
+        fail(n);
+        return "unreachable";
+    } catch (e) {
+        return e.message;
+    }
+}
+print(guarded(3));
+
+function cleanup() {
+    const value = 7;
+    try {
+        return value;
+    } finally {
+        print("cleanup");
+    }
+}
+print(cleanup());
+
+function rethrow() {
+    try {
+        throw "first";
+    } catch (e) {
+        throw "second";
+    } finally {
+        print("finally");
+    }
+}
+
+try {
+    rethrow();
+} catch (e) {
+    print(e);
+}
+
+function collect() {
+    const fns = [];
+    let i = 0;
+    while (i < 3) {
+        try {
+            const v = i;
+            fns[i] = function () {
+                return v;
+            };
+            if (v === 1) {
+                throw v;
+            }
+        } catch (e) {
+            print(e);
+        }
+        i = i + 1;
+    }
+    return fns;
+}
+const fns = collect();
+print(fns[0]());
+print(fns[1]());
+print(fns[2]());
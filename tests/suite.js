@@ -84,7 +84,122 @@ async function getSnapshot(test) {
 }
 
 
-const tests = Array.from(pipeFiles(path.join(__dirname, "src")));
+// Corrupted images of a module and of a bundle holding it, the runner has to reject each with an error
+function malformedImages(program, bundle) {
+    const images = [];
+    const module = fsSync.readFileSync(program);
+    for (const length of [0, 3, 16, 29, module.length >> 1, module.length - 1]) {
+        images.push([`module truncated to ${length} bytes`, module.subarray(0, length)]);
+    }
+    // The header holds the offsets of the sections behind the magic, version and hash
+    for (const [name, offset] of [["string table", 14], ["constant pool", 18], ["data section", 22], ["handler table", 26]]) {
+        const section = module.readUInt32LE(offset);
+        const start = Buffer.from(module);
+        start.writeUInt32LE(0xFFFFFFF0, offset);
+        images.push([`${name} out of bounds`, start]);
+        const length = Buffer.from(module);
+        length.writeUInt32LE(0x7FFFFFFF, section);
+        images.push([`${name} length out of bounds`, length]);
+        const count = Buffer.from(module);
+        count.writeUInt32LE(0x7FFFFFFF, section + 4);
+        images.push([`${name} count out of bounds`, count]);
+    }
+
+    // The module count follows the magic, version and entry point, the index entries hold a hash, offset and length
+    const index = fsSync.readFileSync(bundle);
+    images.push(["bundle truncated", index.subarray(0, 17)]);
+    const count = Buffer.from(index);
+    count.writeUInt32LE(0x7FFFFFFF, 14);
+    images.push(["bundle index out of bounds", count]);
+    const offset = Buffer.from(index);
+    offset.writeUInt32LE(0xFFFFFFF0, 26);
+    images.push(["bundle entry out of bounds", offset]);
+    const length = Buffer.from(index);
+    length.writeUInt32LE(0xFFFFFFF0, 30);
+    images.push(["bundle entry length out of bounds", length]);
+    return images;
+}
+
+async function checkMalformed(program) {
+    const bundle = program + ".bundle.bin";
+    await runSubprocess("node", [COMPILER, "bundle", "-e", program, "-o", bundle], program);
+    const file = program + ".malformed.bin";
+    for (const [name, image] of malformedImages(program, bundle)) {
+        fsSync.writeFileSync(file, image);
+        const result = child_process.spawnSync(VM_RUNNER, [file], {encoding: "utf-8"});
+        testCount++;
+        if (result.status === 0 || result.signal) {
+            process.stdout.write("E");
+            failedFiles.push(`malformed image: ${name}`);
+        } else {
+            process.stdout.write(".");
+        }
+    }
+    fsSync.unlinkSync(file);
+    fsSync.unlinkSync(bundle);
+}
+
+// Programs too large to keep in src/, they are written to a temporary directory and run like the others
+const LITERALS = 70000;
+
+function generateLiterals() {
+    // Every string and double is distinct, so their indices need more than 16 bits. The body of run and the
+    // jump over the if block are longer than 65535 instructions as well.
+    const lines = ["function run(flag) {", "    let text = \"none\";", "    let number = 0.5;", "    if (flag) {"];
+    for (let i = 0; i < LITERALS; i++) {
+        lines.push(`        text = "s${i}";`, `        number = ${i}.25;`);
+        if (i % 5000 == 4999) {
+            lines.push("        print(text, number);");
+        }
+    }
+    lines.push("    }", "    print(text, number);", "}", "run(false);", "run(true);");
+    return lines.join("\n");
+}
+
+const generatedDir = fsSync.mkdtempSync(path.join(os.tmpdir(), "atomix-generated-"));
+const generated = [["literals.js", generateLiterals]].map(([name, generate]) => {
+    const file = path.join(generatedDir, name);
+    fsSync.writeFileSync(file, generate());
+    return file;
+});
+
+// Modules of a bundle imported by its entry point. Their hashes spread over the whole 64 bit range: the halves
+// of some are above INT32_MAX, ordering them by the low half differs from the 64 bit order and the entry
+// point looks up the largest one as well.
+const BUNDLED = 16;
+
+async function checkBundle() {
+    const dir = path.join(generatedDir, "bundle");
+    fsSync.mkdirSync(dir);
+    const programs = [];
+    const imports = [];
+    const expected = [];
+    for (let i = 0; i < BUNDLED; i++) {
+        const file = path.join(dir, `m${i}.js`);
+        fsSync.writeFileSync(file, `export const name = "m${i}";`);
+        await runSubprocess("node", [COMPILER, "compiler", "compile", file, "-o", file + ".bin", "-r", dir], file);
+        programs.push(file + ".bin");
+        imports.push(`import {name as m${i}} from "./m${i}.js";`);
+        expected.push(`m${i}\n`);
+    }
+    const entry = path.join(dir, "entry.js");
+    fsSync.writeFileSync(entry, [...imports, `print(${Array.from({length: BUNDLED}, (_, i) => `m${i}`).join(", ")});`].join("\n"));
+    await runSubprocess("node", [COMPILER, "compiler", "compile", entry, "-o", entry + ".bin", "-r", dir], entry);
+    const bundle = path.join(dir, "bundle.bin");
+    await runSubprocess("node", [COMPILER, "bundle", ...programs, "-e", entry + ".bin", "-o", bundle], entry);
+
+    testCount++;
+    const result = await runProgram(bundle).catch(e => e.message);
+    if (result !== expected.join("")) {
+        process.stdout.write("E");
+        failedFiles.push("bundle imports");
+    } else {
+        process.stdout.write(".");
+    }
+}
+
+const tests = [...generated, ...pipeFiles(path.join(__dirname, "src"))];
+const sample = tests[tests.length - 1];
 let testCount = tests.length;
 const failedFiles = [];
 const mutex = new AsyncLock();
@@ -107,7 +222,11 @@ Promise.all(Array.from({length: WORKERS}, async () => {
             process.stdout.write(".");
         }
     }
-})).then(() => {
+})).then(async () => {
+    await checkMalformed(sample + ".bin");
+    await checkBundle();
+    fsSync.rmSync(generatedDir, {recursive: true});
+
     if (failedFiles.length > 0) {
         console.log();
         console.log();
@@ -1,4 +1,6 @@
 const os = require("os");
+const v8 = require("v8");
+const vm = require("vm");
 // This file is to create mokup functions of the AtomixJS runtime functions.
 
 globalThis.print = function (...args) {
@@ -55,6 +57,74 @@ Object.create = function (proto) {
     return _create(proto);
 }
 
+// Node has no allocation or collection counters, the mock only reports what it can measure: the heap of V8,
+// the bytes the used heap grew by and the collections and pauses of GC.collect, which collects for real
+v8.setFlagsFromString("--expose-gc");
+const collectGarbage = vm.runInNewContext("gc");
+let collections = 0;
+let pauseTotalMs = 0;
+let pauseMaxMs = 0;
+let heapUsed = process.memoryUsage().heapUsed;
+let grownBytes = 0;
+let grownSinceGC = 0;
+let critical = 0;
+
+function measureGrowth() {
+    const used = process.memoryUsage().heapUsed;
+    if (used > heapUsed) {
+        grownBytes += used - heapUsed;
+        grownSinceGC += used - heapUsed;
+    }
+    heapUsed = used;
+}
+
+globalThis.GC = {
+    stats() {
+        measureGrowth();
+        const heap = v8.getHeapStatistics();
+        return {
+            heapSize: heap.total_heap_size,
+            freeBytes: heap.total_heap_size - heap.used_heap_size,
+            unmappedBytes: Math.max(heap.total_heap_size - heap.total_physical_size, 0),
+            bytesSinceGC: grownSinceGC,
+            totalBytes: grownBytes,
+            collections: collections,
+            pauses: collections,
+            pauseTotalMs: pauseTotalMs,
+            pauseMaxMs: pauseMaxMs
+        };
+    },
+    collect() {
+        if (critical > 0) {
+            return;
+        }
+        measureGrowth();
+        const start = process.hrtime.bigint();
+        collectGarbage();
+        const elapsed = Number(process.hrtime.bigint() - start) / 1e6;
+        collections++;
+        pauseTotalMs += elapsed;
+        pauseMaxMs = Math.max(pauseMaxMs, elapsed);
+        heapUsed = process.memoryUsage().heapUsed;
+        grownSinceGC = 0;
+    },
+    collectALittle() {
+        return false;
+    },
+    collectIdle(ms) {
+        return false;
+    },
+    enterCritical() {
+        critical++;
+    },
+    leaveCritical() {
+        if (critical == 0) {
+            throw new Error("No critical section was entered");
+        }
+        critical--;
+    }
+}
+
 if (process.argv.length < 2) {
     throw "Missing argument";
 }